@@ -0,0 +1,480 @@
+#ifndef AES_GCM_HPP
+#define AES_GCM_HPP
+
+#include <string>
+#include <vector>
+#include <stdexcept> // For std::runtime_error
+#include <cstdint>
+#include <cstddef>
+#include <cstring>   // For memcpy, memset
+#include <mutex>
+#include <memory>    // For std::unique_ptr
+
+#include <openssl/evp.h>
+#include <openssl/rand.h>   // For RAND_bytes
+#include <openssl/crypto.h> // For CRYPTO_memcmp, OPENSSL_cleanse
+
+#include "cipher_engine.hpp" // AES engine, executors, error handling
+#include "aesni.hpp"         // CPU feature check
+
+// Authenticated AES-256-GCM for the pixel payload.
+// The stored payload is ciphertext || nonce (12 bytes) || tag (16 bytes). The ciphertext
+// keeps the plaintext offsets, so processing in place works as for ECB/CBC. The nonce
+// is random for every encryption: key and IV come from the passphrase with a fixed
+// salt, and reusing a GCM nonce under one key would expose the keystream and the
+// authentication key.
+//
+// The CTR part is split into block-aligned ranges across the executor (EVP AES-256-CTR
+// from each range's counter). Each range computes the GHASH of its own ciphertext with
+// carry-less multiplies while each 64 KiB chunk is in cache: 16 blocks per reduction
+// with VPCLMULQDQ, 8 with PCLMULQDQ. The partial
+// hashes are combined as X = X * H^n(range) ^ P(range), so the tag costs no second
+// pass. Decryption checks the tag before returning. On mismatch the output buffer is
+// wiped and an error is thrown, so unauthenticated plaintext never reaches a caller.
+// Without AES-NI/PCLMULQDQ (or with IMAGE_PROCESSOR_NO_AESNI=1) the serial EVP
+// AES-256-GCM path is used, which produces the same bytes. Optional additional data
+// (aad) is authenticated but not stored; decryption must pass the same bytes.
+
+const size_t GCM_NONCE_BYTES = 12;
+const size_t GCM_TAG_BYTES = 16;
+const size_t GCM_OVERHEAD_BYTES = GCM_NONCE_BYTES + GCM_TAG_BYTES;
+const size_t GCM_CHUNK_BYTES = 64 * 1024;
+// SP 800-38D: the 32-bit block counter starts at 2 for the payload, so one nonce
+// covers at most 2^32 - 2 blocks (just under 64 GiB) before the keystream repeats.
+const uint64_t GCM_MAX_PAYLOAD_BYTES = ((static_cast<uint64_t>(1) << 32) - 2) * AES_BLOCK_BYTES;
+const int GHASH_AGGREGATE_BLOCKS = 8; // Blocks hashed per reduction (PCLMULQDQ)
+const int GHASH_WIDE_BLOCKS = 16;     // Blocks hashed per reduction (VPCLMULQDQ, 4 per register)
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+inline const EVP_CIPHER* fetched_gcm_cipher() {
+    static EVP_CIPHER* gcm = EVP_CIPHER_fetch(NULL, "AES-256-GCM", NULL);
+    return gcm;
+}
+
+inline const EVP_CIPHER* fetched_ctr_cipher() {
+    static EVP_CIPHER* ctr = EVP_CIPHER_fetch(NULL, "AES-256-CTR", NULL);
+    return ctr;
+}
+#else
+inline const EVP_CIPHER* fetched_gcm_cipher() { return EVP_aes_256_gcm(); }
+inline const EVP_CIPHER* fetched_ctr_cipher() { return EVP_aes_256_ctr(); }
+#endif
+
+namespace gcm_detail {
+
+// --- Serial EVP Path ---
+inline size_t evp_gcm(const unsigned char* key, const unsigned char* nonce, bool encrypt,
+                      const unsigned char* input, size_t len, unsigned char* output, unsigned char* tag,
+                      const unsigned char* aad, size_t aad_len) {
+    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+    if (!ctx) {
+        handle_openssl_errors("EVP_CIPHER_CTX_new failed: ");
+    }
+    struct CtxGuard {
+        EVP_CIPHER_CTX* ctx;
+        ~CtxGuard() { EVP_CIPHER_CTX_free(ctx); }
+    } guard = {ctx};
+    if (1 != EVP_CipherInit_ex(ctx, fetched_gcm_cipher(), NULL, key, nonce, encrypt ? 1 : 0)) {
+        handle_openssl_errors("EVP_CipherInit_ex (GCM) failed: ");
+    }
+    int aad_out = 0;
+    if (aad_len > 0 && 1 != EVP_CipherUpdate(ctx, NULL, &aad_out, aad, static_cast<int>(aad_len))) {
+        handle_openssl_errors("EVP_CipherUpdate (GCM additional data) failed: ");
+    }
+    size_t done = 0;
+    while (done < len) {
+        const int step = static_cast<int>(std::min(len - done, EVP_UPDATE_MAX_BYTES));
+        int out_len = 0;
+        if (1 != EVP_CipherUpdate(ctx, output + done, &out_len, input + done, step)) {
+            handle_openssl_errors("EVP_CipherUpdate (GCM) failed: ");
+        }
+        done += static_cast<size_t>(out_len);
+    }
+    if (!encrypt && 1 != EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, static_cast<int>(GCM_TAG_BYTES), tag)) {
+        handle_openssl_errors("EVP_CTRL_GCM_SET_TAG failed: ");
+    }
+    int final_len = 0;
+    if (1 != EVP_CipherFinal_ex(ctx, output + done, &final_len)) {
+        OPENSSL_cleanse(output, len);
+        throw std::runtime_error("Error: GCM authentication failed (wrong key or corrupted data).");
+    }
+    if (encrypt && 1 != EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, static_cast<int>(GCM_TAG_BYTES), tag)) {
+        handle_openssl_errors("EVP_CTRL_GCM_GET_TAG failed: ");
+    }
+    return done;
+}
+
+// EVP AES-256-CTR from a given counter block, or the bitsliced engine when selected.
+class CtrStream {
+public:
+    CtrStream(const unsigned char* key, const unsigned char* counter) : ctx_(NULL) {
+        if (bitsliced_aes_selected()) {
+            bitsliced_.reset(new BitslicedCtr(key, counter));
+            return;
+        }
+        ctx_ = EVP_CIPHER_CTX_new();
+        if (!ctx_) {
+            handle_openssl_errors("EVP_CIPHER_CTX_new failed: ");
+        }
+        if (1 != EVP_EncryptInit_ex(ctx_, fetched_ctr_cipher(), NULL, key, counter)) {
+            EVP_CIPHER_CTX_free(ctx_);
+            handle_openssl_errors("EVP_EncryptInit_ex (CTR) failed: ");
+        }
+    }
+    ~CtrStream() { EVP_CIPHER_CTX_free(ctx_); }
+
+    CtrStream(const CtrStream&) = delete;
+    CtrStream& operator=(const CtrStream&) = delete;
+
+    void update(const unsigned char* input, size_t len, unsigned char* output) {
+        if (bitsliced_) {
+            bitsliced_->update(input, len, output);
+            return;
+        }
+        for (size_t done = 0; done < len;) {
+            const size_t step = std::min(len - done, EVP_UPDATE_MAX_BYTES);
+            int out_len = 0;
+            if (1 != EVP_EncryptUpdate(ctx_, output + done, &out_len, input + done, static_cast<int>(step))) {
+                handle_openssl_errors("EVP_EncryptUpdate (CTR) failed: ");
+            }
+            done += step;
+        }
+    }
+
+private:
+    EVP_CIPHER_CTX* ctx_;
+    std::unique_ptr<BitslicedCtr> bitsliced_;
+};
+
+#if IMAGE_PROCESSOR_HAVE_AESNI
+#define GCM_TARGET __attribute__((target("pclmul,ssse3,sse4.1")))
+#define GCM_WIDE_TARGET __attribute__((target("pclmul,ssse3,sse4.1,avx512f,avx512bw,vpclmulqdq")))
+
+inline bool pclmul_available() {
+    static const bool available = [] {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("ssse3");
+    }();
+    return available;
+}
+
+inline bool vpclmul_available() {
+    static const bool available = [] {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+               __builtin_cpu_supports("vpclmulqdq");
+    }();
+    return available;
+}
+
+GCM_TARGET inline __m128i byte_swap(__m128i x) {
+    return _mm_shuffle_epi8(x, _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+}
+
+// GF(2^128) arithmetic on byte-reflected GHASH operands, after Intel's carry-less
+// multiplication white paper. The 256-bit carry-less product is linear in its inputs,
+// so several products can be summed before a single shift-and-reduce.
+struct WideProduct {
+    __m128i lo;
+    __m128i hi;
+};
+
+GCM_TARGET inline void clmul_accumulate(WideProduct& acc, __m128i a, __m128i b) {
+    const __m128i mid = _mm_xor_si128(_mm_clmulepi64_si128(a, b, 0x10), _mm_clmulepi64_si128(a, b, 0x01));
+    acc.lo = _mm_xor_si128(acc.lo, _mm_xor_si128(_mm_clmulepi64_si128(a, b, 0x00), _mm_slli_si128(mid, 8)));
+    acc.hi = _mm_xor_si128(acc.hi, _mm_xor_si128(_mm_clmulepi64_si128(a, b, 0x11), _mm_srli_si128(mid, 8)));
+}
+
+GCM_TARGET inline __m128i reduce(WideProduct product) {
+    __m128i lo = product.lo;
+    __m128i hi = product.hi;
+    // The operands are bit-reflected, so the product is shifted left by one.
+    __m128i lo_carry = _mm_srli_epi32(lo, 31);
+    __m128i hi_carry = _mm_srli_epi32(hi, 31);
+    lo = _mm_slli_epi32(lo, 1);
+    hi = _mm_slli_epi32(hi, 1);
+    const __m128i cross = _mm_srli_si128(lo_carry, 12);
+    hi_carry = _mm_slli_si128(hi_carry, 4);
+    lo_carry = _mm_slli_si128(lo_carry, 4);
+    lo = _mm_or_si128(lo, lo_carry);
+    hi = _mm_or_si128(_mm_or_si128(hi, hi_carry), cross);
+
+    // Reduction modulo x^128 + x^7 + x^2 + x + 1.
+    const __m128i t = _mm_xor_si128(_mm_xor_si128(_mm_slli_epi32(lo, 31), _mm_slli_epi32(lo, 30)), _mm_slli_epi32(lo, 25));
+    lo = _mm_xor_si128(lo, _mm_slli_si128(t, 12));
+    __m128i r = _mm_xor_si128(_mm_xor_si128(_mm_srli_epi32(lo, 1), _mm_srli_epi32(lo, 2)), _mm_srli_epi32(lo, 7));
+    r = _mm_xor_si128(r, _mm_srli_si128(t, 4));
+    return _mm_xor_si128(hi, _mm_xor_si128(lo, r));
+}
+
+GCM_TARGET inline __m128i gf_mul(__m128i a, __m128i b) {
+    WideProduct product = {_mm_setzero_si128(), _mm_setzero_si128()};
+    clmul_accumulate(product, a, b);
+    return reduce(product);
+}
+
+// h^n for n >= 1.
+GCM_TARGET inline __m128i gf_pow(__m128i h, size_t n) {
+    __m128i result = h;
+    bool have_result = false;
+    __m128i base = h;
+    while (n > 0) {
+        if (n & 1) {
+            result = have_result ? gf_mul(result, base) : base;
+            have_result = true;
+        }
+        n >>= 1;
+        if (n > 0) base = gf_mul(base, base);
+    }
+    return result;
+}
+
+struct GhashKey {
+    __m128i h[GHASH_WIDE_BLOCKS]; // H, H^2, ..., H^16 (byte-reflected)
+};
+
+// Continues x over len bytes; a trailing partial block is zero-padded (end of data only).
+GCM_TARGET inline __m128i ghash_update(__m128i x, const GhashKey& key, const unsigned char* data, size_t len) {
+    size_t i = 0;
+    // X' = (X ^ B0) * H^8 ^ B1 * H^7 ^ ... ^ B7 * H, reduced once.
+    const size_t group = GHASH_AGGREGATE_BLOCKS * AES_BLOCK_BYTES;
+    for (; i + group <= len; i += group) {
+        WideProduct product = {_mm_setzero_si128(), _mm_setzero_si128()};
+        for (int b = 0; b < GHASH_AGGREGATE_BLOCKS; ++b) {
+            __m128i block = byte_swap(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + b * AES_BLOCK_BYTES)));
+            if (b == 0) block = _mm_xor_si128(block, x);
+            clmul_accumulate(product, block, key.h[GHASH_AGGREGATE_BLOCKS - 1 - b]);
+        }
+        x = reduce(product);
+    }
+    for (; i + AES_BLOCK_BYTES <= len; i += AES_BLOCK_BYTES) {
+        const __m128i b = byte_swap(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)));
+        x = gf_mul(_mm_xor_si128(x, b), key.h[0]);
+    }
+    if (i < len) {
+        unsigned char last[AES_BLOCK_BYTES] = {};
+        std::memcpy(last, data + i, len - i);
+        const __m128i b = byte_swap(_mm_loadu_si128(reinterpret_cast<const __m128i*>(last)));
+        x = gf_mul(_mm_xor_si128(x, b), key.h[0]);
+    }
+    return x;
+}
+
+// ghash_update with four blocks per VPCLMULQDQ: 16 blocks per reduction, the lane
+// products folded into one 256-bit sum first.
+GCM_WIDE_TARGET inline __m128i ghash_update_wide(__m128i x, const GhashKey& key, const unsigned char* data, size_t len) {
+    const __m512i swap = _mm512_set_epi64(0x0001020304050607LL, 0x08090a0b0c0d0e0fLL, 0x0001020304050607LL, 0x08090a0b0c0d0e0fLL,
+                                          0x0001020304050607LL, 0x08090a0b0c0d0e0fLL, 0x0001020304050607LL, 0x08090a0b0c0d0e0fLL);
+    // powers[r] holds H^(16 - 4r), ..., H^(13 - 4r) for the blocks of register r.
+    __m512i powers[GHASH_WIDE_BLOCKS / 4];
+    for (int r = 0; r < GHASH_WIDE_BLOCKS / 4; ++r) {
+        __m128i lanes[4];
+        for (int lane = 0; lane < 4; ++lane) lanes[lane] = key.h[GHASH_WIDE_BLOCKS - 1 - 4 * r - lane];
+        powers[r] = _mm512_loadu_si512(lanes);
+    }
+    const size_t group = GHASH_WIDE_BLOCKS * AES_BLOCK_BYTES;
+    size_t i = 0;
+    for (; i + group <= len; i += group) {
+        __m512i lo = _mm512_setzero_si512();
+        __m512i hi = _mm512_setzero_si512();
+        __m512i mid = _mm512_setzero_si512();
+        for (int r = 0; r < GHASH_WIDE_BLOCKS / 4; ++r) {
+            __m512i blocks = _mm512_shuffle_epi8(_mm512_loadu_si512(data + i + r * 4 * AES_BLOCK_BYTES), swap);
+            if (r == 0) blocks = _mm512_xor_si512(blocks, _mm512_zextsi128_si512(x));
+            lo = _mm512_xor_si512(lo, _mm512_clmulepi64_epi128(blocks, powers[r], 0x00));
+            hi = _mm512_xor_si512(hi, _mm512_clmulepi64_epi128(blocks, powers[r], 0x11));
+            mid = _mm512_xor_si512(mid, _mm512_xor_si512(_mm512_clmulepi64_epi128(blocks, powers[r], 0x10),
+                                                         _mm512_clmulepi64_epi128(blocks, powers[r], 0x01)));
+        }
+        lo = _mm512_xor_si512(lo, _mm512_bslli_epi128(mid, 8));
+        hi = _mm512_xor_si512(hi, _mm512_bsrli_epi128(mid, 8));
+        // Sum the four lanes (through memory: GCC 12's lane extract intrinsics warn under -Wall).
+        __m128i lo_lanes[4];
+        __m128i hi_lanes[4];
+        _mm512_storeu_si512(lo_lanes, lo);
+        _mm512_storeu_si512(hi_lanes, hi);
+        WideProduct product = {_mm_xor_si128(_mm_xor_si128(lo_lanes[0], lo_lanes[1]), _mm_xor_si128(lo_lanes[2], lo_lanes[3])),
+                               _mm_xor_si128(_mm_xor_si128(hi_lanes[0], hi_lanes[1]), _mm_xor_si128(hi_lanes[2], hi_lanes[3]))};
+        x = reduce(product);
+    }
+    return ghash_update(x, key, data + i, len - i);
+}
+
+// Hashes one chunk with the widest carry-less multiply the CPU has.
+GCM_TARGET inline __m128i ghash_chunk(__m128i x, const GhashKey& key, const unsigned char* data, size_t len) {
+    return vpclmul_available() ? ghash_update_wide(x, key, data, len) : ghash_update(x, key, data, len);
+}
+
+struct RangeResult {
+    __m128i ghash;
+    size_t blocks;
+};
+
+inline void store_be32(unsigned char* p, uint32_t v) {
+    p[0] = static_cast<unsigned char>(v >> 24);
+    p[1] = static_cast<unsigned char>(v >> 16);
+    p[2] = static_cast<unsigned char>(v >> 8);
+    p[3] = static_cast<unsigned char>(v);
+}
+
+inline void store_be64(unsigned char* p, uint64_t v) {
+    store_be32(p, static_cast<uint32_t>(v >> 32));
+    store_be32(p + 4, static_cast<uint32_t>(v));
+}
+
+// CTR over [begin, end) from counter 2 + begin / 16, hashing the ciphertext side of
+// every chunk (before decrypting, after encrypting) while it is in cache.
+GCM_TARGET inline RangeResult process_range(const unsigned char* key, const unsigned char* nonce,
+                                            const GhashKey& ghash_key, bool encrypt,
+                                            const unsigned char* input, size_t begin, size_t end,
+                                            unsigned char* output) {
+    unsigned char counter[AES_BLOCK_BYTES];
+    std::memcpy(counter, nonce, GCM_NONCE_BYTES);
+    store_be32(counter + GCM_NONCE_BYTES, static_cast<uint32_t>(2 + begin / AES_BLOCK_BYTES));
+    CtrStream ctr(key, counter);
+    __m128i x = _mm_setzero_si128();
+    for (size_t offset = begin; offset < end; offset += GCM_CHUNK_BYTES) {
+        const size_t len = std::min(GCM_CHUNK_BYTES, end - offset);
+        if (!encrypt) x = ghash_chunk(x, ghash_key, input + offset, len);
+        ctr.update(input + offset, len, output + offset);
+        if (encrypt) x = ghash_chunk(x, ghash_key, output + offset, len);
+    }
+    RangeResult result;
+    result.ghash = x;
+    result.blocks = (end - begin + AES_BLOCK_BYTES - 1) / AES_BLOCK_BYTES;
+    return result;
+}
+
+// Parallel path; writes the tag of the ciphertext to tag_out.
+GCM_TARGET inline void parallel_gcm(const unsigned char* key, const unsigned char* nonce, bool encrypt,
+                                    const unsigned char* input, size_t len, unsigned char* output,
+                                    unsigned char* tag_out, const unsigned char* aad, size_t aad_len,
+                                    RangeExecutor& executor) {
+    // H = E(K, 0^128) and E(K, J0) with J0 = nonce || 1.
+    unsigned char blocks[2 * AES_BLOCK_BYTES] = {};
+    std::memcpy(blocks + AES_BLOCK_BYTES, nonce, GCM_NONCE_BYTES);
+    blocks[2 * AES_BLOCK_BYTES - 1] = 1;
+    unsigned char encrypted[3 * AES_BLOCK_BYTES];
+    CipherEngine<AesMode::ECB, Direction::Encrypt, Padding::None>::process(key, NULL, blocks, sizeof(blocks), encrypted);
+    GhashKey ghash_key;
+    ghash_key.h[0] = byte_swap(_mm_loadu_si128(reinterpret_cast<const __m128i*>(encrypted)));
+    for (int i = 1; i < GHASH_WIDE_BLOCKS; ++i) ghash_key.h[i] = gf_mul(ghash_key.h[i - 1], ghash_key.h[0]);
+
+    const size_t num_blocks = (len + AES_BLOCK_BYTES - 1) / AES_BLOCK_BYTES;
+    const size_t num_ranges = len < OMP_PARALLEL_MIN_BYTES
+        ? 1 : std::min(std::max<size_t>(executor.concurrency(), 1), num_blocks);
+    std::vector<RangeResult> ranges(num_ranges);
+    bool parallel_success = true;
+    std::string parallel_error;
+    std::mutex error_mutex;
+    auto run_range = [&](size_t r) {
+        const size_t begin = num_blocks * r / num_ranges * AES_BLOCK_BYTES;
+        const size_t end = std::min(len, num_blocks * (r + 1) / num_ranges * AES_BLOCK_BYTES);
+        try {
+            ranges[r] = process_range(key, nonce, ghash_key, encrypt, input, begin, end, output);
+        } catch (const std::exception& e) {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            parallel_success = false;
+            parallel_error = e.what();
+        }
+    };
+    if (num_ranges == 1) {
+        run_range(0);
+    } else {
+        executor.run(num_ranges, run_range);
+    }
+    if (!parallel_success) {
+        throw std::runtime_error("Error occurred during parallel GCM processing: " + parallel_error);
+    }
+
+    __m128i x = _mm_setzero_si128();
+    if (aad_len > 0) x = ghash_update(x, ghash_key, aad, aad_len);
+    for (const RangeResult& range : ranges) {
+        if (range.blocks == 0) continue;
+        x = _mm_xor_si128(gf_mul(x, gf_pow(ghash_key.h[0], range.blocks)), range.ghash);
+    }
+    unsigned char length_block[AES_BLOCK_BYTES];
+    store_be64(length_block, static_cast<uint64_t>(aad_len) * 8);
+    store_be64(length_block + 8, static_cast<uint64_t>(len) * 8);
+    x = ghash_update(x, ghash_key, length_block, AES_BLOCK_BYTES);
+    const __m128i tag = _mm_xor_si128(byte_swap(x), _mm_loadu_si128(reinterpret_cast<const __m128i*>(encrypted + AES_BLOCK_BYTES)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(tag_out), tag);
+    OPENSSL_cleanse(encrypted, sizeof(encrypted));
+    OPENSSL_cleanse(&ghash_key, sizeof(ghash_key));
+}
+#endif // IMAGE_PROCESSOR_HAVE_AESNI
+
+inline bool use_parallel_path() {
+#if IMAGE_PROCESSOR_HAVE_AESNI
+    return aesni_available() && pclmul_available();
+#else
+    return false;
+#endif
+}
+
+inline void require_payload_limit(size_t len) {
+    if (static_cast<uint64_t>(len) > GCM_MAX_PAYLOAD_BYTES) {
+        throw std::runtime_error("Error: Pixel data exceeds the GCM block counter (64 GiB).");
+    }
+}
+
+inline void gcm_process(const unsigned char* key, const unsigned char* nonce, bool encrypt,
+                        const unsigned char* input, size_t len, unsigned char* output,
+                        unsigned char* tag, const unsigned char* aad, size_t aad_len,
+                        RangeExecutor& executor) {
+#if IMAGE_PROCESSOR_HAVE_AESNI
+    if (use_parallel_path()) {
+        parallel_gcm(key, nonce, encrypt, input, len, output, tag, aad, aad_len, executor);
+        return;
+    }
+#endif
+    (void)executor;
+    evp_gcm(key, nonce, encrypt, input, len, output, tag, aad, aad_len);
+}
+
+} // namespace gcm_detail
+
+// Encrypts len bytes into output (len + GCM_OVERHEAD_BYTES bytes: ciphertext, nonce,
+// tag). output may be the same buffer as input. Returns the payload length.
+inline size_t gcm_encrypt_pixels(const unsigned char* key, const unsigned char* input, size_t len,
+                                 unsigned char* output, RangeExecutor& executor = OpenMPExecutor::instance(),
+                                 const unsigned char* aad = NULL, size_t aad_len = 0) {
+    gcm_detail::require_payload_limit(len);
+    unsigned char nonce[GCM_NONCE_BYTES];
+    if (1 != RAND_bytes(nonce, sizeof(nonce))) {
+        handle_openssl_errors("RAND_bytes failed for the GCM nonce: ");
+    }
+    unsigned char tag[GCM_TAG_BYTES];
+    gcm_detail::gcm_process(key, nonce, true, input, len, output, tag, aad, aad_len, executor);
+    std::memcpy(output + len, nonce, GCM_NONCE_BYTES);
+    std::memcpy(output + len + GCM_NONCE_BYTES, tag, GCM_TAG_BYTES);
+    return len + GCM_OVERHEAD_BYTES;
+}
+
+// Decrypts a payload written by gcm_encrypt_pixels and checks its tag. On a mismatch
+// the output is wiped and an exception is thrown. output may be the same buffer as input.
+inline size_t gcm_decrypt_pixels(const unsigned char* key, const unsigned char* input, size_t len,
+                                 unsigned char* output, RangeExecutor& executor = OpenMPExecutor::instance(),
+                                 const unsigned char* aad = NULL, size_t aad_len = 0) {
+    if (len < GCM_OVERHEAD_BYTES) {
+        throw std::runtime_error("Error: GCM payload is shorter than its nonce and tag.");
+    }
+    const size_t cipher_len = len - GCM_OVERHEAD_BYTES;
+    gcm_detail::require_payload_limit(cipher_len);
+    unsigned char nonce[GCM_NONCE_BYTES];
+    unsigned char expected[GCM_TAG_BYTES];
+    std::memcpy(nonce, input + cipher_len, GCM_NONCE_BYTES);
+    std::memcpy(expected, input + cipher_len + GCM_NONCE_BYTES, GCM_TAG_BYTES);
+    if (!gcm_detail::use_parallel_path()) {
+        return gcm_detail::evp_gcm(key, nonce, false, input, cipher_len, output, expected, aad, aad_len);
+    }
+    unsigned char tag[GCM_TAG_BYTES];
+    gcm_detail::gcm_process(key, nonce, false, input, cipher_len, output, tag, aad, aad_len, executor);
+    if (CRYPTO_memcmp(tag, expected, GCM_TAG_BYTES) != 0) {
+        OPENSSL_cleanse(output, cipher_len);
+        throw std::runtime_error("Error: GCM authentication failed (wrong key or corrupted data).");
+    }
+    return cipher_len;
+}
+
+#endif // AES_GCM_HPP
@@ -0,0 +1,845 @@
+#ifndef BITSLICED_AES_HPP
+#define BITSLICED_AES_HPP
+
+#include <string>
+#include <cstdint>
+#include <cstdlib> // For std::getenv
+#include <cstddef>
+#include <cstring> // For memcpy, memcmp
+#include <algorithm> // For std::min
+
+#include <openssl/evp.h>    // For the known-answer self-test
+#include <openssl/crypto.h> // For OPENSSL_cleanse
+
+#include "aesni.hpp" // For IMAGE_PROCESSOR_HAVE_AESNI
+
+// Constant-time AES-256 for hosts without AES instructions, where EVP falls back to
+// table lookups (key- and data-dependent memory accesses, and several times slower).
+// The state of several blocks is transposed into eight bit planes, one per bit of every
+// byte, and each round is a fixed sequence of AND/XOR/shift operations on the planes:
+// the S-box is the Boyar-Peralta circuit, ShiftRows and MixColumns are masks and
+// rotations. Nothing indexes memory by key or data, so timing does not depend on either.
+//
+// A plane is a 64-bit word per four blocks (the layout of BearSSL's aes_ct64), held in
+// vector lanes: two lanes (8 blocks per call) with SSE2, four lanes (16 blocks per call)
+// with AVX2. Only the modes whose blocks are independent use it: ECB in both directions,
+// CTR and CBC decryption. CBC encryption is a true chain with one block in flight, so
+// it stays on EVP.
+//
+// Selection: used by default on x86 CPUs with neither AES-NI nor SSSE3, the hosts where
+// EVP has only its table code (with SSSE3 it uses a constant-time vector permutation
+// AES that is at least as fast). IMAGE_PROCESSOR_AES_ENGINE=bitsliced or =evp forces one
+// engine. The first use runs a known-answer test against FIPS-197 and EVP
+// AES-256-ECB/CBC/CTR; on mismatch the EVP path is kept.
+// IMAGE_PROCESSOR_BITSLICED_LANES=sse2 keeps the engine on two lanes on an AVX2 host
+// (e.g. to test both widths on one machine); unset or =avx2 allows what the CPU has.
+
+const size_t BITSLICED_SSE2_BLOCKS = 8;  // Blocks per call with two 64-bit lanes
+const size_t BITSLICED_AVX2_BLOCKS = 16; // Blocks per call with four 64-bit lanes
+
+// Round keys in bit-plane form, shared read-only by every range of a pass.
+struct BitslicedAes256Key {
+    uint64_t planes[15][8];
+
+    explicit BitslicedAes256Key(const unsigned char* key);
+    ~BitslicedAes256Key() { OPENSSL_cleanse(planes, sizeof(planes)); }
+
+    BitslicedAes256Key(const BitslicedAes256Key&) = delete;
+    BitslicedAes256Key& operator=(const BitslicedAes256Key&) = delete;
+};
+
+namespace bitsliced_detail {
+
+const size_t BLOCK_BYTES = 16;
+const int ROUNDS = 14;
+
+#if IMAGE_PROCESSOR_HAVE_AESNI
+#define BITSLICED_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#define BITSLICED_INLINE inline __attribute__((always_inline))
+
+typedef uint64_t Lanes2 __attribute__((vector_size(16)));
+typedef uint64_t Lanes4 __attribute__((vector_size(32)));
+
+inline bool avx2_available() {
+#if IMAGE_PROCESSOR_HAVE_AESNI
+    static const bool available = [] {
+        const char* cap = std::getenv("IMAGE_PROCESSOR_BITSLICED_LANES");
+        if (cap != NULL && std::string(cap) == "sse2") return false;
+        __builtin_cpu_init();
+        return static_cast<bool>(__builtin_cpu_supports("avx2"));
+    }();
+    return available;
+#else
+    return false;
+#endif
+}
+
+// --- Bit-Plane Round Functions ---
+// W is uint64_t (one group of four blocks) or a vector of such words. Every helper is
+// force-inlined, so the AVX2 entry points compile the whole round with 256-bit registers.
+
+// Swaps the bits selected by the low mask of y with those s positions higher in x.
+template <typename W>
+BITSLICED_INLINE void swap_bits(W& x, W& y, uint64_t low_mask, int s) {
+    const W a = x;
+    const W b = y;
+    x = (a & low_mask) | ((b & low_mask) << s);
+    y = ((a >> s) & low_mask) | (b & ~low_mask);
+}
+
+// Transposes between byte order and bit planes; it is its own inverse.
+template <typename W>
+BITSLICED_INLINE void ortho(W* q) {
+    swap_bits(q[0], q[1], 0x5555555555555555ULL, 1);
+    swap_bits(q[2], q[3], 0x5555555555555555ULL, 1);
+    swap_bits(q[4], q[5], 0x5555555555555555ULL, 1);
+    swap_bits(q[6], q[7], 0x5555555555555555ULL, 1);
+
+    swap_bits(q[0], q[2], 0x3333333333333333ULL, 2);
+    swap_bits(q[1], q[3], 0x3333333333333333ULL, 2);
+    swap_bits(q[4], q[6], 0x3333333333333333ULL, 2);
+    swap_bits(q[5], q[7], 0x3333333333333333ULL, 2);
+
+    swap_bits(q[0], q[4], 0x0F0F0F0F0F0F0F0FULL, 4);
+    swap_bits(q[1], q[5], 0x0F0F0F0F0F0F0F0FULL, 4);
+    swap_bits(q[2], q[6], 0x0F0F0F0F0F0F0F0FULL, 4);
+    swap_bits(q[3], q[7], 0x0F0F0F0F0F0F0F0FULL, 4);
+}
+
+// SubBytes on all planes: 113 gates (Boyar-Peralta), q[0] is the low bit of every byte.
+template <typename W>
+BITSLICED_INLINE void sub_bytes(W* q) {
+    const W x0 = q[7], x1 = q[6], x2 = q[5], x3 = q[4];
+    const W x4 = q[3], x5 = q[2], x6 = q[1], x7 = q[0];
+
+    // Top linear transformation.
+    const W y14 = x3 ^ x5;
+    const W y13 = x0 ^ x6;
+    const W y9 = x0 ^ x3;
+    const W y8 = x0 ^ x5;
+    const W t0 = x1 ^ x2;
+    const W y1 = t0 ^ x7;
+    const W y4 = y1 ^ x3;
+    const W y12 = y13 ^ y14;
+    const W y2 = y1 ^ x0;
+    const W y5 = y1 ^ x6;
+    const W y3 = y5 ^ y8;
+    const W t1 = x4 ^ y12;
+    const W y15 = t1 ^ x5;
+    const W y20 = t1 ^ x1;
+    const W y6 = y15 ^ x7;
+    const W y10 = y15 ^ t0;
+    const W y11 = y20 ^ y9;
+    const W y7 = x7 ^ y11;
+    const W y17 = y10 ^ y11;
+    const W y19 = y10 ^ y8;
+    const W y16 = t0 ^ y11;
+    const W y21 = y13 ^ y16;
+    const W y18 = x0 ^ y16;
+
+    // Non-linear section (inversion in GF(2^8) over GF(2^4)).
+    const W t2 = y12 & y15;
+    const W t3 = y3 & y6;
+    const W t4 = t3 ^ t2;
+    const W t5 = y4 & x7;
+    const W t6 = t5 ^ t2;
+    const W t7 = y13 & y16;
+    const W t8 = y5 & y1;
+    const W t9 = t8 ^ t7;
+    const W t10 = y2 & y7;
+    const W t11 = t10 ^ t7;
+    const W t12 = y9 & y11;
+    const W t13 = y14 & y17;
+    const W t14 = t13 ^ t12;
+    const W t15 = y8 & y10;
+    const W t16 = t15 ^ t12;
+    const W t17 = t4 ^ t14;
+    const W t18 = t6 ^ t16;
+    const W t19 = t9 ^ t14;
+    const W t20 = t11 ^ t16;
+    const W t21 = t17 ^ y20;
+    const W t22 = t18 ^ y19;
+    const W t23 = t19 ^ y21;
+    const W t24 = t20 ^ y18;
+
+    const W t25 = t21 ^ t22;
+    const W t26 = t21 & t23;
+    const W t27 = t24 ^ t26;
+    const W t28 = t25 & t27;
+    const W t29 = t28 ^ t22;
+    const W t30 = t23 ^ t24;
+    const W t31 = t22 ^ t26;
+    const W t32 = t31 & t30;
+    const W t33 = t32 ^ t24;
+    const W t34 = t23 ^ t33;
+    const W t35 = t27 ^ t33;
+    const W t36 = t24 & t35;
+    const W t37 = t36 ^ t34;
+    const W t38 = t27 ^ t36;
+    const W t39 = t29 & t38;
+    const W t40 = t25 ^ t39;
+
+    const W t41 = t40 ^ t37;
+    const W t42 = t29 ^ t33;
+    const W t43 = t29 ^ t40;
+    const W t44 = t33 ^ t37;
+    const W t45 = t42 ^ t41;
+    const W z0 = t44 & y15;
+    const W z1 = t37 & y6;
+    const W z2 = t33 & x7;
+    const W z3 = t43 & y16;
+    const W z4 = t40 & y1;
+    const W z5 = t29 & y7;
+    const W z6 = t42 & y11;
+    const W z7 = t45 & y17;
+    const W z8 = t41 & y10;
+    const W z9 = t44 & y12;
+    const W z10 = t37 & y3;
+    const W z11 = t33 & y4;
+    const W z12 = t43 & y13;
+    const W z13 = t40 & y5;
+    const W z14 = t29 & y2;
+    const W z15 = t42 & y9;
+    const W z16 = t45 & y14;
+    const W z17 = t41 & y8;
+
+    // Bottom linear transformation, including the affine constant 0x63.
+    const W t46 = z15 ^ z16;
+    const W t47 = z10 ^ z11;
+    const W t48 = z5 ^ z13;
+    const W t49 = z9 ^ z10;
+    const W t50 = z2 ^ z12;
+    const W t51 = z2 ^ z5;
+    const W t52 = z7 ^ z8;
+    const W t53 = z0 ^ z3;
+    const W t54 = z6 ^ z7;
+    const W t55 = z16 ^ z17;
+    const W t56 = z12 ^ t48;
+    const W t57 = t50 ^ t53;
+    const W t58 = z4 ^ t46;
+    const W t59 = z3 ^ t54;
+    const W t60 = t46 ^ t57;
+    const W t61 = z14 ^ t57;
+    const W t62 = t52 ^ t58;
+    const W t63 = t49 ^ t58;
+    const W t64 = z4 ^ t59;
+    const W t65 = t61 ^ t62;
+    const W t66 = z1 ^ t63;
+    const W s0 = t59 ^ t63;
+    const W s6 = t56 ^ ~t62;
+    const W s7 = t48 ^ ~t60;
+    const W t67 = t64 ^ t65;
+    const W s3 = t53 ^ t66;
+    const W s4 = t51 ^ t66;
+    const W s5 = t47 ^ t65;
+    const W s1 = t64 ^ ~s3;
+    const W s2 = t55 ^ ~t67;
+
+    q[7] = s0; q[6] = s1; q[5] = s2; q[4] = s3;
+    q[3] = s4; q[2] = s5; q[1] = s6; q[0] = s7;
+}
+
+// y -> A^-1(y ^ 0x63), the affine step shared by both sides of the inverse S-box.
+template <typename W>
+BITSLICED_INLINE void inv_affine(W* q) {
+    const W q0 = ~q[0], q1 = ~q[1], q2 = q[2], q3 = q[3];
+    const W q4 = q[4], q5 = ~q[5], q6 = ~q[6], q7 = q[7];
+    q[7] = q1 ^ q4 ^ q6;
+    q[6] = q0 ^ q3 ^ q5;
+    q[5] = q7 ^ q2 ^ q4;
+    q[4] = q6 ^ q1 ^ q3;
+    q[3] = q5 ^ q0 ^ q2;
+    q[2] = q4 ^ q7 ^ q1;
+    q[1] = q3 ^ q6 ^ q0;
+    q[0] = q2 ^ q5 ^ q7;
+}
+
+// S^-1(y) = A^-1(S(A^-1(y ^ 0x63)) ^ 0x63): the forward circuit between two affine steps.
+template <typename W>
+BITSLICED_INLINE void inv_sub_bytes(W* q) {
+    inv_affine(q);
+    sub_bytes(q);
+    inv_affine(q);
+}
+
+// Each 64-bit word holds four rows of 16 bits (four columns of four blocks).
+template <typename W>
+BITSLICED_INLINE void shift_rows(W* q) {
+    for (int i = 0; i < 8; ++i) {
+        const W x = q[i];
+        q[i] = (x & 0x000000000000FFFFULL)
+             | ((x & 0x00000000FFF00000ULL) >> 4)
+             | ((x & 0x00000000000F0000ULL) << 12)
+             | ((x & 0x0000FF0000000000ULL) >> 8)
+             | ((x & 0x000000FF00000000ULL) << 8)
+             | ((x & 0xF000000000000000ULL) >> 12)
+             | ((x & 0x0FFF000000000000ULL) << 4);
+    }
+}
+
+template <typename W>
+BITSLICED_INLINE void inv_shift_rows(W* q) {
+    for (int i = 0; i < 8; ++i) {
+        const W x = q[i];
+        q[i] = (x & 0x000000000000FFFFULL)
+             | ((x & 0x000000000FFF0000ULL) << 4)
+             | ((x & 0x00000000F0000000ULL) >> 12)
+             | ((x & 0x000000FF00000000ULL) << 8)
+             | ((x & 0x0000FF0000000000ULL) >> 8)
+             | ((x & 0x000F000000000000ULL) << 12)
+             | ((x & 0xFFF0000000000000ULL) >> 4);
+    }
+}
+
+template <typename W>
+BITSLICED_INLINE void mix_columns(W* q) {
+    W r[8];
+    W s[8];
+    for (int i = 0; i < 8; ++i) {
+        r[i] = (q[i] >> 16) | (q[i] << 48); // Next row of the same column
+        const W x = q[i] ^ r[i];
+        s[i] = (x << 32) | (x >> 32);       // Rows two and three further on
+    }
+    const W q7 = q[7] ^ r[7];               // Carry of the doubling (x^8 = x^4 + x^3 + x + 1)
+    const W q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3], q4 = q[4], q5 = q[5], q6 = q[6];
+    q[0] = q7 ^ r[0] ^ s[0];
+    q[1] = q0 ^ r[0] ^ q7 ^ r[1] ^ s[1];
+    q[2] = q1 ^ r[1] ^ r[2] ^ s[2];
+    q[3] = q2 ^ r[2] ^ q7 ^ r[3] ^ s[3];
+    q[4] = q3 ^ r[3] ^ q7 ^ r[4] ^ s[4];
+    q[5] = q4 ^ r[4] ^ r[5] ^ s[5];
+    q[6] = q5 ^ r[5] ^ r[6] ^ s[6];
+    q[7] = q6 ^ r[6] ^ r[7] ^ s[7];
+}
+
+// InvMixColumns = MixColumns after a_i -> a_i ^ 4 * (a_i ^ a_(i+2)).
+template <typename W>
+BITSLICED_INLINE void inv_mix_columns(W* q) {
+    W t[8];
+    for (int i = 0; i < 8; ++i) t[i] = q[i] ^ ((q[i] << 32) | (q[i] >> 32));
+    // Multiply the planes by x^2 modulo x^8 + x^4 + x^3 + x + 1.
+    q[0] ^= t[6];
+    q[1] ^= t[6] ^ t[7];
+    q[2] ^= t[0] ^ t[7];
+    q[3] ^= t[1] ^ t[6];
+    q[4] ^= t[2] ^ t[6] ^ t[7];
+    q[5] ^= t[3] ^ t[7];
+    q[6] ^= t[4];
+    q[7] ^= t[5];
+    mix_columns(q);
+}
+
+template <typename W>
+BITSLICED_INLINE void add_round_key(W* q, const uint64_t* round_key) {
+    for (int i = 0; i < 8; ++i) q[i] ^= round_key[i];
+}
+
+template <typename W>
+BITSLICED_INLINE void encrypt_planes(const BitslicedAes256Key& key, W* q) {
+    add_round_key(q, key.planes[0]);
+    for (int round = 1; round < ROUNDS; ++round) {
+        sub_bytes(q);
+        shift_rows(q);
+        mix_columns(q);
+        add_round_key(q, key.planes[round]);
+    }
+    sub_bytes(q);
+    shift_rows(q);
+    add_round_key(q, key.planes[ROUNDS]);
+}
+
+template <typename W>
+BITSLICED_INLINE void decrypt_planes(const BitslicedAes256Key& key, W* q) {
+    add_round_key(q, key.planes[ROUNDS]);
+    for (int round = ROUNDS - 1; round > 0; --round) {
+        inv_shift_rows(q);
+        inv_sub_bytes(q);
+        add_round_key(q, key.planes[round]);
+        inv_mix_columns(q);
+    }
+    inv_shift_rows(q);
+    inv_sub_bytes(q);
+    add_round_key(q, key.planes[0]);
+}
+
+// --- Loading and Storing ---
+inline uint32_t load_le32(const unsigned char* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+inline void store_le32(unsigned char* p, uint32_t v) {
+    p[0] = static_cast<unsigned char>(v);
+    p[1] = static_cast<unsigned char>(v >> 8);
+    p[2] = static_cast<unsigned char>(v >> 16);
+    p[3] = static_cast<unsigned char>(v >> 24);
+}
+
+// Spreads one block (four little-endian words) over two 64-bit words, 16 bits per row.
+BITSLICED_INLINE void interleave_in(uint64_t& lo, uint64_t& hi, const unsigned char* block) {
+    uint64_t x[4];
+    for (int i = 0; i < 4; ++i) {
+        x[i] = load_le32(block + 4 * i);
+        x[i] = (x[i] | (x[i] << 16)) & 0x0000FFFF0000FFFFULL;
+        x[i] = (x[i] | (x[i] << 8)) & 0x00FF00FF00FF00FFULL;
+    }
+    lo = x[0] | (x[2] << 8);
+    hi = x[1] | (x[3] << 8);
+}
+
+BITSLICED_INLINE void interleave_out(unsigned char* block, uint64_t lo, uint64_t hi) {
+    uint64_t x[4] = {lo & 0x00FF00FF00FF00FFULL, hi & 0x00FF00FF00FF00FFULL,
+                     (lo >> 8) & 0x00FF00FF00FF00FFULL, (hi >> 8) & 0x00FF00FF00FF00FFULL};
+    for (int i = 0; i < 4; ++i) {
+        x[i] = (x[i] | (x[i] >> 8)) & 0x0000FFFF0000FFFFULL;
+        store_le32(block + 4 * i, static_cast<uint32_t>(x[i]) | static_cast<uint32_t>(x[i] >> 16));
+    }
+}
+
+template <typename W>
+constexpr size_t lanes() { return sizeof(W) / sizeof(uint64_t); }
+
+static_assert(4 * lanes<Lanes2>() == BITSLICED_SSE2_BLOCKS, "two lanes of four blocks");
+static_assert(4 * lanes<Lanes4>() == BITSLICED_AVX2_BLOCKS, "four lanes of four blocks");
+
+template <typename W>
+BITSLICED_INLINE void set_lane(W& w, size_t lane, uint64_t value) { w[lane] = value; }
+BITSLICED_INLINE void set_lane(uint64_t& w, size_t, uint64_t value) { w = value; }
+
+template <typename W>
+BITSLICED_INLINE uint64_t get_lane(const W& w, size_t lane) { return w[lane]; }
+BITSLICED_INLINE uint64_t get_lane(const uint64_t& w, size_t) { return w; }
+
+// Loads 4 * lanes blocks; lane l holds blocks 4l..4l+3.
+template <typename W>
+BITSLICED_INLINE void load_blocks(W* q, const unsigned char* in) {
+    for (size_t lane = 0; lane < lanes<W>(); ++lane) {
+        for (size_t i = 0; i < 4; ++i) {
+            uint64_t lo, hi;
+            interleave_in(lo, hi, in + (4 * lane + i) * BLOCK_BYTES);
+            set_lane(q[i], lane, lo);
+            set_lane(q[i + 4], lane, hi);
+        }
+    }
+    ortho(q);
+}
+
+template <typename W>
+BITSLICED_INLINE void store_blocks(unsigned char* out, W* q) {
+    ortho(q);
+    for (size_t lane = 0; lane < lanes<W>(); ++lane) {
+        for (size_t i = 0; i < 4; ++i) {
+            interleave_out(out + (4 * lane + i) * BLOCK_BYTES, get_lane(q[i], lane), get_lane(q[i + 4], lane));
+        }
+    }
+}
+
+// --- Modes (one batch of 4 * lanes blocks per iteration) ---
+// A short last batch is padded with zero blocks in a local buffer. Input and output may
+// alias: every batch is read in full before any of it is written.
+
+template <typename W>
+BITSLICED_INLINE void ecb_blocks(const BitslicedAes256Key& key, bool encrypt,
+                                 const unsigned char* in, unsigned char* out, size_t num_blocks) {
+    const size_t batch = 4 * lanes<W>();
+    unsigned char buffer[BITSLICED_AVX2_BLOCKS * BLOCK_BYTES];
+    for (size_t done = 0; done < num_blocks; done += batch) {
+        const size_t count = num_blocks - done < batch ? num_blocks - done : batch;
+        std::memset(buffer, 0, batch * BLOCK_BYTES);
+        std::memcpy(buffer, in + done * BLOCK_BYTES, count * BLOCK_BYTES);
+        W q[8];
+        load_blocks(q, buffer);
+        if (encrypt) encrypt_planes(key, q);
+        else decrypt_planes(key, q);
+        store_blocks(buffer, q);
+        std::memcpy(out + done * BLOCK_BYTES, buffer, count * BLOCK_BYTES);
+    }
+    OPENSSL_cleanse(buffer, sizeof(buffer));
+}
+
+// chain is the previous ciphertext block on entry and the last one on return.
+template <typename W>
+BITSLICED_INLINE void cbc_decrypt_blocks(const BitslicedAes256Key& key, unsigned char* chain,
+                                         const unsigned char* in, unsigned char* out, size_t num_blocks) {
+    const size_t batch = 4 * lanes<W>();
+    unsigned char cipher[BITSLICED_AVX2_BLOCKS * BLOCK_BYTES];
+    unsigned char plain[BITSLICED_AVX2_BLOCKS * BLOCK_BYTES];
+    for (size_t done = 0; done < num_blocks; done += batch) {
+        const size_t count = num_blocks - done < batch ? num_blocks - done : batch;
+        std::memset(cipher, 0, batch * BLOCK_BYTES);
+        std::memcpy(cipher, in + done * BLOCK_BYTES, count * BLOCK_BYTES);
+        W q[8];
+        load_blocks(q, cipher);
+        decrypt_planes(key, q);
+        store_blocks(plain, q);
+        for (size_t i = 0; i < BLOCK_BYTES; ++i) plain[i] ^= chain[i];
+        for (size_t i = BLOCK_BYTES; i < count * BLOCK_BYTES; ++i) plain[i] ^= cipher[i - BLOCK_BYTES];
+        std::memcpy(chain, cipher + (count - 1) * BLOCK_BYTES, BLOCK_BYTES);
+        std::memcpy(out + done * BLOCK_BYTES, plain, count * BLOCK_BYTES);
+    }
+    OPENSSL_cleanse(plain, sizeof(plain));
+}
+
+// Adds one to a 128-bit big-endian counter (as EVP AES-256-CTR does).
+inline void increment_counter(unsigned char* counter) {
+    unsigned carry = 1;
+    for (int i = static_cast<int>(BLOCK_BYTES) - 1; i >= 0; --i) {
+        carry += counter[i];
+        counter[i] = static_cast<unsigned char>(carry);
+        carry >>= 8;
+    }
+}
+
+// Writes num_blocks keystream blocks from counter and advances it past them.
+template <typename W>
+BITSLICED_INLINE void ctr_keystream(const BitslicedAes256Key& key, unsigned char* counter,
+                                    unsigned char* out, size_t num_blocks) {
+    const size_t batch = 4 * lanes<W>();
+    unsigned char buffer[BITSLICED_AVX2_BLOCKS * BLOCK_BYTES];
+    for (size_t done = 0; done < num_blocks; done += batch) {
+        const size_t count = num_blocks - done < batch ? num_blocks - done : batch;
+        for (size_t i = 0; i < batch; ++i) {
+            std::memcpy(buffer + i * BLOCK_BYTES, counter, BLOCK_BYTES);
+            if (i < count) increment_counter(counter);
+        }
+        W q[8];
+        load_blocks(q, buffer);
+        encrypt_planes(key, q);
+        store_blocks(buffer, q);
+        std::memcpy(out + done * BLOCK_BYTES, buffer, count * BLOCK_BYTES);
+    }
+    OPENSSL_cleanse(buffer, sizeof(buffer));
+}
+
+// --- Width Dispatch ---
+inline void ecb_sse2(const BitslicedAes256Key& key, bool encrypt, const unsigned char* in,
+                     unsigned char* out, size_t num_blocks) {
+    ecb_blocks<Lanes2>(key, encrypt, in, out, num_blocks);
+}
+
+inline void cbc_decrypt_sse2(const BitslicedAes256Key& key, unsigned char* chain, const unsigned char* in,
+                             unsigned char* out, size_t num_blocks) {
+    cbc_decrypt_blocks<Lanes2>(key, chain, in, out, num_blocks);
+}
+
+inline void ctr_keystream_sse2(const BitslicedAes256Key& key, unsigned char* counter,
+                               unsigned char* out, size_t num_blocks) {
+    ctr_keystream<Lanes2>(key, counter, out, num_blocks);
+}
+
+#ifdef BITSLICED_AVX2_TARGET
+BITSLICED_AVX2_TARGET inline void ecb_avx2(const BitslicedAes256Key& key, bool encrypt, const unsigned char* in,
+                                           unsigned char* out, size_t num_blocks) {
+    ecb_blocks<Lanes4>(key, encrypt, in, out, num_blocks);
+}
+
+BITSLICED_AVX2_TARGET inline void cbc_decrypt_avx2(const BitslicedAes256Key& key, unsigned char* chain,
+                                                   const unsigned char* in, unsigned char* out, size_t num_blocks) {
+    cbc_decrypt_blocks<Lanes4>(key, chain, in, out, num_blocks);
+}
+
+BITSLICED_AVX2_TARGET inline void ctr_keystream_avx2(const BitslicedAes256Key& key, unsigned char* counter,
+                                                     unsigned char* out, size_t num_blocks) {
+    ctr_keystream<Lanes4>(key, counter, out, num_blocks);
+}
+#endif
+
+// SubWord of the key schedule through the same circuit (lane 0 of a single plane set).
+inline uint32_t sub_word(uint32_t x) {
+    uint64_t q[8] = {x, 0, 0, 0, 0, 0, 0, 0};
+    ortho(q);
+    sub_bytes(q);
+    ortho(q);
+    return static_cast<uint32_t>(q[0]);
+}
+
+} // namespace bitsliced_detail
+
+inline BitslicedAes256Key::BitslicedAes256Key(const unsigned char* key) {
+    using namespace bitsliced_detail;
+    // FIPS-197 AES-256 key expansion on little-endian words.
+    uint32_t words[4 * (ROUNDS + 1)];
+    for (int i = 0; i < 8; ++i) words[i] = load_le32(key + 4 * i);
+    uint32_t rcon = 1;
+    for (int i = 8; i < 4 * (ROUNDS + 1); ++i) {
+        uint32_t temp = words[i - 1];
+        if (i % 8 == 0) {
+            temp = sub_word((temp >> 8) | (temp << 24)) ^ rcon;
+            rcon <<= 1;
+        } else if (i % 8 == 4) {
+            temp = sub_word(temp);
+        }
+        words[i] = words[i - 8] ^ temp;
+    }
+    // Every round key is placed in all four block slots of a word, then transposed.
+    unsigned char round_key[BLOCK_BYTES];
+    for (int round = 0; round <= ROUNDS; ++round) {
+        for (int i = 0; i < 4; ++i) store_le32(round_key + 4 * i, words[4 * round + i]);
+        uint64_t* q = planes[round];
+        interleave_in(q[0], q[4], round_key);
+        q[1] = q[2] = q[3] = q[0];
+        q[5] = q[6] = q[7] = q[4];
+        ortho(q);
+    }
+    OPENSSL_cleanse(words, sizeof(words));
+    OPENSSL_cleanse(round_key, sizeof(round_key));
+}
+
+// --- Block Functions ---
+// Whole blocks only; padding is the caller's business.
+inline void bitsliced_ecb_encrypt(const BitslicedAes256Key& key, const unsigned char* in,
+                                  unsigned char* out, size_t num_blocks) {
+#ifdef BITSLICED_AVX2_TARGET
+    if (bitsliced_detail::avx2_available()) return bitsliced_detail::ecb_avx2(key, true, in, out, num_blocks);
+#endif
+    bitsliced_detail::ecb_sse2(key, true, in, out, num_blocks);
+}
+
+inline void bitsliced_ecb_decrypt(const BitslicedAes256Key& key, const unsigned char* in,
+                                  unsigned char* out, size_t num_blocks) {
+#ifdef BITSLICED_AVX2_TARGET
+    if (bitsliced_detail::avx2_available()) return bitsliced_detail::ecb_avx2(key, false, in, out, num_blocks);
+#endif
+    bitsliced_detail::ecb_sse2(key, false, in, out, num_blocks);
+}
+
+// chain: previous ciphertext block (the IV for the first range) in, last ciphertext block out.
+inline void bitsliced_cbc_decrypt(const BitslicedAes256Key& key, unsigned char* chain,
+                                  const unsigned char* in, unsigned char* out, size_t num_blocks) {
+#ifdef BITSLICED_AVX2_TARGET
+    if (bitsliced_detail::avx2_available()) return bitsliced_detail::cbc_decrypt_avx2(key, chain, in, out, num_blocks);
+#endif
+    bitsliced_detail::cbc_decrypt_sse2(key, chain, in, out, num_blocks);
+}
+
+// Streaming ECB (iv == NULL) or CBC decryption (iv != NULL) context with the contract of
+// an EVP cipher context: update() emits every whole block, except that when removing
+// padding the last whole block is held back for finish(). finish() adds or checks PKCS#7
+// padding, or without padding requires that no partial block is left; it returns false
+// where EVP_CipherFinal_ex fails. As with EVP, input and output may only alias exactly.
+class BitslicedCipher {
+public:
+    BitslicedCipher(const unsigned char* key, const unsigned char* iv, bool encrypt, bool padding)
+        : key_(key), cbc_(iv != NULL), encrypt_(encrypt), padding_(padding), buffered_(0) {
+        if (cbc_) std::memcpy(chain_, iv, BLOCK);
+    }
+    ~BitslicedCipher() {
+        OPENSSL_cleanse(buffer_, sizeof(buffer_));
+        OPENSSL_cleanse(chain_, sizeof(chain_));
+    }
+
+    BitslicedCipher(const BitslicedCipher&) = delete;
+    BitslicedCipher& operator=(const BitslicedCipher&) = delete;
+
+    size_t update(const unsigned char* input, size_t len, unsigned char* output) {
+        const size_t total = buffered_ + len;
+        size_t emit = total - total % BLOCK;
+        if (!encrypt_ && padding_ && emit == total && emit > 0) emit -= BLOCK;
+        if (emit == 0) {
+            std::memcpy(buffer_ + buffered_, input, len);
+            buffered_ += len;
+            return 0;
+        }
+        size_t used = 0;
+        size_t out_len = 0;
+        if (buffered_ > 0) {
+            used = BLOCK - buffered_;
+            std::memcpy(buffer_ + buffered_, input, used);
+            blocks(buffer_, output, 1);
+            out_len = BLOCK;
+        }
+        blocks(input + used, output + out_len, (emit - out_len) / BLOCK);
+        used += emit - out_len;
+        buffered_ = len - used;
+        std::memcpy(buffer_, input + used, buffered_);
+        return emit;
+    }
+
+    // Writes at most one block.
+    bool finish(unsigned char* output, size_t& out_len) {
+        out_len = 0;
+        if (!padding_) return buffered_ == 0;
+        if (encrypt_) {
+            const unsigned char pad = static_cast<unsigned char>(BLOCK - buffered_);
+            std::memset(buffer_ + buffered_, pad, pad);
+            blocks(buffer_, output, 1);
+            buffered_ = 0;
+            out_len = BLOCK;
+            return true;
+        }
+        if (buffered_ != BLOCK) return false;
+        unsigned char block[BLOCK];
+        blocks(buffer_, block, 1);
+        buffered_ = 0;
+        // The padding bytes are checked without data-dependent branches.
+        const unsigned pad = block[BLOCK - 1];
+        unsigned bad = ((pad - 1) >> 8) | ((static_cast<unsigned>(BLOCK) - pad) >> 8); // 0 or > 16
+        for (size_t i = 0; i < BLOCK; ++i) {
+            const unsigned in_padding = ~(static_cast<unsigned>(i + pad - BLOCK) >> 8);
+            bad |= in_padding & ((0u - (block[i] ^ pad)) >> 8);
+        }
+        const bool ok = (bad & 1u) == 0;
+        if (ok) {
+            out_len = BLOCK - pad;
+            std::memcpy(output, block, out_len);
+        }
+        OPENSSL_cleanse(block, sizeof(block));
+        return ok;
+    }
+
+private:
+    static constexpr size_t BLOCK = bitsliced_detail::BLOCK_BYTES;
+    BitslicedAes256Key key_;
+    bool cbc_;
+    bool encrypt_;
+    bool padding_;
+    unsigned char chain_[BLOCK];
+    unsigned char buffer_[BLOCK];
+    size_t buffered_;
+
+    void blocks(const unsigned char* in, unsigned char* out, size_t num_blocks) {
+        if (cbc_) bitsliced_cbc_decrypt(key_, chain_, in, out, num_blocks);
+        else if (encrypt_) bitsliced_ecb_encrypt(key_, in, out, num_blocks);
+        else bitsliced_ecb_decrypt(key_, in, out, num_blocks);
+    }
+};
+
+// AES-256-CTR with a 128-bit big-endian counter, streaming like an EVP context: a partial
+// block leaves the rest of its keystream for the next update.
+class BitslicedCtr {
+public:
+    BitslicedCtr(const unsigned char* key, const unsigned char* counter) : key_(key), used_(BLOCK) {
+        std::memcpy(counter_, counter, BLOCK);
+    }
+    ~BitslicedCtr() { OPENSSL_cleanse(keystream_, sizeof(keystream_)); }
+
+    BitslicedCtr(const BitslicedCtr&) = delete;
+    BitslicedCtr& operator=(const BitslicedCtr&) = delete;
+
+    void update(const unsigned char* input, size_t len, unsigned char* output) {
+        size_t done = 0;
+        for (; done < len && used_ < BLOCK; ++done) output[done] = input[done] ^ keystream_[used_++];
+        while (len - done >= BLOCK) {
+            const size_t blocks = std::min((len - done) / BLOCK, sizeof(keystream_) / BLOCK);
+            generate(keystream_, blocks);
+            for (size_t i = 0; i < blocks * BLOCK; ++i) output[done + i] = input[done + i] ^ keystream_[i];
+            done += blocks * BLOCK;
+        }
+        if (done < len) {
+            generate(keystream_, 1);
+            used_ = 0;
+            for (; done < len; ++done) output[done] = input[done] ^ keystream_[used_++];
+        }
+    }
+
+private:
+    static constexpr size_t BLOCK = bitsliced_detail::BLOCK_BYTES;
+    BitslicedAes256Key key_;
+    unsigned char counter_[BLOCK];
+    unsigned char keystream_[64 * BLOCK];
+    size_t used_; // Bytes of keystream_[0, BLOCK) already consumed by a partial block
+
+    void generate(unsigned char* out, size_t num_blocks) {
+#ifdef BITSLICED_AVX2_TARGET
+        if (bitsliced_detail::avx2_available()) return bitsliced_detail::ctr_keystream_avx2(key_, counter_, out, num_blocks);
+#endif
+        bitsliced_detail::ctr_keystream_sse2(key_, counter_, out, num_blocks);
+    }
+};
+
+// --- Known-Answer Self-Test ---
+namespace bitsliced_detail {
+
+inline bool evp_matches(const EVP_CIPHER* cipher, bool encrypt, const unsigned char* key, const unsigned char* iv,
+                        const unsigned char* in, size_t len, const unsigned char* expected) {
+    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+    if (!ctx) return false;
+    std::string out(len + BLOCK_BYTES, '\0');
+    unsigned char* out_data = reinterpret_cast<unsigned char*>(&out[0]);
+    int out_len = 0;
+    bool ok = 1 == EVP_CipherInit_ex(ctx, cipher, NULL, key, iv, encrypt ? 1 : 0) &&
+              1 == EVP_CIPHER_CTX_set_padding(ctx, 0) &&
+              1 == EVP_CipherUpdate(ctx, out_data, &out_len, in, static_cast<int>(len)) &&
+              static_cast<size_t>(out_len) == len &&
+              std::memcmp(out_data, expected, len) == 0;
+    EVP_CIPHER_CTX_free(ctx);
+    return ok;
+}
+
+// FIPS-197 appendix C.3, then 37 blocks (full batches plus a short one at either width)
+// through each mode against EVP, with a split CTR update to cover the keystream carry.
+inline bool self_test() {
+    unsigned char key[32];
+    unsigned char block[BLOCK_BYTES];
+    for (int i = 0; i < 32; ++i) key[i] = static_cast<unsigned char>(i);
+    for (size_t i = 0; i < BLOCK_BYTES; ++i) block[i] = static_cast<unsigned char>(i * 0x11);
+    static const unsigned char fips_c3[BLOCK_BYTES] = {0x8e, 0xa2, 0xb7, 0xca, 0x51, 0x67, 0x45, 0xbf,
+                                                       0xea, 0xfc, 0x49, 0x90, 0x4b, 0x49, 0x60, 0x89};
+    unsigned char out[BLOCK_BYTES];
+    {
+        BitslicedAes256Key schedule(key);
+        bitsliced_ecb_encrypt(schedule, block, out, 1);
+        if (std::memcmp(out, fips_c3, BLOCK_BYTES) != 0) return false;
+        bitsliced_ecb_decrypt(schedule, out, out, 1);
+        if (std::memcmp(out, block, BLOCK_BYTES) != 0) return false;
+    }
+
+    const size_t num_blocks = 37;
+    const size_t len = num_blocks * BLOCK_BYTES;
+    unsigned char data[num_blocks * BLOCK_BYTES];
+    unsigned char result[num_blocks * BLOCK_BYTES];
+    unsigned char iv[BLOCK_BYTES];
+    uint32_t x = 0x9e3779b9u;
+    for (int i = 0; i < 32; ++i) {
+        x = x * 1664525u + 1013904223u;
+        key[i] = static_cast<unsigned char>(x >> 24);
+    }
+    for (size_t i = 0; i < len; ++i) {
+        x = x * 1664525u + 1013904223u;
+        data[i] = static_cast<unsigned char>(x >> 24);
+    }
+    for (size_t i = 0; i < BLOCK_BYTES; ++i) iv[i] = static_cast<unsigned char>(0xf0 + i);
+    iv[BLOCK_BYTES - 1] = 0xfe; // The counter carries into the next byte within the test
+
+    BitslicedAes256Key schedule(key);
+    bitsliced_ecb_encrypt(schedule, data, result, num_blocks);
+    if (!evp_matches(EVP_aes_256_ecb(), true, key, NULL, data, len, result)) return false;
+    bitsliced_ecb_decrypt(schedule, data, result, num_blocks);
+    if (!evp_matches(EVP_aes_256_ecb(), false, key, NULL, data, len, result)) return false;
+    unsigned char chain[BLOCK_BYTES];
+    std::memcpy(chain, iv, BLOCK_BYTES);
+    bitsliced_cbc_decrypt(schedule, chain, data, result, num_blocks);
+    if (!evp_matches(EVP_aes_256_cbc(), false, key, iv, data, len, result)) return false;
+    if (std::memcmp(chain, data + len - BLOCK_BYTES, BLOCK_BYTES) != 0) return false;
+    BitslicedCtr ctr(key, iv);
+    ctr.update(data, 21, result);
+    ctr.update(data + 21, len - 21, result + 21);
+    return evp_matches(EVP_aes_256_ctr(), true, key, iv, data, len, result);
+}
+
+} // namespace bitsliced_detail
+
+inline bool evp_aes_table_based() {
+#if IMAGE_PROCESSOR_HAVE_AESNI
+    static const bool table_based = [] {
+        __builtin_cpu_init();
+        return !__builtin_cpu_supports("aes") && !__builtin_cpu_supports("ssse3");
+    }();
+    return table_based;
+#else
+    return false;
+#endif
+}
+
+inline bool bitsliced_aes_selected() {
+    static const bool selected = [] {
+        const char* engine = std::getenv("IMAGE_PROCESSOR_AES_ENGINE");
+        if (engine != NULL && std::string(engine) == "evp") return false;
+        const bool wanted = (engine != NULL && std::string(engine) == "bitsliced") || evp_aes_table_based();
+        return wanted && bitsliced_detail::self_test();
+    }();
+    return selected;
+}
+
+#endif // BITSLICED_AES_HPP
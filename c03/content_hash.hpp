@@ -0,0 +1,85 @@
+#ifndef CONTENT_HASH_HPP
+#define CONTENT_HASH_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring> // For memcpy
+#include <string>
+
+// Fast 128-bit non-cryptographic hash for cache file names and integrity checks. Four
+// independent 64-bit multiply/rotate lanes consume 32-byte stripes, so the loop runs
+// at several bytes per cycle; the lanes are folded into two 64-bit halves with an
+// avalanche step. Not collision resistant against an adversary, seeded or not: use
+// it only where a collision costs a spurious miss or rewrite, never to decide whose
+// data a request is served (result_cache.hpp keys its entries with HMAC-SHA256).
+
+struct Hash128 {
+    uint64_t lo;
+    uint64_t hi;
+
+    bool operator==(const Hash128& other) const { return lo == other.lo && hi == other.hi; }
+    bool operator!=(const Hash128& other) const { return !(*this == other); }
+
+    std::string hex() const {
+        static const char digits[] = "0123456789abcdef";
+        std::string out(32, '0');
+        for (int i = 0; i < 16; ++i) {
+            out[15 - i] = digits[(hi >> (4 * i)) & 0xf];
+            out[31 - i] = digits[(lo >> (4 * i)) & 0xf];
+        }
+        return out;
+    }
+};
+
+namespace content_hash_detail {
+
+const uint64_t PRIME1 = 0x9e3779b185ebca87ULL;
+const uint64_t PRIME2 = 0xc2b2ae3d27d4eb4fULL;
+const uint64_t PRIME3 = 0x165667b19e3779f9ULL;
+
+inline uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+inline uint64_t load64(const unsigned char* p) {
+    uint64_t v;
+    std::memcpy(&v, p, 8);
+    return v;
+}
+
+inline uint64_t avalanche(uint64_t h) {
+    h ^= h >> 33;
+    h *= PRIME2;
+    h ^= h >> 29;
+    h *= PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+
+} // namespace content_hash_detail
+
+inline Hash128 hash_bytes_128(const unsigned char* data, size_t len, uint64_t seed = 0) {
+    using namespace content_hash_detail;
+    uint64_t acc0 = seed + PRIME1 + PRIME2;
+    uint64_t acc1 = seed + PRIME2;
+    uint64_t acc2 = seed;
+    uint64_t acc3 = seed - PRIME1;
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        acc0 = rotl(acc0 + load64(data + i) * PRIME2, 31) * PRIME1;
+        acc1 = rotl(acc1 + load64(data + i + 8) * PRIME2, 31) * PRIME1;
+        acc2 = rotl(acc2 + load64(data + i + 16) * PRIME2, 31) * PRIME1;
+        acc3 = rotl(acc3 + load64(data + i + 24) * PRIME2, 31) * PRIME1;
+    }
+    uint64_t tail = static_cast<uint64_t>(len) * PRIME3;
+    for (; i + 8 <= len; i += 8) {
+        tail = rotl(tail ^ (load64(data + i) * PRIME2), 27) * PRIME1 + PRIME3;
+    }
+    for (; i < len; ++i) {
+        tail = rotl(tail ^ (data[i] * PRIME3), 11) * PRIME1;
+    }
+    Hash128 h;
+    h.lo = avalanche(acc0 ^ rotl(acc1, 7) ^ rotl(acc2, 12) ^ rotl(acc3, 18) ^ tail);
+    h.hi = avalanche(acc1 ^ rotl(acc3, 29) ^ rotl(acc0, 41) ^ rotl(acc2, 47) ^ (tail * PRIME1) ^ h.lo);
+    return h;
+}
+
+#endif // CONTENT_HASH_HPP
@@ -0,0 +1,835 @@
+#ifndef HTTP_SERVER_HPP
+#define HTTP_SERVER_HPP
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <stdexcept> // For std::runtime_error
+#include <cstring>   // For memcpy, strerror
+#include <cstdlib>   // For strtoull
+#include <cstdio>    // For snprintf
+#include <cerrno>
+#include <algorithm> // For std::min
+
+#include <netinet/in.h>
+#include <netinet/tcp.h> // For TCP_NODELAY
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "cipher_engine.hpp"  // AES engine, OpenSSL runtime and error handling
+#include "image_pipeline.hpp" // BMP parsing, key derivation and the pixel cipher pass
+#include "result_cache.hpp"   // Buffered requests are served from the cache
+#include "worker_pool.hpp"    // Shared threads for the buffered pixel passes
+#include "tcp_listener.hpp"   // For listen_tcp
+
+// Long-running mode of image_processor_ssl that speaks HTTP/1.1, so c03 can talk to
+// the native processor without the c04 JVM in between.
+//
+//   GET  /          "Hello World!" (c04's liveness answer)
+//   POST /sendData  c04's contract: JSON {imageData (base64), mode, operation, aes_key,
+//                   originalFileName, ...}; the answer is the processed BMP as
+//                   application/octet-stream. As in c04, a request that fails to
+//                   process gets 200 with an empty body (X-Imagecrypt-Error says why).
+//                   An optional "compress" field ("lz4" or "zstd") compresses the
+//                   pixels before encryption.
+//   POST /process   Raw variant: the body is the BMP itself; X-Operation, X-Mode and
+//                   X-Aes-Key carry the parameters, X-Compress optionally the codec.
+//                   ECB and CBC stream: the response (chunked) starts as soon as the
+//                   BMP header has arrived and each received piece is ciphered and
+//                   sent on. If the cipher fails after that (e.g. bad CBC padding on
+//                   decrypt), the connection is closed before the final chunk, so
+//                   the client sees a truncated transfer.
+//                   GCM, ChaCha20, AUTO decryption and compressed payloads (either
+//                   direction) need the whole image and are buffered; errors are
+//                   answered with 400 (request) or 422 (cipher).
+//
+// Request bodies may use Content-Length or chunked encoding; "Expect: 100-continue"
+// (curl's default for large uploads) is honoured. Buffered bodies are limited to
+// IMAGE_PROCESSOR_HTTP_MAX_BODY_MB (default 64). Connections are served by a fixed set
+// of threads (IMAGE_PROCESSOR_HTTP_THREADS) that share one worker pool for the pixel
+// passes.
+
+const size_t HTTP_DEFAULT_MAX_BODY_MB = 64;
+
+namespace http_detail {
+
+const size_t MAX_HEADER_BYTES = 64 * 1024;
+const size_t IO_BUFFER_BYTES = 256 * 1024;
+const int IDLE_TIMEOUT_SECONDS = 30;
+
+// A request that cannot be answered normally; status is the HTTP status to send.
+struct HttpError : std::runtime_error {
+    int status;
+    HttpError(int status_code, const std::string& message) : std::runtime_error(message), status(status_code) {}
+};
+
+inline const char* status_text(int status) {
+    switch (status) {
+    case 100: return "Continue";
+    case 200: return "OK";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 413: return "Payload Too Large";
+    case 422: return "Unprocessable Entity";
+    case 500: return "Internal Server Error";
+    }
+    return "Unknown";
+}
+
+// Error messages go into headers; OpenSSL ones span several lines.
+inline std::string header_safe(const std::string& text) {
+    std::string safe = text;
+    for (char& c : safe) {
+        if (static_cast<unsigned char>(c) < 0x20 || c == 0x7f) c = ' ';
+    }
+    while (!safe.empty() && safe.back() == ' ') safe.pop_back();
+    return safe;
+}
+
+inline std::string lowercase(std::string text) {
+    for (char& c : text) {
+        if (c >= 'A' && c <= 'Z') c = static_cast<char>(c - 'A' + 'a');
+    }
+    return text;
+}
+
+// --- Connection I/O ---
+class Connection {
+public:
+    explicit Connection(int fd) : fd_(fd), buffer_(IO_BUFFER_BYTES), begin_(0), end_(0) {}
+
+    // Up to len bytes, buffered data first; 0 at end of stream.
+    size_t read_some(unsigned char* out, size_t len) {
+        if (begin_ == end_) {
+            if (len >= buffer_.size()) return receive(out, len);
+            begin_ = 0;
+            end_ = receive(buffer_.data(), buffer_.size());
+            if (end_ == 0) return 0;
+        }
+        const size_t n = std::min(len, end_ - begin_);
+        std::memcpy(out, buffer_.data() + begin_, n);
+        begin_ += n;
+        return n;
+    }
+
+    void read_exact(unsigned char* out, size_t len) {
+        while (len > 0) {
+            const size_t n = read_some(out, len);
+            if (n == 0) throw HttpError(400, "Error: Connection closed in the middle of the request.");
+            out += n;
+            len -= n;
+        }
+    }
+
+    // One CRLF-terminated line without the terminator; false at a clean end of stream
+    // before any byte of the line.
+    bool read_line(std::string& line, size_t limit) {
+        line.clear();
+        while (true) {
+            if (begin_ == end_) {
+                begin_ = 0;
+                end_ = receive(buffer_.data(), buffer_.size());
+                if (end_ == 0) {
+                    if (line.empty()) return false;
+                    throw HttpError(400, "Error: Connection closed in the middle of the request.");
+                }
+            }
+            const unsigned char* start = buffer_.data() + begin_;
+            const void* newline = std::memchr(start, '\n', end_ - begin_);
+            const size_t take = newline != NULL ? static_cast<const unsigned char*>(newline) - start + 1 : end_ - begin_;
+            line.append(reinterpret_cast<const char*>(start), take);
+            begin_ += take;
+            if (line.size() > limit) throw HttpError(400, "Error: Request header too large.");
+            if (newline != NULL) break;
+        }
+        line.pop_back();
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        return true;
+    }
+
+    void write_all(const void* data, size_t len) {
+        const char* p = static_cast<const char*>(data);
+        while (len > 0) {
+            ssize_t n = send(fd_, p, len, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) throw std::runtime_error(std::string("Error: Could not send the response: ") + std::strerror(errno));
+            p += n;
+            len -= static_cast<size_t>(n);
+        }
+    }
+
+    void write_all(const std::string& text) { write_all(text.data(), text.size()); }
+
+private:
+    int fd_;
+    std::vector<unsigned char> buffer_;
+    size_t begin_;
+    size_t end_;
+
+    size_t receive(unsigned char* out, size_t len) {
+        while (true) {
+            ssize_t n = recv(fd_, out, len, 0);
+            if (n >= 0) return static_cast<size_t>(n);
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) throw HttpError(400, "Error: Timed out reading the request.");
+            throw HttpError(400, std::string("Error: Could not read the request: ") + std::strerror(errno));
+        }
+    }
+};
+
+// --- Requests ---
+struct Request {
+    std::string method;
+    std::string path;
+    std::map<std::string, std::string> headers; // Lowercase names
+    bool keep_alive = true;
+    bool chunked = false;
+    uint64_t content_length = 0;
+
+    const std::string* header(const std::string& name) const {
+        auto it = headers.find(name);
+        return it != headers.end() ? &it->second : NULL;
+    }
+};
+
+// Reads the request line and headers; false if the peer closed between requests.
+inline bool read_request(Connection& connection, Request& request) {
+    std::string line;
+    do {
+        if (!connection.read_line(line, MAX_HEADER_BYTES)) return false;
+    } while (line.empty()); // Stray CRLF between requests is allowed
+    const size_t method_end = line.find(' ');
+    const size_t target_end = line.rfind(' ');
+    if (method_end == std::string::npos || target_end <= method_end) {
+        throw HttpError(400, "Error: Malformed request line.");
+    }
+    request.method = line.substr(0, method_end);
+    request.path = line.substr(method_end + 1, target_end - method_end - 1);
+    request.path = request.path.substr(0, request.path.find('?'));
+    const std::string version = line.substr(target_end + 1);
+    if (version != "HTTP/1.1" && version != "HTTP/1.0") {
+        throw HttpError(400, "Error: Unsupported HTTP version.");
+    }
+    request.keep_alive = version == "HTTP/1.1";
+
+    size_t header_bytes = line.size();
+    while (connection.read_line(line, MAX_HEADER_BYTES) && !line.empty()) {
+        header_bytes += line.size();
+        const size_t colon = line.find(':');
+        if (colon == std::string::npos || header_bytes > MAX_HEADER_BYTES) {
+            throw HttpError(400, "Error: Malformed request header.");
+        }
+        size_t value_begin = colon + 1;
+        size_t value_end = line.size();
+        while (value_begin < value_end && (line[value_begin] == ' ' || line[value_begin] == '\t')) ++value_begin;
+        while (value_end > value_begin && (line[value_end - 1] == ' ' || line[value_end - 1] == '\t')) --value_end;
+        request.headers[lowercase(line.substr(0, colon))] = line.substr(value_begin, value_end - value_begin);
+    }
+
+    if (const std::string* connection_header = request.header("connection")) {
+        const std::string value = lowercase(*connection_header);
+        if (value == "close") request.keep_alive = false;
+        if (value == "keep-alive") request.keep_alive = true;
+    }
+    if (const std::string* encoding = request.header("transfer-encoding")) {
+        if (lowercase(*encoding) != "chunked") throw HttpError(400, "Error: Unsupported transfer encoding.");
+        request.chunked = true;
+    } else if (const std::string* length = request.header("content-length")) {
+        char* end = NULL;
+        request.content_length = std::strtoull(length->c_str(), &end, 10);
+        if (length->empty() || *end != '\0') throw HttpError(400, "Error: Invalid Content-Length.");
+    }
+    return true;
+}
+
+// The request body, de-chunked.
+class BodyReader {
+public:
+    BodyReader(Connection& connection, const Request& request)
+        : connection_(connection), chunked_(request.chunked),
+          remaining_(request.chunked ? 0 : request.content_length), done_(!request.chunked && request.content_length == 0) {}
+
+    // Up to len bytes; 0 once the body is complete.
+    size_t read(unsigned char* out, size_t len) {
+        if (done_) return 0;
+        if (chunked_ && remaining_ == 0) {
+            next_chunk();
+            if (done_) return 0;
+        }
+        const size_t n = connection_.read_some(out, static_cast<size_t>(std::min<uint64_t>(len, remaining_)));
+        if (n == 0) throw HttpError(400, "Error: Connection closed in the middle of the request body.");
+        remaining_ -= n;
+        if (remaining_ == 0) {
+            if (chunked_) {
+                expect_crlf();
+            } else {
+                done_ = true;
+            }
+        }
+        return n;
+    }
+
+    void read_all(std::vector<unsigned char>& body, size_t limit) {
+        body.clear();
+        unsigned char block[64 * 1024];
+        size_t n;
+        while ((n = read(block, sizeof(block))) > 0) {
+            if (body.size() + n > limit) {
+                throw HttpError(413, "Error: Request body exceeds " + std::to_string(limit / (1024 * 1024)) + " MB.");
+            }
+            body.insert(body.end(), block, block + n);
+        }
+    }
+
+    // Reads whatever is left so the connection can carry the next request.
+    void discard() {
+        unsigned char block[64 * 1024];
+        while (read(block, sizeof(block)) > 0) {}
+    }
+
+private:
+    Connection& connection_;
+    bool chunked_;
+    uint64_t remaining_;
+    bool done_;
+
+    void next_chunk() {
+        std::string line;
+        if (!connection_.read_line(line, MAX_HEADER_BYTES)) {
+            throw HttpError(400, "Error: Connection closed in the middle of the request body.");
+        }
+        char* end = NULL;
+        remaining_ = std::strtoull(line.c_str(), &end, 16);
+        if (end == line.c_str() || (*end != '\0' && *end != ';' && *end != ' ')) {
+            throw HttpError(400, "Error: Malformed chunk size.");
+        }
+        if (remaining_ == 0) {
+            // Trailer fields, if any, end with an empty line.
+            while (connection_.read_line(line, MAX_HEADER_BYTES) && !line.empty()) {}
+            done_ = true;
+        }
+    }
+
+    void expect_crlf() {
+        std::string line;
+        if (!connection_.read_line(line, MAX_HEADER_BYTES) || !line.empty()) {
+            throw HttpError(400, "Error: Malformed chunked body.");
+        }
+    }
+};
+
+// --- Responses ---
+inline void send_response(Connection& connection, int status, const char* content_type,
+                          const unsigned char* body, size_t body_len, bool keep_alive,
+                          const std::string& extra_headers = "") {
+    std::string head = "HTTP/1.1 " + std::to_string(status) + " " + status_text(status) + "\r\n" +
+                       "Content-Type: " + content_type + "\r\n" +
+                       "Content-Length: " + std::to_string(body_len) + "\r\n" + extra_headers +
+                       (keep_alive ? "" : "Connection: close\r\n") + "\r\n";
+    connection.write_all(head);
+    if (body_len > 0) connection.write_all(body, body_len);
+}
+
+inline void send_text(Connection& connection, int status, const std::string& text, bool keep_alive) {
+    send_response(connection, status, "text/plain; charset=utf-8",
+                  reinterpret_cast<const unsigned char*>(text.data()), text.size(), keep_alive);
+}
+
+class ChunkedWriter {
+public:
+    ChunkedWriter(Connection& connection, bool keep_alive) : connection_(connection) {
+        connection_.write_all(std::string("HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\n"
+                                          "Transfer-Encoding: chunked\r\n") +
+                              (keep_alive ? "" : "Connection: close\r\n") + "\r\n");
+    }
+
+    void write(const unsigned char* data, size_t len) {
+        if (len == 0) return;
+        char size_line[32];
+        const int n = std::snprintf(size_line, sizeof(size_line), "%zx\r\n", len);
+        connection_.write_all(size_line, static_cast<size_t>(n));
+        connection_.write_all(data, len);
+        connection_.write_all("\r\n", 2);
+    }
+
+    void finish() { connection_.write_all("0\r\n\r\n", 5); }
+
+private:
+    Connection& connection_;
+};
+
+// Thrown once a streamed response has started; the only way left to signal failure
+// is to close the connection before the final chunk.
+struct StreamAborted : std::runtime_error {
+    explicit StreamAborted(const std::string& message) : std::runtime_error(message) {}
+};
+
+// --- /sendData Body ---
+// The c04 DTO is one flat JSON object; string values are kept as raw (still escaped)
+// slices of the body, anything else is skipped.
+struct JsonSlice {
+    const char* data;
+    size_t len;
+};
+
+inline void skip_json_space(const char*& p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) ++p;
+}
+
+inline JsonSlice scan_json_string(const char*& p, const char* end) {
+    if (p >= end || *p != '"') throw HttpError(400, "Error: Malformed JSON body.");
+    const char* start = ++p;
+    while (p < end && *p != '"') {
+        if (*p == '\\') ++p;
+        ++p;
+    }
+    if (p >= end) throw HttpError(400, "Error: Malformed JSON body.");
+    return JsonSlice{start, static_cast<size_t>(p++ - start)};
+}
+
+inline void skip_json_value(const char*& p, const char* end) {
+    if (p < end && *p == '"') {
+        scan_json_string(p, end);
+        return;
+    }
+    int depth = 0;
+    while (p < end) {
+        if (*p == '"') {
+            scan_json_string(p, end);
+            continue;
+        }
+        if (*p == '{' || *p == '[') ++depth;
+        if (*p == '}' || *p == ']') {
+            if (depth == 0) return;
+            --depth;
+        }
+        if (*p == ',' && depth == 0) return;
+        ++p;
+    }
+}
+
+inline std::map<std::string, JsonSlice> parse_json_object(const std::vector<unsigned char>& body) {
+    std::map<std::string, JsonSlice> fields;
+    const char* p = reinterpret_cast<const char*>(body.data());
+    const char* end = p + body.size();
+    skip_json_space(p, end);
+    if (p >= end || *p++ != '{') throw HttpError(400, "Error: Request body is not a JSON object.");
+    skip_json_space(p, end);
+    if (p < end && *p == '}') return fields;
+    while (true) {
+        skip_json_space(p, end);
+        JsonSlice key = scan_json_string(p, end);
+        skip_json_space(p, end);
+        if (p >= end || *p++ != ':') throw HttpError(400, "Error: Malformed JSON body.");
+        skip_json_space(p, end);
+        if (p < end && *p == '"') {
+            fields[std::string(key.data, key.len)] = scan_json_string(p, end);
+        } else {
+            skip_json_value(p, end);
+        }
+        skip_json_space(p, end);
+        if (p < end && *p == ',') {
+            ++p;
+            continue;
+        }
+        if (p < end && *p == '}') break;
+        throw HttpError(400, "Error: Malformed JSON body.");
+    }
+    return fields;
+}
+
+inline std::string json_string(const std::map<std::string, JsonSlice>& fields, const char* name) {
+    auto it = fields.find(name);
+    if (it == fields.end()) return std::string();
+    std::string out;
+    const char* p = it->second.data;
+    const char* end = p + it->second.len;
+    while (p < end) {
+        if (*p != '\\') {
+            out += *p++;
+            continue;
+        }
+        if (++p >= end) break;
+        switch (*p) {
+        case 'n': out += '\n'; break;
+        case 't': out += '\t'; break;
+        case 'r': out += '\r'; break;
+        case 'b': out += '\b'; break;
+        case 'f': out += '\f'; break;
+        case 'u': {
+            if (end - p < 5) throw HttpError(400, "Error: Malformed JSON string escape.");
+            const unsigned long code = std::strtoul(std::string(p + 1, 4).c_str(), NULL, 16);
+            if (code < 0x80) {
+                out += static_cast<char>(code);
+            } else if (code < 0x800) {
+                out += static_cast<char>(0xc0 | (code >> 6));
+                out += static_cast<char>(0x80 | (code & 0x3f));
+            } else {
+                out += static_cast<char>(0xe0 | (code >> 12));
+                out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+                out += static_cast<char>(0x80 | (code & 0x3f));
+            }
+            p += 4;
+            break;
+        }
+        default: out += *p; break; // \" \\ \/
+        }
+        ++p;
+    }
+    return out;
+}
+
+// Decodes standard base64 (Jackson's byte[] encoding) from a raw JSON string; the only
+// escape base64 text can carry is "\/". The output keeps room for the processed image.
+inline void decode_base64(const JsonSlice& text, std::vector<unsigned char>& out) {
+    static const signed char* table = [] {
+        static signed char values[256];
+        std::memset(values, -1, sizeof(values));
+        const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        for (int i = 0; i < 64; ++i) values[static_cast<unsigned char>(alphabet[i])] = static_cast<signed char>(i);
+        return values;
+    }();
+    out.clear();
+    out.reserve(max_processed_image_len(text.len / 4 * 3 + 3));
+    uint32_t accumulator = 0;
+    int bits = 0;
+    bool padding = false;
+    for (size_t i = 0; i < text.len; ++i) {
+        char c = text.data[i];
+        if (c == '\\' && i + 1 < text.len && text.data[i + 1] == '/') c = text.data[++i];
+        if (c == '=') {
+            padding = true;
+            continue;
+        }
+        const signed char value = table[static_cast<unsigned char>(c)];
+        if (value < 0 || padding) throw HttpError(400, "Error: imageData is not valid base64.");
+        accumulator = (accumulator << 6) | static_cast<uint32_t>(value);
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            out.push_back(static_cast<unsigned char>(accumulator >> bits));
+        }
+    }
+}
+
+// --- Server State ---
+struct ServerState {
+    ResultCache cache;
+    WorkerPool pool;
+    size_t max_body_bytes;
+    std::atomic<bool> stopping{false};
+    std::atomic<size_t> served{0};
+    std::mutex idle_mutex;
+    std::set<int> idle_connections; // Waiting for their next request; shut down on stop
+
+    ServerState(size_t pool_threads, size_t max_body)
+        : cache(result_cache_config_from_env(RESULT_CACHE_DEFAULT_MEMORY_BYTES)), pool(pool_threads),
+          max_body_bytes(max_body) {}
+};
+
+inline bool parse_request_parameters(const std::string& operation, const std::string& mode_name,
+                                     Direction& direction, AesMode& mode, std::string& error) {
+    if (!parse_direction(operation, direction)) {
+        error = "Error: Invalid operation. Must be 'encrypt' or 'decrypt'.";
+        return false;
+    }
+    if (!parse_aes_mode(mode_name, mode, true)) {
+        error = "Error: Invalid mode. Must be 'ECB', 'CBC', 'GCM', 'CHACHA20' or 'AUTO'.";
+        return false;
+    }
+    return true;
+}
+
+// Processes a whole image held in image in place, growing it to the output size.
+inline void process_buffered(ServerState& state, std::vector<unsigned char>& image, const std::string& passphrase,
+                             AesMode mode, Direction direction, PixelCodec codec) {
+    const size_t image_len = image.size();
+    image.resize(processed_image_capacity(locate_pixel_data(image.data(), image_len, direction), image_len));
+    image.resize(process_image_buffer_cached(state.cache, image.data(), image_len, image.data(), image.size(),
+                                             passphrase, mode, direction, codec, state.pool));
+}
+
+// --- Handlers ---
+inline void handle_send_data(ServerState& state, Connection& connection, const Request& request, BodyReader& body) {
+    std::vector<unsigned char> json;
+    body.read_all(json, state.max_body_bytes);
+    const std::map<std::string, JsonSlice> fields = parse_json_object(json);
+    auto image_field = fields.find("imageData");
+    if (image_field == fields.end()) throw HttpError(400, "Error: imageData is missing.");
+    std::vector<unsigned char> image;
+    decode_base64(image_field->second, image);
+    std::string passphrase = json_string(fields, "aes_key");
+    const std::string operation = json_string(fields, "operation");
+    const std::string mode_name = json_string(fields, "mode");
+    const std::string codec_name = json_string(fields, "compress");
+    OPENSSL_cleanse(json.data(), json.size());
+    std::vector<unsigned char>().swap(json); // The fields point into it
+
+    std::string error;
+    try {
+        Direction direction;
+        AesMode mode;
+        if (!parse_request_parameters(operation, mode_name, direction, mode, error)) {
+            throw std::runtime_error(error);
+        }
+        const PixelCodec codec = direction == Direction::Encrypt ? pixel_codec_from_name(codec_name) : PixelCodec::None;
+        process_buffered(state, image, passphrase, mode, direction, codec);
+    } catch (const std::exception& e) {
+        error = e.what();
+    }
+    OPENSSL_cleanse(&passphrase[0], passphrase.size());
+    if (!error.empty()) {
+        // c04 answers a failed conversion with an empty body.
+        send_response(connection, 200, "application/octet-stream", NULL, 0, request.keep_alive,
+                      "X-Imagecrypt-Error: " + header_safe(error) + "\r\n");
+        return;
+    }
+    send_response(connection, 200, "application/octet-stream", image.data(), image.size(), request.keep_alive);
+}
+
+// ECB/CBC through one cipher context as the body arrives. Same output as
+// process_image_buffer: the header is copied, ECB drops a trailing partial block.
+// Returns false without answering if the header announces a compressed payload, which
+// has to be decrypted whole; head then holds the bytes read so far.
+inline bool stream_process(Connection& connection, const Request& request, BodyReader& body,
+                           std::vector<unsigned char>& head, const std::string& passphrase,
+                           AesMode mode, Direction direction, RangeExecutor& executor) {
+    // Hold the response until the header and one pixel byte are in, so that every
+    // layout error is still answered with a status code.
+    std::vector<unsigned char> input(IO_BUFFER_BYTES);
+    size_t needed = BMP_HEADER_SIZE;
+    while (head.size() < needed) {
+        const size_t n = body.read(input.data(), input.size());
+        if (n == 0) break;
+        head.insert(head.end(), input.data(), input.data() + n);
+        if (head.size() >= BMP_HEADER_SIZE) {
+            needed = std::max<size_t>(get_pixel_data_offset(head.data(), BMP_HEADER_SIZE), BMP_HEADER_SIZE) + 1;
+        }
+    }
+    BmpLayout layout;
+    try {
+        layout = locate_pixel_data(head.data(), head.size(), direction);
+    } catch (const std::exception& e) {
+        throw HttpError(400, e.what());
+    }
+    if (layout.codec != PixelCodec::None) return false;
+
+    unsigned char key[AES_KEY_BYTES];
+    unsigned char iv[AES_IV_BYTES];
+    derive_image_key_and_iv(passphrase, key, iv, executor);
+    try {
+        dispatch_cipher(mode, direction, pixel_padding(mode), [&](auto engine_tag) {
+            using Engine = typename decltype(engine_tag)::type;
+            Engine engine(key, iv);
+            ChunkedWriter writer(connection, request.keep_alive);
+            writer.write(head.data(), layout.header_len);
+            std::vector<unsigned char> output(IO_BUFFER_BYTES + AES_BLOCK_BYTES);
+            // pending holds received pixel bytes not yet given to the cipher (ECB: a partial block).
+            std::vector<unsigned char> pending(head.begin() + layout.header_len, head.end());
+            try {
+                while (true) {
+                    const size_t usable = mode == AesMode::ECB ? pending.size() / AES_BLOCK_BYTES * AES_BLOCK_BYTES
+                                                               : pending.size();
+                    for (size_t offset = 0; offset < usable; offset += IO_BUFFER_BYTES) {
+                        const size_t len = std::min(IO_BUFFER_BYTES, usable - offset);
+                        writer.write(output.data(), engine.update(pending.data() + offset, len, output.data()));
+                    }
+                    pending.erase(pending.begin(), pending.begin() + usable);
+                    const size_t n = body.read(input.data(), input.size());
+                    if (n == 0) break;
+                    pending.insert(pending.end(), input.data(), input.data() + n);
+                }
+                writer.write(output.data(), engine.finish(output.data()));
+                writer.finish();
+            } catch (const std::exception& e) {
+                throw StreamAborted(e.what());
+            }
+            return size_t(0);
+        });
+    } catch (...) {
+        OPENSSL_cleanse(key, sizeof(key));
+        OPENSSL_cleanse(iv, sizeof(iv));
+        throw;
+    }
+    OPENSSL_cleanse(key, sizeof(key));
+    OPENSSL_cleanse(iv, sizeof(iv));
+    return true;
+}
+
+inline void handle_process(ServerState& state, Connection& connection, const Request& request, BodyReader& body) {
+    const std::string* operation = request.header("x-operation");
+    const std::string* mode_name = request.header("x-mode");
+    const std::string* key = request.header("x-aes-key");
+    if (operation == NULL || mode_name == NULL || key == NULL) {
+        throw HttpError(400, "Error: X-Operation, X-Mode and X-Aes-Key headers are required.");
+    }
+    Direction direction;
+    AesMode mode;
+    std::string error;
+    if (!parse_request_parameters(*operation, *mode_name, direction, mode, error)) throw HttpError(400, error);
+    if (mode == AesMode::AUTO && direction == Direction::Encrypt) mode = auto_encrypt_mode();
+    PixelCodec codec = PixelCodec::None;
+    const std::string* codec_name = request.header("x-compress");
+    if (codec_name != NULL && direction == Direction::Encrypt) {
+        try {
+            codec = pixel_codec_from_name(*codec_name);
+        } catch (const std::exception& e) {
+            throw HttpError(400, e.what());
+        }
+    }
+
+    std::string passphrase = *key;
+    try {
+        std::vector<unsigned char> head;
+        const bool streamable = (mode == AesMode::ECB || mode == AesMode::CBC) && codec == PixelCodec::None;
+        if (!streamable || !stream_process(connection, request, body, head, passphrase, mode, direction, state.pool)) {
+            std::vector<unsigned char> image;
+            body.read_all(image, state.max_body_bytes - std::min(head.size(), state.max_body_bytes));
+            image.insert(image.begin(), head.begin(), head.end());
+            try {
+                locate_pixel_data(image.data(), image.size(), direction);
+            } catch (const std::exception& e) {
+                throw HttpError(400, e.what());
+            }
+            try {
+                process_buffered(state, image, passphrase, mode, direction, codec);
+            } catch (const std::exception& e) {
+                throw HttpError(422, e.what());
+            }
+            send_response(connection, 200, "application/octet-stream", image.data(), image.size(), request.keep_alive);
+        }
+    } catch (...) {
+        OPENSSL_cleanse(&passphrase[0], passphrase.size());
+        throw;
+    }
+    OPENSSL_cleanse(&passphrase[0], passphrase.size());
+}
+
+// Serves requests on one connection until it closes, fails or the server stops.
+inline void serve_connection(ServerState& state, int fd) {
+    Connection connection(fd);
+    while (!state.stopping) {
+        Request request;
+        {
+            std::lock_guard<std::mutex> lock(state.idle_mutex);
+            state.idle_connections.insert(fd);
+        }
+        bool received = false;
+        try {
+            received = read_request(connection, request);
+        } catch (const HttpError&) {
+            received = false;
+        }
+        {
+            std::lock_guard<std::mutex> lock(state.idle_mutex);
+            state.idle_connections.erase(fd);
+        }
+        if (!received) return;
+        if (state.stopping) request.keep_alive = false;
+
+        BodyReader body(connection, request);
+        try {
+            if (const std::string* expect = request.header("expect")) {
+                if (lowercase(*expect) == "100-continue") connection.write_all("HTTP/1.1 100 Continue\r\n\r\n");
+            }
+            if (request.path == "/") {
+                if (request.method != "GET") throw HttpError(405, "Error: Use GET for /.");
+                body.discard();
+                send_text(connection, 200, "Hello World!", request.keep_alive);
+            } else if (request.path == "/sendData" || request.path == "/process") {
+                if (request.method != "POST") throw HttpError(405, "Error: Use POST for " + request.path + ".");
+                if (request.path == "/sendData") {
+                    handle_send_data(state, connection, request, body);
+                } else {
+                    handle_process(state, connection, request, body);
+                }
+                body.discard();
+            } else {
+                throw HttpError(404, "Error: No such endpoint: " + request.path);
+            }
+            ++state.served;
+        } catch (const StreamAborted&) {
+            return;
+        } catch (const HttpError& e) {
+            // The unread rest of the body makes the connection unusable for another request.
+            try {
+                send_text(connection, e.status, std::string(e.what()) + "\n", false);
+            } catch (const std::exception&) {}
+            return;
+        } catch (const std::exception& e) {
+            try {
+                send_text(connection, 500, std::string(e.what()) + "\n", false);
+            } catch (const std::exception&) {}
+            return;
+        }
+        if (!request.keep_alive) return;
+    }
+}
+
+} // namespace http_detail
+
+// Serves HTTP on bind_address:port until SIGTERM or SIGINT. Requests in flight finish;
+// idle keep-alive connections are closed.
+inline int run_http_server(const std::string& bind_address, uint16_t port) {
+    using namespace http_detail;
+    init_openssl_runtime();
+
+    // Signals are taken by sigwait() below, never by the connection threads.
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGTERM);
+    sigaddset(&stop_signals, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, NULL);
+
+    const size_t cpus = std::max(1u, std::thread::hardware_concurrency());
+    const size_t connection_threads = env_size("IMAGE_PROCESSOR_HTTP_THREADS", std::max<size_t>(4, 2 * cpus));
+    const size_t max_body_mb = env_size("IMAGE_PROCESSOR_HTTP_MAX_BODY_MB", HTTP_DEFAULT_MAX_BODY_MB);
+    // Connection threads work on their own requests too, so the pool holds one thread less.
+    ServerState state(cpus - 1, max_body_mb * 1024 * 1024);
+    int listen_fd = listen_tcp(bind_address, port);
+    std::cout << "HTTP server listening on " << bind_address << ":" << port << " (" << connection_threads
+              << " connection threads)." << std::endl;
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < std::max<size_t>(connection_threads, 1); ++i) {
+        threads.emplace_back([&state, listen_fd] {
+            while (!state.stopping) {
+                int fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+                if (fd < 0) {
+                    if (errno == EINTR || errno == ECONNABORTED) continue;
+                    if (state.stopping) return;
+                    continue;
+                }
+                int one = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                timeval timeout = {IDLE_TIMEOUT_SECONDS, 0};
+                setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+                serve_connection(state, fd);
+                close(fd);
+            }
+        });
+    }
+
+    int signal_number = 0;
+    sigwait(&stop_signals, &signal_number);
+    state.stopping = true;
+    shutdown(listen_fd, SHUT_RDWR); // Wakes the threads blocked in accept()
+    {
+        std::lock_guard<std::mutex> lock(state.idle_mutex);
+        for (int fd : state.idle_connections) shutdown(fd, SHUT_RDWR);
+    }
+    for (std::thread& thread : threads) thread.join();
+    close(listen_fd);
+    std::cout << "HTTP server stopped after " << state.served << " requests." << std::endl;
+    return 0;
+}
+
+#endif // HTTP_SERVER_HPP
@@ -0,0 +1,478 @@
+#ifndef IMAGE_PIPELINE_HPP
+#define IMAGE_PIPELINE_HPP
+
+#include <string>
+#include <vector>
+#include <stdexcept> // For std::runtime_error
+#include <cstdint>
+#include <cstddef>
+#include <cstring>   // For memmove
+#include <algorithm> // For std::min, std::max
+#include <mutex>
+
+#include <openssl/evp.h>
+#include <openssl/crypto.h> // For OPENSSL_cleanse
+
+#include "imagecrypt.h"        // IMAGECRYPT_MODE_* values of the C API
+#include "cipher_engine.hpp"   // AES engine, OpenSSL runtime and error handling
+#include "multibuffer_cbc.hpp" // Interleaved CBC encryption of independent images
+#include "ecb_dedup.hpp"       // ECB block memoization
+#include "aes_gcm.hpp"         // Authenticated GCM pass
+#include "chacha20.hpp"        // ChaCha20 pass for hosts without AES instructions
+#include "multilane_pbkdf2.hpp" // Batched PBKDF2 for key/IV derivation
+#include "pixel_codec.hpp"     // Optional compression of the pixel payload
+
+// BMP-level processing shared by the image_processor_ssl command line tool and
+// libimagecrypt: key derivation, header parsing, compression and the pixel cipher pass.
+// Nothing in here writes to stdout/stderr; failures are reported by exceptions.
+
+// --- Configuration ---
+const int BMP_HEADER_SIZE = 54; // Common size for BMP header
+const int PIXEL_DATA_OFFSET_LOCATION = 10; // Location of pixel data offset in BMP header
+const int PBKDF2_ITERATIONS = 10000; // Iterations for PBKDF2
+// IMPORTANT: FIXED SALT - NOT FOR PRODUCTION! Generate & store random salt.
+const char IMAGE_KDF_SALT[] = "OpenMP_AES_Salt"; // Example fixed salt
+
+// --- Key/IV Derivation ---
+// IMPORTANT: In a real application, for encryption, salt should be randomly generated
+// and stored/transmitted with the ciphertext. For decryption, the same salt must be used.
+// This example uses a FIXED salt for simplicity. DO NOT DO THIS IN PRODUCTION.
+//
+// The key is PBKDF2-HMAC-SHA256 over PBKDF2_ITERATIONS. The IV reuses PBKDF2 with a
+// different digest (MD5) and half the iterations so that it differs from the key; a
+// random IV per encryption would be preferable for CBC, but this example derives it
+// deterministically from passphrase + salt. Both derivations run on the multi-lane
+// PBKDF2 (bit-identical to PKCS5_PBKDF2_HMAC).
+const size_t KDF_PASSPHRASES_PER_TASK = 16; // One AVX-512 lane group
+
+// Derives keys and IVs (AES_KEY_BYTES / AES_IV_BYTES per passphrase, in order). The key
+// and the IV derivations of each group of passphrases are separate executor tasks, so
+// even a single passphrase derives its key and IV concurrently.
+inline void derive_keys_and_ivs(const std::vector<const std::string*>& passphrases,
+                                const unsigned char* salt, size_t salt_len,
+                                unsigned char* keys_out, unsigned char* ivs_out,
+                                RangeExecutor& executor = OpenMPExecutor::instance()) {
+    const size_t num_groups = (passphrases.size() + KDF_PASSPHRASES_PER_TASK - 1) / KDF_PASSPHRASES_PER_TASK;
+    bool parallel_success = true;
+    std::string parallel_error;
+    std::mutex error_mutex;
+    auto run_task = [&](size_t task) {
+        const bool derive_iv = (task % 2) == 1;
+        const size_t begin = task / 2 * KDF_PASSPHRASES_PER_TASK;
+        const size_t end = std::min(passphrases.size(), begin + KDF_PASSPHRASES_PER_TASK);
+        const size_t out_len = derive_iv ? AES_IV_BYTES : AES_KEY_BYTES;
+        try {
+            std::vector<Pbkdf2Request> requests;
+            for (size_t i = begin; i < end; ++i) {
+                const std::string& passphrase = *passphrases[i];
+                requests.push_back({reinterpret_cast<const unsigned char*>(passphrase.data()), passphrase.length(),
+                                    salt, salt_len, (derive_iv ? ivs_out : keys_out) + i * out_len, out_len});
+            }
+            if (derive_iv) {
+                pbkdf2_hmac_batch<pbkdf2_detail::Md5>(requests, PBKDF2_ITERATIONS / 2);
+            } else {
+                pbkdf2_hmac_batch<pbkdf2_detail::Sha256>(requests, PBKDF2_ITERATIONS);
+            }
+        } catch (const std::exception& e) {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            parallel_success = false;
+            parallel_error = e.what();
+        }
+    };
+    executor.run(2 * num_groups, run_task);
+    if (!parallel_success) {
+        OPENSSL_cleanse(keys_out, passphrases.size() * AES_KEY_BYTES);
+        OPENSSL_cleanse(ivs_out, passphrases.size() * AES_IV_BYTES);
+        throw std::runtime_error("Error: Key derivation failed: " + parallel_error);
+    }
+}
+
+// Servers pass the executor of the request (their shared pool), so a derivation never
+// starts an OpenMP team on a connection or coroutine thread.
+inline bool derive_key_and_iv(const std::string& passphrase, const unsigned char* salt, int salt_len,
+                              unsigned char* key_out, int key_out_len,
+                              unsigned char* iv_out, int iv_out_len,
+                              RangeExecutor& executor = OpenMPExecutor::instance()) {
+    if (key_out_len != AES_KEY_BYTES || iv_out_len != AES_IV_BYTES || salt_len < 0) {
+        return false; // Requested key/IV length mismatch with AES configuration
+    }
+    derive_keys_and_ivs({&passphrase}, salt, static_cast<size_t>(salt_len), key_out, iv_out, executor);
+    return true;
+}
+
+// Key and IV for image processing, derived with the image salt.
+inline void derive_image_key_and_iv(const std::string& passphrase,
+                                    unsigned char* key_out, unsigned char* iv_out,
+                                    RangeExecutor& executor = OpenMPExecutor::instance()) {
+    if (!derive_key_and_iv(passphrase,
+                           reinterpret_cast<const unsigned char*>(IMAGE_KDF_SALT), sizeof(IMAGE_KDF_SALT) - 1,
+                           key_out, AES_KEY_BYTES, iv_out, AES_IV_BYTES, executor)) {
+        throw std::runtime_error("Failed to derive AES key and IV from passphrase.");
+    }
+}
+
+// Image keys and IVs for several passphrases in one multi-lane pass.
+inline void derive_image_keys_and_ivs(const std::vector<const std::string*>& passphrases,
+                                      unsigned char* keys_out, unsigned char* ivs_out,
+                                      RangeExecutor& executor = OpenMPExecutor::instance()) {
+    derive_keys_and_ivs(passphrases, reinterpret_cast<const unsigned char*>(IMAGE_KDF_SALT), sizeof(IMAGE_KDF_SALT) - 1,
+                        keys_out, ivs_out, executor);
+}
+
+// --- BMP Header Handling ---
+inline uint32_t get_pixel_data_offset(const unsigned char* header_data, size_t header_len) {
+    if (header_len < PIXEL_DATA_OFFSET_LOCATION + 4) {
+        throw std::runtime_error("Error: BMP header segment is too small to read pixel data offset.");
+    }
+    return static_cast<uint32_t>(header_data[PIXEL_DATA_OFFSET_LOCATION]) |
+           static_cast<uint32_t>(header_data[PIXEL_DATA_OFFSET_LOCATION + 1]) << 8 |
+           static_cast<uint32_t>(header_data[PIXEL_DATA_OFFSET_LOCATION + 2]) << 16 |
+           static_cast<uint32_t>(header_data[PIXEL_DATA_OFFSET_LOCATION + 3]) << 24;
+}
+
+// --- Compressed Pixel Payloads ---
+// An encryption of a compressed payload is marked in the BMP file header, outside the
+// ciphertext: the reserved fields (bytes 6-9) hold "IZ" and the codec, and the file
+// size field (bytes 2-5) the length of the decrypted BMP. Only marked images are
+// decompressed after decryption. GCM authenticates these eight header bytes as
+// additional data, so the marker cannot be added or stripped without failing the tag.
+// Compression is only applied to BMPs whose reserved fields are zero and whose file
+// size field is exact, so decryption restores the original header byte for byte.
+const size_t BMP_FILE_SIZE_OFFSET = 2;
+const size_t BMP_RESERVED_OFFSET = 6;
+const size_t PIXEL_CODEC_MARKER_BYTES = 8; // File size and reserved fields
+const unsigned char PIXEL_CODEC_MARKER[2] = {'I', 'Z'};
+
+inline uint32_t read_header_le32(const unsigned char* p) {
+    return static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8 |
+           static_cast<uint32_t>(p[2]) << 16 | static_cast<uint32_t>(p[3]) << 24;
+}
+
+inline bool pixel_codec_marked(const unsigned char* header) {
+    return std::memcmp(header + BMP_RESERVED_OFFSET, PIXEL_CODEC_MARKER, sizeof(PIXEL_CODEC_MARKER)) == 0;
+}
+
+// True if an encryption of this image may be compressed (see above).
+inline bool pixel_codec_markable(const unsigned char* image_data, size_t image_len) {
+    static const unsigned char zero[4] = {};
+    return std::memcmp(image_data + BMP_RESERVED_OFFSET, zero, sizeof(zero)) == 0 &&
+           read_header_le32(image_data + BMP_FILE_SIZE_OFFSET) == image_len;
+}
+
+inline void mark_pixel_codec(unsigned char* header, PixelCodec codec) {
+    std::memcpy(header + BMP_RESERVED_OFFSET, PIXEL_CODEC_MARKER, sizeof(PIXEL_CODEC_MARKER));
+    header[BMP_RESERVED_OFFSET + 2] = static_cast<unsigned char>(codec);
+    header[BMP_RESERVED_OFFSET + 3] = 0;
+}
+
+inline void clear_pixel_codec_marker(unsigned char* header) {
+    std::memset(header + BMP_RESERVED_OFFSET, 0, 4);
+}
+
+struct BmpLayout {
+    size_t header_len;    // Bytes copied through unchanged (up to the pixel data offset)
+    size_t pixel_len;     // Bytes after the header that go through the cipher
+    PixelCodec codec;     // Decryption of a marked image: codec of the encrypted container
+    size_t decrypted_len; // Decryption of a marked image: length of the decrypted BMP
+};
+
+// Encryption refuses marked headers, whose output could not be told apart from a
+// compressed encryption.
+inline BmpLayout locate_pixel_data(const unsigned char* image_data, size_t image_len, Direction direction) {
+    if (image_len < BMP_HEADER_SIZE) {
+        throw std::runtime_error("Error: Input file is smaller than a typical BMP header.");
+    }
+    uint32_t pixel_offset = get_pixel_data_offset(image_data, BMP_HEADER_SIZE);
+    if (pixel_offset >= image_len || pixel_offset < BMP_HEADER_SIZE) {
+        // Basic sanity check for pixel_offset. A more robust BMP parser would validate various header fields.
+        throw std::runtime_error("Error: Invalid pixel data offset found in BMP header or header too small.");
+    }
+    BmpLayout layout;
+    layout.header_len = pixel_offset;
+    layout.pixel_len = image_len - pixel_offset;
+    layout.codec = PixelCodec::None;
+    layout.decrypted_len = 0;
+    if (layout.pixel_len == 0 && direction == Direction::Encrypt) {
+        throw std::runtime_error("Error: No pixel data found in BMP file for encryption.");
+    }
+    if (pixel_codec_marked(image_data)) {
+        if (direction == Direction::Encrypt) {
+            throw std::runtime_error("Error: BMP header carries the compressed-payload marker; decrypt the image first.");
+        }
+        const unsigned char codec = image_data[BMP_RESERVED_OFFSET + 2];
+        layout.codec = static_cast<PixelCodec>(codec);
+        layout.decrypted_len = read_header_le32(image_data + BMP_FILE_SIZE_OFFSET);
+        if ((layout.codec != PixelCodec::LZ4 && layout.codec != PixelCodec::Zstd) ||
+            image_data[BMP_RESERVED_OFFSET + 3] != 0 || layout.decrypted_len <= layout.header_len) {
+            throw std::runtime_error("Error: Invalid compressed-payload marker in BMP header.");
+        }
+    }
+    return layout;
+}
+
+// Paths that work on the raw pixel payload (row ranges, tile updates, fan-out, worker
+// tasks) cannot process compressed encryptions.
+inline void require_uncompressed_layout(const BmpLayout& layout) {
+    if (layout.codec != PixelCodec::None) {
+        throw std::runtime_error("Error: The image holds a compressed payload; only whole-image decryption supports it.");
+    }
+}
+
+// --- Pixel Cipher Pass ---
+// ECB is processed without padding so the output keeps the input size; a trailing
+// partial block is not processed. CBC pads (PKCS#7) the whole pixel payload once.
+// GCM keeps every byte and appends its nonce and tag (GCM_OVERHEAD_BYTES); CHACHA20
+// appends its nonce trailer (CHACHA20_TRAILER_BYTES).
+inline Padding pixel_padding(AesMode mode) {
+    return mode == AesMode::ECB ? Padding::None : Padding::PKCS7;
+}
+
+inline size_t pixel_cipher_input_len(AesMode mode, size_t pixel_len) {
+    return mode == AesMode::ECB ? pixel_len / AES_BLOCK_BYTES * AES_BLOCK_BYTES : pixel_len;
+}
+
+// Room a processed payload may need beyond its input: a CBC padding block, the GCM
+// nonce and tag, or the ChaCha20 trailer.
+const size_t PIXEL_OUTPUT_SLACK_BYTES = GCM_OVERHEAD_BYTES > AES_BLOCK_BYTES ? GCM_OVERHEAD_BYTES : AES_BLOCK_BYTES;
+static_assert(CHACHA20_TRAILER_BYTES <= PIXEL_OUTPUT_SLACK_BYTES, "ChaCha20 trailer must fit the output slack");
+static_assert(PIXEL_OUTPUT_SLACK_BYTES == IMAGECRYPT_OUTPUT_SLACK_BYTES, "imagecrypt.h must publish the output slack");
+
+// Upper bound on the processed image size (header + processed pixels), except for the
+// decryption of a compressed payload (see processed_image_capacity).
+inline size_t max_processed_image_len(size_t image_len) {
+    return image_len + PIXEL_OUTPUT_SLACK_BYTES;
+}
+
+// Output capacity process_image_buffer needs for this image: max_processed_image_len,
+// or the decrypted length recorded in a marked header if that is larger.
+inline size_t processed_image_capacity(const BmpLayout& layout, size_t image_len) {
+    return std::max(max_processed_image_len(image_len), layout.decrypted_len);
+}
+
+// --- Mode Selection ---
+// AUTO encrypts with CBC where the CPU has AES instructions and with ChaCha20 where it
+// does not (EVP AES then falls back to table lookups, several times slower). Decryption
+// recognises ChaCha20 payloads by their trailer and treats everything else as CBC.
+// IMAGE_PROCESSOR_NO_AESNI=1 makes AUTO pick ChaCha20 on any host.
+inline AesMode auto_encrypt_mode() {
+    return aesni_available() ? AesMode::CBC : AesMode::CHACHA20;
+}
+
+inline AesMode resolve_pixel_mode(AesMode mode, Direction direction,
+                                  const unsigned char* pixel_data, size_t pixel_len) {
+    if (mode != AesMode::AUTO) return mode;
+    if (direction == Direction::Encrypt) return auto_encrypt_mode();
+    return chacha20_payload(pixel_data, pixel_len) ? AesMode::CHACHA20 : AesMode::CBC;
+}
+
+// True if encryption draws a fresh nonce, so equal inputs never give equal outputs.
+inline bool pixel_encryption_randomized(AesMode mode) {
+    if (mode == AesMode::AUTO) mode = auto_encrypt_mode();
+    return mode == AesMode::GCM || mode == AesMode::CHACHA20;
+}
+
+// Maps an IMAGECRYPT_MODE_* value (C API, shared memory requests) onto a pixel mode.
+inline bool pixel_mode_from_imagecrypt(int value, AesMode& mode) {
+    switch (value) {
+    case IMAGECRYPT_MODE_ECB: mode = AesMode::ECB; return true;
+    case IMAGECRYPT_MODE_CBC: mode = AesMode::CBC; return true;
+    case IMAGECRYPT_MODE_GCM: mode = AesMode::GCM; return true;
+    case IMAGECRYPT_MODE_CHACHA20: mode = AesMode::CHACHA20; return true;
+    case IMAGECRYPT_MODE_AUTO: mode = AesMode::AUTO; return true;
+    }
+    return false;
+}
+
+// As pixel_mode_from_imagecrypt, for the entry points that also take one of the
+// IMAGECRYPT_COMPRESS_* flags; false for a codec this build lacks.
+inline bool pixel_mode_codec_from_imagecrypt(int value, AesMode& mode, PixelCodec& codec) {
+    const int flags = value & (IMAGECRYPT_COMPRESS_LZ4 | IMAGECRYPT_COMPRESS_ZSTD);
+    if (flags == 0) {
+        codec = PixelCodec::None;
+    } else if (flags == IMAGECRYPT_COMPRESS_LZ4 && IMAGE_PROCESSOR_HAVE_LZ4) {
+        codec = PixelCodec::LZ4;
+    } else if (flags == IMAGECRYPT_COMPRESS_ZSTD && IMAGE_PROCESSOR_HAVE_ZSTD) {
+        codec = PixelCodec::Zstd;
+    } else {
+        return false;
+    }
+    return pixel_mode_from_imagecrypt(value & ~flags, mode);
+}
+
+// Runs the cipher over pixel_len bytes of pixel data. The output buffer must hold
+// pixel_len + PIXEL_OUTPUT_SLACK_BYTES bytes. Returns the processed pixel data length.
+// ECB goes through the block memoization path when ecb_dedup_enabled(). GCM uses a
+// fresh random nonce instead of iv, and decryption throws if the tag does not match.
+// CHACHA20 also uses a fresh nonce; AUTO is resolved with resolve_pixel_mode(). aad is
+// authenticated by GCM only.
+inline size_t process_pixel_data(const unsigned char* key, const unsigned char* iv,
+                                 AesMode mode, Direction direction,
+                                 const unsigned char* pixel_data, size_t pixel_len,
+                                 unsigned char* output_data,
+                                 RangeExecutor& executor = OpenMPExecutor::instance(),
+                                 const unsigned char* aad = NULL, size_t aad_len = 0) {
+    mode = resolve_pixel_mode(mode, direction, pixel_data, pixel_len);
+    if (mode == AesMode::GCM) {
+        return direction == Direction::Encrypt
+            ? gcm_encrypt_pixels(key, pixel_data, pixel_len, output_data, executor, aad, aad_len)
+            : gcm_decrypt_pixels(key, pixel_data, pixel_len, output_data, executor, aad, aad_len);
+    }
+    if (mode == AesMode::CHACHA20) {
+        return direction == Direction::Encrypt
+            ? chacha20_encrypt_pixels(key, pixel_data, pixel_len, output_data, executor)
+            : chacha20_decrypt_pixels(key, pixel_data, pixel_len, output_data, executor);
+    }
+    const size_t input_len = pixel_cipher_input_len(mode, pixel_len);
+    if (mode == AesMode::ECB && ecb_dedup_enabled()) {
+        return direction == Direction::Encrypt
+            ? ecb_dedup_process<Direction::Encrypt>(key, pixel_data, input_len, output_data, OMP_PARALLEL_MIN_BYTES, executor)
+            : ecb_dedup_process<Direction::Decrypt>(key, pixel_data, input_len, output_data, OMP_PARALLEL_MIN_BYTES, executor);
+    }
+    return dispatch_cipher(mode, direction, pixel_padding(mode), [&](auto engine_tag) {
+        using Engine = typename decltype(engine_tag)::type;
+        return Engine::process(key, iv, pixel_data, input_len, output_data,
+                               OMP_PARALLEL_MIN_BYTES, executor);
+    });
+}
+
+namespace image_pipeline_detail {
+
+// Body of process_image_buffer. pass(key, iv, payload, payload_len, output, aad, aad_len)
+// runs process_pixel_data (or a variant of it) over the pixel payload: the image's
+// pixels, or the compressed container when codec applies.
+template <typename PixelPass>
+inline size_t process_image(const unsigned char* image_data, size_t image_len,
+                            unsigned char* output_data, size_t output_capacity,
+                            const std::string& passphrase, Direction direction, PixelCodec codec,
+                            RangeExecutor& executor, PixelPass&& pass) {
+    const BmpLayout layout = locate_pixel_data(image_data, image_len, direction);
+    if (output_capacity < processed_image_capacity(layout, image_len)) {
+        throw std::runtime_error("Error: Output buffer is too small for the processed image.");
+    }
+    const unsigned char* pixels = image_data + layout.header_len;
+    unsigned char* pixels_out = output_data + layout.header_len;
+    unsigned char derived_key[AES_KEY_BYTES];
+    unsigned char derived_iv[AES_IV_BYTES];
+    std::vector<unsigned char> container; // Compressed plaintext; wiped before it is released
+    size_t pixel_out_len = 0;
+    try {
+        if (direction == Direction::Encrypt && codec != PixelCodec::None &&
+            (!pixel_codec_markable(image_data, image_len) ||
+             !compress_pixel_payload(codec, pixels, layout.pixel_len, container, executor))) {
+            codec = PixelCodec::None;
+        }
+        derive_image_key_and_iv(passphrase, derived_key, derived_iv, executor);
+        if (direction == Direction::Encrypt && codec != PixelCodec::None) {
+            std::memmove(output_data, image_data, layout.header_len);
+            mark_pixel_codec(output_data, codec);
+            pixel_out_len = pass(derived_key, derived_iv, container.data(), container.size(), pixels_out,
+                                 output_data + BMP_FILE_SIZE_OFFSET, PIXEL_CODEC_MARKER_BYTES);
+        } else if (layout.codec != PixelCodec::None) {
+            // The marker is authenticated before it is cleared from the output header.
+            container.resize(layout.pixel_len + PIXEL_OUTPUT_SLACK_BYTES);
+            const size_t container_len = pass(derived_key, derived_iv, pixels, layout.pixel_len, container.data(),
+                                              image_data + BMP_FILE_SIZE_OFFSET, PIXEL_CODEC_MARKER_BYTES);
+            pixel_out_len = layout.decrypted_len - layout.header_len;
+            if (pixel_container_original_len(container.data(), container_len) != pixel_out_len) {
+                throw std::runtime_error("Error: Compressed pixel container is corrupt.");
+            }
+            std::memmove(output_data, image_data, layout.header_len);
+            clear_pixel_codec_marker(output_data);
+            decompress_pixel_payload(container.data(), container_len, pixels_out, executor);
+        } else {
+            std::memmove(output_data, image_data, layout.header_len);
+            pixel_out_len = pass(derived_key, derived_iv, pixels, layout.pixel_len, pixels_out, NULL, 0);
+        }
+    } catch (...) {
+        OPENSSL_cleanse(derived_key, sizeof(derived_key));
+        OPENSSL_cleanse(derived_iv, sizeof(derived_iv));
+        OPENSSL_cleanse(container.data(), container.size());
+        throw;
+    }
+    OPENSSL_cleanse(derived_key, sizeof(derived_key));
+    OPENSSL_cleanse(derived_iv, sizeof(derived_iv));
+    OPENSSL_cleanse(container.data(), container.size());
+    return layout.header_len + pixel_out_len;
+}
+
+} // namespace image_pipeline_detail
+
+// Processes a whole BMP held in memory: the header is copied through and the pixel
+// data goes through the cipher. output may be the same buffer as input (in-place);
+// output_capacity must be at least processed_image_capacity(). An encryption with a
+// codec compresses the pixels first when they shrink and the header allows it (see
+// Compressed Pixel Payloads); the decryption of a marked image decompresses.
+// Returns the processed image length.
+inline size_t process_image_buffer(const unsigned char* image_data, size_t image_len,
+                                   unsigned char* output_data, size_t output_capacity,
+                                   const std::string& passphrase,
+                                   AesMode mode, Direction direction, PixelCodec codec,
+                                   RangeExecutor& executor = OpenMPExecutor::instance()) {
+    return image_pipeline_detail::process_image(
+        image_data, image_len, output_data, output_capacity, passphrase, direction, codec, executor,
+        [&](const unsigned char* key, const unsigned char* iv, const unsigned char* payload, size_t payload_len,
+            unsigned char* output, const unsigned char* aad, size_t aad_len) {
+            return process_pixel_data(key, iv, mode, direction, payload, payload_len, output, executor, aad, aad_len);
+        });
+}
+
+inline size_t process_image_buffer(const unsigned char* image_data, size_t image_len,
+                                   unsigned char* output_data, size_t output_capacity,
+                                   const std::string& passphrase,
+                                   AesMode mode, Direction direction,
+                                   RangeExecutor& executor = OpenMPExecutor::instance()) {
+    return process_image_buffer(image_data, image_len, output_data, output_capacity, passphrase,
+                                mode, direction, PixelCodec::None, executor);
+}
+
+// --- Batched CBC Encryption ---
+// One image of a batch; output_len is set by encrypt_images_cbc_batch.
+struct CbcImageRequest {
+    const unsigned char* image_data;
+    size_t image_len;
+    unsigned char* output_data; // Same rules as process_image_buffer
+    size_t output_capacity;
+    std::string passphrase;
+    size_t output_len;
+};
+
+// CBC-encrypts several independent BMPs with the multi-buffer engine. The output of
+// each image is identical to process_image_buffer(..., AesMode::CBC, Direction::Encrypt).
+inline void encrypt_images_cbc_batch(std::vector<CbcImageRequest>& requests,
+                                     RangeExecutor& executor = OpenMPExecutor::instance()) {
+    std::vector<unsigned char> key_material(requests.size() * (AES_KEY_BYTES + AES_IV_BYTES));
+    std::vector<CbcEncryptJob> jobs(requests.size());
+    std::vector<const std::string*> passphrases(requests.size());
+    unsigned char* keys = key_material.data();
+    unsigned char* ivs = keys + requests.size() * AES_KEY_BYTES;
+    try {
+        for (size_t i = 0; i < requests.size(); ++i) {
+            CbcImageRequest& request = requests[i];
+            BmpLayout layout = locate_pixel_data(request.image_data, request.image_len, Direction::Encrypt);
+            if (request.output_capacity < max_processed_image_len(request.image_len)) {
+                throw std::runtime_error("Error: Output buffer is too small for the processed image.");
+            }
+            passphrases[i] = &request.passphrase;
+            std::memmove(request.output_data, request.image_data, layout.header_len);
+            CbcEncryptJob& job = jobs[i];
+            job.key = keys + i * AES_KEY_BYTES;
+            job.iv = ivs + i * AES_IV_BYTES;
+            job.input = request.image_data + layout.header_len;
+            job.input_len = layout.pixel_len;
+            job.output = request.output_data + layout.header_len;
+            job.output_len = 0;
+            request.output_len = layout.header_len;
+        }
+        derive_image_keys_and_ivs(passphrases, keys, ivs, executor);
+        cbc_encrypt_multibuffer(jobs);
+    } catch (...) {
+        OPENSSL_cleanse(key_material.data(), key_material.size());
+        throw;
+    }
+    OPENSSL_cleanse(key_material.data(), key_material.size());
+    for (size_t i = 0; i < requests.size(); ++i) {
+        requests[i].output_len += jobs[i].output_len;
+    }
+}
+
+#endif // IMAGE_PIPELINE_HPP
@@ -0,0 +1,295 @@
+#ifndef PIXEL_CODEC_HPP
+#define PIXEL_CODEC_HPP
+
+#include <string>
+#include <vector>
+#include <stdexcept> // For std::runtime_error
+#include <cstdint>
+#include <cstdlib>   // For std::getenv
+#include <cstddef>
+#include <cstring>   // For memcpy, memcmp, memset
+#include <cmath>     // For std::log2
+#include <algorithm> // For std::min
+
+#include "cipher_engine.hpp" // Executors, AES_BLOCK_BYTES
+#include "content_hash.hpp"  // Container header check
+
+// Optional compression of the pixel payload before encryption (and decompression after
+// decryption), applied by process_image_buffer. Callers choose the codec for an
+// encryption (IMAGE_PROCESSOR_COMPRESS=lz4|zstd for the command line tool, the
+// IMAGECRYPT_COMPRESS_* mode flags for the C API). Whether a ciphertext holds a
+// container is recorded outside it, in the BMP header (see image_pipeline.hpp);
+// decrypted plaintext is never inspected to decide.
+//
+// The payload is cut into independent frames of PIXEL_CODEC_FRAME_BYTES, which are
+// compressed and decompressed in parallel. A frame whose sampled byte entropy is above
+// PIXEL_CODEC_MAX_ENTROPY, or that does not shrink, is stored raw. If no frame
+// shrinks, the container is dropped, and the output is exactly the uncompressed
+// encryption.
+//
+// Container (host byte order), zero-padded to a whole number of AES blocks:
+//   PixelContainerHeader, PixelFrameEntry[num_frames], frame data.
+// The container header and its table_hash only check that a marked payload decrypted
+// into a well-formed container. The codecs are available when their headers are found
+// at build time (link with -llz4 / -lzstd).
+
+#if defined(__has_include)
+#if __has_include(<lz4.h>)
+#include <lz4.h>
+#define IMAGE_PROCESSOR_HAVE_LZ4 1
+#endif
+#if __has_include(<zstd.h>)
+#include <zstd.h>
+#define IMAGE_PROCESSOR_HAVE_ZSTD 1
+#endif
+#endif
+#ifndef IMAGE_PROCESSOR_HAVE_LZ4
+#define IMAGE_PROCESSOR_HAVE_LZ4 0
+#endif
+#ifndef IMAGE_PROCESSOR_HAVE_ZSTD
+#define IMAGE_PROCESSOR_HAVE_ZSTD 0
+#endif
+
+const unsigned char PIXEL_CONTAINER_MAGIC[8] = {'I', 'C', 'P', 'X', 'Z', 'F', 'R', 'M'};
+const uint32_t PIXEL_CONTAINER_VERSION = 1;
+const size_t PIXEL_CODEC_FRAME_BYTES = 1024 * 1024;
+const double PIXEL_CODEC_MAX_ENTROPY = 7.5; // Bits per byte; above this a frame is stored raw
+const size_t PIXEL_CODEC_ENTROPY_SAMPLES = 4096;
+const int PIXEL_CODEC_ZSTD_LEVEL = 3;
+
+enum class PixelCodec : uint32_t { None = 0, LZ4 = 1, Zstd = 2 };
+
+struct PixelContainerHeader {
+    unsigned char magic[8];
+    uint32_t version;
+    uint32_t codec;
+    uint64_t original_len;
+    uint32_t frame_bytes;
+    uint32_t num_frames;
+    uint64_t table_hash; // Of the header (with this field zero) and the frame table
+};
+
+struct PixelFrameEntry {
+    uint32_t stored_len;
+    uint32_t compressed; // 0: frame stored raw
+};
+
+inline const char* pixel_codec_name(PixelCodec codec) {
+    return codec == PixelCodec::LZ4 ? "lz4" : codec == PixelCodec::Zstd ? "zstd" : "none";
+}
+
+// Parses a codec name ("lz4", "zstd", or "none"/empty); throws for unknown names and
+// for codecs this build lacks.
+inline PixelCodec pixel_codec_from_name(const std::string& name) {
+    if (name.empty() || name == "none") return PixelCodec::None;
+    if (name == "lz4") {
+        if (!IMAGE_PROCESSOR_HAVE_LZ4) throw std::runtime_error("Error: This build has no lz4 support.");
+        return PixelCodec::LZ4;
+    }
+    if (name == "zstd") {
+        if (!IMAGE_PROCESSOR_HAVE_ZSTD) throw std::runtime_error("Error: This build has no zstd support.");
+        return PixelCodec::Zstd;
+    }
+    throw std::runtime_error("Error: Unknown compression codec '" + name + "'. Must be 'lz4' or 'zstd'.");
+}
+
+inline PixelCodec pixel_codec_from_env() {
+    const char* value = std::getenv("IMAGE_PROCESSOR_COMPRESS");
+    return pixel_codec_from_name(value != NULL ? value : "");
+}
+
+namespace pixel_codec_detail {
+
+// Shannon entropy in bits per byte of evenly spaced samples of the frame.
+inline double sampled_entropy(const unsigned char* data, size_t len) {
+    size_t counts[256] = {};
+    const size_t samples = std::min(len, PIXEL_CODEC_ENTROPY_SAMPLES);
+    for (size_t i = 0; i < samples; ++i) {
+        ++counts[data[i * len / samples]];
+    }
+    double entropy = 0.0;
+    for (size_t count : counts) {
+        if (count == 0) continue;
+        const double p = static_cast<double>(count) / samples;
+        entropy -= p * std::log2(p);
+    }
+    return entropy;
+}
+
+inline size_t compress_bound(PixelCodec codec, size_t len) {
+#if IMAGE_PROCESSOR_HAVE_LZ4
+    if (codec == PixelCodec::LZ4) return static_cast<size_t>(LZ4_compressBound(static_cast<int>(len)));
+#endif
+#if IMAGE_PROCESSOR_HAVE_ZSTD
+    if (codec == PixelCodec::Zstd) return ZSTD_compressBound(len);
+#endif
+    (void)codec;
+    return len;
+}
+
+// Returns the compressed length, or 0 if the codec failed or the frame did not shrink.
+inline size_t compress_frame(PixelCodec codec, const unsigned char* src, size_t len,
+                             unsigned char* dst, size_t capacity) {
+    size_t out = 0;
+#if IMAGE_PROCESSOR_HAVE_LZ4
+    if (codec == PixelCodec::LZ4) {
+        int n = LZ4_compress_default(reinterpret_cast<const char*>(src), reinterpret_cast<char*>(dst),
+                                     static_cast<int>(len), static_cast<int>(capacity));
+        out = n > 0 ? static_cast<size_t>(n) : 0;
+    }
+#endif
+#if IMAGE_PROCESSOR_HAVE_ZSTD
+    if (codec == PixelCodec::Zstd) {
+        size_t n = ZSTD_compress(dst, capacity, src, len, PIXEL_CODEC_ZSTD_LEVEL);
+        out = ZSTD_isError(n) ? 0 : n;
+    }
+#endif
+    (void)codec; (void)src; (void)dst; (void)capacity;
+    return out < len ? out : 0;
+}
+
+// Returns false unless exactly len bytes were produced.
+inline bool decompress_frame(PixelCodec codec, const unsigned char* src, size_t stored_len,
+                             unsigned char* dst, size_t len) {
+#if IMAGE_PROCESSOR_HAVE_LZ4
+    if (codec == PixelCodec::LZ4) {
+        int n = LZ4_decompress_safe(reinterpret_cast<const char*>(src), reinterpret_cast<char*>(dst),
+                                    static_cast<int>(stored_len), static_cast<int>(len));
+        return n >= 0 && static_cast<size_t>(n) == len;
+    }
+#endif
+#if IMAGE_PROCESSOR_HAVE_ZSTD
+    if (codec == PixelCodec::Zstd) {
+        size_t n = ZSTD_decompress(dst, len, src, stored_len);
+        return !ZSTD_isError(n) && n == len;
+    }
+#endif
+    (void)codec; (void)src; (void)stored_len; (void)dst; (void)len;
+    return false;
+}
+
+inline uint64_t container_table_hash(PixelContainerHeader header, const PixelFrameEntry* frames) {
+    header.table_hash = 0;
+    std::vector<unsigned char> bytes(sizeof(header) + header.num_frames * sizeof(PixelFrameEntry));
+    std::memcpy(bytes.data(), &header, sizeof(header));
+    std::memcpy(bytes.data() + sizeof(header), frames, header.num_frames * sizeof(PixelFrameEntry));
+    return hash_bytes_128(bytes.data(), bytes.size()).lo;
+}
+
+} // namespace pixel_codec_detail
+
+// Compresses len bytes of pixel data into container. Returns false (container left
+// empty) when compression would not make the payload smaller.
+inline bool compress_pixel_payload(PixelCodec codec, const unsigned char* data, size_t len,
+                                   std::vector<unsigned char>& container,
+                                   RangeExecutor& executor = OpenMPExecutor::instance()) {
+    using namespace pixel_codec_detail;
+    container.clear();
+    if (codec == PixelCodec::None || len == 0) return false;
+    const size_t num_frames = (len + PIXEL_CODEC_FRAME_BYTES - 1) / PIXEL_CODEC_FRAME_BYTES;
+    const size_t slot = compress_bound(codec, PIXEL_CODEC_FRAME_BYTES);
+    std::vector<unsigned char> scratch(num_frames * slot);
+    std::vector<PixelFrameEntry> frames(num_frames);
+
+    executor.run(num_frames, [&](size_t f) {
+        const size_t offset = f * PIXEL_CODEC_FRAME_BYTES;
+        const size_t frame_len = std::min(PIXEL_CODEC_FRAME_BYTES, len - offset);
+        size_t stored = 0;
+        if (sampled_entropy(data + offset, frame_len) <= PIXEL_CODEC_MAX_ENTROPY) {
+            stored = compress_frame(codec, data + offset, frame_len, scratch.data() + f * slot, slot);
+        }
+        frames[f].compressed = stored > 0 ? 1 : 0;
+        frames[f].stored_len = static_cast<uint32_t>(stored > 0 ? stored : frame_len);
+    });
+
+    size_t payload_len = 0;
+    bool any_compressed = false;
+    for (const PixelFrameEntry& frame : frames) {
+        payload_len += frame.stored_len;
+        any_compressed = any_compressed || frame.compressed;
+    }
+    const size_t table_len = sizeof(PixelContainerHeader) + num_frames * sizeof(PixelFrameEntry);
+    const size_t container_len = (table_len + payload_len + AES_BLOCK_BYTES - 1) / AES_BLOCK_BYTES * AES_BLOCK_BYTES;
+    if (!any_compressed || container_len >= len) return false;
+
+    PixelContainerHeader header;
+    std::memcpy(header.magic, PIXEL_CONTAINER_MAGIC, sizeof(header.magic));
+    header.version = PIXEL_CONTAINER_VERSION;
+    header.codec = static_cast<uint32_t>(codec);
+    header.original_len = len;
+    header.frame_bytes = static_cast<uint32_t>(PIXEL_CODEC_FRAME_BYTES);
+    header.num_frames = static_cast<uint32_t>(num_frames);
+    header.table_hash = container_table_hash(header, frames.data());
+
+    container.assign(container_len, 0);
+    std::memcpy(container.data(), &header, sizeof(header));
+    std::memcpy(container.data() + sizeof(header), frames.data(), num_frames * sizeof(PixelFrameEntry));
+    size_t offset = table_len;
+    for (size_t f = 0; f < num_frames; ++f) {
+        const unsigned char* src = frames[f].compressed ? scratch.data() + f * slot : data + f * PIXEL_CODEC_FRAME_BYTES;
+        std::memcpy(container.data() + offset, src, frames[f].stored_len);
+        offset += frames[f].stored_len;
+    }
+    return true;
+}
+
+// Original payload length if data holds a valid container header and frame table, else 0.
+inline size_t pixel_container_original_len(const unsigned char* data, size_t len) {
+    using namespace pixel_codec_detail;
+    PixelContainerHeader header;
+    if (len < sizeof(header)) return 0;
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, PIXEL_CONTAINER_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != PIXEL_CONTAINER_VERSION || header.frame_bytes == 0 ||
+        header.num_frames != (header.original_len + header.frame_bytes - 1) / header.frame_bytes ||
+        header.num_frames > (len - sizeof(header)) / sizeof(PixelFrameEntry)) {
+        return 0;
+    }
+    std::vector<PixelFrameEntry> frames(header.num_frames);
+    std::memcpy(frames.data(), data + sizeof(header), header.num_frames * sizeof(PixelFrameEntry));
+    if (container_table_hash(header, frames.data()) != header.table_hash) return 0;
+    return static_cast<size_t>(header.original_len);
+}
+
+// Restores the original payload of a container into output, which must hold
+// pixel_container_original_len() bytes.
+inline void decompress_pixel_payload(const unsigned char* data, size_t len, unsigned char* output,
+                                     RangeExecutor& executor = OpenMPExecutor::instance()) {
+    using namespace pixel_codec_detail;
+    PixelContainerHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    const PixelCodec codec = static_cast<PixelCodec>(header.codec);
+    std::vector<PixelFrameEntry> frames(header.num_frames);
+    std::memcpy(frames.data(), data + sizeof(header), header.num_frames * sizeof(PixelFrameEntry));
+
+    // Frame start offsets, with every frame checked against the container bounds.
+    std::vector<size_t> starts(header.num_frames);
+    size_t offset = sizeof(header) + header.num_frames * sizeof(PixelFrameEntry);
+    for (size_t f = 0; f < frames.size(); ++f) {
+        const size_t frame_len = std::min<size_t>(header.frame_bytes, header.original_len - f * header.frame_bytes);
+        if (frames[f].stored_len > len - offset || (!frames[f].compressed && frames[f].stored_len != frame_len)) {
+            throw std::runtime_error("Error: Compressed pixel container is corrupt.");
+        }
+        starts[f] = offset;
+        offset += frames[f].stored_len;
+    }
+
+    std::vector<char> ok(frames.size(), 1);
+    executor.run(frames.size(), [&](size_t f) {
+        const size_t out_offset = f * header.frame_bytes;
+        const size_t frame_len = std::min<size_t>(header.frame_bytes, header.original_len - out_offset);
+        if (frames[f].compressed) {
+            ok[f] = decompress_frame(codec, data + starts[f], frames[f].stored_len, output + out_offset, frame_len);
+        } else {
+            std::memcpy(output + out_offset, data + starts[f], frame_len);
+        }
+    });
+    for (char frame_ok : ok) {
+        if (!frame_ok) {
+            throw std::runtime_error(std::string("Error: Could not decompress pixel data (") +
+                                     pixel_codec_name(codec) + " frame).");
+        }
+    }
+}
+
+#endif // PIXEL_CODEC_HPP
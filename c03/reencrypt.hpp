@@ -0,0 +1,170 @@
+#ifndef REENCRYPT_HPP
+#define REENCRYPT_HPP
+
+#include <string>
+#include <vector>
+#include <stdexcept> // For std::runtime_error
+#include <cstddef>
+#include <cstring>   // For memcpy
+#include <mutex>
+
+#include <openssl/crypto.h> // For OPENSSL_cleanse
+
+#include "cipher_engine.hpp"  // AES engine, executors
+#include "image_pipeline.hpp" // Key derivation, BMP layout
+
+// Key rotation in one pass: the pixel data is decrypted with the old key and mode and
+// encrypted with the new ones chunk by chunk, so each chunk goes through both ciphers
+// while it is still in cache, and the plaintext never exists beyond one chunk per task.
+// The result is byte-identical to a decrypt followed by an encrypt.
+//
+// The pass is split into block-aligned ranges across the executor whenever the new mode
+// is ECB (both decryptions are block-parallel). A CBC encryption is a chain, so it runs
+// as a single range. The last block of an old CBC payload carries the padding. It is
+// decrypted and checked first, so a wrong old passphrase fails before any output is written.
+
+const size_t REENCRYPT_CHUNK_BYTES = 64 * 1024; // Per-task plaintext buffer
+
+namespace reencrypt_detail {
+
+// Decrypts [begin, end) of input with the old engine and encrypts it with the new one,
+// REENCRYPT_CHUNK_BYTES at a time. old_chain is the ciphertext block before begin (or the IV).
+template <AesMode OLD, AesMode NEW>
+void reencrypt_range(const unsigned char* old_key, const unsigned char* old_chain,
+                     const unsigned char* new_key, const unsigned char* new_chain,
+                     const unsigned char* input, size_t begin, size_t end, unsigned char* output) {
+    CipherEngine<OLD, Direction::Decrypt, Padding::None> decrypt(old_key, old_chain);
+    CipherEngine<NEW, Direction::Encrypt, Padding::None> encrypt(new_key, new_chain);
+    std::vector<unsigned char> plain(REENCRYPT_CHUNK_BYTES + AES_BLOCK_BYTES);
+    for (size_t offset = begin; offset < end; offset += REENCRYPT_CHUNK_BYTES) {
+        const size_t len = std::min(REENCRYPT_CHUNK_BYTES, end - offset);
+        decrypt.update(input + offset, len, plain.data());
+        encrypt.update(plain.data(), len, output + offset);
+    }
+    OPENSSL_cleanse(plain.data(), plain.size());
+}
+
+template <AesMode OLD, AesMode NEW>
+size_t reencrypt_pixels(const unsigned char* old_key, const unsigned char* old_iv,
+                        const unsigned char* new_key, const unsigned char* new_iv,
+                        const unsigned char* input, size_t input_len, unsigned char* output,
+                        RangeExecutor& executor) {
+    // --- Plaintext length and tail ---
+    // body_len bytes decrypt to whole plaintext blocks; an old CBC payload also has
+    // tail_len (< 16) plaintext bytes in its last, padded block.
+    size_t body_len = input_len / AES_BLOCK_BYTES * AES_BLOCK_BYTES;
+    unsigned char tail[2 * AES_BLOCK_BYTES];
+    size_t tail_len = 0;
+    if constexpr (OLD == AesMode::CBC) {
+        if (input_len % AES_BLOCK_BYTES != 0 || input_len == 0) {
+            throw std::runtime_error("Error: Encrypted pixel data is not a whole number of AES blocks.");
+        }
+        body_len -= AES_BLOCK_BYTES;
+        CipherEngine<AesMode::CBC, Direction::Decrypt, Padding::PKCS7> last(
+            old_key, body_len > 0 ? input + body_len - AES_BLOCK_BYTES : old_iv);
+        tail_len = last.update(input + body_len, AES_BLOCK_BYTES, tail);
+        tail_len += last.finish(tail + tail_len);
+    }
+
+    // --- Whole blocks ---
+    const size_t num_blocks = body_len / AES_BLOCK_BYTES;
+    size_t num_ranges = 1;
+    if (NEW == AesMode::ECB && body_len >= OMP_PARALLEL_MIN_BYTES) {
+        num_ranges = std::min(std::max<size_t>(executor.concurrency(), 1), num_blocks);
+    }
+    // Chain blocks are copied before any output is written, so input and output may alias.
+    std::vector<unsigned char> range_chains(num_ranges * AES_BLOCK_BYTES);
+    for (size_t range_idx = 0; range_idx < num_ranges; ++range_idx) {
+        const size_t offset = num_blocks * range_idx / num_ranges * AES_BLOCK_BYTES;
+        std::memcpy(range_chains.data() + range_idx * AES_BLOCK_BYTES,
+                    offset > 0 && OLD == AesMode::CBC ? input + offset - AES_BLOCK_BYTES : old_iv,
+                    AES_BLOCK_BYTES);
+    }
+    if (num_ranges == 1) {
+        reencrypt_range<OLD, NEW>(old_key, range_chains.data(), new_key, new_iv, input, 0, body_len, output);
+    } else {
+        bool parallel_success = true;
+        std::string parallel_error;
+        std::mutex error_mutex;
+        executor.run(num_ranges, [&](size_t range_idx) {
+            const size_t begin = num_blocks * range_idx / num_ranges * AES_BLOCK_BYTES;
+            const size_t end = num_blocks * (range_idx + 1) / num_ranges * AES_BLOCK_BYTES;
+            try {
+                reencrypt_range<OLD, NEW>(old_key, range_chains.data() + range_idx * AES_BLOCK_BYTES,
+                                          new_key, new_iv, input, begin, end, output);
+            } catch (const std::exception& e) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                parallel_success = false;
+                parallel_error = e.what();
+            }
+        });
+        if (!parallel_success) {
+            throw std::runtime_error("Error occurred during parallel re-encryption: " + parallel_error);
+        }
+    }
+
+    // --- Final block ---
+    // ECB drops a trailing partial block; CBC pads the tail (or a full padding block).
+    size_t output_len = body_len;
+    if constexpr (NEW == AesMode::CBC) {
+        CipherEngine<AesMode::CBC, Direction::Encrypt, Padding::PKCS7> last(
+            new_key, body_len > 0 ? output + body_len - AES_BLOCK_BYTES : new_iv);
+        output_len += last.update(tail, tail_len, output + output_len);
+        output_len += last.finish(output + output_len);
+    }
+    OPENSSL_cleanse(tail, sizeof(tail));
+    return output_len;
+}
+
+} // namespace reencrypt_detail
+
+// Re-encrypts pixel_len bytes of encrypted pixel data. The output buffer must hold
+// pixel_len + AES_BLOCK_BYTES bytes and may be the same buffer as the input.
+// Returns the re-encrypted pixel data length.
+inline size_t reencrypt_pixel_data(const unsigned char* old_key, const unsigned char* old_iv, AesMode old_mode,
+                                   const unsigned char* new_key, const unsigned char* new_iv, AesMode new_mode,
+                                   const unsigned char* pixel_data, size_t pixel_len, unsigned char* output_data,
+                                   RangeExecutor& executor = OpenMPExecutor::instance()) {
+    using namespace reencrypt_detail;
+    if (old_mode == AesMode::ECB) {
+        return new_mode == AesMode::ECB
+            ? reencrypt_pixels<AesMode::ECB, AesMode::ECB>(old_key, old_iv, new_key, new_iv, pixel_data, pixel_len, output_data, executor)
+            : reencrypt_pixels<AesMode::ECB, AesMode::CBC>(old_key, old_iv, new_key, new_iv, pixel_data, pixel_len, output_data, executor);
+    }
+    return new_mode == AesMode::ECB
+        ? reencrypt_pixels<AesMode::CBC, AesMode::ECB>(old_key, old_iv, new_key, new_iv, pixel_data, pixel_len, output_data, executor)
+        : reencrypt_pixels<AesMode::CBC, AesMode::CBC>(old_key, old_iv, new_key, new_iv, pixel_data, pixel_len, output_data, executor);
+}
+
+// Re-encrypts a whole encrypted BMP held in memory; the header is copied through.
+// output may be the same buffer as input (in-place); output_capacity must be at least
+// max_processed_image_len(image_len). Returns the re-encrypted image length.
+inline size_t reencrypt_image_buffer(const unsigned char* image_data, size_t image_len,
+                                     unsigned char* output_data, size_t output_capacity,
+                                     const std::string& old_passphrase, AesMode old_mode,
+                                     const std::string& new_passphrase, AesMode new_mode,
+                                     RangeExecutor& executor = OpenMPExecutor::instance()) {
+    BmpLayout layout = locate_pixel_data(image_data, image_len, Direction::Decrypt);
+    if (output_capacity < max_processed_image_len(image_len)) {
+        throw std::runtime_error("Error: Output buffer is too small for the processed image.");
+    }
+    unsigned char keys[2 * AES_KEY_BYTES];
+    unsigned char ivs[2 * AES_IV_BYTES];
+    size_t pixel_out_len = 0;
+    try {
+        derive_image_keys_and_ivs({&old_passphrase, &new_passphrase}, keys, ivs, executor);
+        std::memmove(output_data, image_data, layout.header_len);
+        pixel_out_len = reencrypt_pixel_data(keys, ivs, old_mode, keys + AES_KEY_BYTES, ivs + AES_IV_BYTES, new_mode,
+                                             image_data + layout.header_len, layout.pixel_len,
+                                             output_data + layout.header_len, executor);
+    } catch (...) {
+        OPENSSL_cleanse(keys, sizeof(keys));
+        OPENSSL_cleanse(ivs, sizeof(ivs));
+        throw;
+    }
+    OPENSSL_cleanse(keys, sizeof(keys));
+    OPENSSL_cleanse(ivs, sizeof(ivs));
+    return layout.header_len + pixel_out_len;
+}
+
+#endif // REENCRYPT_HPP
@@ -0,0 +1,403 @@
+#ifndef RESULT_CACHE_HPP
+#define RESULT_CACHE_HPP
+
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <algorithm> // For std::sort
+#include <memory>
+#include <mutex>
+#include <stdexcept> // For std::runtime_error
+#include <cstdint>
+#include <cstdlib>   // For std::getenv, std::strtoull
+#include <cstddef>
+#include <cstring>   // For memcpy, memcmp
+#include <cstdio>    // For std::rename, std::remove
+
+#include <dirent.h>   // For opendir
+#include <fcntl.h>    // For open
+#include <sys/mman.h> // For mmap
+#include <sys/stat.h> // For fstat, mkdir, utimensat
+#include <unistd.h>   // For close, write, getpid
+
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+#include <openssl/crypto.h> // For OPENSSL_cleanse
+
+#include "cipher_engine.hpp"  // Mode/direction enums, executors
+#include "content_hash.hpp"   // Entry file names and output checks
+#include "image_pipeline.hpp" // process_image_buffer
+
+// Content-addressed cache of processed images. A repeated request (same bytes, same
+// passphrase, same mode, operation and codec) costs one HMAC pass over the input
+// instead of the key derivation and the cipher pass.
+//
+// Keys hold HMAC-SHA256 tags of the input and of the passphrase under a cache secret;
+// the passphrase itself is never stored. The input is keyed too: with an unkeyed hash
+// anyone who can submit images could build a colliding input and be served another
+// client's result. The secret is random per process for the memory tier and lives in
+// <dir>/cache.secret (0600) when the disk tier is on, so entries survive restarts
+// without being usable to test passphrase guesses offline; whoever can read that file
+// can read the entries themselves.
+//
+// Tiers:
+//   - memory: LRU list bounded by IMAGE_PROCESSOR_CACHE_BYTES (bytes of cached output);
+//   - disk (optional): one file per entry under IMAGE_PROCESSOR_CACHE_DIR, bounded by
+//     IMAGE_PROCESSOR_CACHE_DISK_BYTES, evicted by last use (mtime), read through mmap.
+//     Entries carry a hash of their output that is checked on every read; a corrupt
+//     entry is deleted and treated as a miss.
+
+const uint32_t RESULT_CACHE_MAGIC = 0x52434349;  // "ICCR"
+const uint32_t RESULT_CACHE_VERSION = 3;          // Bump when the output format changes
+const size_t RESULT_CACHE_DEFAULT_MEMORY_BYTES = 128ULL * 1024 * 1024; // Long-lived processes
+const size_t RESULT_CACHE_DEFAULT_DISK_BYTES = 1024ULL * 1024 * 1024;
+
+struct ResultCacheKey {
+    unsigned char content_tag[32];     // HMAC-SHA256(cache secret, input image)
+    unsigned char key_fingerprint[32]; // HMAC-SHA256(cache secret, passphrase)
+    uint64_t input_len;
+    int32_t mode;
+    int32_t direction;
+    int32_t codec;                     // PixelCodec requested for an encryption
+};
+
+struct ResultCacheEntryHeader {
+    uint32_t magic;
+    uint32_t version;
+    ResultCacheKey key;
+    uint64_t output_len;
+    Hash128 output_hash;
+};
+
+struct ResultCacheConfig {
+    size_t memory_bytes;   // 0 disables the memory tier
+    std::string disk_dir;  // Empty disables the disk tier
+    size_t disk_bytes;
+};
+
+inline size_t env_size(const char* name, size_t default_value) {
+    const char* value = std::getenv(name);
+    if (value == NULL || *value == '\0') return default_value;
+    return static_cast<size_t>(std::strtoull(value, NULL, 10));
+}
+
+// The memory tier only pays off in long-lived processes, so each caller picks its default.
+inline ResultCacheConfig result_cache_config_from_env(size_t default_memory_bytes) {
+    ResultCacheConfig config;
+    config.memory_bytes = env_size("IMAGE_PROCESSOR_CACHE_BYTES", default_memory_bytes);
+    const char* dir = std::getenv("IMAGE_PROCESSOR_CACHE_DIR");
+    config.disk_dir = dir != NULL ? dir : "";
+    config.disk_bytes = env_size("IMAGE_PROCESSOR_CACHE_DISK_BYTES", RESULT_CACHE_DEFAULT_DISK_BYTES);
+    return config;
+}
+
+class ResultCache {
+public:
+    explicit ResultCache(const ResultCacheConfig& config)
+        : config_(config), memory_used_(0), disk_used_(0) {
+        if (!config_.disk_dir.empty()) {
+            if (!open_disk_tier()) {
+                config_.disk_dir.clear(); // Unusable directory: carry on with the memory tier only
+            }
+        }
+        if (config_.disk_dir.empty() && RAND_bytes(secret_, sizeof(secret_)) != 1) {
+            handle_openssl_errors("RAND_bytes failed for the result cache secret: ");
+        }
+    }
+
+    ~ResultCache() { OPENSSL_cleanse(secret_, sizeof(secret_)); }
+
+    ResultCache(const ResultCache&) = delete;
+    ResultCache& operator=(const ResultCache&) = delete;
+
+    bool enabled() const { return config_.memory_bytes > 0 || !config_.disk_dir.empty(); }
+
+    ResultCacheKey make_key(const unsigned char* input, size_t input_len, const std::string& passphrase,
+                            AesMode mode, Direction direction, PixelCodec codec = PixelCodec::None) const {
+        ResultCacheKey key;
+        std::memset(&key, 0, sizeof(key));
+        unsigned int tag_len = sizeof(key.content_tag);
+        unsigned int fingerprint_len = sizeof(key.key_fingerprint);
+        if (HMAC(fetched_digest("SHA256"), secret_, sizeof(secret_), input, input_len,
+                 key.content_tag, &tag_len) == NULL ||
+            HMAC(fetched_digest("SHA256"), secret_, sizeof(secret_),
+                 reinterpret_cast<const unsigned char*>(passphrase.data()), passphrase.size(),
+                 key.key_fingerprint, &fingerprint_len) == NULL) {
+            handle_openssl_errors("HMAC failed for the result cache key: ");
+        }
+        key.input_len = input_len;
+        key.mode = static_cast<int32_t>(mode);
+        key.direction = static_cast<int32_t>(direction);
+        key.codec = static_cast<int32_t>(direction == Direction::Encrypt ? codec : PixelCodec::None);
+        return key;
+    }
+
+    // Copies a cached result into output. Returns false on a miss or if it does not fit.
+    bool lookup(const ResultCacheKey& key, unsigned char* output, size_t output_capacity, size_t& output_len) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (config_.memory_bytes > 0) {
+            auto it = memory_index_.find(key_bytes(key));
+            if (it != memory_index_.end()) {
+                memory_lru_.splice(memory_lru_.begin(), memory_lru_, it->second);
+                const std::vector<unsigned char>& data = it->second->data;
+                if (data.size() > output_capacity) return false;
+                std::memcpy(output, data.data(), data.size());
+                output_len = data.size();
+                return true;
+            }
+        }
+        if (!config_.disk_dir.empty() && disk_lookup(key, output, output_capacity, output_len)) {
+            memory_store(key, output, output_len);
+            return true;
+        }
+        return false;
+    }
+
+    void store(const ResultCacheKey& key, const unsigned char* output, size_t output_len) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        memory_store(key, output, output_len);
+        if (!config_.disk_dir.empty()) {
+            disk_store(key, output, output_len);
+        }
+    }
+
+private:
+    struct MemoryEntry {
+        std::string key;
+        std::vector<unsigned char> data;
+    };
+    struct DiskEntry {
+        std::string name;
+        size_t bytes;
+        time_t last_use;
+    };
+
+    ResultCacheConfig config_;
+    unsigned char secret_[32];
+    std::mutex mutex_;
+    std::list<MemoryEntry> memory_lru_; // Most recently used first
+    std::unordered_map<std::string, std::list<MemoryEntry>::iterator> memory_index_;
+    size_t memory_used_;
+    std::unordered_map<std::string, DiskEntry> disk_index_;
+    size_t disk_used_;
+
+    static std::string key_bytes(const ResultCacheKey& key) {
+        return std::string(reinterpret_cast<const char*>(&key), sizeof(key));
+    }
+
+    // --- Memory tier ---
+    void memory_store(const ResultCacheKey& key, const unsigned char* output, size_t output_len) {
+        if (output_len > config_.memory_bytes) return;
+        const std::string id = key_bytes(key);
+        auto existing = memory_index_.find(id);
+        if (existing != memory_index_.end()) {
+            memory_used_ -= existing->second->data.size();
+            memory_lru_.erase(existing->second);
+            memory_index_.erase(existing);
+        }
+        while (!memory_lru_.empty() && memory_used_ + output_len > config_.memory_bytes) {
+            memory_used_ -= memory_lru_.back().data.size();
+            memory_index_.erase(memory_lru_.back().key);
+            memory_lru_.pop_back();
+        }
+        MemoryEntry entry;
+        entry.key = id;
+        entry.data.assign(output, output + output_len);
+        memory_lru_.push_front(std::move(entry));
+        memory_index_[id] = memory_lru_.begin();
+        memory_used_ += output_len;
+    }
+
+    // --- Disk tier ---
+    std::string entry_path(const std::string& name) const { return config_.disk_dir + "/" + name; }
+
+    static std::string entry_name(const ResultCacheKey& key) {
+        return hash_bytes_128(reinterpret_cast<const unsigned char*>(&key), sizeof(key)).hex() + ".entry";
+    }
+
+    bool open_disk_tier() {
+        mkdir(config_.disk_dir.c_str(), 0700);
+        if (!load_or_create_secret()) return false;
+        DIR* dir = opendir(config_.disk_dir.c_str());
+        if (dir == NULL) return false;
+        while (struct dirent* item = readdir(dir)) {
+            const std::string name = item->d_name;
+            if (name.size() < 6 || name.compare(name.size() - 6, 6, ".entry") != 0) continue;
+            struct stat st;
+            if (stat(entry_path(name).c_str(), &st) != 0) continue;
+            DiskEntry entry = {name, static_cast<size_t>(st.st_size), st.st_mtime};
+            disk_index_[name] = entry;
+            disk_used_ += entry.bytes;
+        }
+        closedir(dir);
+        return true;
+    }
+
+    // The secret is created once with O_EXCL; concurrent processes read the winner's copy.
+    bool load_or_create_secret() {
+        const std::string path = entry_path("cache.secret");
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0600);
+        if (fd >= 0) {
+            bool ok = RAND_bytes(secret_, sizeof(secret_)) == 1 &&
+                      write(fd, secret_, sizeof(secret_)) == static_cast<ssize_t>(sizeof(secret_));
+            close(fd);
+            if (ok) return true;
+            std::remove(path.c_str());
+            return false;
+        }
+        for (int attempt = 0; attempt < 100; ++attempt) {
+            fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0) return false;
+            ssize_t got = read(fd, secret_, sizeof(secret_));
+            close(fd);
+            if (got == static_cast<ssize_t>(sizeof(secret_))) return true;
+            usleep(1000); // Creator has not finished writing yet
+        }
+        return false;
+    }
+
+    bool disk_lookup(const ResultCacheKey& key, unsigned char* output, size_t output_capacity, size_t& output_len) {
+        const std::string name = entry_name(key);
+        const std::string path = entry_path(name);
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(ResultCacheEntryHeader)) {
+            close(fd);
+            return false;
+        }
+        const size_t file_len = static_cast<size_t>(st.st_size);
+        void* mapped = mmap(NULL, file_len, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapped == MAP_FAILED) return false;
+
+        const unsigned char* bytes = static_cast<const unsigned char*>(mapped);
+        ResultCacheEntryHeader header;
+        std::memcpy(&header, bytes, sizeof(header));
+        const unsigned char* data = bytes + sizeof(header);
+        const bool valid = header.magic == RESULT_CACHE_MAGIC && header.version == RESULT_CACHE_VERSION &&
+                           std::memcmp(&header.key, &key, sizeof(key)) == 0 &&
+                           header.output_len == file_len - sizeof(header) &&
+                           hash_bytes_128(data, header.output_len) == header.output_hash;
+        bool hit = false;
+        if (valid && header.output_len <= output_capacity) {
+            std::memcpy(output, data, header.output_len);
+            output_len = header.output_len;
+            hit = true;
+        }
+        munmap(mapped, file_len);
+
+        if (!valid) {
+            disk_remove(name); // Corrupt, truncated or from another format version
+        } else if (hit) {
+            utimensat(AT_FDCWD, path.c_str(), NULL, 0); // Last use, for eviction
+            auto it = disk_index_.find(name);
+            if (it != disk_index_.end()) it->second.last_use = time(NULL);
+        }
+        return hit;
+    }
+
+    void disk_store(const ResultCacheKey& key, const unsigned char* output, size_t output_len) {
+        const size_t file_len = sizeof(ResultCacheEntryHeader) + output_len;
+        if (file_len > config_.disk_bytes) return;
+        disk_evict(file_len);
+
+        ResultCacheEntryHeader header;
+        std::memset(&header, 0, sizeof(header));
+        header.magic = RESULT_CACHE_MAGIC;
+        header.version = RESULT_CACHE_VERSION;
+        header.key = key;
+        header.output_len = output_len;
+        header.output_hash = hash_bytes_128(output, output_len);
+
+        // Written under a temporary name and renamed, so readers never see a partial entry.
+        const std::string name = entry_name(key);
+        const std::string tmp_path = entry_path(name + ".tmp" + std::to_string(getpid()));
+        int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+        if (fd < 0) return;
+        bool ok = write_all(fd, reinterpret_cast<const unsigned char*>(&header), sizeof(header)) &&
+                  write_all(fd, output, output_len);
+        close(fd);
+        if (!ok || std::rename(tmp_path.c_str(), entry_path(name).c_str()) != 0) {
+            std::remove(tmp_path.c_str());
+            return;
+        }
+        auto existing = disk_index_.find(name);
+        if (existing != disk_index_.end()) disk_used_ -= existing->second.bytes;
+        DiskEntry entry = {name, file_len, time(NULL)};
+        disk_index_[name] = entry;
+        disk_used_ += file_len;
+    }
+
+    void disk_evict(size_t incoming_bytes) {
+        if (disk_used_ + incoming_bytes <= config_.disk_bytes) return;
+        std::vector<DiskEntry> entries;
+        for (const auto& item : disk_index_) entries.push_back(item.second);
+        std::sort(entries.begin(), entries.end(),
+                  [](const DiskEntry& a, const DiskEntry& b) { return a.last_use < b.last_use; });
+        for (const DiskEntry& entry : entries) {
+            if (disk_used_ + incoming_bytes <= config_.disk_bytes) break;
+            disk_remove(entry.name);
+        }
+    }
+
+    void disk_remove(const std::string& name) {
+        std::remove(entry_path(name).c_str());
+        auto it = disk_index_.find(name);
+        if (it != disk_index_.end()) {
+            disk_used_ -= it->second.bytes;
+            disk_index_.erase(it);
+        }
+    }
+
+    static bool write_all(int fd, const unsigned char* data, size_t len) {
+        while (len > 0) {
+            ssize_t written = write(fd, data, len);
+            if (written <= 0) return false;
+            data += written;
+            len -= static_cast<size_t>(written);
+        }
+        return true;
+    }
+};
+
+// process_image_buffer with the cache in front. The key is computed before processing,
+// so output may still be the input buffer (in-place).
+inline size_t process_image_buffer_cached(ResultCache& cache,
+                                          const unsigned char* image_data, size_t image_len,
+                                          unsigned char* output_data, size_t output_capacity,
+                                          const std::string& passphrase,
+                                          AesMode mode, Direction direction, PixelCodec codec,
+                                          RangeExecutor& executor = OpenMPExecutor::instance(),
+                                          bool* cache_hit = NULL) {
+    if (cache_hit != NULL) *cache_hit = false;
+    // GCM and ChaCha20 encryptions draw a fresh nonce, so their output is never reused.
+    if (!cache.enabled() || (direction == Direction::Encrypt && pixel_encryption_randomized(mode))) {
+        return process_image_buffer(image_data, image_len, output_data, output_capacity,
+                                    passphrase, mode, direction, codec, executor);
+    }
+    const ResultCacheKey key = cache.make_key(image_data, image_len, passphrase, mode, direction, codec);
+    size_t output_len = 0;
+    if (cache.lookup(key, output_data, output_capacity, output_len)) {
+        if (cache_hit != NULL) *cache_hit = true;
+        return output_len;
+    }
+    output_len = process_image_buffer(image_data, image_len, output_data, output_capacity,
+                                      passphrase, mode, direction, codec, executor);
+    cache.store(key, output_data, output_len);
+    return output_len;
+}
+
+inline size_t process_image_buffer_cached(ResultCache& cache,
+                                          const unsigned char* image_data, size_t image_len,
+                                          unsigned char* output_data, size_t output_capacity,
+                                          const std::string& passphrase,
+                                          AesMode mode, Direction direction,
+                                          RangeExecutor& executor = OpenMPExecutor::instance(),
+                                          bool* cache_hit = NULL) {
+    return process_image_buffer_cached(cache, image_data, image_len, output_data, output_capacity, passphrase,
+                                       mode, direction, PixelCodec::None, executor, cache_hit);
+}
+
+#endif // RESULT_CACHE_HPP
@@ -0,0 +1,208 @@
+#ifndef ROW_DECRYPT_HPP
+#define ROW_DECRYPT_HPP
+
+#include <string>
+#include <vector>
+#include <stdexcept> // For std::runtime_error
+#include <cstdint>
+#include <cstddef>
+#include <cstring>   // For memcpy, strerror
+#include <cerrno>
+
+#include <fcntl.h>    // For open
+#include <sys/stat.h> // For fstat
+#include <unistd.h>   // For pread, close
+
+#include <openssl/crypto.h> // For OPENSSL_cleanse
+
+#include "cipher_engine.hpp"  // AES engine, executors
+#include "image_pipeline.hpp" // Key derivation, BMP header constants
+
+// Random-access decryption of a row range of an encrypted BMP.
+// Both stored formats are seekable as they are: ECB blocks are independent, and a CBC
+// block only needs the ciphertext block before it (or the IV for block 0). So only the
+// blocks covering the requested rows, plus one block of chain state for CBC, are read
+// (with pread) and decrypted; the cost follows the region, not the image.
+// The PKCS#7 padding at the end of a CBC payload is never part of a row, so no padding
+// check is made: a wrong key yields garbage rows instead of an error.
+
+// --- BMP Geometry ---
+struct BmpGeometry {
+    uint32_t pixel_offset; // Start of the pixel array in the file
+    int32_t width;
+    int32_t height;        // Always positive; see bottom_up
+    bool bottom_up;        // Positive biHeight: the last stored row is the top of the image
+    uint16_t bits_per_pixel;
+    size_t row_stride;     // Stored bytes per row, padded to 4 bytes
+};
+
+inline int32_t read_le32(const unsigned char* p) {
+    return static_cast<int32_t>(static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8 |
+                                static_cast<uint32_t>(p[2]) << 16 | static_cast<uint32_t>(p[3]) << 24);
+}
+
+inline void write_le32(unsigned char* p, uint32_t v) {
+    p[0] = static_cast<unsigned char>(v);
+    p[1] = static_cast<unsigned char>(v >> 8);
+    p[2] = static_cast<unsigned char>(v >> 16);
+    p[3] = static_cast<unsigned char>(v >> 24);
+}
+
+inline BmpGeometry read_bmp_geometry(const unsigned char* header, size_t header_len) {
+    if (header_len < BMP_HEADER_SIZE || header[0] != 'B' || header[1] != 'M') {
+        throw std::runtime_error("Error: Input is not a BMP file.");
+    }
+    const uint32_t compression = static_cast<uint32_t>(read_le32(header + 30));
+    if (compression != 0 && compression != 3) { // BI_RGB or BI_BITFIELDS: rows are plain arrays
+        throw std::runtime_error("Error: Compressed BMPs do not have fixed-size rows.");
+    }
+    BmpGeometry geometry;
+    geometry.pixel_offset = get_pixel_data_offset(header, header_len);
+    geometry.width = read_le32(header + 18);
+    const int32_t height = read_le32(header + 22);
+    geometry.bottom_up = height > 0;
+    geometry.height = height > 0 ? height : -height;
+    geometry.bits_per_pixel = static_cast<uint16_t>(header[28] | header[29] << 8);
+    if (geometry.width <= 0 || geometry.height <= 0 || geometry.bits_per_pixel == 0) {
+        throw std::runtime_error("Error: Invalid BMP dimensions.");
+    }
+    geometry.row_stride = (static_cast<size_t>(geometry.width) * geometry.bits_per_pixel + 31) / 32 * 4;
+    return geometry;
+}
+
+// Byte range of the pixel array holding rows [first_row, first_row + row_count), with
+// row 0 the top of the image. Rows are contiguous in storage for either orientation.
+struct PixelByteRange {
+    size_t offset; // From the start of the pixel array
+    size_t length;
+};
+
+inline PixelByteRange rows_to_pixel_range(const BmpGeometry& geometry, size_t first_row, size_t row_count) {
+    const size_t height = static_cast<size_t>(geometry.height);
+    if (row_count == 0 || first_row >= height || row_count > height - first_row) {
+        throw std::runtime_error("Error: Row range is outside the image.");
+    }
+    const size_t first_stored = geometry.bottom_up ? height - first_row - row_count : first_row;
+    PixelByteRange range;
+    range.offset = first_stored * geometry.row_stride;
+    range.length = row_count * geometry.row_stride;
+    return range;
+}
+
+// --- Range Decryption ---
+inline void pread_exact(int fd, unsigned char* buffer, size_t len, off_t offset) {
+    while (len > 0) {
+        ssize_t got = pread(fd, buffer, len, offset);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) {
+            throw std::runtime_error(std::string("Error: Could not read encrypted image: ") +
+                                     (got < 0 ? std::strerror(errno) : "unexpected end of file"));
+        }
+        buffer += got;
+        len -= static_cast<size_t>(got);
+        offset += got;
+    }
+}
+
+// Decrypts bytes [range.offset, range.offset + range.length) of the encrypted pixel array
+// (pixel_len bytes, starting at file offset pixel_offset) into output.
+// The ECB encoder drops a trailing partial block, so those bytes are not in the file;
+// they come back zero-filled, like the short output of a full ECB decryption.
+inline void decrypt_pixel_range(int fd, size_t pixel_offset, size_t pixel_len,
+                                const unsigned char* key, const unsigned char* iv, AesMode mode,
+                                const PixelByteRange& range, unsigned char* output,
+                                RangeExecutor& executor = OpenMPExecutor::instance()) {
+    const size_t encrypted_end = pixel_len / AES_BLOCK_BYTES * AES_BLOCK_BYTES;
+    const size_t range_end = range.offset + range.length;
+    if (range_end > (mode == AesMode::ECB ? encrypted_end + AES_BLOCK_BYTES - 1 : pixel_len)) {
+        throw std::runtime_error("Error: Requested rows extend past the encrypted pixel data.");
+    }
+    const size_t first_block = range.offset / AES_BLOCK_BYTES;
+    const size_t cipher_start = first_block * AES_BLOCK_BYTES;
+    const size_t cipher_end = std::min(encrypted_end,
+                                       (range_end + AES_BLOCK_BYTES - 1) / AES_BLOCK_BYTES * AES_BLOCK_BYTES);
+
+    if (cipher_start < cipher_end) {
+        // CBC also reads the ciphertext block before the range as its chain state.
+        const bool need_chain = mode == AesMode::CBC && first_block > 0;
+        const size_t read_start = need_chain ? cipher_start - AES_BLOCK_BYTES : cipher_start;
+        std::vector<unsigned char> cipher(cipher_end - read_start);
+        pread_exact(fd, cipher.data(), cipher.size(), static_cast<off_t>(pixel_offset + read_start));
+        const unsigned char* body = cipher.data() + (need_chain ? AES_BLOCK_BYTES : 0);
+        const unsigned char* chain = need_chain ? cipher.data() : iv;
+        const size_t body_len = cipher_end - cipher_start;
+
+        std::vector<unsigned char> plain(body_len + AES_BLOCK_BYTES);
+        dispatch_cipher(mode, Direction::Decrypt, Padding::None, [&](auto engine_tag) {
+            using Engine = typename decltype(engine_tag)::type;
+            return Engine::process(key, chain, body, body_len, plain.data(), OMP_PARALLEL_MIN_BYTES, executor);
+        });
+        const size_t copy_end = std::min(range_end, cipher_end);
+        std::memcpy(output, plain.data() + (range.offset - cipher_start), copy_end - range.offset);
+        OPENSSL_cleanse(plain.data(), plain.size());
+    }
+    if (range_end > cipher_end) {
+        const size_t missing_start = std::max(range.offset, cipher_end);
+        std::memset(output + (missing_start - range.offset), 0, range_end - missing_start);
+    }
+}
+
+// Decrypts rows [first_row, first_row + row_count) of an encrypted BMP file into a
+// standalone BMP of just those rows (header fields for height and sizes adjusted).
+inline std::vector<unsigned char> decrypt_bmp_rows(const std::string& input_path, const std::string& passphrase,
+                                                   AesMode mode, size_t first_row, size_t row_count,
+                                                   RangeExecutor& executor = OpenMPExecutor::instance()) {
+    int fd = open(input_path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Error: Could not open file for reading: " + input_path);
+    }
+    struct FdGuard {
+        int fd;
+        ~FdGuard() { close(fd); }
+    } guard = {fd};
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        throw std::runtime_error("Error: Could not stat file: " + input_path);
+    }
+    const size_t file_len = static_cast<size_t>(st.st_size);
+    unsigned char fixed_header[BMP_HEADER_SIZE];
+    if (file_len < BMP_HEADER_SIZE) {
+        throw std::runtime_error("Error: Input file is smaller than a typical BMP header.");
+    }
+    pread_exact(fd, fixed_header, BMP_HEADER_SIZE, 0);
+    if (pixel_codec_marked(fixed_header)) {
+        throw std::runtime_error("Error: The image holds a compressed payload; only whole-image decryption supports it.");
+    }
+    const BmpGeometry geometry = read_bmp_geometry(fixed_header, BMP_HEADER_SIZE);
+    if (geometry.pixel_offset >= file_len || geometry.pixel_offset < BMP_HEADER_SIZE) {
+        throw std::runtime_error("Error: Invalid pixel data offset found in BMP header or header too small.");
+    }
+    const PixelByteRange range = rows_to_pixel_range(geometry, first_row, row_count);
+
+    std::vector<unsigned char> output(geometry.pixel_offset + range.length);
+    pread_exact(fd, output.data(), geometry.pixel_offset, 0);
+
+    unsigned char derived_key[AES_KEY_BYTES];
+    unsigned char derived_iv[AES_IV_BYTES];
+    try {
+        derive_image_key_and_iv(passphrase, derived_key, derived_iv, executor);
+        decrypt_pixel_range(fd, geometry.pixel_offset, file_len - geometry.pixel_offset,
+                            derived_key, derived_iv, mode, range, output.data() + geometry.pixel_offset, executor);
+    } catch (...) {
+        OPENSSL_cleanse(derived_key, sizeof(derived_key));
+        OPENSSL_cleanse(derived_iv, sizeof(derived_iv));
+        throw;
+    }
+    OPENSSL_cleanse(derived_key, sizeof(derived_key));
+    OPENSSL_cleanse(derived_iv, sizeof(derived_iv));
+
+    // Header of the cropped image: file size, height (orientation kept) and image size.
+    write_le32(output.data() + 2, static_cast<uint32_t>(output.size()));
+    const int32_t new_height = static_cast<int32_t>(row_count);
+    write_le32(output.data() + 22, static_cast<uint32_t>(geometry.bottom_up ? new_height : -new_height));
+    write_le32(output.data() + 34, static_cast<uint32_t>(range.length));
+    return output;
+}
+
+#endif // ROW_DECRYPT_HPP
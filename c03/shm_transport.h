@@ -0,0 +1,155 @@
+#ifndef SHM_TRANSPORT_H
+#define SHM_TRANSPORT_H
+
+/*
+ * Shared-memory transport between a client (e.g. the JVM) and `image_processor_ssl --serve-shm`.
+ *
+ * One POSIX shared memory object (/dev/shm/<name>) holds:
+ *   - a region header,
+ *   - a request ring  (client -> server, single producer / single consumer),
+ *   - a response ring (server -> client, single producer / single consumer),
+ *   - a payload slab.
+ * Ring entries are fixed 64-byte messages that reference payloads by slab offset, so
+ * image bytes are written once by the client and encrypted in place by the server.
+ * The client owns slab allocation: a payload slot must hold shm_payload_capacity()
+ * bytes. Each ring index doubles as a futex word; a side reads it, and only sleeps
+ * (FUTEX_WAIT) when the ring is empty/full, and a writer only issues FUTEX_WAKE when
+ * the other side has announced it is waiting.
+ *
+ * Plain C with GCC atomic builtins so the same header serves the C++ server and C clients.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "imagecrypt.h" /* Status codes, operations and modes */
+
+#define SHM_TRANSPORT_MAGIC   0x48534349u /* "ICSH" */
+#define SHM_TRANSPORT_VERSION 1u
+#define SHM_RING_SLOTS        64u         /* Power of two */
+#define SHM_SPIN_ITERATIONS   2000        /* Polls before sleeping on the futex */
+
+/* Operation value in a request that asks the server to exit. */
+#define SHM_OP_SHUTDOWN -1
+
+/*
+ * Request: payload_offset/payload_len is the input BMP, payload_capacity the slot size.
+ * key_offset/key_len is the passphrase in the slab.
+ * Response: payload_len is the processed length (written in place at payload_offset), or
+ * on failure status < 0 and the slot holds a NUL-terminated error message.
+ */
+struct shm_message {
+    uint64_t request_id;
+    uint64_t payload_offset;
+    uint64_t payload_len;
+    uint64_t payload_capacity;
+    uint64_t key_offset;
+    uint32_t key_len;
+    int32_t operation;
+    int32_t mode;
+    int32_t status;
+    uint8_t reserved[8];
+};
+
+struct shm_ring {
+    uint32_t head;          /* Next slot the producer writes; futex word for the consumer */
+    uint32_t head_waiters;
+    uint8_t pad0[56];
+    uint32_t tail;          /* Next slot the consumer reads; futex word for the producer */
+    uint32_t tail_waiters;
+    uint8_t pad1[56];
+    struct shm_message slots[SHM_RING_SLOTS];
+};
+
+struct shm_region {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t region_size;
+    uint64_t slab_offset;   /* From the start of the region */
+    uint64_t slab_size;
+    uint8_t pad[32];
+    struct shm_ring requests;
+    struct shm_ring responses;
+};
+
+static inline size_t shm_region_size(size_t slab_size) {
+    return sizeof(struct shm_region) + slab_size;
+}
+
+static inline uint8_t* shm_slab(struct shm_region* region) {
+    return (uint8_t*)region + region->slab_offset;
+}
+
+/*
+ * Slot size a request for this BMP needs: imagecrypt_max_output_size(), or for the
+ * decryption of a compressed encryption ("IZ" in the reserved fields) the decrypted
+ * length its file size field records, if that is larger.
+ */
+static inline size_t shm_payload_capacity(const uint8_t* bmp, size_t bmp_len) {
+    size_t capacity = bmp_len + IMAGECRYPT_OUTPUT_SLACK_BYTES;
+    if (bmp_len >= 10 && bmp[6] == 'I' && bmp[7] == 'Z') {
+        const size_t decrypted_len = (size_t)bmp[2] | (size_t)bmp[3] << 8 | (size_t)bmp[4] << 16 | (size_t)bmp[5] << 24;
+        if (decrypted_len > capacity) capacity = decrypted_len;
+    }
+    return capacity;
+}
+
+/* --- Futex wait/wake on a ring index --- */
+static inline void shm_futex_wait(uint32_t* word, uint32_t* waiters, uint32_t seen) {
+    __atomic_add_fetch(waiters, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(word, __ATOMIC_SEQ_CST) == seen) {
+        syscall(SYS_futex, word, FUTEX_WAIT, seen, NULL, NULL, 0);
+    }
+    __atomic_sub_fetch(waiters, 1, __ATOMIC_SEQ_CST);
+}
+
+static inline void shm_futex_wake(uint32_t* word, uint32_t* waiters) {
+    if (__atomic_load_n(waiters, __ATOMIC_SEQ_CST) != 0) {
+        syscall(SYS_futex, word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+    }
+}
+
+/* --- Ring operations (one producer, one consumer) --- */
+static inline void shm_ring_push(struct shm_ring* ring, const struct shm_message* message) {
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    int spins = 0;
+    for (;;) {
+        uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        if (head - tail < SHM_RING_SLOTS) break;
+        if (++spins < SHM_SPIN_ITERATIONS) continue;
+        shm_futex_wait(&ring->tail, &ring->tail_waiters, tail);
+    }
+    ring->slots[head % SHM_RING_SLOTS] = *message;
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_SEQ_CST);
+    shm_futex_wake(&ring->head, &ring->head_waiters);
+}
+
+static inline void shm_ring_pop(struct shm_ring* ring, struct shm_message* message) {
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    int spins = 0;
+    for (;;) {
+        uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        if (head != tail) break;
+        if (++spins < SHM_SPIN_ITERATIONS) continue;
+        shm_futex_wait(&ring->head, &ring->head_waiters, head);
+    }
+    *message = ring->slots[tail % SHM_RING_SLOTS];
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_SEQ_CST);
+    shm_futex_wake(&ring->tail, &ring->tail_waiters);
+}
+
+/* Non-blocking pop; returns 1 if a message was taken. */
+static inline int shm_ring_try_pop(struct shm_ring* ring, struct shm_message* message) {
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    if (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == tail) return 0;
+    *message = ring->slots[tail % SHM_RING_SLOTS];
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_SEQ_CST);
+    shm_futex_wake(&ring->tail, &ring->tail_waiters);
+    return 1;
+}
+
+#endif /* SHM_TRANSPORT_H */
@@ -4,8 +4,10 @@ import org.springframework.amqp.rabbit.annotation.RabbitListener;
 import org.springframework.stereotype.Component;
 import reactor.core.publisher.Mono;
 import reactor.core.scheduler.Schedulers;
+import reactor.util.function.Tuple2;
 import stud.bratutudor.c03_consumer.config.RabbitMQConfig;
 import stud.bratutudor.c03_consumer.services.ImageProcessingService;
+import stud.bratutudor.c03_consumer.services.NativeImageCrypt;
 import stud.bratutudor.c03_consumer.services.WebClientService;
 import stud.bratutudor.distributedsystems.dto.ImageProcessingRequestDTO;
 
@@ -71,17 +73,43 @@ public class RabbitMQConsumer {
 
 //        webClientService.storeBlobBlocking(result, message.getOriginalFileName());
 
-        Mono<byte[]> processMono1 = Mono.fromCallable(() ->
-                imageProcessingService.processImageWithNativeApp(
-                        fullData,
-                        message.getOriginalFileName(),
-                        message.getMode(),
-                        message.getOperation(),
-                        message.getAes_key()
-                )
+        // Small images stay local: the c04 round trip costs more than the encryption.
+        // Without advice (e.g. the native library is missing) c04 is used as before.
+        boolean localOnly = false;
+        long decisionId = 0;
+        try {
+            NativeImageCrypt.SplitAdvice advice = imageProcessingService.adviseSplit(
+                    fullData.length, message.getMode(), message.getOperation());
+            localOnly = advice.isLocalOnly();
+            decisionId = advice.decisionId();
+        } catch (IOException ex) {
+            System.err.println("Split advice unavailable: " + ex.getMessage());
+        }
+        final long splitDecision = decisionId;
+
+        Mono<byte[]> processMono1 = Mono.fromCallable(() -> {
+                    long start = System.nanoTime();
+                    byte[] result = imageProcessingService.processImageWithNativeApp(
+                            fullData,
+                            message.getOriginalFileName(),
+                            message.getMode(),
+                            message.getOperation(),
+                            message.getAes_key()
+                    );
+                    imageProcessingService.recordTiming(splitDecision, null, message.getMode(), message.getOperation(),
+                            fullData.length, (System.nanoTime() - start) / 1e6);
+                    return result;
+                }
         ).subscribeOn(Schedulers.boundedElastic());  // Non-blocking
 
-        Mono<byte[]> processMono2 = webClientService.sendDataForProcessingInC4(fullData, message);
+        Mono<byte[]> processMono2 = localOnly
+                ? Mono.just(new byte[0])
+                : webClientService.sendDataForProcessingInC4(fullData, message)
+                        .elapsed()
+                        .doOnNext(timed -> imageProcessingService.recordTiming(splitDecision,
+                                WebClientService.C4_BASE_URL, message.getMode(), message.getOperation(),
+                                fullData.length, timed.getT1()))
+                        .map(Tuple2::getT2);
 
         // Zip and process the pipeline
         Mono<Void> pipeline = Mono.zip(processMono1, processMono2)
@@ -0,0 +1,236 @@
+package stud.bratutudor.c03_consumer.services;
+
+import org.springframework.beans.factory.annotation.Value;
+import org.springframework.stereotype.Component;
+
+import java.io.IOException;
+import java.lang.foreign.Arena;
+import java.lang.foreign.FunctionDescriptor;
+import java.lang.foreign.Linker;
+import java.lang.foreign.MemoryLayout;
+import java.lang.foreign.MemorySegment;
+import java.lang.foreign.StructLayout;
+import java.lang.foreign.SymbolLookup;
+import java.lang.invoke.MethodHandle;
+import java.nio.charset.StandardCharsets;
+import java.nio.file.Path;
+import java.util.ArrayList;
+import java.util.Arrays;
+import java.util.List;
+
+import static java.lang.foreign.ValueLayout.ADDRESS;
+import static java.lang.foreign.ValueLayout.JAVA_BYTE;
+import static java.lang.foreign.ValueLayout.JAVA_DOUBLE;
+import static java.lang.foreign.ValueLayout.JAVA_INT;
+import static java.lang.foreign.ValueLayout.JAVA_LONG;
+
+/**
+ * Panama (FFM) binding for libimagecrypt (see openmpi/imagecrypt.h).
+ * The process call is a normal downcall over off-heap segments from a confined arena: the
+ * image is copied in and the result copied out, so the JVM can still reach a safepoint
+ * (and run the GC) while a large image is being processed, and nothing is pinned.
+ */
+@Component
+public class NativeImageCrypt {
+
+    private static final int IMAGECRYPT_OK = 0;
+    private static final int IMAGECRYPT_ENCRYPT = 0;
+    private static final int IMAGECRYPT_DECRYPT = 1;
+    private static final int IMAGECRYPT_MODE_ECB = 0;
+    private static final int IMAGECRYPT_MODE_CBC = 1;
+
+    // imagecrypt_worker and imagecrypt_shard
+    private static final StructLayout WORKER_LAYOUT = MemoryLayout.structLayout(
+            ADDRESS.withName("name"), JAVA_DOUBLE.withName("throughput_mbps"), JAVA_DOUBLE.withName("rtt_ms"));
+    private static final StructLayout SHARD_LAYOUT = MemoryLayout.structLayout(
+            JAVA_LONG.withName("offset"), JAVA_LONG.withName("length"), JAVA_INT.withName("location"),
+            MemoryLayout.paddingLayout(4));
+
+    private final String libraryPath;
+    private volatile Bindings bindings;
+
+    private record Bindings(MethodHandle maxOutputSize, MethodHandle process, MethodHandle lastError,
+                            MethodHandle advise, MethodHandle observe) {
+    }
+
+    /** A remote worker as measured by the caller; 0 throughput / negative RTT mean unknown. */
+    public record RemoteWorker(String name, double throughputMbps, double rttMs) {
+    }
+
+    /** location is -1 for local processing, otherwise an index into the workers passed to advise. */
+    public record Shard(long offset, long length, int location) {
+    }
+
+    public record SplitAdvice(long decisionId, double estimatedMs, List<Shard> shards) {
+        public boolean isLocalOnly() {
+            return shards.stream().allMatch(shard -> shard.location() < 0);
+        }
+    }
+
+    public NativeImageCrypt(@Value("${native.image.crypt.library}") String libraryPath) {
+        this.libraryPath = libraryPath;
+    }
+
+    // The library is bound on first use so the application context starts without it.
+    private Bindings bindings() {
+        Bindings current = bindings;
+        if (current == null) {
+            synchronized (this) {
+                current = bindings;
+                if (current == null) {
+                    current = bind(libraryPath);
+                    bindings = current;
+                }
+            }
+        }
+        return current;
+    }
+
+    private static Bindings bind(String libraryPath) {
+        Linker linker = Linker.nativeLinker();
+        SymbolLookup library = SymbolLookup.libraryLookup(Path.of(libraryPath).toAbsolutePath(), Arena.global());
+
+        MethodHandle maxOutputSize = linker.downcallHandle(
+                library.find("imagecrypt_max_output_size").orElseThrow(),
+                FunctionDescriptor.of(JAVA_LONG, JAVA_LONG));
+        MethodHandle process = linker.downcallHandle(
+                library.find("imagecrypt_process").orElseThrow(),
+                FunctionDescriptor.of(JAVA_INT,
+                        ADDRESS, JAVA_LONG,            // input, input_len
+                        ADDRESS, JAVA_LONG, ADDRESS,   // output, output_capacity, output_len
+                        ADDRESS, JAVA_LONG,            // passphrase, passphrase_len
+                        JAVA_INT, JAVA_INT));          // operation, mode
+        MethodHandle lastError = linker.downcallHandle(
+                library.find("imagecrypt_last_error").orElseThrow(),
+                FunctionDescriptor.of(ADDRESS));
+        MethodHandle advise = linker.downcallHandle(
+                library.find("imagecrypt_advise").orElseThrow(),
+                FunctionDescriptor.of(JAVA_INT,
+                        JAVA_LONG, JAVA_INT, JAVA_INT,          // payload_len, operation, mode
+                        ADDRESS, JAVA_LONG,                     // workers, num_workers
+                        ADDRESS, JAVA_LONG, ADDRESS,            // shards, shard_capacity, num_shards
+                        ADDRESS, ADDRESS));                     // estimated_ms, decision_id
+        MethodHandle observe = linker.downcallHandle(
+                library.find("imagecrypt_observe").orElseThrow(),
+                FunctionDescriptor.of(JAVA_INT,
+                        JAVA_LONG, ADDRESS, JAVA_INT, JAVA_INT, // decision_id, location, operation, mode
+                        JAVA_LONG, JAVA_DOUBLE));               // bytes, elapsed_ms
+        return new Bindings(maxOutputSize, process, lastError, advise, observe);
+    }
+
+    private static int operationCode(String operation) throws IOException {
+        return switch (operation) {
+            case "encrypt" -> IMAGECRYPT_ENCRYPT;
+            case "decrypt" -> IMAGECRYPT_DECRYPT;
+            default -> throw new IOException("Invalid operation. Must be 'encrypt' or 'decrypt'.");
+        };
+    }
+
+    private static int modeCode(String mode) throws IOException {
+        return switch (mode) {
+            case "ECB" -> IMAGECRYPT_MODE_ECB;
+            case "CBC" -> IMAGECRYPT_MODE_CBC;
+            default -> throw new IOException("Invalid mode. Must be 'ECB' or 'CBC'.");
+        };
+    }
+
+    public byte[] process(byte[] imageData, String mode, String operation, String aesKey) throws IOException {
+        int op = operationCode(operation);
+        int nativeMode = modeCode(mode);
+        byte[] passphrase = aesKey.getBytes(StandardCharsets.UTF_8);
+
+        try (Arena arena = Arena.ofConfined()) {
+            Bindings lib = bindings();
+            long capacity = (long) lib.maxOutputSize().invokeExact((long) imageData.length);
+            MemorySegment input = arena.allocate(Math.max(1, imageData.length));
+            MemorySegment.copy(imageData, 0, input, JAVA_BYTE, 0, imageData.length);
+            MemorySegment output = arena.allocate(capacity);
+            MemorySegment outputLen = arena.allocate(JAVA_LONG);
+            MemorySegment nativePassphrase = arena.allocate(Math.max(1, passphrase.length));
+            MemorySegment.copy(passphrase, 0, nativePassphrase, JAVA_BYTE, 0, passphrase.length);
+            try {
+                int status = (int) lib.process().invokeExact(
+                        input, (long) imageData.length,
+                        output, capacity, outputLen,
+                        nativePassphrase, (long) passphrase.length,
+                        op, nativeMode);
+                if (status != IMAGECRYPT_OK) {
+                    throw new IOException("Native image processing failed with status " + status + ": " + lastErrorMessage(lib));
+                }
+                return output.asSlice(0, outputLen.get(JAVA_LONG, 0)).toArray(JAVA_BYTE);
+            } finally {
+                nativePassphrase.fill((byte) 0);
+            }
+        } catch (IOException e) {
+            throw e;
+        } catch (Throwable t) {
+            throw new IOException("Native image processing call failed", t);
+        } finally {
+            Arrays.fill(passphrase, (byte) 0);
+        }
+    }
+
+    /**
+     * Asks the native cost model how to split payloadLength bytes between this service and
+     * the workers. Report the measured times back with {@link #observe} so it keeps learning.
+     */
+    public SplitAdvice advise(long payloadLength, String mode, String operation, List<RemoteWorker> workers)
+            throws IOException {
+        int op = operationCode(operation);
+        int nativeMode = modeCode(mode);
+        try (Arena arena = Arena.ofConfined()) {
+            Bindings lib = bindings();
+            MemorySegment nativeWorkers = arena.allocate(WORKER_LAYOUT, Math.max(1, workers.size()));
+            for (int i = 0; i < workers.size(); i++) {
+                MemorySegment entry = nativeWorkers.asSlice(i * WORKER_LAYOUT.byteSize(), WORKER_LAYOUT);
+                entry.set(ADDRESS, 0, arena.allocateFrom(workers.get(i).name()));
+                entry.set(JAVA_DOUBLE, 8, workers.get(i).throughputMbps());
+                entry.set(JAVA_DOUBLE, 16, workers.get(i).rttMs());
+            }
+            long capacity = workers.size() + 1;
+            MemorySegment shards = arena.allocate(SHARD_LAYOUT, capacity);
+            MemorySegment numShards = arena.allocate(JAVA_LONG);
+            MemorySegment estimatedMs = arena.allocate(JAVA_DOUBLE);
+            MemorySegment decisionId = arena.allocate(JAVA_LONG);
+            int status = (int) lib.advise().invokeExact(payloadLength, op, nativeMode,
+                    nativeWorkers, (long) workers.size(), shards, capacity, numShards, estimatedMs, decisionId);
+            if (status != IMAGECRYPT_OK) {
+                throw new IOException("Split advice failed with status " + status + ": " + lastErrorMessage(lib));
+            }
+            List<Shard> result = new ArrayList<>();
+            for (long i = 0; i < numShards.get(JAVA_LONG, 0); i++) {
+                MemorySegment shard = shards.asSlice(i * SHARD_LAYOUT.byteSize(), SHARD_LAYOUT);
+                result.add(new Shard(shard.get(JAVA_LONG, 0), shard.get(JAVA_LONG, 8), shard.get(JAVA_INT, 16)));
+            }
+            return new SplitAdvice(decisionId.get(JAVA_LONG, 0), estimatedMs.get(JAVA_DOUBLE, 0), result);
+        } catch (IOException e) {
+            throw e;
+        } catch (Throwable t) {
+            throw new IOException("Split advice call failed", t);
+        }
+    }
+
+    /** Reports a measured phase: location is null for local processing, otherwise a worker name. */
+    public void observe(long decisionId, String location, String mode, String operation, long bytes, double elapsedMs)
+            throws IOException {
+        int op = operationCode(operation);
+        int nativeMode = modeCode(mode);
+        try (Arena arena = Arena.ofConfined()) {
+            Bindings lib = bindings();
+            MemorySegment nativeLocation = location == null ? MemorySegment.NULL : arena.allocateFrom(location);
+            int status = (int) lib.observe().invokeExact(decisionId, nativeLocation, op, nativeMode, bytes, elapsedMs);
+            if (status != IMAGECRYPT_OK) {
+                throw new IOException("Split observation failed with status " + status + ": " + lastErrorMessage(lib));
+            }
+        } catch (IOException e) {
+            throw e;
+        } catch (Throwable t) {
+            throw new IOException("Split observation call failed", t);
+        }
+    }
+
+    private static String lastErrorMessage(Bindings lib) throws Throwable {
+        MemorySegment message = (MemorySegment) lib.lastError().invokeExact();
+        return message.reinterpret(Long.MAX_VALUE).getString(0);
+    }
+}
@@ -10,6 +10,8 @@ import java.util.Map;
 
 @Service
 public class WebClientService {
+    public static final String C4_BASE_URL = "http://con04:8084";
+
     private final WebClient webClient;
 
     public static String getUuidFromString(String inputString) {
@@ -81,7 +83,7 @@ public class WebClientService {
 
     public Mono<byte[]> sendDataForProcessingInC4(byte[] data, ImageProcessingRequestDTO requestDTO){
         requestDTO.setImageData(data);
-        return webClient.post().uri("http://con04:8084/sendData").bodyValue(requestDTO).retrieve().bodyToMono(byte[].class);
+        return webClient.post().uri(C4_BASE_URL + "/sendData").bodyValue(requestDTO).retrieve().bodyToMono(byte[].class);
 
     }
     /**
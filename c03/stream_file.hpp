@@ -0,0 +1,453 @@
+#ifndef STREAM_FILE_HPP
+#define STREAM_FILE_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <future>    // For std::async (read-ahead)
+#include <stdexcept> // For std::runtime_error
+#include <cstdint>
+#include <cstring>   // For memcpy, memcmp, strerror
+#include <cerrno>
+#include <algorithm> // For std::min
+
+#include <fcntl.h>    // For open
+#include <sys/stat.h> // For fstat
+#include <unistd.h>   // For pread, write, close
+
+#include "cipher_engine.hpp"    // AES engine, executors
+#include "image_pipeline.hpp"   // BMP layout, pixel modes
+#include "integrity_digest.hpp" // CRC32C and the digesting cipher pass
+#include "result_cache.hpp"     // For env_size
+
+// File-to-file processing for images too large to hold in memory (whole-slide scans
+// run past 4 GB). The pixel data is read, ciphered and written in windows of
+// IMAGE_PROCESSOR_STREAM_WINDOW_MB (default STREAM_DEFAULT_WINDOW_MB). Memory stays at
+// three windows whatever the file size: the window being ciphered, the next one being
+// read ahead, and the output. AsyncRuntime::process (and with it the CLI) switches to
+// this path for ECB and CBC inputs of IMAGE_PROCESSOR_STREAM_THRESHOLD_MB (default
+// STREAM_DEFAULT_THRESHOLD_MB) or more.
+//
+// Each window runs through the same digesting pass as an in-memory image (split across
+// the executor where the mode allows). CBC decryption carries the last ciphertext block
+// of a window into the next one. CBC encryption keeps one engine across all windows.
+// The output is identical to process_image_buffer. It is written to <output>.partial
+// and renamed when complete, so a failure (e.g. bad CBC padding in the last window)
+// leaves no truncated output behind.
+//
+// Checkpoints: every IMAGE_PROCESSOR_CHECKPOINT_MB (default STREAM_DEFAULT_CHECKPOINT_MB,
+// 0 turns them off) the partial output is synced and <output>.journal records how far
+// it got: the pixel offset, the output length, the chain block and the running CRCs.
+// A run that is killed (timeout, container restart, OOM) leaves both behind. Running
+// it again with the same arguments continues from the last checkpoint and produces
+// the same output as an uninterrupted run. The journal is bound to the input file's
+// size and modification time and to the key, so any other run ignores it and starts
+// over. I/O errors (ENOSPC, EIO) keep both as well, since a rerun may get past them;
+// errors that would recur on a rerun (bad padding, i.e. a wrong key or damaged data)
+// remove both files.
+
+const size_t STREAM_DEFAULT_WINDOW_MB = 64;
+const size_t STREAM_DEFAULT_THRESHOLD_MB = 1024;
+const size_t STREAM_DEFAULT_CHECKPOINT_MB = 256;
+
+struct StreamedImage {
+    uint64_t input_len;  // Whole input file
+    uint64_t output_len; // Whole output file
+    uint32_t input_crc;  // CRC32C of the input file
+    uint32_t output_crc; // CRC32C of the output file
+    uint64_t resumed_at; // Pixel bytes taken over from an earlier run's checkpoint
+};
+
+// <output>.journal (host byte order). Fields up to journal_crc are covered by it.
+struct StreamJournal {
+    unsigned char magic[8];
+    uint32_t version;
+    uint32_t mode;
+    uint32_t direction;
+    uint32_t reserved;
+    uint64_t input_size;
+    int64_t input_mtime_ns;
+    unsigned char key_check[16];        // SHA-256 of a label, the key and the IV (truncated)
+    uint64_t pixel_offset;              // Pixel input bytes processed
+    uint64_t output_len;                // Output bytes written and synced, header included
+    unsigned char chain[AES_BLOCK_BYTES]; // CBC chain block for the next window
+    uint32_t input_crc;                 // Pixel input so far
+    uint32_t output_crc;                // Pixel output so far
+    uint32_t journal_crc;
+};
+
+const unsigned char STREAM_JOURNAL_MAGIC[8] = {'I', 'C', 'J', 'O', 'U', 'R', 'N', 'L'};
+const uint32_t STREAM_JOURNAL_VERSION = 1;
+
+namespace stream_file_detail {
+
+class InputFile {
+public:
+    explicit InputFile(const std::string& path) : path_(path), fd_(open(path.c_str(), O_RDONLY | O_CLOEXEC)) {
+        if (fd_ < 0) {
+            throw std::runtime_error("Error: Could not open file for reading: " + path);
+        }
+        struct stat st;
+        if (fstat(fd_, &st) != 0) {
+            close(fd_);
+            throw std::runtime_error("Error: Could not stat file: " + path);
+        }
+        size_ = static_cast<uint64_t>(st.st_size);
+        mtime_ns_ = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+        posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+    ~InputFile() { close(fd_); }
+
+    InputFile(const InputFile&) = delete;
+    InputFile& operator=(const InputFile&) = delete;
+
+    uint64_t size() const { return size_; }
+    int64_t mtime_ns() const { return mtime_ns_; }
+
+    // Reads exactly len bytes at offset (the caller stays within the file).
+    void read_at(uint64_t offset, unsigned char* out, size_t len) const {
+        while (len > 0) {
+            ssize_t n = pread(fd_, out, len, static_cast<off_t>(offset));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                throw std::runtime_error("Error: Could not read file: " + path_);
+            }
+            out += n;
+            offset += static_cast<uint64_t>(n);
+            len -= static_cast<size_t>(n);
+        }
+    }
+
+private:
+    std::string path_;
+    int fd_;
+    uint64_t size_;
+    int64_t mtime_ns_;
+};
+
+// Written under a temporary name; commit() puts it in place. Otherwise the partial
+// file stays behind for a rerun once a checkpoint points into it, and is removed if
+// none does; discard() removes it and the journal either way. resume_len > 0
+// continues an existing (checkpointed) partial file from there.
+class OutputFile {
+public:
+    OutputFile(const std::string& path, uint64_t resume_len)
+        : path_(path), partial_path_(path + ".partial"), journal_path_(path + ".journal"),
+          checkpointed_(resume_len > 0),
+          fd_(open(partial_path_.c_str(), O_WRONLY | O_CREAT | (resume_len > 0 ? 0 : O_TRUNC) | O_CLOEXEC, 0644)) {
+        if (fd_ < 0) {
+            throw std::runtime_error("Error: Could not open file for writing: " + path);
+        }
+        // A journal that is not being resumed no longer describes the partial file.
+        if (resume_len == 0) unlink(journal_path_.c_str());
+        if (resume_len > 0 && (ftruncate(fd_, static_cast<off_t>(resume_len)) != 0 ||
+                               lseek(fd_, static_cast<off_t>(resume_len), SEEK_SET) < 0)) {
+            close(fd_);
+            throw std::runtime_error("Error: Could not resume partial output: " + partial_path_);
+        }
+    }
+    ~OutputFile() {
+        if (fd_ >= 0) {
+            close(fd_);
+            if (!checkpointed_) unlink(partial_path_.c_str());
+        }
+    }
+
+    const std::string& journal_path() const { return journal_path_; }
+
+    // A journal now points into the partial file (save_journal).
+    void mark_checkpointed() { checkpointed_ = true; }
+
+    // For failures that would recur on a rerun: nothing is left to resume.
+    void discard() {
+        close(fd_);
+        fd_ = -1;
+        unlink(partial_path_.c_str());
+        unlink(journal_path_.c_str());
+    }
+
+    // Everything written so far is on disk before a journal points past it.
+    void sync() {
+        if (fdatasync(fd_) != 0) {
+            throw std::runtime_error("Error: Could not sync partial output: " + partial_path_ + ": " + std::strerror(errno));
+        }
+    }
+
+    OutputFile(const OutputFile&) = delete;
+    OutputFile& operator=(const OutputFile&) = delete;
+
+    void write_all(const unsigned char* data, size_t len) {
+        while (len > 0) {
+            ssize_t n = write(fd_, data, len);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                throw std::runtime_error("Error: Could not write to file: " + path_ + ": " + std::strerror(errno));
+            }
+            data += n;
+            len -= static_cast<size_t>(n);
+        }
+    }
+
+    void commit() {
+        const int status = close(fd_);
+        fd_ = -1;
+        if (status != 0 || rename(partial_path_.c_str(), path_.c_str()) != 0) {
+            unlink(partial_path_.c_str());
+            unlink(journal_path_.c_str());
+            throw std::runtime_error("Error: Could not write to file: " + path_);
+        }
+        unlink(journal_path_.c_str());
+    }
+
+private:
+    std::string path_;
+    std::string partial_path_;
+    std::string journal_path_;
+    bool checkpointed_;
+    int fd_;
+};
+
+// --- Checkpoint Journal ---
+inline void journal_key_check(const unsigned char* key, const unsigned char* iv, unsigned char* check) {
+    static const char label[] = "image stream journal";
+    unsigned char material[sizeof(label) + AES_KEY_BYTES + AES_IV_BYTES];
+    std::memcpy(material, label, sizeof(label));
+    std::memcpy(material + sizeof(label), key, AES_KEY_BYTES);
+    std::memcpy(material + sizeof(label) + AES_KEY_BYTES, iv, AES_IV_BYTES);
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int digest_len = 0;
+    if (EVP_Digest(material, sizeof(material), digest, &digest_len, fetched_digest("SHA256"), NULL) != 1) {
+        OPENSSL_cleanse(material, sizeof(material));
+        handle_openssl_errors("Journal key check derivation failed: ");
+    }
+    OPENSSL_cleanse(material, sizeof(material));
+    std::memcpy(check, digest, sizeof(StreamJournal::key_check));
+}
+
+inline uint32_t journal_crc(const StreamJournal& journal) {
+    return crc32c(reinterpret_cast<const unsigned char*>(&journal), offsetof(StreamJournal, journal_crc));
+}
+
+// The journal of an earlier run of this job, if there is a usable one: same input file,
+// mode, direction and key, and a partial output at least as long as it records.
+inline bool load_journal(const std::string& output_path, const StreamJournal& expected, StreamJournal& journal) {
+    int fd = open((output_path + ".journal").c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    const bool complete = read(fd, &journal, sizeof(journal)) == static_cast<ssize_t>(sizeof(journal));
+    close(fd);
+    struct stat st;
+    return complete && journal_crc(journal) == journal.journal_crc &&
+           std::memcmp(&journal, &expected, offsetof(StreamJournal, pixel_offset)) == 0 &&
+           stat((output_path + ".partial").c_str(), &st) == 0 && static_cast<uint64_t>(st.st_size) >= journal.output_len;
+}
+
+// Replaces the journal atomically (temporary file, fsync, rename, directory fsync).
+inline void save_journal(OutputFile& output, StreamJournal journal) {
+    journal.journal_crc = journal_crc(journal);
+    const std::string temp_path = output.journal_path() + ".tmp";
+    int fd = open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    const bool written = fd >= 0 && write(fd, &journal, sizeof(journal)) == static_cast<ssize_t>(sizeof(journal)) &&
+                         fsync(fd) == 0;
+    if (fd >= 0) close(fd);
+    if (!written || rename(temp_path.c_str(), output.journal_path().c_str()) != 0) {
+        unlink(temp_path.c_str());
+        throw std::runtime_error("Error: Could not write checkpoint journal: " + output.journal_path());
+    }
+    const std::string& journal_path = output.journal_path();
+    const size_t slash = journal_path.rfind('/');
+    const std::string dir = slash == std::string::npos ? "." : slash == 0 ? "/" : journal_path.substr(0, slash);
+    int dir_fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd >= 0) {
+        fsync(dir_fd);
+        close(dir_fd);
+    }
+    output.mark_checkpointed();
+}
+
+// Header bytes and layout, checked exactly as locate_pixel_data checks a whole image.
+inline BmpLayout read_layout(const InputFile& input, Direction direction, std::vector<unsigned char>& header) {
+    header.resize(static_cast<size_t>(std::min<uint64_t>(input.size(), BMP_HEADER_SIZE)));
+    input.read_at(0, header.data(), header.size());
+    if (header.size() == BMP_HEADER_SIZE) {
+        // The header plus one pixel byte is all locate_pixel_data needs to see.
+        const uint64_t needed = static_cast<uint64_t>(get_pixel_data_offset(header.data(), header.size())) + 1;
+        header.resize(static_cast<size_t>(std::min(input.size(), std::max<uint64_t>(needed, BMP_HEADER_SIZE))));
+        input.read_at(0, header.data(), header.size());
+    }
+    BmpLayout layout = locate_pixel_data(header.data(), header.size(), direction);
+    layout.pixel_len = input.size() - layout.header_len;
+    header.resize(layout.header_len);
+    return layout;
+}
+
+} // namespace stream_file_detail
+
+inline uint64_t stream_checkpoint_bytes() {
+    return static_cast<uint64_t>(env_size("IMAGE_PROCESSOR_CHECKPOINT_MB", STREAM_DEFAULT_CHECKPOINT_MB)) * 1024 * 1024;
+}
+
+inline size_t stream_window_bytes() {
+    const size_t window = env_size("IMAGE_PROCESSOR_STREAM_WINDOW_MB", STREAM_DEFAULT_WINDOW_MB) * 1024 * 1024;
+    return std::max<size_t>(window, 1024 * 1024);
+}
+
+// True if this file should be streamed instead of read whole. A file that
+// cannot be examined is left to the in-memory path, which reports the error.
+inline bool stream_file_enabled(const std::string& path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return false;
+    return static_cast<uint64_t>(st.st_size) >=
+           env_size("IMAGE_PROCESSOR_STREAM_THRESHOLD_MB", STREAM_DEFAULT_THRESHOLD_MB) * 1024 * 1024;
+}
+
+// Mode a streamed run would use: AUTO resolves as in resolve_pixel_mode (decryption
+// looks at the file's trailer). Returns false if the file must be processed in memory:
+// GCM and ChaCha20 (tag and trailer handling), ECB dedup, or a decryption of a
+// compressed payload (marked in the header).
+inline bool streamable_pixel_mode(const std::string& input_path, AesMode& mode, Direction direction) {
+    using namespace stream_file_detail;
+    InputFile input(input_path);
+    std::vector<unsigned char> header;
+    const BmpLayout layout = read_layout(input, direction, header);
+    if (mode == AesMode::AUTO) {
+        unsigned char tail[CHACHA20_TRAILER_BYTES];
+        const size_t tail_len = static_cast<size_t>(std::min<uint64_t>(layout.pixel_len, sizeof(tail)));
+        input.read_at(input.size() - tail_len, tail, tail_len);
+        mode = direction == Direction::Encrypt ? auto_encrypt_mode()
+             : chacha20_payload(tail, tail_len) ? AesMode::CHACHA20 : AesMode::CBC;
+    }
+    if (mode != AesMode::CBC && (mode != AesMode::ECB || ecb_dedup_enabled())) return false;
+    return layout.codec == PixelCodec::None;
+}
+
+// Processes input_path into output_path window by window (ECB or CBC; see
+// streamable_pixel_mode). Same output as process_image_buffer. With checkpoint_bytes > 0
+// a journal is kept, and a matching journal from an interrupted run is resumed.
+inline StreamedImage process_image_file_streamed(const std::string& input_path, const std::string& output_path,
+                                                 const unsigned char* key, const unsigned char* iv,
+                                                 AesMode mode, Direction direction, size_t window_bytes,
+                                                 uint64_t checkpoint_bytes = 0,
+                                                 RangeExecutor& executor = OpenMPExecutor::instance()) {
+    using namespace stream_file_detail;
+    if (mode != AesMode::ECB && mode != AesMode::CBC) {
+        throw std::runtime_error("Error: Streamed processing supports ECB and CBC.");
+    }
+    InputFile input(input_path);
+    std::vector<unsigned char> header;
+    const BmpLayout layout = read_layout(input, direction, header);
+    const uint64_t pixel_len = layout.pixel_len;
+    const uint64_t input_len = pixel_cipher_input_len(mode, pixel_len);
+    const size_t window = std::max<size_t>(window_bytes / AES_BLOCK_BYTES * AES_BLOCK_BYTES, AES_BLOCK_BYTES);
+
+    // --- Checkpoint Journal ---
+    StreamJournal journal = {};
+    std::memcpy(journal.magic, STREAM_JOURNAL_MAGIC, sizeof(journal.magic));
+    journal.version = STREAM_JOURNAL_VERSION;
+    journal.mode = static_cast<uint32_t>(mode);
+    journal.direction = static_cast<uint32_t>(direction);
+    journal.input_size = input.size();
+    journal.input_mtime_ns = input.mtime_ns();
+    journal_key_check(key, iv, journal.key_check);
+    journal.output_len = header.size();
+    std::memcpy(journal.chain, iv, AES_BLOCK_BYTES);
+    StreamJournal previous;
+    const bool resume = checkpoint_bytes > 0 && load_journal(output_path, journal, previous);
+    if (resume) journal = previous;
+
+    OutputFile output(output_path, resume ? journal.output_len : 0);
+    if (!resume) output.write_all(header.data(), header.size());
+    StreamedImage result;
+    result.input_len = input.size();
+    result.output_len = journal.output_len;
+    result.resumed_at = journal.pixel_offset;
+    const uint32_t header_crc = crc32c(header.data(), header.size());
+    uint32_t input_crc = journal.input_crc;
+    uint32_t output_crc = journal.output_crc;
+
+    std::vector<unsigned char> buffers[2] = {std::vector<unsigned char>(window), std::vector<unsigned char>(window)};
+    std::vector<unsigned char> out(window + AES_BLOCK_BYTES);
+    unsigned char chain[AES_BLOCK_BYTES];
+    std::memcpy(chain, journal.chain, AES_BLOCK_BYTES);
+    // A fresh engine over the last ciphertext block continues the chain exactly, since
+    // every window before the last is whole blocks.
+    std::unique_ptr<CipherEngine<AesMode::CBC, Direction::Encrypt, Padding::PKCS7>> chained;
+    if (mode == AesMode::CBC && direction == Direction::Encrypt) {
+        chained.reset(new CipherEngine<AesMode::CBC, Direction::Encrypt, Padding::PKCS7>(key, chain));
+    }
+    uint64_t checkpointed = journal.pixel_offset;
+
+    auto read_window = [&](uint64_t offset, int slot) {
+        const size_t len = static_cast<size_t>(std::min<uint64_t>(window, pixel_len - offset));
+        input.read_at(layout.header_len + offset, buffers[slot].data(), len);
+        return len;
+    };
+    uint64_t offset = journal.pixel_offset;
+    std::future<size_t> next = std::async(std::launch::async, read_window, offset, 0);
+    int slot = 0;
+    // One pass even for an empty payload, so CBC decryption still reports it.
+    do {
+        const size_t len = next.get();
+        const unsigned char* in = buffers[slot].data();
+        const bool last = offset + len == pixel_len;
+        if (!last) next = std::async(std::launch::async, read_window, offset + len, 1 - slot);
+
+        // ECB leaves a trailing partial block out of the cipher (and the output).
+        const size_t cipher_len = static_cast<size_t>(std::min<uint64_t>(len, input_len - std::min(input_len, offset)));
+        PixelPassDigests digests;
+        size_t out_len;
+        try {
+            if (chained) {
+                digest_pass_detail::RangeDigest digest = digest_pass_detail::stream_range(*chained, in, cipher_len, out.data());
+                digests.input_crc = digest.input_crc;
+                digests.output_crc = digest.output_crc;
+                out_len = digest.len;
+                if (last) {
+                    const size_t tail = chained->finish(out.data() + out_len);
+                    digests.output_crc = crc32c_update(digests.output_crc, out.data() + out_len, tail);
+                    out_len += tail;
+                }
+            } else {
+                const Padding padding = last ? pixel_padding(mode) : Padding::None;
+                out_len = dispatch_cipher(mode, direction, padding, [&](auto engine_tag) {
+                    using Engine = typename decltype(engine_tag)::type;
+                    return digest_pass_detail::digest_pass<Engine::mode, Engine::direction, Engine::padding>(
+                        key, mode == AesMode::ECB ? NULL : chain, in, cipher_len, out.data(), digests, executor);
+                });
+            }
+        } catch (...) {
+            // Cipher errors (bad padding) come back on every rerun.
+            output.discard();
+            throw;
+        }
+        // CBC chains on ciphertext: the output when encrypting, the input when decrypting.
+        const unsigned char* ciphertext = direction == Direction::Encrypt ? out.data() : in;
+        if (cipher_len >= AES_BLOCK_BYTES) std::memcpy(chain, ciphertext + cipher_len - AES_BLOCK_BYTES, AES_BLOCK_BYTES);
+        digests.input_crc = crc32c_update(digests.input_crc, in + cipher_len, len - cipher_len);
+        input_crc = crc32c_combine(input_crc, digests.input_crc, len);
+        output_crc = crc32c_combine(output_crc, digests.output_crc, out_len);
+        output.write_all(out.data(), out_len);
+        result.output_len += out_len;
+        offset += len;
+        slot = 1 - slot;
+
+        if (checkpoint_bytes > 0 && !last && offset - checkpointed >= checkpoint_bytes) {
+            output.sync();
+            journal.pixel_offset = offset;
+            journal.output_len = result.output_len;
+            std::memcpy(journal.chain, chain, AES_BLOCK_BYTES);
+            journal.input_crc = input_crc;
+            journal.output_crc = output_crc;
+            save_journal(output, journal);
+            checkpointed = offset;
+        }
+    } while (offset < pixel_len);
+
+    OPENSSL_cleanse(chain, sizeof(chain));
+    OPENSSL_cleanse(&journal, sizeof(journal));
+    output.commit();
+    result.input_crc = crc32c_combine(header_crc, input_crc, pixel_len);
+    result.output_crc = crc32c_combine(header_crc, output_crc, result.output_len - header.size());
+    return result;
+}
+
+#endif // STREAM_FILE_HPP
@@ -0,0 +1,604 @@
+#ifndef WORK_COORDINATOR_HPP
+#define WORK_COORDINATOR_HPP
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <set>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>    // For the task deadlines
+#include <stdexcept> // For std::runtime_error
+#include <cstring>   // For memcpy, strerror
+#include <cerrno>
+#include <algorithm> // For std::min
+
+#include <arpa/inet.h>   // For inet_ntop
+#include <netdb.h>       // For getaddrinfo
+#include <netinet/in.h>
+#include <netinet/tcp.h> // For TCP_NODELAY, TCP_KEEP*
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>     // For iovec
+#include <unistd.h>
+
+#include <openssl/crypto.h> // For OPENSSL_cleanse
+
+#include "cipher_engine.hpp"  // AES engine, OpenSSL runtime and error handling
+#include "image_pipeline.hpp" // BMP parsing, key derivation and the pixel cipher pass
+#include "result_cache.hpp"   // For env_size
+#include "tcp_listener.hpp"   // For listen_tcp
+
+// Multi-process processing of one image: a coordinator (--coordinate) cuts the pixel
+// data into block-aligned tasks of COORDINATOR_DEFAULT_TASK_BYTES
+// (IMAGE_PROCESSOR_TASK_BYTES), and any number of workers (--work) connect over TCP and
+// pull tasks. Each worker announces how many tasks it runs at once and gets a new task
+// for every result it returns, so faster nodes take more of the image. Tasks held by a
+// worker whose connection drops (TCP keepalive and send/receive timeouts notice dead
+// peers) go back to the front of the queue. A worker that stays connected but stalls
+// keeps its tasks, so once the queue is empty, a task that has been out for
+// IMAGE_PROCESSOR_TASK_TIMEOUT_MS (default COORDINATOR_DEFAULT_TASK_TIMEOUT_MS) is sent
+// again to a worker with a free slot, at most once per timeout. The first result for
+// a task is kept; later copies are ignored. Results are written in place at their task
+// offset, so the output (header included) matches process_image_buffer.
+//
+// ECB and CBC decryption split freely: a CBC decryption task carries the ciphertext
+// block before it as its chain block. CBC encryption is one chain and runs as a single
+// task. GCM, ChaCha20 and AUTO are not distributed.
+//
+// Workers receive the derived key, not the passphrase, but the protocol itself is
+// neither encrypted nor authenticated: run it on loopback or a trusted network. The
+// coordinator binds to 127.0.0.1 unless IMAGE_PROCESSOR_COORDINATOR_BIND says otherwise.
+// Frames are in host byte order; coordinator and workers must share it.
+//
+// Frame: coordinator_frame header, then payload_len bytes.
+//   HELLO  worker -> coordinator  payload: version, slots (uint32 each)
+//   JOB    coordinator -> worker  payload: mode, direction (uint32 each), key
+//   TASK   coordinator -> worker  payload: final flag (uint32), chain block, input
+//   RESULT worker -> coordinator  payload: output of the task
+//   FAILED worker -> coordinator  payload: error message (e.g. bad CBC padding)
+//   DONE   coordinator -> worker  the job is complete; the worker reconnects for the next
+
+const size_t COORDINATOR_DEFAULT_TASK_BYTES = 1024 * 1024;
+const size_t COORDINATOR_DEFAULT_TASK_TIMEOUT_MS = 10000;
+const uint32_t COORDINATOR_MAGIC = 0x4b535443u; // "CTSK"
+const uint32_t COORDINATOR_VERSION = 1;
+
+struct coordinator_frame {
+    uint32_t magic;
+    uint32_t type;
+    uint64_t task_id;
+    uint64_t payload_len;
+};
+
+enum CoordinatorFrameType : uint32_t {
+    FRAME_HELLO = 1,
+    FRAME_JOB = 2,
+    FRAME_TASK = 3,
+    FRAME_RESULT = 4,
+    FRAME_FAILED = 5,
+    FRAME_DONE = 6
+};
+
+namespace coordinator_detail {
+
+const int KEEPALIVE_IDLE_SECONDS = 5;
+const int KEEPALIVE_INTERVAL_SECONDS = 2;
+const int KEEPALIVE_COUNT = 3;
+const int IO_TIMEOUT_SECONDS = 60;
+const int MAX_POLL_MS = 1000; // Longest wait before overdue tasks are checked
+const uint64_t MAX_PAYLOAD_BYTES = 1ULL << 30;
+
+// Dead peers are noticed within seconds instead of the TCP default of hours.
+inline void configure_socket(int fd) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof(one));
+    int idle = KEEPALIVE_IDLE_SECONDS, interval = KEEPALIVE_INTERVAL_SECONDS, count = KEEPALIVE_COUNT;
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(count));
+    timeval timeout = {IO_TIMEOUT_SECONDS, 0};
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+}
+
+// Sends a frame with one sendmsg per pass, so header and payload leave together.
+inline bool send_frame(int fd, uint32_t type, uint64_t task_id, std::vector<iovec> payload) {
+    coordinator_frame header;
+    header.magic = COORDINATOR_MAGIC;
+    header.type = type;
+    header.task_id = task_id;
+    header.payload_len = 0;
+    for (const iovec& part : payload) header.payload_len += part.iov_len;
+    payload.insert(payload.begin(), iovec{&header, sizeof(header)});
+    size_t first = 0;
+    while (first < payload.size()) {
+        msghdr message = {};
+        message.msg_iov = payload.data() + first;
+        message.msg_iovlen = payload.size() - first;
+        ssize_t n = sendmsg(fd, &message, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        size_t sent = static_cast<size_t>(n);
+        while (first < payload.size() && sent >= payload[first].iov_len) {
+            sent -= payload[first].iov_len;
+            ++first;
+        }
+        if (first < payload.size()) {
+            payload[first].iov_base = static_cast<char*>(payload[first].iov_base) + sent;
+            payload[first].iov_len -= sent;
+        }
+    }
+    return true;
+}
+
+inline bool read_exact(int fd, void* out, size_t len) {
+    char* p = static_cast<char*>(out);
+    while (len > 0) {
+        ssize_t n = recv(fd, p, len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// False if the connection ended or the frame is malformed.
+inline bool read_frame(int fd, coordinator_frame& header, std::vector<unsigned char>& payload) {
+    if (!read_exact(fd, &header, sizeof(header))) return false;
+    if (header.magic != COORDINATOR_MAGIC || header.payload_len > MAX_PAYLOAD_BYTES) return false;
+    payload.resize(header.payload_len);
+    return read_exact(fd, payload.data(), payload.size());
+}
+
+struct JobSpec {
+    uint32_t mode;
+    uint32_t direction;
+    unsigned char key[AES_KEY_BYTES];
+};
+
+struct TaskPrefix {
+    uint32_t final;
+    unsigned char chain[AES_BLOCK_BYTES];
+};
+
+// --- Coordinator ---
+typedef std::chrono::steady_clock TaskClock;
+
+struct Task {
+    size_t begin;
+    size_t end;
+    bool final;   // Carries the CBC padding
+    bool done;
+    size_t copies;                  // Workers holding the task
+    TaskClock::time_point sent_at;  // Last dispatch
+};
+
+struct WorkerConnection {
+    int fd;
+    std::string name;
+    size_t slots;            // 0 until HELLO
+    std::set<size_t> tasks;  // In flight on this worker
+    size_t completed;
+    bool dead;
+
+    WorkerConnection(int socket_fd, const std::string& peer)
+        : fd(socket_fd), name(peer), slots(0), completed(0), dead(false) {}
+};
+
+inline std::string peer_name(const sockaddr_in& address) {
+    char text[INET_ADDRSTRLEN] = "?";
+    inet_ntop(AF_INET, &address.sin_addr, text, sizeof(text));
+    return std::string(text) + ":" + std::to_string(ntohs(address.sin_port));
+}
+
+class Coordinator {
+public:
+    Coordinator(const unsigned char* pixels, unsigned char* out, const unsigned char* key, const unsigned char* iv,
+                AesMode mode, Direction direction, std::vector<Task> tasks, TaskClock::duration task_timeout)
+        : pixels_(pixels), out_(out), key_(key), iv_(iv), mode_(mode), direction_(direction),
+          tasks_(std::move(tasks)), task_timeout_(task_timeout), remaining_(tasks_.size()), output_end_(0) {
+        for (size_t i = 0; i < tasks_.size(); ++i) pending_.push_back(i);
+    }
+
+    // Serves workers on listen_fd until every task is done; returns the output length.
+    size_t run(int listen_fd) {
+        const int poll_ms = static_cast<int>(std::max<long long>(1, std::min<long long>(
+            MAX_POLL_MS, std::chrono::duration_cast<std::chrono::milliseconds>(task_timeout_).count())));
+        while (remaining_ > 0) {
+            std::vector<pollfd> fds(1 + workers_.size());
+            fds[0] = pollfd{listen_fd, POLLIN, 0};
+            for (size_t w = 0; w < workers_.size(); ++w) fds[w + 1] = pollfd{workers_[w]->fd, POLLIN, 0};
+            if (poll(fds.data(), fds.size(), poll_ms) < 0) {
+                if (errno == EINTR) continue;
+                throw std::runtime_error(std::string("Error: poll failed: ") + std::strerror(errno));
+            }
+            if (fds[0].revents & POLLIN) accept_worker(listen_fd);
+            for (size_t w = 0; w < fds.size() - 1 && remaining_ > 0; ++w) {
+                if (fds[w + 1].revents != 0) serve(*workers_[w]);
+            }
+            if (!failure_.empty()) break;
+            remove_dead_workers();
+            if (remaining_ > 0 && pending_.empty()) dispatch_overdue();
+        }
+        for (const std::unique_ptr<WorkerConnection>& worker : workers_) {
+            send_frame(worker->fd, FRAME_DONE, 0, {});
+            close(worker->fd);
+        }
+        if (!failure_.empty()) throw std::runtime_error(failure_);
+        return output_end_;
+    }
+
+    void print_summary() const {
+        for (const auto& entry : completed_by_) {
+            std::cout << "  " << entry.first << ": " << entry.second << " tasks" << std::endl;
+        }
+    }
+
+private:
+    const unsigned char* pixels_;
+    unsigned char* out_;
+    const unsigned char* key_;
+    const unsigned char* iv_;
+    AesMode mode_;
+    Direction direction_;
+    std::vector<Task> tasks_;
+    TaskClock::duration task_timeout_;
+    std::deque<size_t> pending_;
+    std::vector<std::unique_ptr<WorkerConnection>> workers_;
+    std::vector<std::pair<std::string, size_t>> completed_by_;
+    size_t remaining_;
+    size_t output_end_;
+    std::string failure_;
+
+    void accept_worker(int listen_fd) {
+        sockaddr_in address = {};
+        socklen_t address_len = sizeof(address);
+        int fd = accept4(listen_fd, reinterpret_cast<sockaddr*>(&address), &address_len, SOCK_CLOEXEC);
+        if (fd < 0) return;
+        configure_socket(fd);
+        // Sends block the loop, so a worker that does not take a task within the task
+        // timeout is dropped instead of holding up the others.
+        const long long timeout_ms = std::min<long long>(
+            IO_TIMEOUT_SECONDS * 1000LL, std::chrono::duration_cast<std::chrono::milliseconds>(task_timeout_).count());
+        timeval send_timeout = {static_cast<time_t>(timeout_ms / 1000), static_cast<suseconds_t>(timeout_ms % 1000 * 1000)};
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+        workers_.emplace_back(new WorkerConnection(fd, peer_name(address)));
+    }
+
+    void serve(WorkerConnection& worker) {
+        coordinator_frame header;
+        std::vector<unsigned char> payload;
+        if (!read_frame(worker.fd, header, payload)) {
+            drop(worker);
+            return;
+        }
+        if (header.type == FRAME_HELLO) {
+            uint32_t hello[2];
+            if (worker.slots != 0 || payload.size() != sizeof(hello)) return drop(worker);
+            std::memcpy(hello, payload.data(), sizeof(hello));
+            if (hello[0] != COORDINATOR_VERSION) return drop(worker);
+            worker.slots = std::max<uint32_t>(hello[1], 1);
+            JobSpec job;
+            job.mode = static_cast<uint32_t>(mode_);
+            job.direction = static_cast<uint32_t>(direction_);
+            std::memcpy(job.key, key_, AES_KEY_BYTES);
+            const bool sent = send_frame(worker.fd, FRAME_JOB, 0, {iovec{&job, sizeof(job)}});
+            OPENSSL_cleanse(&job, sizeof(job));
+            if (!sent) return drop(worker);
+            std::cout << "Worker " << worker.name << " joined with " << worker.slots << " slots." << std::endl;
+        } else if (header.type == FRAME_RESULT) {
+            if (!accept_result(worker, header.task_id, payload)) return drop(worker);
+        } else if (header.type == FRAME_FAILED) {
+            // Cipher failures (bad padding, wrong key) are properties of the input, not the worker.
+            failure_ = std::string(payload.begin(), payload.end());
+            return;
+        } else {
+            return drop(worker);
+        }
+        dispatch(worker);
+    }
+
+    bool accept_result(WorkerConnection& worker, uint64_t task_id, const std::vector<unsigned char>& result) {
+        if (task_id >= tasks_.size() || worker.tasks.erase(task_id) == 0) return false;
+        Task& task = tasks_[task_id];
+        --task.copies;
+        if (task.done) return true; // A copy sent to another worker answered first
+        const size_t input_len = task.end - task.begin;
+        // Only the final task changes length: CBC padding added or removed.
+        if (task.final ? result.size() > input_len + AES_BLOCK_BYTES : result.size() != input_len) return false;
+        std::memcpy(out_ + task.begin, result.data(), result.size());
+        if (task.final) output_end_ = task.begin + result.size();
+        task.done = true;
+        --remaining_;
+        ++worker.completed;
+        return true;
+    }
+
+    void send_task(WorkerConnection& worker, size_t id) {
+        Task& task = tasks_[id];
+        TaskPrefix prefix;
+        prefix.final = task.final ? 1 : 0;
+        // CBC continues from the ciphertext block before the task (decryption input).
+        std::memcpy(prefix.chain, task.begin > 0 ? pixels_ + task.begin - AES_BLOCK_BYTES : iv_, AES_BLOCK_BYTES);
+        worker.tasks.insert(id);
+        ++task.copies;
+        task.sent_at = TaskClock::now();
+        if (!send_frame(worker.fd, FRAME_TASK, id,
+                        {iovec{&prefix, sizeof(prefix)},
+                         iovec{const_cast<unsigned char*>(pixels_ + task.begin), task.end - task.begin}})) {
+            drop(worker);
+        }
+    }
+
+    void dispatch(WorkerConnection& worker) {
+        while (!worker.dead && worker.tasks.size() < worker.slots && !pending_.empty()) {
+            const size_t id = pending_.front();
+            pending_.pop_front();
+            send_task(worker, id);
+        }
+    }
+
+    // With the queue empty, free slots take a copy of each task that has gone without a
+    // result for task_timeout_ (a stalled worker), oldest dispatch first.
+    void dispatch_overdue() {
+        const TaskClock::time_point now = TaskClock::now();
+        for (const std::unique_ptr<WorkerConnection>& worker : workers_) {
+            while (!worker->dead && worker->slots > 0 && worker->tasks.size() < worker->slots) {
+                size_t overdue = tasks_.size();
+                for (size_t id = 0; id < tasks_.size(); ++id) {
+                    const Task& task = tasks_[id];
+                    if (task.done || task.copies == 0 || now - task.sent_at < task_timeout_ ||
+                        worker->tasks.count(id) != 0) {
+                        continue;
+                    }
+                    if (overdue == tasks_.size() || task.sent_at < tasks_[overdue].sent_at) overdue = id;
+                }
+                if (overdue == tasks_.size()) break;
+                std::cout << "Task " << overdue << " overdue; sent a copy to worker " << worker->name << "."
+                          << std::endl;
+                send_task(*worker, overdue);
+            }
+        }
+    }
+
+    // Its tasks that no other worker holds go to the front of the queue and out to
+    // workers with free slots.
+    void drop(WorkerConnection& worker) {
+        if (worker.dead) return;
+        worker.dead = true;
+        size_t requeued = 0;
+        for (auto it = worker.tasks.rbegin(); it != worker.tasks.rend(); ++it) {
+            Task& task = tasks_[*it];
+            if (--task.copies == 0 && !task.done) {
+                pending_.push_front(*it);
+                ++requeued;
+            }
+        }
+        if (requeued > 0) {
+            std::cout << "Worker " << worker.name << " lost; re-queued " << requeued << " tasks." << std::endl;
+        }
+        worker.tasks.clear();
+        for (const std::unique_ptr<WorkerConnection>& other : workers_) {
+            if (!other->dead && other->slots > 0) dispatch(*other);
+        }
+    }
+
+    void remove_dead_workers() {
+        for (size_t w = 0; w < workers_.size();) {
+            if (workers_[w]->dead) {
+                if (workers_[w]->completed > 0) completed_by_.emplace_back(workers_[w]->name, workers_[w]->completed);
+                close(workers_[w]->fd);
+                workers_.erase(workers_.begin() + w);
+            } else {
+                ++w;
+            }
+        }
+        if (remaining_ == 0) {
+            for (const std::unique_ptr<WorkerConnection>& worker : workers_) {
+                if (worker->completed > 0) completed_by_.emplace_back(worker->name, worker->completed);
+            }
+        }
+    }
+};
+
+// --- Worker ---
+struct WorkerTask {
+    uint64_t id;
+    std::vector<unsigned char> payload; // TaskPrefix + input
+};
+
+// One connection to a coordinator, for one job. Returns when the job is done or the
+// connection is gone.
+inline void serve_job(int fd, size_t slots) {
+    uint32_t hello[2] = {COORDINATOR_VERSION, static_cast<uint32_t>(slots)};
+    if (!send_frame(fd, FRAME_HELLO, 0, {iovec{hello, sizeof(hello)}})) return;
+
+    JobSpec job = {};
+    bool have_job = false;
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<WorkerTask> queue;
+    bool stopping = false;
+    std::mutex send_mutex;
+
+    auto slot_loop = [&] {
+        while (true) {
+            WorkerTask task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                ready.wait(lock, [&] { return stopping || !queue.empty(); });
+                if (queue.empty()) return;
+                task = std::move(queue.front());
+                queue.pop_front();
+            }
+            TaskPrefix prefix;
+            std::memcpy(&prefix, task.payload.data(), sizeof(prefix));
+            const unsigned char* input = task.payload.data() + sizeof(prefix);
+            const size_t input_len = task.payload.size() - sizeof(prefix);
+            std::vector<unsigned char> output(input_len + AES_BLOCK_BYTES);
+            const AesMode mode = static_cast<AesMode>(job.mode);
+            const Direction direction = static_cast<Direction>(job.direction);
+            size_t output_len = 0;
+            std::string error;
+            try {
+                output_len = dispatch_cipher(mode, direction, prefix.final ? pixel_padding(mode) : Padding::None,
+                                             [&](auto engine_tag) {
+                    using Engine = typename decltype(engine_tag)::type;
+                    Engine engine(job.key, prefix.chain);
+                    size_t len = engine.update(input, input_len, output.data());
+                    return len + engine.finish(output.data() + len);
+                });
+            } catch (const std::exception& e) {
+                error = e.what();
+            }
+            std::lock_guard<std::mutex> lock(send_mutex);
+            const bool sent = error.empty()
+                ? send_frame(fd, FRAME_RESULT, task.id, {iovec{output.data(), output_len}})
+                : send_frame(fd, FRAME_FAILED, task.id, {iovec{&error[0], error.size()}});
+            if (!sent) shutdown(fd, SHUT_RDWR); // Ends the reader below
+        }
+    };
+
+    std::vector<std::thread> threads;
+    coordinator_frame header;
+    std::vector<unsigned char> payload;
+    while (read_frame(fd, header, payload)) {
+        if (header.type == FRAME_JOB && !have_job && payload.size() == sizeof(JobSpec)) {
+            std::memcpy(&job, payload.data(), sizeof(job));
+            OPENSSL_cleanse(payload.data(), payload.size());
+            AesMode mode = static_cast<AesMode>(job.mode);
+            if (mode != AesMode::ECB && mode != AesMode::CBC) break;
+            have_job = true;
+            for (size_t i = 0; i < slots; ++i) threads.emplace_back(slot_loop);
+        } else if (header.type == FRAME_TASK && have_job && payload.size() >= sizeof(TaskPrefix)) {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.push_back(WorkerTask{header.task_id, std::move(payload)});
+            ready.notify_one();
+            payload = std::vector<unsigned char>();
+        } else {
+            break; // DONE, or a frame this worker does not understand
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        queue.clear(); // The coordinator re-queues whatever it did not get back
+    }
+    ready.notify_all();
+    for (std::thread& thread : threads) thread.join();
+    OPENSSL_cleanse(&job, sizeof(job));
+}
+
+inline int connect_tcp(const std::string& host, const std::string& port) {
+    addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* result = NULL;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &result) != 0) return -1;
+    int fd = -1;
+    for (addrinfo* candidate = result; candidate != NULL && fd < 0; candidate = candidate->ai_next) {
+        fd = socket(candidate->ai_family, candidate->ai_socktype | SOCK_CLOEXEC, candidate->ai_protocol);
+        if (fd >= 0 && connect(fd, candidate->ai_addr, candidate->ai_addrlen) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(result);
+    return fd;
+}
+
+} // namespace coordinator_detail
+
+// Processes one image with whatever workers connect to port; the output matches
+// process_image_buffer. Workers may join and leave at any time. output_data must not
+// overlap the input: pending CBC decryption tasks still read their chain blocks from it.
+inline size_t process_image_coordinated(const unsigned char* image_data, size_t image_len,
+                                        unsigned char* output_data, size_t output_capacity,
+                                        const std::string& passphrase, AesMode mode, Direction direction,
+                                        const std::string& bind_address, uint16_t port) {
+    using namespace coordinator_detail;
+    if (mode != AesMode::ECB && mode != AesMode::CBC) {
+        throw std::runtime_error("Error: Coordinated processing supports ECB and CBC.");
+    }
+    const BmpLayout layout = locate_pixel_data(image_data, image_len, direction);
+    require_uncompressed_layout(layout);
+    if (output_capacity < max_processed_image_len(image_len)) {
+        throw std::runtime_error("Error: Output buffer too small for processed image.");
+    }
+    const size_t input_len = pixel_cipher_input_len(mode, layout.pixel_len);
+    if (input_len == 0) {
+        // Nothing to distribute (e.g. ECB with less than one block of pixels).
+        return process_image_buffer(image_data, image_len, output_data, output_capacity, passphrase, mode, direction);
+    }
+
+    // Task boundaries are block-aligned; CBC encryption is one chain, hence one task.
+    const size_t task_bytes = std::max<size_t>(
+        env_size("IMAGE_PROCESSOR_TASK_BYTES", COORDINATOR_DEFAULT_TASK_BYTES) / AES_BLOCK_BYTES * AES_BLOCK_BYTES,
+        AES_BLOCK_BYTES);
+    std::vector<Task> tasks;
+    const bool chained = mode == AesMode::CBC && direction == Direction::Encrypt;
+    for (size_t begin = 0; begin < input_len; begin += chained ? input_len : task_bytes) {
+        const size_t end = chained ? input_len : std::min(input_len, begin + task_bytes);
+        tasks.push_back(Task{begin, end, end == input_len, false, 0, TaskClock::time_point()});
+    }
+
+    unsigned char key[AES_KEY_BYTES];
+    unsigned char iv[AES_IV_BYTES];
+    derive_image_key_and_iv(passphrase, key, iv);
+    std::memcpy(output_data, image_data, layout.header_len);
+    const unsigned char* pixels = image_data + layout.header_len;
+    int listen_fd = -1;
+    size_t pixel_out_len = 0;
+    try {
+        listen_fd = listen_tcp(bind_address, port);
+        std::cout << "Coordinating " << tasks.size() << " tasks on " << bind_address << ":" << port
+                  << "; waiting for workers..." << std::endl;
+        const std::chrono::milliseconds task_timeout(
+            env_size("IMAGE_PROCESSOR_TASK_TIMEOUT_MS", COORDINATOR_DEFAULT_TASK_TIMEOUT_MS));
+        Coordinator coordinator(pixels, output_data + layout.header_len, key, iv, mode, direction, std::move(tasks),
+                                task_timeout);
+        pixel_out_len = coordinator.run(listen_fd);
+        coordinator.print_summary();
+    } catch (...) {
+        if (listen_fd >= 0) close(listen_fd);
+        OPENSSL_cleanse(key, sizeof(key));
+        OPENSSL_cleanse(iv, sizeof(iv));
+        throw;
+    }
+    close(listen_fd);
+    OPENSSL_cleanse(key, sizeof(key));
+    OPENSSL_cleanse(iv, sizeof(iv));
+    return layout.header_len + pixel_out_len;
+}
+
+// Connects to the coordinator at host:port, serves its job, and reconnects for the next
+// one. Runs until killed; a killed worker's tasks are re-queued by the coordinator.
+inline int run_worker(const std::string& host, const std::string& port) {
+    using namespace coordinator_detail;
+    init_openssl_runtime();
+    const size_t slots = env_size("IMAGE_PROCESSOR_WORKER_SLOTS", std::max(1u, std::thread::hardware_concurrency()));
+    bool waiting_reported = false;
+    while (true) {
+        int fd = connect_tcp(host, port);
+        if (fd < 0) {
+            if (!waiting_reported) {
+                std::cout << "Waiting for a coordinator at " << host << ":" << port << "..." << std::endl;
+                waiting_reported = true;
+            }
+            sleep(1);
+            continue;
+        }
+        waiting_reported = false;
+        configure_socket(fd);
+        serve_job(fd, std::max<size_t>(slots, 1));
+        close(fd);
+    }
+}
+
+#endif // WORK_COORDINATOR_HPP
@@ -0,0 +1,144 @@
+#ifndef WORKER_POOL_HPP
+#define WORKER_POOL_HPP
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "cipher_engine.hpp" // RangeExecutor
+
+// Fixed set of worker threads shared by every caller of the library. Unlike an
+// OpenMP team, which belongs to the thread that starts it, one pool serves any
+// number of concurrent callers (e.g. JVM request threads) without multiplying
+// the thread count. The calling thread works on its own batch while it waits.
+// Threads start on first use, as many as a batch can keep busy besides its caller
+// (one for a two-task key derivation, all of them for a split cipher pass) and one
+// for a posted job, so a process that never splits its work (a small one-shot
+// image) does not pay for the rest.
+class WorkerPool : public RangeExecutor {
+public:
+    explicit WorkerPool(size_t num_threads) : num_threads_(num_threads), stopping_(false) {}
+
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        work_cv_.notify_all();
+        for (std::thread& t : threads_) {
+            t.join();
+        }
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    size_t concurrency() const override { return num_threads_ + 1; }
+
+    void run(size_t num_tasks, const std::function<void(size_t)>& task) override {
+        if (num_tasks == 0) return;
+        Batch batch;
+        batch.task = &task;
+        batch.next = 0;
+        batch.total = num_tasks;
+        batch.done = 0;
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (num_tasks > 1) {
+            start_threads(num_tasks - 1);
+            queue_.push_back(&batch);
+            work_cv_.notify_all();
+        }
+        // The caller runs tasks from its own batch until none are left to claim.
+        while (batch.next < batch.total) {
+            size_t index = claim(batch);
+            lock.unlock();
+            task(index);
+            lock.lock();
+            ++batch.done;
+        }
+        batch.done_cv.wait(lock, [&batch] { return batch.done == batch.total; });
+    }
+
+    // Runs job on a pool thread without waiting for it (e.g. resuming a coroutine).
+    // Needs at least one pool thread. Batches come first, since their callers are waiting;
+    // jobs still queued when the pool is destroyed are dropped.
+    void post(std::function<void()> job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            start_threads(1);
+            jobs_.push_back(std::move(job));
+        }
+        work_cv_.notify_one();
+    }
+
+private:
+    struct Batch {
+        const std::function<void(size_t)>* task;
+        size_t next;  // next index to hand out
+        size_t total;
+        size_t done;
+        std::condition_variable done_cv;
+    };
+
+    const size_t num_threads_;
+    std::vector<std::thread> threads_; // started so far, up to num_threads_
+    std::deque<Batch*> queue_; // batches that still have unclaimed tasks
+    std::deque<std::function<void()>> jobs_; // posted jobs
+    std::mutex mutex_;
+    std::condition_variable work_cv_;
+    bool stopping_;
+
+    // Called with mutex_ held.
+    void start_threads(size_t count) {
+        while (threads_.size() < std::min(count, num_threads_)) {
+            threads_.emplace_back([this] { worker_loop(); });
+        }
+    }
+
+    // Called with mutex_ held.
+    size_t claim(Batch& batch) {
+        size_t index = batch.next++;
+        if (batch.next == batch.total) {
+            for (auto it = queue_.begin(); it != queue_.end(); ++it) {
+                if (*it == &batch) {
+                    queue_.erase(it);
+                    break;
+                }
+            }
+        }
+        return index;
+    }
+
+    void worker_loop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            work_cv_.wait(lock, [this] { return stopping_ || !queue_.empty() || !jobs_.empty(); });
+            if (stopping_) return;
+            if (queue_.empty()) {
+                std::function<void()> job = std::move(jobs_.front());
+                jobs_.pop_front();
+                lock.unlock();
+                job();
+                lock.lock();
+                continue;
+            }
+            Batch* batch = queue_.front();
+            size_t index = claim(*batch);
+            lock.unlock();
+            (*batch->task)(index);
+            lock.lock();
+            if (++batch->done == batch->total) {
+                batch->done_cv.notify_all();
+            }
+        }
+    }
+};
+
+#endif // WORKER_POOL_HPP
@@ -0,0 +1,432 @@
+#ifndef ZYGOTE_SERVER_HPP
+#define ZYGOTE_SERVER_HPP
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdexcept> // For std::runtime_error
+#include <cstring>   // For memcpy, strerror
+#include <cstdio>    // For fflush
+#include <cstdlib>   // For clearenv, putenv, strtol
+#include <cerrno>
+#include <chrono>
+#include <memory>    // For std::unique_ptr
+#include <algorithm> // For std::max
+
+#include <fcntl.h>         // For open
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>        // For fork, dup2, chdir
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>      // For umask
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "zygote_protocol.h"    // Request/response layout shared with zygote_front.c
+#include "cipher_engine.hpp"    // OpenSSL runtime, fetched algorithms
+#include "image_pipeline.hpp"   // Fetched GCM/CTR/ChaCha20 ciphers
+
+// Long-running mode of image_processor_ssl for callers that still start one process
+// per image. zygote_front (same command line) connects here, and every job runs in a
+// child forked from this process with the caller's arguments, environment, working
+// directory and stdio. The child inherits a process that has already loaded its
+// libraries, initialized OpenSSL and fetched its algorithms.
+//
+// The OpenMP team is the exception: libgomp does not survive fork() once its threads
+// exist, so the zygote never enters a parallel region and each job starts its own
+// team (only for inputs of at least OMP_PARALLEL_MIN_BYTES, as before).
+//
+// Requests are read without blocking, as part of the poll loop: a connection that
+// sends its request slowly (or never) holds up nobody else, and is rejected once it
+// has had REQUEST_TIMEOUT_SECONDS. Requests for a server mode (zygote_server_mode) are
+// rejected too.
+
+typedef int (*ZygoteEntry)(int argc, char* argv[]);
+
+namespace zygote_detail {
+
+const int REQUEST_TIMEOUT_SECONDS = 5; // Time a connection has to send its whole request
+
+typedef std::chrono::steady_clock RequestClock;
+
+struct Request {
+    std::string cwd;
+    std::vector<std::string> args;
+    std::vector<std::string> env;
+    mode_t umask_bits = 022;
+    int stdio[3] = {-1, -1, -1};
+
+    ~Request() {
+        for (int fd : stdio) {
+            if (fd >= 0) close(fd);
+        }
+    }
+};
+
+// A connection whose request is still arriving.
+struct PendingRequest {
+    int connection;
+    RequestClock::time_point deadline;
+    zygote_request header;
+    size_t header_got = 0;
+    std::vector<char> payload;
+    size_t payload_got = 0;
+    Request request;
+
+    PendingRequest(int fd, RequestClock::time_point until) : connection(fd), deadline(until) {}
+    ~PendingRequest() {
+        if (connection >= 0) close(connection);
+    }
+
+    PendingRequest(const PendingRequest&) = delete;
+    PendingRequest& operator=(const PendingRequest&) = delete;
+};
+
+enum class ReadStatus { More, Done, Failed };
+
+struct Job {
+    pid_t pid;
+    int connection;
+    bool abandoned; // Front went away; the job was sent SIGTERM
+};
+
+// Everything a job would otherwise set up itself and that is safe to share over fork().
+inline void warm_up() {
+    init_openssl_runtime();
+    load_openssl_error_strings();
+    fetched_aes_cipher(AesMode::ECB);
+    fetched_aes_cipher(AesMode::CBC);
+    fetched_digest("SHA256");
+    fetched_gcm_cipher();
+    fetched_ctr_cipher();
+    fetched_chacha20_cipher();
+}
+
+inline void send_response(int connection, int32_t outcome, int32_t value) {
+    zygote_response response;
+    response.magic = ZYGOTE_MAGIC;
+    response.outcome = outcome;
+    response.value = value;
+    // The front may already be gone; there is nobody left to report a failure to.
+    (void)send(connection, &response, sizeof(response), MSG_NOSIGNAL);
+}
+
+// Takes the three stdio descriptors from a message; any other descriptors are closed.
+inline void take_descriptors(msghdr& message, Request& request) {
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&message); cmsg != NULL; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) continue;
+        const size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        const bool wanted = count == 3 && request.stdio[0] < 0;
+        for (size_t i = 0; i < count; ++i) {
+            int fd;
+            std::memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+            if (wanted) {
+                request.stdio[i] = fd;
+            } else {
+                close(fd);
+            }
+        }
+    }
+}
+
+// Reads what has arrived of a request (header with the three stdio descriptors, then
+// the payload) without blocking. Done once the whole request is in and well-formed.
+inline ReadStatus read_request(PendingRequest& pending) {
+    Request& request = pending.request;
+    while (pending.header_got < sizeof(pending.header)) {
+        union {
+            char buffer[CMSG_SPACE(3 * sizeof(int))];
+            cmsghdr align;
+        } control;
+        iovec iov = {reinterpret_cast<unsigned char*>(&pending.header) + pending.header_got,
+                     sizeof(pending.header) - pending.header_got};
+        msghdr message = {};
+        message.msg_iov = &iov;
+        message.msg_iovlen = 1;
+        message.msg_control = control.buffer;
+        message.msg_controllen = sizeof(control.buffer);
+        const ssize_t n = recvmsg(pending.connection, &message, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return ReadStatus::More;
+        if (n > 0) take_descriptors(message, request);
+        if (n <= 0) return ReadStatus::Failed;
+        pending.header_got += static_cast<size_t>(n);
+        if (pending.header_got < sizeof(pending.header)) continue;
+
+        const zygote_request& header = pending.header;
+        if (header.magic != ZYGOTE_MAGIC || header.version != ZYGOTE_VERSION || header.argc == 0 ||
+            header.payload_len > ZYGOTE_MAX_PAYLOAD || request.stdio[0] < 0) {
+            return ReadStatus::Failed;
+        }
+        pending.payload.resize(header.payload_len);
+    }
+    while (pending.payload_got < pending.payload.size()) {
+        const ssize_t n = recv(pending.connection, pending.payload.data() + pending.payload_got,
+                               pending.payload.size() - pending.payload_got, MSG_DONTWAIT);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return ReadStatus::More;
+        if (n <= 0) return ReadStatus::Failed;
+        pending.payload_got += static_cast<size_t>(n);
+    }
+
+    // cwd, argc arguments and envc environment entries, each NUL-terminated.
+    const std::vector<char>& payload = pending.payload;
+    std::vector<std::string> strings;
+    size_t start = 0;
+    for (size_t i = 0; i < payload.size(); ++i) {
+        if (payload[i] == '\0') {
+            strings.emplace_back(payload.data() + start, i - start);
+            start = i + 1;
+        }
+    }
+    const zygote_request& header = pending.header;
+    if (start != payload.size() || strings.size() != 1 + static_cast<size_t>(header.argc) + header.envc) {
+        return ReadStatus::Failed;
+    }
+    request.cwd = strings[0];
+    request.args.assign(strings.begin() + 1, strings.begin() + 1 + header.argc);
+    request.env.assign(strings.begin() + 1 + header.argc, strings.end());
+    request.umask_bits = static_cast<mode_t>(header.umask & 0777);
+    return ReadStatus::Done;
+}
+
+// Child side: becomes the caller's process as far as the job can tell, then runs it.
+[[noreturn]] inline void run_job(Request& request, ZygoteEntry entry) {
+    sigset_t none;
+    sigemptyset(&none);
+    sigprocmask(SIG_SETMASK, &none, NULL);
+    signal(SIGPIPE, SIG_DFL);
+    for (int target = 0; target < 3; ++target) {
+        if (dup2(request.stdio[target], target) < 0) _exit(127);
+    }
+    for (int& fd : request.stdio) {
+        if (fd > 2) close(fd);
+        fd = -1;
+    }
+    umask(request.umask_bits);
+    if (chdir(request.cwd.c_str()) != 0) {
+        std::cerr << "Error: Could not enter working directory " << request.cwd << ": " << std::strerror(errno) << std::endl;
+        _exit(127);
+    }
+
+    // The job reads its settings (IMAGE_PROCESSOR_*) from the caller's environment.
+    // libgomp parsed OMP_* when the zygote started, so only the thread count is re-applied.
+    clearenv();
+    for (std::string& entry_string : request.env) {
+        putenv(&entry_string[0]);
+    }
+#ifdef _OPENMP
+    const char* threads = std::getenv("OMP_NUM_THREADS");
+    if (threads != NULL) {
+        const long count = std::strtol(threads, NULL, 10);
+        if (count > 0) omp_set_num_threads(static_cast<int>(count));
+    }
+#endif
+
+    std::vector<char*> argv;
+    for (std::string& arg : request.args) argv.push_back(&arg[0]);
+    argv.push_back(NULL);
+    const int status = entry(static_cast<int>(request.args.size()), argv.data());
+    std::cout.flush();
+    std::cerr.flush();
+    std::fflush(NULL);
+    _exit(status);
+}
+
+// Binds the listening socket; a stale socket file from a dead zygote is replaced.
+inline int listen_on(const std::string& path) {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error("Error: Invalid zygote socket path: " + path);
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        throw std::runtime_error(std::string("Error: Could not create zygote socket: ") + std::strerror(errno));
+    }
+    if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0) {
+        close(fd);
+        throw std::runtime_error("Error: A zygote is already listening on " + path);
+    }
+    unlink(path.c_str());
+    // Jobs run with the zygote's user, so only that user may connect.
+    const mode_t previous_umask = umask(077);
+    const bool bound = bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+    umask(previous_umask);
+    if (!bound || listen(fd, SOMAXCONN) != 0) {
+        int err = errno;
+        close(fd);
+        throw std::runtime_error("Error: Could not listen on " + path + ": " + std::strerror(err));
+    }
+    return fd;
+}
+
+inline bool same_user(int connection) {
+    ucred credentials;
+    socklen_t len = sizeof(credentials);
+    return getsockopt(connection, SOL_SOCKET, SO_PEERCRED, &credentials, &len) == 0 && credentials.uid == getuid();
+}
+
+// In a forked job: drops another caller's connection and stdio without touching the
+// parent's bookkeeping.
+inline void close_in_child(const PendingRequest& pending) {
+    if (pending.connection >= 0) close(pending.connection);
+    for (int fd : pending.request.stdio) {
+        if (fd >= 0) close(fd);
+    }
+}
+
+} // namespace zygote_detail
+
+// Serves jobs until SIGTERM or SIGINT, then stops accepting, waits for the running jobs
+// and removes the socket.
+inline int run_zygote_server(const std::string& socket_path, ZygoteEntry entry) {
+    using namespace zygote_detail;
+    warm_up();
+
+    sigset_t handled;
+    sigemptyset(&handled);
+    sigaddset(&handled, SIGCHLD);
+    sigaddset(&handled, SIGTERM);
+    sigaddset(&handled, SIGINT);
+    sigprocmask(SIG_BLOCK, &handled, NULL);
+    int signal_fd = signalfd(-1, &handled, SFD_CLOEXEC);
+    if (signal_fd < 0) {
+        throw std::runtime_error(std::string("Error: Could not create signalfd: ") + std::strerror(errno));
+    }
+    signal(SIGPIPE, SIG_IGN);
+    int listen_fd = listen_on(socket_path);
+    std::cout << "Zygote listening on " << socket_path << "." << std::endl;
+
+    std::vector<Job> jobs;
+    std::vector<std::unique_ptr<PendingRequest>> pending;
+    size_t served = 0;
+    while (listen_fd >= 0 || !jobs.empty()) {
+        std::vector<pollfd> fds;
+        fds.push_back({signal_fd, POLLIN, 0});
+        if (listen_fd >= 0) fds.push_back({listen_fd, POLLIN, 0});
+        // Wake up for the earliest request deadline.
+        const size_t first_pending_fd = fds.size();
+        const RequestClock::time_point now = RequestClock::now();
+        int timeout_ms = -1;
+        for (const std::unique_ptr<PendingRequest>& request : pending) {
+            fds.push_back({request->connection, POLLIN, 0});
+            const long long left =
+                std::chrono::duration_cast<std::chrono::milliseconds>(request->deadline - now).count() + 1;
+            const int wait = static_cast<int>(std::max(0LL, left));
+            if (timeout_ms < 0 || wait < timeout_ms) timeout_ms = wait;
+        }
+        const size_t first_job_fd = fds.size();
+        for (const Job& job : jobs) {
+            fds.push_back({job.abandoned ? -1 : job.connection, POLLIN, 0});
+        }
+        if (poll(fds.data(), fds.size(), timeout_ms) < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error(std::string("Error: poll failed: ") + std::strerror(errno));
+        }
+
+        // A front never sends after its request, so a readable connection means it hung up.
+        for (size_t j = 0; j < jobs.size(); ++j) {
+            if (fds[first_job_fd + j].revents != 0 && !jobs[j].abandoned) {
+                kill(jobs[j].pid, SIGTERM);
+                jobs[j].abandoned = true;
+            }
+        }
+
+        // Requests that are complete start a job; malformed or overdue ones are rejected.
+        const RequestClock::time_point checked = RequestClock::now();
+        std::vector<std::unique_ptr<PendingRequest>> ready;
+        std::vector<std::unique_ptr<PendingRequest>> still_pending;
+        for (size_t i = 0; i < pending.size(); ++i) {
+            ReadStatus status = ReadStatus::More;
+            if (fds[first_pending_fd + i].revents != 0) status = read_request(*pending[i]);
+            if (status == ReadStatus::More && checked >= pending[i]->deadline) status = ReadStatus::Failed;
+            // Server modes would turn a job into a long-lived server; zygote_front runs them standalone.
+            const std::vector<std::string>& args = pending[i]->request.args;
+            if (status == ReadStatus::Done && args.size() > 1 && zygote_server_mode(args[1].c_str())) {
+                status = ReadStatus::Failed;
+            }
+            if (status == ReadStatus::More) {
+                still_pending.push_back(std::move(pending[i]));
+            } else if (status == ReadStatus::Done) {
+                ready.push_back(std::move(pending[i]));
+            } else {
+                send_response(pending[i]->connection, ZYGOTE_REJECTED, 0);
+            }
+        }
+        pending.swap(still_pending);
+        for (std::unique_ptr<PendingRequest>& request : ready) {
+            std::cout.flush();
+            std::cerr.flush();
+            pid_t pid = fork();
+            if (pid == 0) {
+                close(listen_fd);
+                close(signal_fd);
+                for (const Job& job : jobs) close(job.connection);
+                for (const std::unique_ptr<PendingRequest>& other : pending) close_in_child(*other);
+                for (const std::unique_ptr<PendingRequest>& other : ready) {
+                    if (other != request) close_in_child(*other);
+                }
+                close(request->connection);
+                run_job(request->request, entry);
+            }
+            if (pid < 0) {
+                send_response(request->connection, ZYGOTE_REJECTED, 0);
+                continue;
+            }
+            jobs.push_back({pid, request->connection, false});
+            request->connection = -1; // Now owned by the job
+        }
+
+        if (fds[0].revents & POLLIN) {
+            signalfd_siginfo info;
+            if (read(signal_fd, &info, sizeof(info)) == static_cast<ssize_t>(sizeof(info)) &&
+                info.ssi_signo != SIGCHLD && listen_fd >= 0) {
+                close(listen_fd);
+                listen_fd = -1;
+                unlink(socket_path.c_str());
+                for (const std::unique_ptr<PendingRequest>& request : pending) {
+                    send_response(request->connection, ZYGOTE_REJECTED, 0);
+                }
+                pending.clear();
+                std::cout << "Zygote stopping; waiting for " << jobs.size() << " running jobs." << std::endl;
+            }
+            int status = 0;
+            pid_t pid;
+            while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+                for (size_t j = 0; j < jobs.size(); ++j) {
+                    if (jobs[j].pid != pid) continue;
+                    if (WIFSIGNALED(status)) {
+                        send_response(jobs[j].connection, ZYGOTE_SIGNALED, WTERMSIG(status));
+                    } else {
+                        send_response(jobs[j].connection, ZYGOTE_EXITED, WEXITSTATUS(status));
+                    }
+                    close(jobs[j].connection);
+                    jobs.erase(jobs.begin() + j);
+                    ++served;
+                    break;
+                }
+            }
+        }
+
+        if (listen_fd >= 0 && (fds[1].revents & POLLIN)) {
+            int connection = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+            if (connection < 0) continue;
+            if (!same_user(connection)) {
+                send_response(connection, ZYGOTE_REJECTED, 0);
+                close(connection);
+                continue;
+            }
+            pending.emplace_back(new PendingRequest(
+                connection, RequestClock::now() + std::chrono::seconds(REQUEST_TIMEOUT_SECONDS)));
+        }
+    }
+
+    close(signal_fd);
+    std::cout << "Zygote stopped after " << served << " jobs." << std::endl;
+    return 0;
+}
+
+#endif // ZYGOTE_SERVER_HPP
@@ -0,0 +1,103 @@
+#ifndef AESNI_HPP
+#define AESNI_HPP
+
+#include <string>
+#include <cstdlib> // For std::getenv
+
+// Direct AES-NI primitives for the engines that need to interleave work OpenSSL keeps
+// serial (multi-buffer CBC encryption). Everything else goes through EVP.
+// Functions are compiled with a target attribute, so the rest of the build needs no
+// -maes; callers must check aesni_available() before using them.
+
+#if defined(__x86_64__) || defined(__i386__)
+#define IMAGE_PROCESSOR_HAVE_AESNI 1
+#include <immintrin.h>
+#define AESNI_TARGET __attribute__((target("aes,sse4.1")))
+#else
+#define IMAGE_PROCESSOR_HAVE_AESNI 0
+#endif
+
+// Setting IMAGE_PROCESSOR_NO_AESNI=1 forces the EVP paths (e.g. to compare outputs).
+inline bool aesni_available() {
+#if IMAGE_PROCESSOR_HAVE_AESNI
+    static const bool available = [] {
+        const char* disabled = std::getenv("IMAGE_PROCESSOR_NO_AESNI");
+        if (disabled != NULL && std::string(disabled) == "1") return false;
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("aes") && __builtin_cpu_supports("sse4.1");
+    }();
+    return available;
+#else
+    return false;
+#endif
+}
+
+#if IMAGE_PROCESSOR_HAVE_AESNI
+
+const int AES256_ROUNDS = 14;
+
+// Expanded AES-256 encryption key: AES256_ROUNDS + 1 round keys.
+struct alignas(16) Aes256KeySchedule {
+    __m128i round_keys[AES256_ROUNDS + 1];
+};
+
+namespace aesni_detail {
+
+// Key expansion steps from the Intel AES-NI white paper; rcon must be an immediate.
+AESNI_TARGET inline __m128i expand_even(__m128i prev_even, __m128i assist) {
+    assist = _mm_shuffle_epi32(assist, 0xff);
+    __m128i shifted = _mm_slli_si128(prev_even, 4);
+    prev_even = _mm_xor_si128(prev_even, shifted);
+    shifted = _mm_slli_si128(shifted, 4);
+    prev_even = _mm_xor_si128(prev_even, shifted);
+    shifted = _mm_slli_si128(shifted, 4);
+    prev_even = _mm_xor_si128(prev_even, shifted);
+    return _mm_xor_si128(prev_even, assist);
+}
+
+AESNI_TARGET inline __m128i expand_odd(__m128i even, __m128i prev_odd) {
+    __m128i assist = _mm_shuffle_epi32(_mm_aeskeygenassist_si128(even, 0x00), 0xaa);
+    __m128i shifted = _mm_slli_si128(prev_odd, 4);
+    prev_odd = _mm_xor_si128(prev_odd, shifted);
+    shifted = _mm_slli_si128(shifted, 4);
+    prev_odd = _mm_xor_si128(prev_odd, shifted);
+    shifted = _mm_slli_si128(shifted, 4);
+    prev_odd = _mm_xor_si128(prev_odd, shifted);
+    return _mm_xor_si128(prev_odd, assist);
+}
+
+} // namespace aesni_detail
+
+AESNI_TARGET inline void aes256_expand_key(const unsigned char* key, Aes256KeySchedule& schedule) {
+    using namespace aesni_detail;
+    __m128i* rk = schedule.round_keys;
+    __m128i even = _mm_loadu_si128(reinterpret_cast<const __m128i*>(key));
+    __m128i odd = _mm_loadu_si128(reinterpret_cast<const __m128i*>(key + 16));
+    rk[0] = even;
+    rk[1] = odd;
+    even = expand_even(even, _mm_aeskeygenassist_si128(odd, 0x01)); rk[2] = even;
+    odd = expand_odd(even, odd);                                     rk[3] = odd;
+    even = expand_even(even, _mm_aeskeygenassist_si128(odd, 0x02)); rk[4] = even;
+    odd = expand_odd(even, odd);                                     rk[5] = odd;
+    even = expand_even(even, _mm_aeskeygenassist_si128(odd, 0x04)); rk[6] = even;
+    odd = expand_odd(even, odd);                                     rk[7] = odd;
+    even = expand_even(even, _mm_aeskeygenassist_si128(odd, 0x08)); rk[8] = even;
+    odd = expand_odd(even, odd);                                     rk[9] = odd;
+    even = expand_even(even, _mm_aeskeygenassist_si128(odd, 0x10)); rk[10] = even;
+    odd = expand_odd(even, odd);                                     rk[11] = odd;
+    even = expand_even(even, _mm_aeskeygenassist_si128(odd, 0x20)); rk[12] = even;
+    odd = expand_odd(even, odd);                                     rk[13] = odd;
+    even = expand_even(even, _mm_aeskeygenassist_si128(odd, 0x40)); rk[14] = even;
+}
+
+AESNI_TARGET inline __m128i aes256_encrypt_block(__m128i block, const Aes256KeySchedule& schedule) {
+    block = _mm_xor_si128(block, schedule.round_keys[0]);
+    for (int round = 1; round < AES256_ROUNDS; ++round) {
+        block = _mm_aesenc_si128(block, schedule.round_keys[round]);
+    }
+    return _mm_aesenclast_si128(block, schedule.round_keys[AES256_ROUNDS]);
+}
+
+#endif // IMAGE_PROCESSOR_HAVE_AESNI
+
+#endif // AESNI_HPP
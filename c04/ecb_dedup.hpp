@@ -0,0 +1,286 @@
+#ifndef ECB_DEDUP_HPP
+#define ECB_DEDUP_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <stdexcept> // For std::runtime_error
+#include <cstdint>
+#include <cstdlib>   // For std::getenv
+#include <cstddef>
+#include <cstring>   // For memcpy, memcmp
+
+#include "cipher_engine.hpp" // AES engine, executors
+#include "aesni.hpp"         // For aesni_available
+
+// ECB block memoization. ECB maps equal input blocks to equal output blocks under one
+// key, and scanned documents are mostly white margins and black borders, so most
+// blocks repeat. A block equal to its predecessor reuses its output directly; other
+// blocks are hashed and looked up in a small plaintext->ciphertext table. Only misses
+// go through the cipher (batched, so AES-NI stays pipelined).
+//
+// Two phases over the same block ranges as the parallel ECB path:
+//   1. every range warms up a private table on its first ECB_DEDUP_WARMUP_BLOCKS blocks;
+//   2. the private tables are merged into one shared, read-only table and the ranges
+//      continue, looking up the shared table first and then their own.
+// A range whose recent hit rate drops below ECB_DEDUP_MIN_HIT_RATE turns dedup off and
+// encrypts the rest directly; if the warm-up hit rate is already that low, phase 2 is a
+// plain ECB pass. Output is identical to the regular ECB path.
+
+// --- Configuration ---
+const size_t ECB_DEDUP_CHUNK_BLOCKS = 256;    // Blocks looked up before the misses are ciphered
+const size_t ECB_DEDUP_LOCAL_SLOTS = 4096;    // Per-range table (power of two, 128 KiB)
+const size_t ECB_DEDUP_SHARED_SLOTS = 16384;  // Merged table (power of two, 512 KiB)
+const size_t ECB_DEDUP_WARMUP_BLOCKS = 4096;  // Per range, before the merge
+const size_t ECB_DEDUP_WINDOW_BLOCKS = 4096;  // Hit rate is re-checked over this many blocks
+const double ECB_DEDUP_MIN_HIT_RATE = 0.5;
+
+// With AES-NI the cipher already runs close to memory bandwidth, so lookups only pay
+// off on CPUs without it; that is the default. IMAGE_PROCESSOR_ECB_DEDUP=1 or =0 forces
+// the path on or off.
+inline bool ecb_dedup_enabled() {
+    static const bool enabled = [] {
+        const char* setting = std::getenv("IMAGE_PROCESSOR_ECB_DEDUP");
+        if (setting != NULL && std::string(setting) == "1") return true;
+        if (setting != NULL && std::string(setting) == "0") return false;
+        return !aesni_available();
+    }();
+    return enabled;
+}
+
+inline uint64_t hash_aes_block(const unsigned char* block) {
+    uint64_t lo, hi;
+    std::memcpy(&lo, block, 8);
+    std::memcpy(&hi, block + 8, 8);
+    uint64_t h = lo * 0xff51afd7ed558ccdULL ^ (hi + 0x9e3779b97f4a7c15ULL) * 0xc4ceb9fe1a85ec53ULL;
+    return h ^ (h >> 31);
+}
+
+// Direct-mapped plaintext->ciphertext table; a colliding insert replaces the old entry.
+class BlockCache {
+public:
+    explicit BlockCache(size_t slots) : entries_(slots), used_(slots, 0), mask_(slots - 1) {}
+
+    const unsigned char* find(const unsigned char* block, uint64_t hash) const {
+        const size_t slot = hash & mask_;
+        if (used_[slot] && std::memcmp(entries_[slot].plain, block, AES_BLOCK_BYTES) == 0) {
+            return entries_[slot].cipher;
+        }
+        return NULL;
+    }
+
+    void insert(const unsigned char* plain, const unsigned char* cipher, uint64_t hash) {
+        const size_t slot = hash & mask_;
+        std::memcpy(entries_[slot].plain, plain, AES_BLOCK_BYTES);
+        std::memcpy(entries_[slot].cipher, cipher, AES_BLOCK_BYTES);
+        used_[slot] = 1;
+    }
+
+    void merge_from(const BlockCache& other) {
+        for (size_t i = 0; i < other.entries_.size(); ++i) {
+            if (other.used_[i]) {
+                insert(other.entries_[i].plain, other.entries_[i].cipher, hash_aes_block(other.entries_[i].plain));
+            }
+        }
+    }
+
+    void clear_secrets() {
+        OPENSSL_cleanse(entries_.data(), entries_.size() * sizeof(Entry));
+    }
+
+private:
+    struct Entry {
+        unsigned char plain[AES_BLOCK_BYTES];
+        unsigned char cipher[AES_BLOCK_BYTES];
+    };
+    std::vector<Entry> entries_;
+    std::vector<uint8_t> used_;
+    size_t mask_;
+};
+
+// State of one block range across both phases.
+template <Direction D>
+struct EcbDedupRange {
+    using Engine = CipherEngine<AesMode::ECB, D, Padding::None>;
+
+    std::unique_ptr<Engine> engine;
+    BlockCache local;
+    size_t next_block;  // First block not yet processed
+    size_t last_block;  // One past the range
+    size_t hits;
+    size_t blocks;
+    bool dedup_on;
+    std::vector<unsigned char> staging;     // Missed plaintext blocks, then their ciphertext
+    std::vector<size_t> miss_index;
+    std::vector<size_t> deferred_block;     // Repeats of a block that missed in the same chunk
+    std::vector<size_t> deferred_miss;
+
+    EcbDedupRange()
+        : local(ECB_DEDUP_LOCAL_SLOTS), next_block(0), last_block(0), hits(0), blocks(0), dedup_on(true),
+          staging(2 * ECB_DEDUP_CHUNK_BLOCKS * AES_BLOCK_BYTES), miss_index(ECB_DEDUP_CHUNK_BLOCKS),
+          deferred_block(ECB_DEDUP_CHUNK_BLOCKS), deferred_miss(ECB_DEDUP_CHUNK_BLOCKS) {}
+
+    // Processes up to `count` blocks from next_block with cache lookups.
+    void process_cached(const unsigned char* input, unsigned char* output, size_t count, const BlockCache* shared) {
+        const size_t stop = std::min(last_block, next_block + count);
+        size_t window_blocks = 0, window_hits = 0;
+        while (next_block < stop && dedup_on) {
+            const size_t chunk = std::min(ECB_DEDUP_CHUNK_BLOCKS, stop - next_block);
+            const size_t chunk_hits = process_chunk(input + next_block * AES_BLOCK_BYTES,
+                                                    output + next_block * AES_BLOCK_BYTES, chunk, shared);
+            next_block += chunk;
+            blocks += chunk;
+            hits += chunk_hits;
+            window_blocks += chunk;
+            window_hits += chunk_hits;
+            if (window_blocks >= ECB_DEDUP_WINDOW_BLOCKS) {
+                dedup_on = window_hits >= ECB_DEDUP_MIN_HIT_RATE * window_blocks;
+                window_blocks = window_hits = 0;
+            }
+        }
+    }
+
+    // Everything left in the range, without lookups.
+    void process_direct(const unsigned char* input, unsigned char* output) {
+        const size_t offset = next_block * AES_BLOCK_BYTES;
+        engine->update(input + offset, (last_block - next_block) * AES_BLOCK_BYTES, output + offset);
+        blocks += last_block - next_block;
+        next_block = last_block;
+    }
+
+private:
+    // Returns the number of blocks served without the cipher. A block equal to the one
+    // before it (uniform regions) reuses that block's output without a table lookup.
+    // input and output may alias: a block is read before its output slot is written.
+    size_t process_chunk(const unsigned char* input, unsigned char* output, size_t num_blocks,
+                         const BlockCache* shared) {
+        unsigned char* staged_plain = staging.data();
+        unsigned char* staged_cipher = staging.data() + ECB_DEDUP_CHUNK_BLOCKS * AES_BLOCK_BYTES;
+        size_t misses = 0, deferred = 0;
+        uint64_t prev_lo = 0, prev_hi = 0;
+        unsigned char prev_cipher[AES_BLOCK_BYTES] = {};
+        size_t prev_miss = SIZE_MAX; // Miss slot holding the previous output, if not known yet
+        for (size_t b = 0; b < num_blocks; ++b) {
+            const unsigned char* block = input + b * AES_BLOCK_BYTES;
+            uint64_t lo, hi;
+            std::memcpy(&lo, block, 8);
+            std::memcpy(&hi, block + 8, 8);
+            if (b > 0 && lo == prev_lo && hi == prev_hi) {
+                if (prev_miss == SIZE_MAX) {
+                    std::memcpy(output + b * AES_BLOCK_BYTES, prev_cipher, AES_BLOCK_BYTES);
+                } else {
+                    deferred_block[deferred] = b;
+                    deferred_miss[deferred++] = prev_miss;
+                }
+                continue;
+            }
+            prev_lo = lo;
+            prev_hi = hi;
+            const uint64_t hash = hash_aes_block(block);
+            const unsigned char* cached = shared != NULL ? shared->find(block, hash) : NULL;
+            if (cached == NULL) cached = local.find(block, hash);
+            if (cached != NULL) {
+                std::memcpy(prev_cipher, cached, AES_BLOCK_BYTES);
+                std::memcpy(output + b * AES_BLOCK_BYTES, prev_cipher, AES_BLOCK_BYTES);
+                prev_miss = SIZE_MAX;
+            } else {
+                std::memcpy(staged_plain + misses * AES_BLOCK_BYTES, block, AES_BLOCK_BYTES);
+                prev_miss = misses;
+                miss_index[misses++] = b;
+            }
+        }
+        if (misses > 0) {
+            engine->update(staged_plain, misses * AES_BLOCK_BYTES, staged_cipher);
+            for (size_t m = 0; m < misses; ++m) {
+                const unsigned char* plain = staged_plain + m * AES_BLOCK_BYTES;
+                const unsigned char* cipher = staged_cipher + m * AES_BLOCK_BYTES;
+                std::memcpy(output + miss_index[m] * AES_BLOCK_BYTES, cipher, AES_BLOCK_BYTES);
+                local.insert(plain, cipher, hash_aes_block(plain));
+            }
+            for (size_t d = 0; d < deferred; ++d) {
+                std::memcpy(output + deferred_block[d] * AES_BLOCK_BYTES,
+                            staged_cipher + deferred_miss[d] * AES_BLOCK_BYTES, AES_BLOCK_BYTES);
+            }
+        }
+        return num_blocks - misses;
+    }
+};
+
+// ECB over input_len bytes (a multiple of AES_BLOCK_BYTES) with block memoization.
+// input and output may be the same buffer. Returns the output length.
+template <Direction D>
+inline size_t ecb_dedup_process(const unsigned char* key, const unsigned char* input_data, size_t input_len,
+                                unsigned char* output_data,
+                                size_t parallel_min_bytes = OMP_PARALLEL_MIN_BYTES,
+                                RangeExecutor& executor = OpenMPExecutor::instance()) {
+    if (input_len % AES_BLOCK_BYTES != 0) {
+        throw std::runtime_error("Error: Input length is not a multiple of the AES block size and padding is disabled.");
+    }
+    const size_t num_blocks = input_len / AES_BLOCK_BYTES;
+    if (num_blocks == 0) return 0;
+    const size_t num_ranges = input_len < parallel_min_bytes
+        ? 1 : std::min(std::max<size_t>(executor.concurrency(), 1), num_blocks);
+
+    std::vector<EcbDedupRange<D>> ranges(num_ranges);
+    for (size_t r = 0; r < num_ranges; ++r) {
+        ranges[r].engine.reset(new typename EcbDedupRange<D>::Engine(key, NULL));
+        ranges[r].next_block = num_blocks * r / num_ranges;
+        ranges[r].last_block = num_blocks * (r + 1) / num_ranges;
+    }
+
+    bool parallel_success = true;
+    std::string parallel_error;
+    std::mutex error_mutex;
+    auto run_ranges = [&](const std::function<void(EcbDedupRange<D>&)>& phase) {
+        executor.run(num_ranges, [&](size_t r) {
+            try {
+                phase(ranges[r]);
+            } catch (const std::exception& e) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                parallel_success = false;
+                parallel_error = e.what();
+            }
+        });
+        if (!parallel_success) {
+            throw std::runtime_error("Error occurred during parallel ECB processing: " + parallel_error);
+        }
+    };
+
+    // Phase 1: private warm-up.
+    run_ranges([&](EcbDedupRange<D>& range) {
+        range.process_cached(input_data, output_data, ECB_DEDUP_WARMUP_BLOCKS, NULL);
+    });
+
+    size_t warmup_hits = 0, warmup_blocks = 0;
+    for (size_t r = 0; r < num_ranges; ++r) {
+        warmup_hits += ranges[r].hits;
+        warmup_blocks += ranges[r].blocks;
+    }
+    const bool keep_dedup = warmup_hits >= ECB_DEDUP_MIN_HIT_RATE * warmup_blocks;
+
+    // Phase 2: continue against the merged table (or plain ECB if dedup does not pay).
+    std::unique_ptr<BlockCache> shared;
+    if (keep_dedup && num_ranges > 1) {
+        shared.reset(new BlockCache(ECB_DEDUP_SHARED_SLOTS));
+        for (size_t r = 0; r < num_ranges; ++r) {
+            shared->merge_from(ranges[r].local);
+        }
+    }
+    run_ranges([&](EcbDedupRange<D>& range) {
+        if (keep_dedup) {
+            range.process_cached(input_data, output_data, num_blocks, shared.get());
+        }
+        if (range.next_block < range.last_block) {
+            range.process_direct(input_data, output_data);
+        }
+    });
+
+    for (size_t r = 0; r < num_ranges; ++r) {
+        ranges[r].local.clear_secrets();
+    }
+    if (shared) shared->clear_secrets();
+    return input_len;
+}
+
+#endif // ECB_DEDUP_HPP
@@ -1,168 +1,33 @@
 #include <iostream>
 #include <fstream>
+#include <sstream>   // For std::istringstream
 #include <vector>
 #include <string>
 #include <stdexcept> // For std::runtime_error
 #include <cstring>   // For memcpy, memset
+#include <cstdlib>   // For strtoul
 #include <omp.h>     // OpenMP library
 
 // OpenSSL headers
 #include <openssl/evp.h>
 #include <openssl/rand.h> // For RAND_bytes if generating random salt/IV
 #include <openssl/err.h>  // For error reporting
-#include <openssl/conf.h> // For EVP_cleanup, OpenSSL_add_all_algorithms
-
-// --- Configuration ---
-const int BMP_HEADER_SIZE = 54; // Common size for BMP header
-const int PIXEL_DATA_OFFSET_LOCATION = 10; // Location of pixel data offset in BMP header
-const int AES_KEY_BITS = 256; // Using AES-256
-const int AES_KEY_BYTES = AES_KEY_BITS / 8;
-const int AES_IV_BYTES = 16;    // AES block size is 128 bits (16 bytes), so IV is 16 bytes
-const int AES_BLOCK_BYTES = 16; // AES block size
-const int PBKDF2_ITERATIONS = 10000; // Iterations for PBKDF2
-
-// --- OpenSSL Error Handling ---
-void handle_openssl_errors(const std::string& context_message = "") {
-    unsigned long err_code;
-    std::string error_string = context_message;
-    while ((err_code = ERR_get_error())) {
-        error_string += "OpenSSL Error: ";
-        error_string += ERR_error_string(err_code, NULL);
-        error_string += "\n";
-    }
-    if (!error_string.empty() && error_string != context_message) { // Check if errors were actually added
-        throw std::runtime_error(error_string);
-    }
-}
-
-// --- Key/IV Derivation ---
-// IMPORTANT: In a real application, for encryption, salt should be randomly generated
-// and stored/transmitted with the ciphertext. For decryption, the same salt must be used.
-// This example uses a FIXED salt for simplicity. DO NOT DO THIS IN PRODUCTION.
-bool derive_key_and_iv(const std::string& passphrase, const unsigned char* salt, int salt_len,
-                       unsigned char* key_out, int key_out_len,
-                       unsigned char* iv_out, int iv_out_len) {
-    if (key_out_len != AES_KEY_BYTES || iv_out_len != AES_IV_BYTES) {
-        std::cerr << "Error: Requested key/IV length mismatch with AES configuration." << std::endl;
-        return false;
-    }
-
-    // Derive the key
-    if (PKCS5_PBKDF2_HMAC(passphrase.c_str(), passphrase.length(),
-                          salt, salt_len,
-                          PBKDF2_ITERATIONS,
-                          EVP_sha256(), // Use SHA-256 for KDF
-                          key_out_len, key_out) != 1) {
-        std::cerr << "Error: PKCS5_PBKDF2_HMAC failed for key derivation." << std::endl;
-        handle_openssl_errors("Key derivation failed: ");
-        return false;
-    }
-
-    // Derive the IV. For simplicity, we derive it like the key but with a different "context"
-    // (e.g. by using a different salt or appending something to the passphrase internally).
-    // A common good practice for CBC is to generate a cryptographically random IV for each encryption.
-    // Here, we deterministically derive it from the passphrase + salt for consistency in this example.
-    // To make the IV derivation different from key derivation with the same inputs,
-    // we can use a different digest or a slightly modified salt concept for the IV part.
-    // For this example, we'll use a simple approach: use the derived key to seed an IV derivation,
-    // or use PBKDF2 again with a different "purpose" (e.g. different salt or different digest).
-    // Let's use PBKDF2 again but with a different digest (e.g., MD5) for the IV part to ensure it's different.
-    // This is just for example; random IV generation is preferred for CBC encryption.
-    if (PKCS5_PBKDF2_HMAC(passphrase.c_str(), passphrase.length(), // Passphrase
-                          salt, salt_len,                           // Salt (could use a modified salt for IV)
-                          PBKDF2_ITERATIONS / 2,                  // Fewer iterations or different count
-                          EVP_md5(),                              // Different hash for IV
-                          iv_out_len, iv_out) != 1) {
-        std::cerr << "Error: PKCS5_PBKDF2_HMAC failed for IV derivation." << std::endl;
-        handle_openssl_errors("IV derivation failed: ");
-        return false;
-    }
-    return true;
-}
-
-// --- AES Operation using OpenSSL EVP Interface ---
-bool aes_openssl_operation(
-    const unsigned char* input_data, int input_len,
-    unsigned char* output_data, int& output_len, // output_data buffer must be large enough
-    const unsigned char* key,
-    const unsigned char* iv,
-    const std::string& operation, // "encrypt" or "decrypt"
-    const std::string& mode,      // "ECB" or "CBC"
-    bool enable_padding           // PKCS#7 padding
-) {
-    EVP_CIPHER_CTX *ctx = NULL;
-    const EVP_CIPHER *cipher_type = NULL;
-    int len = 0;
-    output_len = 0;
-
-    try {
-        if (mode == "ECB") {
-            cipher_type = EVP_aes_256_ecb();
-        } else if (mode == "CBC") {
-            cipher_type = EVP_aes_256_cbc();
-        } else {
-            throw std::runtime_error("Unsupported AES mode: " + mode);
-        }
-
-        if (!(ctx = EVP_CIPHER_CTX_new())) {
-            handle_openssl_errors("EVP_CIPHER_CTX_new failed: ");
-            return false;
-        }
-
-        bool is_encrypt = (operation == "encrypt");
-
-        if (is_encrypt) {
-            if (1 != EVP_EncryptInit_ex(ctx, cipher_type, NULL, key, iv)) {
-                handle_openssl_errors("EVP_EncryptInit_ex failed: ");
-                EVP_CIPHER_CTX_free(ctx); return false;
-            }
-        } else { // Decrypt
-            if (1 != EVP_DecryptInit_ex(ctx, cipher_type, NULL, key, iv)) {
-                handle_openssl_errors("EVP_DecryptInit_ex failed: ");
-                EVP_CIPHER_CTX_free(ctx); return false;
-            }
-        }
-
-        // Set padding
-        if (1 != EVP_CIPHER_CTX_set_padding(ctx, enable_padding ? 1 : 0)) {
-             handle_openssl_errors("EVP_CIPHER_CTX_set_padding failed: ");
-             EVP_CIPHER_CTX_free(ctx); return false;
-        }
-
-
-        if (1 != EVP_CipherUpdate(ctx, output_data, &len, input_data, input_len)) {
-            handle_openssl_errors("EVP_CipherUpdate failed: ");
-            EVP_CIPHER_CTX_free(ctx); return false;
-        }
-        output_len = len;
-
-        if (is_encrypt) {
-            if (1 != EVP_EncryptFinal_ex(ctx, output_data + len, &len)) {
-                handle_openssl_errors("EVP_EncryptFinal_ex failed: ");
-                EVP_CIPHER_CTX_free(ctx); return false;
-            }
-        } else { // Decrypt
-            if (1 != EVP_DecryptFinal_ex(ctx, output_data + len, &len)) {
-                // This can fail if key/IV is wrong, ciphertext is corrupt, or padding is incorrect
-                std::cerr << "Warning: EVP_DecryptFinal_ex failed. This often means incorrect key/IV, corrupted data, or padding error." << std::endl;
-                handle_openssl_errors("EVP_DecryptFinal_ex failed (check key/IV/data/padding): ");
-                // output_len will remain as whatever EVP_CipherUpdate produced, final block fails.
-                // For robust error handling, you might want to clear output_data or signal a more specific error.
-                EVP_CIPHER_CTX_free(ctx); return false; // Indicate failure
-            }
-        }
-        output_len += len;
-
-    } catch (const std::exception& e) {
-        std::cerr << "Exception in aes_openssl_operation: " << e.what() << std::endl;
-        if(ctx) EVP_CIPHER_CTX_free(ctx);
-        return false;
-    }
-    
-    if(ctx) EVP_CIPHER_CTX_free(ctx);
-    return true;
-}
 
+#include "cipher_engine.hpp"  // AES engine, OpenSSL runtime and error handling
+#include "image_pipeline.hpp" // BMP parsing, key derivation and the pixel cipher pass
+#include "shm_server.hpp"     // --serve-shm mode
+#include "result_cache.hpp"   // Optional on-disk result cache (IMAGE_PROCESSOR_CACHE_DIR)
+#include "row_decrypt.hpp"    // --decrypt-rows mode
+#include "incremental_update.hpp" // --update and --manifest modes
+#include "reencrypt.hpp"      // --reencrypt mode
+#include "fanout.hpp"         // --fanout mode
+#include "pixel_codec.hpp"    // Optional compression before encryption (IMAGE_PROCESSOR_COMPRESS)
+#include "integrity_digest.hpp" // CRC32C of input and output, --verify mode
+#include "zygote_server.hpp"   // --zygote mode (pre-forked jobs for zygote_front)
+#include "http_server.hpp"     // --serve-http mode (c04's /sendData over native HTTP)
+#include "work_coordinator.hpp" // --coordinate and --work modes (tasks pulled by worker processes)
+#include "stream_file.hpp"     // Window-by-window processing of files too large for memory
+#include "async_engine.hpp"    // --batch mode (coroutine API over io_uring and the CPU pool)
 
 // --- BMP File Handling Utilities (from previous version) ---
 std::vector<unsigned char> read_file_bytes(const std::string& file_path) {
@@ -192,182 +57,498 @@ void write_file_bytes(const std::string& file_path, const std::vector<unsigned c
     file.close();
 }
 
-uint32_t get_pixel_data_offset(const std::vector<unsigned char>& header_data_segment) {
-    // Use the provided segment, assuming it's at least PIXEL_DATA_OFFSET_LOCATION + 4 bytes long
-    if (header_data_segment.size() < PIXEL_DATA_OFFSET_LOCATION + 4) {
-         // This might happen if full_image_data.size() < BMP_HEADER_SIZE initially.
-         // The main function checks full_image_data.size() >= BMP_HEADER_SIZE.
-         // Then bmp_header is created with BMP_HEADER_SIZE. So this path should be safe.
-        throw std::runtime_error("Error: BMP header segment is too small to read pixel data offset.");
-    }
-    return static_cast<uint32_t>(header_data_segment[PIXEL_DATA_OFFSET_LOCATION]) |
-           static_cast<uint32_t>(header_data_segment[PIXEL_DATA_OFFSET_LOCATION + 1]) << 8 |
-           static_cast<uint32_t>(header_data_segment[PIXEL_DATA_OFFSET_LOCATION + 2]) << 16 |
-           static_cast<uint32_t>(header_data_segment[PIXEL_DATA_OFFSET_LOCATION + 3]) << 24;
+
+// --- Row Range Decryption ---
+// Decrypts only the rows [first_row, first_row + row_count) (row 0 is the top of the image)
+// and writes them as a standalone BMP.
+int decrypt_rows_main(char* argv[]) {
+    std::string input_path = argv[2];
+    std::string passphrase = argv[3];
+    std::string output_path = argv[4];
+    AesMode mode;
+    if (!parse_aes_mode(argv[5], mode)) {
+        std::cerr << "Error: Invalid mode. Must be 'ECB' or 'CBC'." << std::endl; return 1;
+    }
+    char* end_first = NULL;
+    char* end_count = NULL;
+    unsigned long long first_row = std::strtoull(argv[6], &end_first, 10);
+    unsigned long long row_count = std::strtoull(argv[7], &end_count, 10);
+    if (*argv[6] == '\0' || *end_first != '\0' || *argv[7] == '\0' || *end_count != '\0') {
+        std::cerr << "Error: Row numbers must be non-negative integers." << std::endl; return 1;
+    }
+
+    init_openssl_runtime();
+    std::cout << "Decrypting rows " << first_row << " to " << (first_row + row_count) << " of " << input_path
+              << " (" << argv[5] << ")..." << std::endl;
+    try {
+        std::vector<unsigned char> rows_image = decrypt_bmp_rows(input_path, passphrase, mode, first_row, row_count);
+        write_file_bytes(output_path, rows_image);
+        std::cout << "Row range decrypted successfully. Output saved to: " << output_path << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "An error occurred: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
 }
 
 
-// --- Main Application Logic ---
-int main(int argc, char* argv[]) {
-    if (argc != 6) {
-        std::cerr << "Usage: " << argv[0] << " <input_bmp_path> <aes_passphrase> <output_bmp_path> <encrypt|decrypt> <ECB|CBC>" << std::endl;
+// --- Incremental Update ---
+// Brings an existing encrypted BMP up to date with an edited plaintext, re-encrypting
+// only the changed row tiles. <previous> is the previous plaintext BMP or its manifest.
+int update_main(int argc, char* argv[]) {
+    std::string encrypted_path = argv[2];
+    std::string passphrase = argv[3];
+    AesMode mode;
+    if (!parse_aes_mode(argv[4], mode)) {
+        std::cerr << "Error: Invalid mode. Must be 'ECB' or 'CBC'." << std::endl; return 1;
+    }
+    std::string new_path = argv[5];
+    std::string previous_path = argv[6];
+    std::string manifest_out = argc == 8 ? argv[7] : "";
+
+    init_openssl_runtime();
+    std::cout << "Updating " << encrypted_path << " from " << new_path << " (" << argv[4] << ")..." << std::endl;
+    try {
+        std::vector<unsigned char> new_image = read_file_bytes(new_path);
+        std::vector<unsigned char> previous = read_file_bytes(previous_path);
+        UpdateStats stats = update_encrypted_image(encrypted_path, passphrase, mode, new_image, previous, manifest_out);
+        if (stats.full_rewrite) {
+            std::cout << "Image layout changed; re-encrypted the whole image." << std::endl;
+        }
+        std::cout << "Changed tiles: " << stats.changed_tiles << " of " << stats.tiles
+                  << ", bytes written: " << stats.bytes_written << std::endl;
+        if (!manifest_out.empty()) {
+            std::cout << "Tile manifest saved to: " << manifest_out << std::endl;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "An error occurred: " << e.what() << std::endl;
         return 1;
     }
+    return 0;
+}
 
-    std::string input_path = argv[1];
-    std::string passphrase = argv[2];
+// Writes the tile manifest of a plaintext BMP, for a later --update.
+int manifest_main(char* argv[]) {
+    init_openssl_runtime();
+    try {
+        write_tile_manifest(argv[4], manifest_for_image(read_file_bytes(argv[2]), argv[3]));
+        std::cout << "Tile manifest saved to: " << argv[4] << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "An error occurred: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+
+// --- Key Rotation ---
+// Re-encrypts an encrypted BMP under a new passphrase and/or mode in one pass,
+// without writing the plaintext anywhere.
+int reencrypt_main(char* argv[]) {
+    std::string input_path = argv[2];
     std::string output_path = argv[3];
-    std::string operation_str = argv[4];
-    std::string mode_str = argv[5];
+    std::string old_passphrase = argv[4];
+    std::string new_passphrase = argv[6];
+    AesMode old_mode;
+    AesMode new_mode;
+    if (!parse_aes_mode(argv[5], old_mode) || !parse_aes_mode(argv[7], new_mode)) {
+        std::cerr << "Error: Invalid mode. Must be 'ECB' or 'CBC'." << std::endl; return 1;
+    }
+
+    init_openssl_runtime();
+    std::cout << "Re-encrypting " << input_path << " (" << argv[5] << " -> " << argv[7] << ")..." << std::endl;
+    try {
+        std::vector<unsigned char> image = read_file_bytes(input_path);
+        // Processed in place; the spare block holds a CBC padding block that ECB input lacks.
+        const size_t image_len = image.size();
+        image.resize(max_processed_image_len(image_len));
+        image.resize(reencrypt_image_buffer(image.data(), image_len, image.data(), image.size(),
+                                            old_passphrase, old_mode, new_passphrase, new_mode));
+        write_file_bytes(output_path, image);
+        std::cout << "Re-encryption successful. Output saved to: " << output_path << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "An error occurred: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+
+// --- Multi-Output Fan-Out ---
+// One input, several targets given as <aes_passphrase> <output_bmp_path> <encrypt|decrypt> <ECB|CBC>
+// groups. The input is read once; every target's output matches a separate run.
+int fanout_main(int argc, char* argv[]) {
+    std::string input_path = argv[2];
+    const size_t num_targets = static_cast<size_t>(argc - 3) / 4;
+    std::vector<FanoutTarget> targets(num_targets);
+    for (size_t t = 0; t < num_targets; ++t) {
+        char** group = argv + 3 + 4 * t;
+        targets[t].passphrase = group[0];
+        if (!parse_direction(group[2], targets[t].direction)) {
+            std::cerr << "Error: Invalid operation. Must be 'encrypt' or 'decrypt'." << std::endl; return 1;
+        }
+        if (!parse_aes_mode(group[3], targets[t].mode)) {
+            std::cerr << "Error: Invalid mode. Must be 'ECB' or 'CBC'." << std::endl; return 1;
+        }
+    }
+
+    init_openssl_runtime();
+    std::cout << "Processing " << input_path << " into " << num_targets << " outputs..." << std::endl;
+    int status = 0;
+    try {
+        std::vector<unsigned char> image = read_file_bytes(input_path);
+        std::vector<std::vector<unsigned char>> outputs(num_targets);
+        for (size_t t = 0; t < num_targets; ++t) {
+            outputs[t].resize(max_processed_image_len(image.size()));
+            targets[t].output_data = outputs[t].data();
+        }
+        process_image_fanout(image.data(), image.size(), targets);
+        for (size_t t = 0; t < num_targets; ++t) {
+            char** group = argv + 3 + 4 * t;
+            if (!targets[t].error.empty()) {
+                std::cerr << "An error occurred for " << group[1] << ": " << targets[t].error << std::endl;
+                status = 1;
+                continue;
+            }
+            outputs[t].resize(targets[t].output_len);
+            write_file_bytes(group[1], outputs[t]);
+            std::cout << group[2] << " " << group[3] << " output saved to: " << group[1] << std::endl;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "An error occurred: " << e.what() << std::endl;
+        return 1;
+    }
+    return status;
+}
+
 
-    if (operation_str != "encrypt" && operation_str != "decrypt") {
+// --- Coordinated Processing ---
+// Serves the image's tasks to --work processes on <port> and writes the reassembled output.
+int coordinate_main(char* argv[]) {
+    unsigned long port = std::strtoul(argv[2], NULL, 10);
+    std::string input_path = argv[3];
+    std::string passphrase = argv[4];
+    std::string output_path = argv[5];
+    Direction direction;
+    AesMode mode;
+    if (port == 0 || port > 65535) {
+        std::cerr << "Error: Invalid port: " << argv[2] << std::endl; return 1;
+    }
+    if (!parse_direction(argv[6], direction)) {
         std::cerr << "Error: Invalid operation. Must be 'encrypt' or 'decrypt'." << std::endl; return 1;
     }
-    if (mode_str != "ECB" && mode_str != "CBC") {
+    if (!parse_aes_mode(argv[7], mode)) {
         std::cerr << "Error: Invalid mode. Must be 'ECB' or 'CBC'." << std::endl; return 1;
     }
+    const char* bind_address = std::getenv("IMAGE_PROCESSOR_COORDINATOR_BIND");
+
+    init_openssl_runtime();
+    try {
+        std::vector<unsigned char> image = read_file_bytes(input_path);
+        std::vector<unsigned char> output(max_processed_image_len(image.size()));
+        output.resize(process_image_coordinated(image.data(), image.size(), output.data(), output.size(),
+                                                passphrase, mode, direction,
+                                                bind_address != NULL && *bind_address != '\0' ? bind_address : "127.0.0.1",
+                                                static_cast<uint16_t>(port)));
+        write_file_bytes(output_path, output);
+        std::cout << "Coordinated " << argv[6] << " successful. Output saved to: " << output_path << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "An error occurred: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
 
-    // Initialize OpenSSL (recommended for some versions/setups)
-    OpenSSL_add_all_algorithms(); // Deprecated in OpenSSL 3.0, but good for compatibility
-    ERR_load_crypto_strings();
-    // EVP_cleanup(); // Also deprecated, OpenSSL_cleanup() is newer but auto-cleanup is common
 
-    std::cout << "Starting image processing with OpenSSL..." << std::endl;
-    std::cout << "Input: " << input_path << ", Output: " << output_path << std::endl;
-    std::cout << "Operation: " << operation_str << ", Mode: " << mode_str << std::endl;
+// --- Batch ---
+// Every line of the list file is one job: <input_bmp_path> <aes_passphrase> <output_bmp_path>
+// <encrypt|decrypt> <ECB|CBC|GCM|CHACHA20|AUTO>; blank lines and lines starting with '#' are
+// skipped. All jobs are in flight at once on the async runtime; each output matches a
+// separate run (the same result cache, compression and streaming settings apply).
+int batch_main(char* argv[]) {
+    std::ifstream list(argv[2]);
+    if (!list.is_open()) {
+        std::cerr << "Error: Could not open file for reading: " << argv[2] << std::endl; return 1;
+    }
+    std::vector<AsyncImageRequest> requests;
+    std::string line;
+    for (size_t line_number = 1; std::getline(list, line); ++line_number) {
+        std::istringstream fields(line);
+        std::string input_path, passphrase, output_path, operation_str, mode_str, extra;
+        if (!(fields >> input_path) || input_path[0] == '#') continue;
+        AsyncImageRequest request;
+        if (!(fields >> passphrase >> output_path >> operation_str >> mode_str) || (fields >> extra) ||
+            !parse_direction(operation_str, request.direction) || !parse_aes_mode(mode_str, request.mode, true)) {
+            std::cerr << "Error: Invalid job on line " << line_number << " of " << argv[2] << "." << std::endl; return 1;
+        }
+        request.input_path = input_path;
+        request.passphrase = passphrase;
+        request.output_path = output_path;
+        requests.push_back(request);
+    }
 
+    init_openssl_runtime();
+    PixelCodec codec;
     try {
-        std::vector<unsigned char> full_image_data = read_file_bytes(input_path);
-        if (full_image_data.size() < BMP_HEADER_SIZE) {
-            throw std::runtime_error("Error: Input file is smaller than a typical BMP header.");
+        codec = pixel_codec_from_env();
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl; return 1;
+    }
+    AsyncRuntime runtime(0, result_cache_config_from_env(0));
+    std::cout << "Processing " << requests.size() << " jobs on " << runtime.pool().concurrency() - 1
+              << " CPU threads, I/O through " << (runtime.uring() ? "io_uring" : "blocking reads and writes")
+              << "..." << std::endl;
+    std::vector<task<AsyncImageResult>> jobs;
+    for (AsyncImageRequest& request : requests) {
+        if (request.direction == Direction::Encrypt) request.codec = codec;
+        jobs.push_back(runtime.process(request));
+        OPENSSL_cleanse(&request.passphrase[0], request.passphrase.size());
+    }
+    std::vector<async_detail::Outcome<AsyncImageResult>> outcomes = sync_wait_all(std::move(jobs));
+
+    int status = 0;
+    for (size_t i = 0; i < outcomes.size(); ++i) {
+        const AsyncImageRequest& request = requests[i];
+        if (outcomes[i].error) {
+            try {
+                std::rethrow_exception(outcomes[i].error);
+            } catch (const std::exception& e) {
+                std::cout << "FAILED: " << request.input_path << ": " << e.what() << std::endl;
+            }
+            status = 1;
+            continue;
         }
+        const AsyncImageResult& result = *outcomes[i].value;
+        std::cout << "OK: " << request.input_path << " -> " << request.output_path << " (" << result.input_len
+                  << " -> " << result.output_len << " bytes, CRC32C " << crc32c_hex(result.input_crc) << " -> "
+                  << crc32c_hex(result.output_crc) << ")" << std::endl;
+    }
+    return status;
+}
 
-        std::vector<unsigned char> bmp_header_for_offset_calc(full_image_data.begin(), full_image_data.begin() + BMP_HEADER_SIZE);
-        uint32_t pixel_offset = get_pixel_data_offset(bmp_header_for_offset_calc);
+// --- Integrity Check ---
+// Checks a stored file against the CRC32C printed when it was produced.
+int verify_main(char* argv[]) {
+    std::string file_path = argv[2];
+    std::string expected = argv[3];
+    char* end = NULL;
+    unsigned long expected_crc = std::strtoul(expected.c_str(), &end, 16);
+    if (expected.empty() || expected.size() > 8 || *end != '\0') {
+        std::cerr << "Error: Expected digest must be a CRC32C in hex (up to 8 digits)." << std::endl; return 1;
+    }
+    try {
+        const uint32_t crc = crc32c_file(file_path);
+        if (crc != expected_crc) {
+            std::cout << "MISMATCH: " << file_path << " has CRC32C " << crc32c_hex(crc)
+                      << ", expected " << crc32c_hex(static_cast<uint32_t>(expected_crc)) << std::endl;
+            return 1;
+        }
+        std::cout << "OK: " << file_path << " CRC32C " << crc32c_hex(crc) << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "An error occurred: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+void print_digests(uint32_t input_crc, uint32_t output_crc) {
+    std::cout << "Input CRC32C: " << crc32c_hex(input_crc) << std::endl;
+    std::cout << "Output CRC32C: " << crc32c_hex(output_crc) << std::endl;
+}
 
-        if (pixel_offset >= full_image_data.size() || pixel_offset < BMP_HEADER_SIZE) {
-             // Basic sanity check for pixel_offset. It should be at least BMP_HEADER_SIZE
-             // if the initial header part was indeed that size.
-             // A more robust BMP parser would validate various header fields.
-            throw std::runtime_error("Error: Invalid pixel data offset found in BMP header or header too small.");
+// What a single run did, from the result of AsyncRuntime::process. cpu_threads is the
+// pool size a split pass runs on.
+void print_image_report(const AsyncImageResult& result, const AsyncImageRequest& request, size_t cpu_threads) {
+    const std::string mode_name = aes_mode_name(result.mode);
+    if (result.path == AsyncImagePath::Streamed) {
+        std::cout << "Streamed " << mode_name << " in windows of " << stream_window_bytes() / (1024 * 1024)
+                  << " MB." << std::endl;
+        if (result.resumed_at > 0) {
+            std::cout << "Resumed from checkpoint at pixel byte " << result.resumed_at << "." << std::endl;
+        }
+    } else {
+        std::cout << "Actual BMP Header size (from offset): " << result.header_len << " bytes." << std::endl;
+        std::cout << "Pixel data size: " << result.pixel_len << " bytes." << std::endl;
+    }
+    if (request.mode == AesMode::AUTO) {
+        const char* reason = request.direction == Direction::Decrypt ? " (from the payload trailer)."
+                           : aesni_available() ? " (AES instructions available)." : " (no AES instructions).";
+        std::cout << "Mode AUTO resolved to " << mode_name << reason << std::endl;
+    }
+
+    if (result.path == AsyncImagePath::Cached) {
+        std::cout << "Result cache hit; key derivation and AES processing skipped." << std::endl;
+    } else if (result.mode == AesMode::CBC && request.direction == Direction::Encrypt) {
+        std::cout << "Processed CBC mode serially (CBC encryption chains every block)." << std::endl;
+    } else {
+        // ECB, CBC decryption (which only chains on ciphertext), GCM and ChaCha20 split into
+        // ranges, unless the pixel data is below OMP_PARALLEL_MIN_BYTES (streamed windows never are).
+        const uint64_t cipher_len = result.compressed != PixelCodec::None ? result.output_len - result.header_len
+                                                                          : result.pixel_len;
+        const size_t threads = result.path == AsyncImagePath::Streamed || cipher_len >= OMP_PARALLEL_MIN_BYTES
+                             ? cpu_threads : 1;
+        std::cout << "Processed " << mode_name << " mode on " << threads << (threads == 1 ? " CPU thread." : " CPU threads.")
+                  << std::endl;
+    }
+    if (result.path != AsyncImagePath::Cached && result.mode == AesMode::ECB) {
+        if (ecb_dedup_enabled()) {
+            std::cout << "ECB block dedup enabled (repeated blocks are copied from a cache)." << std::endl;
         }
-        
-        std::vector<unsigned char> actual_header_data(full_image_data.begin(), full_image_data.begin() + pixel_offset);
-        std::vector<unsigned char> pixel_data(full_image_data.begin() + pixel_offset, full_image_data.end());
+        // ECB is processed without padding so the output keeps the input size. If the
+        // pixel data size is not a multiple of AES_BLOCK_BYTES, the last partial block
+        // is not processed.
+        if (result.path == AsyncImagePath::Buffered && result.pixel_len % AES_BLOCK_BYTES != 0 &&
+            result.compressed == PixelCodec::None && result.decompressed == PixelCodec::None) {
+            std::cout << "Warning: Pixel data size (" << result.pixel_len
+                      << ") is not a multiple of AES block size (" << AES_BLOCK_BYTES
+                      << "). For parallel ECB without padding per chunk, the last partial block will be ignored." << std::endl;
+        }
+    }
 
-        if (pixel_data.empty() && operation_str == "encrypt") { // Allow empty pixel data for decryption attempt if header is present
-            throw std::runtime_error("Error: No pixel data found in BMP file for encryption.");
+    if (request.codec != PixelCodec::None) {
+        if (result.compressed != PixelCodec::None) {
+            std::cout << "Compressed pixel data with " << pixel_codec_name(result.compressed) << " before encryption." << std::endl;
+        } else {
+            std::cout << "Pixel data does not compress (or the BMP header cannot record it); encrypted it as is." << std::endl;
         }
-        std::cout << "Actual BMP Header size (from offset): " << actual_header_data.size() << " bytes." << std::endl;
-        std::cout << "Pixel data size: " << pixel_data.size() << " bytes." << std::endl;
+    }
+    if (result.decompressed != PixelCodec::None) {
+        std::cout << "Decompressed " << pixel_codec_name(result.decompressed) << " pixel data: " << result.pixel_len
+                  << " -> " << result.output_len - result.header_len << " bytes." << std::endl;
+    }
+    std::cout << "AES processing complete. " << result.input_len << " -> " << result.output_len << " bytes." << std::endl;
+    print_digests(result.input_crc, result.output_crc);
+    std::cout << "Image processing finished successfully. Output saved to: " << request.output_path << std::endl;
+}
 
-        // --- Derive Key and IV ---
-        // IMPORTANT: FIXED SALT - NOT FOR PRODUCTION! Generate & store random salt.
-        unsigned char fixed_salt[] = "OpenMP_AES_Salt"; // Example fixed salt
-        unsigned char derived_key[AES_KEY_BYTES];
-        unsigned char derived_iv[AES_IV_BYTES];
 
-        if (!derive_key_and_iv(passphrase, fixed_salt, sizeof(fixed_salt) - 1, derived_key, AES_KEY_BYTES, derived_iv, AES_IV_BYTES)) {
-            throw std::runtime_error("Failed to derive AES key and IV from passphrase.");
+// --- Main Application Logic ---
+// Everything a single invocation does; also the entry point of jobs forked by --zygote.
+int run_command_line(int argc, char* argv[]) {
+    if (argc >= 3 && argc <= 4 && std::string(argv[1]) == "--serve-shm") {
+        size_t slab_mb = argc == 4 ? std::strtoul(argv[3], NULL, 10) : SHM_DEFAULT_SLAB_MB;
+        if (slab_mb == 0) {
+            std::cerr << "Error: Invalid slab size in MB: " << argv[3] << std::endl; return 1;
         }
-        std::cout << "AES Key and IV derived successfully." << std::endl;
-
-
-        // --- Perform AES operation ---
-        std::vector<unsigned char> processed_pixel_data; // To store output
-
-        if (mode_str == "ECB") {
-            std::cout << "Processing ECB mode with OpenMP..." << std::endl;
-            std::cout << "Number of available OpenMP threads: " << omp_get_max_threads() << std::endl;
-            
-            // For ECB, we can try to parallelize. However, padding is an issue.
-            // If we disable padding, pixel_data size must be a multiple of AES_BLOCK_BYTES.
-            // If we enable padding, it should be applied ONCE to the whole data, not per chunk.
-            // This example will process ECB chunks in parallel *without padding* per chunk.
-            // This means if pixel_data.size() is not a multiple of AES_BLOCK_BYTES,
-            // the last partial block will NOT be processed by this loop.
-            // A robust solution would pad pixel_data first or handle the remainder.
-
-            if (pixel_data.size() % AES_BLOCK_BYTES != 0) {
-                std::cout << "Warning: Pixel data size (" << pixel_data.size()
-                          << ") is not a multiple of AES block size (" << AES_BLOCK_BYTES
-                          << "). For parallel ECB without padding per chunk, the last partial block will be ignored." << std::endl;
-            }
-            
-            size_t num_full_blocks = pixel_data.size() / AES_BLOCK_BYTES;
-            processed_pixel_data.resize(num_full_blocks * AES_BLOCK_BYTES); // Output will be same size as input processed
-
-            bool ecb_parallel_success = true;
-            #pragma omp parallel for schedule(static)
-            for (size_t block_idx = 0; block_idx < num_full_blocks; ++block_idx) {
-                if (!ecb_parallel_success) continue; // Skip if an error occurred in another thread
-
-                const unsigned char* chunk_input_ptr = pixel_data.data() + (block_idx * AES_BLOCK_BYTES);
-                unsigned char* chunk_output_ptr = processed_pixel_data.data() + (block_idx * AES_BLOCK_BYTES);
-                int chunk_output_len = 0;
-
-                // Process one AES block, NO PADDING for these individual blocks in parallel ECB
-                if (!aes_openssl_operation(chunk_input_ptr, AES_BLOCK_BYTES,
-                                           chunk_output_ptr, chunk_output_len,
-                                           derived_key, derived_iv, // IV is ignored by EVP_aes_ecb anyway
-                                           operation_str, mode_str,
-                                           false /* no padding for individual blocks */)) {
-                    #pragma omp critical
-                    {
-                        std::cerr << "Error processing ECB block " << block_idx << " in thread " << omp_get_thread_num() << std::endl;
-                        ecb_parallel_success = false;
-                    }
-                } else if (chunk_output_len != AES_BLOCK_BYTES) {
-                     #pragma omp critical
-                    {
-                        std::cerr << "Error: ECB block " << block_idx << " output length mismatch (" << chunk_output_len << ")" << std::endl;
-                        ecb_parallel_success = false;
-                    }
-                }
-            } // end omp parallel for
-
-            if (!ecb_parallel_success) {
-                throw std::runtime_error("Error occurred during parallel ECB processing.");
-            }
-            // Handle any remaining partial block if necessary (not done in this simplified loop)
-
-        } else if (mode_str == "CBC") {
-            std::cout << "Processing CBC mode serially (OpenMP not used for CBC crypto part due to sequential nature)..." << std::endl;
-            // For CBC, process the entire pixel data at once to maintain the chain.
-            // Output buffer needs to accommodate potential padding.
-            processed_pixel_data.resize(pixel_data.size() + AES_BLOCK_BYTES); // Max possible size with padding
-            int actual_output_len = 0;
-
-            if (!aes_openssl_operation(pixel_data.data(), pixel_data.size(),
-                                       processed_pixel_data.data(), actual_output_len,
-                                       derived_key, derived_iv,
-                                       operation_str, mode_str,
-                                       true /* enable padding for whole data */)) {
-                throw std::runtime_error("Error during serial CBC processing.");
-            }
-            processed_pixel_data.resize(actual_output_len); // Trim to actual size
+        try {
+            return run_shm_server(argv[2], slab_mb * 1024 * 1024);
+        } catch (const std::exception& e) {
+            std::cerr << "An error occurred: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+    if (argc >= 3 && argc <= 4 && std::string(argv[1]) == "--serve-http") {
+        unsigned long port = std::strtoul(argv[2], NULL, 10);
+        if (port == 0 || port > 65535) {
+            std::cerr << "Error: Invalid port: " << argv[2] << std::endl; return 1;
+        }
+        try {
+            return run_http_server(argc == 4 ? argv[3] : "127.0.0.1", static_cast<uint16_t>(port));
+        } catch (const std::exception& e) {
+            std::cerr << "An error occurred: " << e.what() << std::endl;
+            return 1;
         }
+    }
+    if (argc == 8 && std::string(argv[1]) == "--coordinate") {
+        return coordinate_main(argv);
+    }
+    if (argc == 4 && std::string(argv[1]) == "--work") {
+        return run_worker(argv[2], argv[3]);
+    }
+    if (argc == 8 && std::string(argv[1]) == "--decrypt-rows") {
+        return decrypt_rows_main(argv);
+    }
+    if ((argc == 7 || argc == 8) && std::string(argv[1]) == "--update") {
+        return update_main(argc, argv);
+    }
+    if (argc == 8 && std::string(argv[1]) == "--reencrypt") {
+        return reencrypt_main(argv);
+    }
+    if (argc >= 7 && (argc - 3) % 4 == 0 && std::string(argv[1]) == "--fanout") {
+        return fanout_main(argc, argv);
+    }
+    if (argc == 3 && std::string(argv[1]) == "--batch") {
+        return batch_main(argv);
+    }
+    if (argc == 4 && std::string(argv[1]) == "--verify") {
+        return verify_main(argv);
+    }
+    if (argc == 5 && std::string(argv[1]) == "--manifest") {
+        return manifest_main(argv);
+    }
+    if (argc != 6) {
+        std::cerr << "Usage: " << argv[0] << " <input_bmp_path> <aes_passphrase> <output_bmp_path> <encrypt|decrypt> <ECB|CBC|GCM|CHACHA20|AUTO>" << std::endl;
+        std::cerr << "       " << argv[0] << " --serve-shm <shm_name> [slab_mb]" << std::endl;
+        std::cerr << "       " << argv[0] << " --zygote <socket_path>" << std::endl;
+        std::cerr << "       " << argv[0] << " --serve-http <port> [bind_address]" << std::endl;
+        std::cerr << "       " << argv[0] << " --coordinate <port> <input_bmp_path> <aes_passphrase> <output_bmp_path> <encrypt|decrypt> <ECB|CBC>" << std::endl;
+        std::cerr << "       " << argv[0] << " --work <coordinator_host> <port>" << std::endl;
+        std::cerr << "       " << argv[0] << " --decrypt-rows <input_bmp_path> <aes_passphrase> <output_bmp_path> <ECB|CBC> <first_row> <row_count>" << std::endl;
+        std::cerr << "       " << argv[0] << " --update <encrypted_bmp_path> <aes_passphrase> <ECB|CBC> <new_bmp_path> <previous_bmp_or_manifest> [manifest_out]" << std::endl;
+        std::cerr << "       " << argv[0] << " --reencrypt <input_bmp_path> <output_bmp_path> <old_passphrase> <old_mode> <new_passphrase> <new_mode>" << std::endl;
+        std::cerr << "       " << argv[0] << " --fanout <input_bmp_path> <aes_passphrase> <output_bmp_path> <encrypt|decrypt> <ECB|CBC> [<aes_passphrase> <output_bmp_path> <encrypt|decrypt> <ECB|CBC> ...]" << std::endl;
+        std::cerr << "       " << argv[0] << " --batch <job_list_path>" << std::endl;
+        std::cerr << "       " << argv[0] << " --verify <file_path> <crc32c_hex>" << std::endl;
+        std::cerr << "       " << argv[0] << " --manifest <bmp_path> <aes_passphrase> <manifest_out>" << std::endl;
+        return 1;
+    }
 
-        std::cout << "AES processing complete. Processed pixel data size: " << processed_pixel_data.size() << " bytes." << std::endl;
+    std::string input_path = argv[1];
+    std::string passphrase = argv[2];
+    std::string output_path = argv[3];
+    std::string operation_str = argv[4];
+    std::string mode_str = argv[5];
 
-        // Combine header and processed pixel data
-        std::vector<unsigned char> output_image_data = actual_header_data;
-        output_image_data.insert(output_image_data.end(), processed_pixel_data.begin(), processed_pixel_data.end());
+    Direction direction;
+    AesMode mode;
+    if (!parse_direction(operation_str, direction)) {
+        std::cerr << "Error: Invalid operation. Must be 'encrypt' or 'decrypt'." << std::endl; return 1;
+    }
+    if (!parse_aes_mode(mode_str, mode, true)) {
+        std::cerr << "Error: Invalid mode. Must be 'ECB', 'CBC', 'GCM', 'CHACHA20' or 'AUTO'." << std::endl; return 1;
+    }
+
+    // Initialize OpenSSL without the eager algorithm table and error string loading
+    init_openssl_runtime();
 
-        write_file_bytes(output_path, output_image_data);
-        std::cout << "Image processing finished successfully. Output saved to: " << output_path << std::endl;
+    std::cout << "Starting image processing with OpenSSL..." << std::endl;
+    std::cout << "Input: " << input_path << ", Output: " << output_path << std::endl;
+    std::cout << "Operation: " << operation_str << ", Mode: " << mode_str << std::endl;
 
+    try {
+        // A one-shot process has nothing in memory to reuse, so only the disk tier of the
+        // result cache is on by default. With a single request there is no I/O to overlap,
+        // so it reads and writes directly rather than setting up io_uring.
+        AsyncRuntime runtime(0, result_cache_config_from_env(0), AsyncIo::Blocking);
+        AsyncImageRequest request;
+        request.input_path = input_path;
+        request.output_path = output_path;
+        request.passphrase = passphrase;
+        request.mode = mode;
+        request.direction = direction;
+        request.codec = direction == Direction::Encrypt ? pixel_codec_from_env() : PixelCodec::None;
+        task<AsyncImageResult> job = runtime.process(request);
+        OPENSSL_cleanse(&request.passphrase[0], request.passphrase.size());
+        const AsyncImageResult result = sync_wait(std::move(job));
+        print_image_report(result, request, runtime.pool().concurrency() - 1);
     } catch (const std::exception& e) {
         std::cerr << "An error occurred: " << e.what() << std::endl;
-        // Clean up OpenSSL
-        ERR_free_strings();
-        EVP_cleanup(); // Or OpenSSL_cleanup() for newer OpenSSL
+        // OpenSSL 1.1+ releases its state automatically at exit
         return 1;
     }
 
-    // Clean up OpenSSL
-    ERR_free_strings();
-    EVP_cleanup(); // Or OpenSSL_cleanup() for newer OpenSSL
     return 0;
 }
 
+int main(int argc, char* argv[]) {
+    // The zygote is only started directly; jobs forked from it go through run_command_line.
+    if (argc == 3 && std::string(argv[1]) == "--zygote") {
+        try {
+            return run_zygote_server(argv[2], run_command_line);
+        } catch (const std::exception& e) {
+            std::cerr << "An error occurred: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+    return run_command_line(argc, argv);
+}
@@ -0,0 +1,184 @@
+#ifndef IMAGECRYPT_H
+#define IMAGECRYPT_H
+
+/*
+ * libimagecrypt - in-process BMP encryption with the same output as image_processor_ssl.
+ *
+ * Plain C ABI so it can be bound directly from Java (Panama FFM downcalls) or any
+ * other FFI without a wrapper. All functions are thread-safe. Errors are reported
+ * through the returned status code; imagecrypt_last_error() gives a message for the
+ * most recent failure on the calling thread. Nothing is written to stdout/stderr.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Status codes */
+#define IMAGECRYPT_OK                    0
+#define IMAGECRYPT_ERR_ARGUMENT         -1 /* NULL pointer, unknown mode/operation */
+#define IMAGECRYPT_ERR_FORMAT           -2 /* input is not a BMP this library can process */
+#define IMAGECRYPT_ERR_BUFFER_TOO_SMALL -3 /* output_capacity < imagecrypt_max_output_size() */
+#define IMAGECRYPT_ERR_CRYPTO           -4 /* OpenSSL failure, e.g. wrong key on CBC decrypt or a GCM tag mismatch */
+#define IMAGECRYPT_ERR_INTERNAL         -5
+
+/* Operations */
+#define IMAGECRYPT_ENCRYPT 0
+#define IMAGECRYPT_DECRYPT 1
+
+/* Modes */
+#define IMAGECRYPT_MODE_ECB 0
+#define IMAGECRYPT_MODE_CBC 1
+/* The modes below are accepted by imagecrypt_process and the shm server only. */
+#define IMAGECRYPT_MODE_GCM      2 /* Authenticated; appends a random nonce and the tag */
+#define IMAGECRYPT_MODE_CHACHA20 3 /* Appends a random nonce; fast without AES instructions */
+#define IMAGECRYPT_MODE_AUTO     4 /* CBC, or CHACHA20 on CPUs without AES instructions */
+
+/*
+ * Compression flags, OR'd into the mode of an imagecrypt_process or shm server
+ * encryption: the pixel data is compressed first when that makes it smaller. The BMP
+ * header records it (reserved fields and file size), so decryption needs no flag;
+ * flags are ignored on decryption. Compression needs a BMP whose reserved fields are
+ * zero and whose file size field is exact; other BMPs are encrypted uncompressed.
+ */
+#define IMAGECRYPT_COMPRESS_LZ4  0x100
+#define IMAGECRYPT_COMPRESS_ZSTD 0x200
+
+/* Bytes an output may exceed its input by: a GCM nonce and tag (12 + 16). */
+#define IMAGECRYPT_OUTPUT_SLACK_BYTES 28
+
+/*
+ * Starts the worker pool with num_threads threads (0 = one per online CPU, or the
+ * IMAGECRYPT_THREADS environment variable). Optional: the first imagecrypt_process
+ * call starts the pool with the default size. Returns IMAGECRYPT_ERR_ARGUMENT if the
+ * pool is already running.
+ */
+int imagecrypt_init(int num_threads);
+
+/* Stops the worker pool. No other call may be in progress. */
+void imagecrypt_shutdown(void);
+
+/*
+ * Output buffer size that is enough for a BMP of input_len bytes, except for the
+ * decryption of a compressed encryption, which grows back to the size recorded in its
+ * header (imagecrypt_process reports that size; see there). Always input_len plus
+ * IMAGECRYPT_OUTPUT_SLACK_BYTES, for callers that size buffers without the library.
+ */
+size_t imagecrypt_max_output_size(size_t input_len);
+
+/*
+ * Encrypts or decrypts the pixel data of the BMP in input into output; the header is
+ * copied unchanged. input and output may be the same buffer (in-place), but must not
+ * otherwise overlap. The passphrase is passed as bytes and need not be NUL-terminated.
+ * On success *output_len receives the number of bytes written.
+ * IMAGECRYPT_MODE_GCM appends a random nonce and the authentication tag to the pixel
+ * data; decryption returns IMAGECRYPT_ERR_CRYPTO, with output wiped, if the tag fails.
+ * If output_capacity is too small, returns IMAGECRYPT_ERR_BUFFER_TOO_SMALL and stores
+ * the required size in *output_len.
+ */
+int imagecrypt_process(const uint8_t* input, size_t input_len,
+                       uint8_t* output, size_t output_capacity, size_t* output_len,
+                       const uint8_t* passphrase, size_t passphrase_len,
+                       int operation, int mode);
+
+/* One output of imagecrypt_process_multi. output_len and status are set by the call. */
+typedef struct imagecrypt_target {
+    const uint8_t* passphrase;
+    size_t passphrase_len;
+    int operation;
+    int mode;
+    uint8_t* output;
+    size_t output_capacity;
+    size_t output_len;
+    int status;
+} imagecrypt_target;
+
+/*
+ * Produces several outputs from one input BMP: each target is the result of
+ * imagecrypt_process with its own passphrase, operation and mode. The input is parsed
+ * once and walked once; every chunk goes through all target ciphers while it is in
+ * cache. Outputs must not overlap the input or each other. Every target gets its own
+ * status. The return value is IMAGECRYPT_OK, or the status of the first failed target
+ * (imagecrypt_last_error() describes that one).
+ */
+int imagecrypt_process_multi(const uint8_t* input, size_t input_len,
+                             imagecrypt_target* targets, size_t num_targets);
+
+/*
+ * Re-encrypts an encrypted BMP from old_passphrase/old_mode to new_passphrase/new_mode
+ * in one pass; the plaintext only ever exists one chunk at a time. The output is the
+ * same as imagecrypt_process decrypt followed by encrypt. Buffer rules are those of
+ * imagecrypt_process, including in-place use.
+ */
+int imagecrypt_reencrypt(const uint8_t* input, size_t input_len,
+                         uint8_t* output, size_t output_capacity, size_t* output_len,
+                         const uint8_t* old_passphrase, size_t old_passphrase_len, int old_mode,
+                         const uint8_t* new_passphrase, size_t new_passphrase_len, int new_mode);
+
+/*
+ * Decrypts only rows [first_row, first_row + row_count) of the encrypted BMP file at path
+ * (row 0 is the top of the image) and writes them to output as a standalone BMP. Only
+ * the blocks covering those rows are read from the file, so the cost follows the size
+ * of the region. If output_capacity is too small, returns IMAGECRYPT_ERR_BUFFER_TOO_SMALL
+ * and stores the required size in *output_len.
+ */
+int imagecrypt_decrypt_rows(const char* path,
+                            const uint8_t* passphrase, size_t passphrase_len, int mode,
+                            uint32_t first_row, uint32_t row_count,
+                            uint8_t* output, size_t output_capacity, size_t* output_len);
+
+/*
+ * CRC32C (Castagnoli) of len bytes, computed in parallel on the worker pool. Matches the
+ * "Output CRC32C" printed by image_processor_ssl, so stored results can be checked
+ * without decrypting them.
+ */
+uint32_t imagecrypt_crc32c(const uint8_t* data, size_t len);
+
+/* A remote worker the caller could send shards to, as the caller measured it. */
+typedef struct imagecrypt_worker {
+    const char* name;        /* Stable identifier, e.g. its base URL; keys the learned costs */
+    double throughput_mbps;  /* MB/s (10^6 bytes), 0 if unknown */
+    double rtt_ms;           /* Round trip time, negative if unknown */
+} imagecrypt_worker;
+
+/* One shard of an imagecrypt_advise plan. */
+typedef struct imagecrypt_shard {
+    uint64_t offset;  /* Into the payload */
+    uint64_t length;
+    int location;     /* -1 = process locally, otherwise an index into workers */
+} imagecrypt_shard;
+
+/*
+ * Advises how to split a payload of payload_len bytes (for a BMP, its pixel data) between
+ * local processing and the given workers: fills shards[0..*num_shards) so that all of
+ * them are expected to finish together, and *estimated_ms with that time. Small payloads
+ * get one local shard. Only ECB and CBC decryption are split; other modes get one shard
+ * at the cheapest location. The cost model behind it learns from imagecrypt_observe.
+ * shard_capacity must be at least num_workers + 1. decision_id (may be NULL) receives an
+ * id to pass back to imagecrypt_observe. With IMAGE_PROCESSOR_SPLIT_LOG set, decisions
+ * and observations are appended to that file as JSON lines.
+ */
+int imagecrypt_advise(uint64_t payload_len, int operation, int mode,
+                      const imagecrypt_worker* workers, size_t num_workers,
+                      imagecrypt_shard* shards, size_t shard_capacity, size_t* num_shards,
+                      double* estimated_ms, uint64_t* decision_id);
+
+/*
+ * Reports that processing bytes bytes at location (NULL for local, otherwise a worker
+ * name as passed to imagecrypt_advise) took elapsed_ms, request to response. Updates the
+ * cost model that imagecrypt_advise uses.
+ */
+int imagecrypt_observe(uint64_t decision_id, const char* location, int operation, int mode,
+                       uint64_t bytes, double elapsed_ms);
+
+/* Message for the last failed call on this thread; empty string if none. */
+const char* imagecrypt_last_error(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IMAGECRYPT_H */
@@ -0,0 +1,387 @@
+#ifndef INTEGRITY_DIGEST_HPP
+#define INTEGRITY_DIGEST_HPP
+
+#include <string>
+#include <vector>
+#include <stdexcept> // For std::runtime_error
+#include <cstdint>
+#include <cstddef>
+#include <cstring>   // For memcpy
+#include <mutex>
+
+#include <fcntl.h>    // For open
+#include <sys/mman.h> // For mmap
+#include <sys/stat.h> // For fstat
+#include <unistd.h>   // For close
+
+#include "cipher_engine.hpp"  // AES engine, executors
+#include "image_pipeline.hpp" // process_pixel_data, pixel_cipher_input_len
+
+// End-to-end integrity digests: CRC32C (Castagnoli) of the input and output of a run,
+// so a file can be checked after temp files, HTTP and queues without decrypting it.
+// CRC32C runs on the SSE4.2 crc32 instruction where available (table-driven otherwise).
+// Partial CRCs of consecutive ranges combine exactly (crc32c_combine), so the digest is
+// computed per range in parallel. In the cipher pass each range hashes its input and
+// output chunk by chunk while the chunk is in cache, which adds almost nothing to the
+// encryption time.
+
+const uint32_t CRC32C_POLY = 0x82f63b78; // Reflected Castagnoli polynomial
+const size_t DIGEST_CHUNK_BYTES = 64 * 1024;
+
+#if defined(__x86_64__)
+#include <nmmintrin.h> // For _mm_crc32_u64
+#define IMAGE_PROCESSOR_HAVE_CRC32_INSN 1
+#else
+#define IMAGE_PROCESSOR_HAVE_CRC32_INSN 0
+#endif
+
+namespace crc32c_detail {
+
+struct Tables {
+    uint32_t t[8][256];
+    Tables() {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t crc = i;
+            for (int k = 0; k < 8; ++k) crc = (crc >> 1) ^ (CRC32C_POLY & (0u - (crc & 1)));
+            t[0][i] = crc;
+        }
+        for (uint32_t i = 0; i < 256; ++i) {
+            for (int s = 1; s < 8; ++s) t[s][i] = (t[s - 1][i] >> 8) ^ t[0][t[s - 1][i] & 0xff];
+        }
+    }
+};
+
+inline const Tables& tables() {
+    static const Tables instance;
+    return instance;
+}
+
+// Slicing-by-8 on the raw (not inverted) register.
+inline uint32_t update_table(uint32_t crc, const unsigned char* data, size_t len) {
+    const Tables& tb = tables();
+    while (len >= 8) {
+        uint64_t word;
+        std::memcpy(&word, data, 8);
+        word ^= crc;
+        crc = tb.t[7][word & 0xff] ^ tb.t[6][(word >> 8) & 0xff] ^ tb.t[5][(word >> 16) & 0xff] ^
+              tb.t[4][(word >> 24) & 0xff] ^ tb.t[3][(word >> 32) & 0xff] ^ tb.t[2][(word >> 40) & 0xff] ^
+              tb.t[1][(word >> 48) & 0xff] ^ tb.t[0][word >> 56];
+        data += 8;
+        len -= 8;
+    }
+    while (len-- > 0) crc = (crc >> 8) ^ tb.t[0][(crc ^ *data++) & 0xff];
+    return crc;
+}
+
+#if IMAGE_PROCESSOR_HAVE_CRC32_INSN
+__attribute__((target("sse4.2")))
+inline uint32_t update_hw(uint32_t crc, const unsigned char* data, size_t len) {
+    uint64_t c = crc;
+    while (len >= 8) {
+        uint64_t word;
+        std::memcpy(&word, data, 8);
+        c = _mm_crc32_u64(c, word);
+        data += 8;
+        len -= 8;
+    }
+    uint32_t c32 = static_cast<uint32_t>(c);
+    while (len-- > 0) c32 = _mm_crc32_u8(c32, *data++);
+    return c32;
+}
+
+inline bool hw_available() {
+    static const bool available = [] {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("sse4.2");
+    }();
+    return available;
+}
+#endif
+
+inline uint32_t gf2_matrix_times(const uint32_t* mat, uint32_t vec) {
+    uint32_t sum = 0;
+    for (; vec != 0; vec >>= 1, ++mat) {
+        if (vec & 1) sum ^= *mat;
+    }
+    return sum;
+}
+
+inline void gf2_matrix_square(uint32_t* square, const uint32_t* mat) {
+    for (int n = 0; n < 32; ++n) square[n] = gf2_matrix_times(mat, mat[n]);
+}
+
+} // namespace crc32c_detail
+
+// Continues a finished CRC32C (crc of the preceding bytes, 0 for none) over data.
+inline uint32_t crc32c_update(uint32_t crc, const unsigned char* data, size_t len) {
+    using namespace crc32c_detail;
+#if IMAGE_PROCESSOR_HAVE_CRC32_INSN
+    if (hw_available()) return ~update_hw(~crc, data, len);
+#endif
+    return ~update_table(~crc, data, len);
+}
+
+inline uint32_t crc32c(const unsigned char* data, size_t len) {
+    return crc32c_update(0, data, len);
+}
+
+// CRC32C of A followed by B, from crc(A), crc(B) and len(B) (zlib's GF(2) method).
+inline uint32_t crc32c_combine(uint32_t crc1, uint32_t crc2, size_t len2) {
+    using namespace crc32c_detail;
+    if (len2 == 0) return crc1;
+    uint32_t even[32];
+    uint32_t odd[32];
+    odd[0] = CRC32C_POLY; // Operator for one zero bit
+    uint32_t row = 1;
+    for (int n = 1; n < 32; ++n) {
+        odd[n] = row;
+        row <<= 1;
+    }
+    gf2_matrix_square(even, odd); // Two zero bits
+    gf2_matrix_square(odd, even); // Four zero bits
+    do {
+        gf2_matrix_square(even, odd);
+        if (len2 & 1) crc1 = gf2_matrix_times(even, crc1);
+        len2 >>= 1;
+        if (len2 == 0) break;
+        gf2_matrix_square(odd, even);
+        if (len2 & 1) crc1 = gf2_matrix_times(odd, crc1);
+        len2 >>= 1;
+    } while (len2 != 0);
+    return crc1 ^ crc2;
+}
+
+inline std::string crc32c_hex(uint32_t crc) {
+    static const char digits[] = "0123456789abcdef";
+    std::string out(8, '0');
+    for (int i = 0; i < 8; ++i) out[7 - i] = digits[(crc >> (4 * i)) & 0xf];
+    return out;
+}
+
+// CRC32C of a whole buffer, split into ranges across the executor.
+inline uint32_t crc32c_parallel(const unsigned char* data, size_t len,
+                                RangeExecutor& executor = OpenMPExecutor::instance()) {
+    if (len < OMP_PARALLEL_MIN_BYTES) return crc32c(data, len);
+    const size_t num_ranges = std::max<size_t>(executor.concurrency(), 1);
+    std::vector<uint32_t> partial(num_ranges);
+    executor.run(num_ranges, [&](size_t r) {
+        const size_t begin = len * r / num_ranges;
+        const size_t end = len * (r + 1) / num_ranges;
+        partial[r] = crc32c(data + begin, end - begin);
+    });
+    uint32_t crc = 0;
+    for (size_t r = 0; r < num_ranges; ++r) {
+        crc = crc32c_combine(crc, partial[r], len * (r + 1) / num_ranges - len * r / num_ranges);
+    }
+    return crc;
+}
+
+// CRC32C of a whole file, read through a read-only mapping.
+inline uint32_t crc32c_file(const std::string& path, RangeExecutor& executor = OpenMPExecutor::instance()) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Error: Could not open file for reading: " + path);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        throw std::runtime_error("Error: Could not stat file: " + path);
+    }
+    const size_t len = static_cast<size_t>(st.st_size);
+    if (len == 0) {
+        close(fd);
+        return 0;
+    }
+    void* map = mmap(NULL, len, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        throw std::runtime_error("Error: Could not map file: " + path);
+    }
+    const uint32_t crc = crc32c_parallel(static_cast<const unsigned char*>(map), len, executor);
+    munmap(map, len);
+    return crc;
+}
+
+// --- Cipher Pass with Digests ---
+struct PixelPassDigests {
+    uint32_t input_crc;  // All pixel_len input bytes
+    uint32_t output_crc; // All returned output bytes
+};
+
+namespace digest_pass_detail {
+
+struct RangeDigest {
+    uint32_t input_crc;
+    uint32_t output_crc;
+    size_t len;
+};
+
+// Streams [0, len) through engine in DIGEST_CHUNK_BYTES chunks, hashing each chunk of
+// input before and of output after it is processed (in-place safe).
+template <typename Engine>
+RangeDigest stream_range(Engine& engine, const unsigned char* input, size_t len, unsigned char* output) {
+    RangeDigest digest = {0, 0, 0};
+    for (size_t offset = 0; offset < len; offset += DIGEST_CHUNK_BYTES) {
+        const size_t chunk = std::min(DIGEST_CHUNK_BYTES, len - offset);
+        digest.input_crc = crc32c_update(digest.input_crc, input + offset, chunk);
+        const size_t produced = engine.update(input + offset, chunk, output + digest.len);
+        digest.output_crc = crc32c_update(digest.output_crc, output + digest.len, produced);
+        digest.len += produced;
+    }
+    return digest;
+}
+
+template <AesMode M, Direction D, Padding P>
+size_t digest_pass(const unsigned char* key, const unsigned char* iv,
+                   const unsigned char* input, size_t input_len, unsigned char* output,
+                   PixelPassDigests& digests, RangeExecutor& executor) {
+    using PaddedEngine = CipherEngine<M, D, P>;
+    using RangeEngine = CipherEngine<M, D, Padding::None>;
+    uint32_t input_crc = 0;
+    uint32_t output_crc = 0;
+    size_t output_len = 0;
+
+    if constexpr (!PaddedEngine::block_parallel) {
+        // A true chain (CBC encryption): one streaming pass.
+        PaddedEngine engine(key, iv);
+        RangeDigest digest = stream_range(engine, input, input_len, output);
+        input_crc = digest.input_crc;
+        output_crc = digest.output_crc;
+        output_len = digest.len;
+        const size_t tail = engine.finish(output + output_len);
+        output_crc = crc32c_update(output_crc, output + output_len, tail);
+        output_len += tail;
+    } else {
+        // As in CipherEngine::process: the block carrying the padding is done last.
+        size_t body_len = input_len - input_len % AES_BLOCK_BYTES;
+        if (P == Padding::PKCS7 && D == Direction::Decrypt && body_len == input_len && body_len > 0) {
+            body_len -= AES_BLOCK_BYTES;
+        }
+        const size_t num_blocks = body_len / AES_BLOCK_BYTES;
+        const size_t num_ranges = body_len < OMP_PARALLEL_MIN_BYTES
+            ? 1 : std::min(std::max<size_t>(executor.concurrency(), 1), num_blocks);
+        // Chain blocks are copied before any output is written, so input and output may alias.
+        std::vector<unsigned char> chains((num_ranges + 1) * AES_BLOCK_BYTES, 0);
+        for (size_t r = 0; r <= num_ranges; ++r) {
+            const size_t offset = num_blocks * std::min(r, num_ranges) / num_ranges * AES_BLOCK_BYTES;
+            const unsigned char* chain = offset > 0 ? input + offset - AES_BLOCK_BYTES : iv;
+            if (chain != NULL) std::memcpy(chains.data() + r * AES_BLOCK_BYTES, chain, AES_BLOCK_BYTES);
+        }
+        std::vector<RangeDigest> ranges(num_ranges);
+        bool parallel_success = true;
+        std::string parallel_error;
+        std::mutex error_mutex;
+        auto run_range = [&](size_t r) {
+            const size_t begin = num_blocks * r / num_ranges * AES_BLOCK_BYTES;
+            const size_t end = num_blocks * (r + 1) / num_ranges * AES_BLOCK_BYTES;
+            try {
+                RangeEngine engine(key, chains.data() + r * AES_BLOCK_BYTES);
+                ranges[r] = stream_range(engine, input + begin, end - begin, output + begin);
+            } catch (const std::exception& e) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                parallel_success = false;
+                parallel_error = e.what();
+            }
+        };
+        if (num_ranges == 1) {
+            run_range(0);
+        } else {
+            executor.run(num_ranges, run_range);
+        }
+        if (!parallel_success) {
+            throw std::runtime_error("Error occurred during parallel " + std::string(M == AesMode::ECB ? "ECB" : "CBC") +
+                                     " processing: " + parallel_error);
+        }
+        for (const RangeDigest& range : ranges) {
+            input_crc = crc32c_combine(input_crc, range.input_crc, range.len);
+            output_crc = crc32c_combine(output_crc, range.output_crc, range.len);
+        }
+        output_len = body_len;
+        if (P == Padding::PKCS7) {
+            PaddedEngine tail(key, chains.data() + num_ranges * AES_BLOCK_BYTES);
+            input_crc = crc32c_update(input_crc, input + body_len, input_len - body_len);
+            size_t tail_len = tail.update(input + body_len, input_len - body_len, output + output_len);
+            tail_len += tail.finish(output + output_len + tail_len);
+            output_crc = crc32c_update(output_crc, output + output_len, tail_len);
+            output_len += tail_len;
+        }
+    }
+    digests.input_crc = input_crc;
+    digests.output_crc = output_crc;
+    return output_len;
+}
+
+} // namespace digest_pass_detail
+
+// process_pixel_data that also returns the CRC32C of its input and output. The input
+// CRC covers all pixel_len bytes, including an ECB tail that is not encrypted.
+// The ECB memoization, GCM and ChaCha20 paths keep their own pass and are hashed
+// afterwards in parallel.
+inline size_t process_pixel_data_digest(const unsigned char* key, const unsigned char* iv,
+                                        AesMode mode, Direction direction,
+                                        const unsigned char* pixel_data, size_t pixel_len,
+                                        unsigned char* output_data, PixelPassDigests& digests,
+                                        RangeExecutor& executor = OpenMPExecutor::instance()) {
+    mode = resolve_pixel_mode(mode, direction, pixel_data, pixel_len);
+    const size_t input_len = pixel_cipher_input_len(mode, pixel_len);
+    size_t output_len;
+    if ((mode == AesMode::ECB && ecb_dedup_enabled()) || mode == AesMode::GCM || mode == AesMode::CHACHA20) {
+        digests.input_crc = crc32c_parallel(pixel_data, input_len, executor);
+        output_len = process_pixel_data(key, iv, mode, direction, pixel_data, pixel_len, output_data, executor);
+        digests.output_crc = crc32c_parallel(output_data, output_len, executor);
+    } else {
+        output_len = dispatch_cipher(mode, direction, pixel_padding(mode), [&](auto engine_tag) {
+            using Engine = typename decltype(engine_tag)::type;
+            return digest_pass_detail::digest_pass<Engine::mode, Engine::direction, Engine::padding>(
+                key, iv, pixel_data, input_len, output_data, digests, executor);
+        });
+    }
+    digests.input_crc = crc32c_update(digests.input_crc, pixel_data + input_len, pixel_len - input_len);
+    return output_len;
+}
+
+// --- Image Pass with Digests ---
+struct ImageDigests {
+    uint32_t input_crc;  // Of the whole input image
+    uint32_t output_crc; // Of the whole output image
+};
+
+// process_image_buffer that also returns the CRC32C of the input and output images.
+// Uncompressed payloads are hashed in the cipher pass (process_pixel_data_digest); a
+// compressed one (the pass then gets the header marker as aad) is hashed in separate
+// passes before and after.
+inline size_t process_image_buffer_digest(const unsigned char* image_data, size_t image_len,
+                                          unsigned char* output_data, size_t output_capacity,
+                                          const std::string& passphrase,
+                                          AesMode mode, Direction direction, PixelCodec codec,
+                                          ImageDigests& digests,
+                                          RangeExecutor& executor = OpenMPExecutor::instance()) {
+    const BmpLayout layout = locate_pixel_data(image_data, image_len, direction);
+    const bool may_compress = layout.codec != PixelCodec::None ||
+        (direction == Direction::Encrypt && codec != PixelCodec::None && pixel_codec_markable(image_data, image_len));
+    // Taken first: output may be the input buffer.
+    const uint32_t header_crc = crc32c(image_data, layout.header_len);
+    const uint32_t image_crc = may_compress ? crc32c_parallel(image_data, image_len, executor) : 0;
+    PixelPassDigests pass_digests;
+    bool pass_digested = false;
+    const size_t output_len = image_pipeline_detail::process_image(
+        image_data, image_len, output_data, output_capacity, passphrase, direction, codec, executor,
+        [&](const unsigned char* key, const unsigned char* iv, const unsigned char* payload, size_t payload_len,
+            unsigned char* output, const unsigned char* aad, size_t aad_len) {
+            if (aad != NULL) {
+                return process_pixel_data(key, iv, mode, direction, payload, payload_len, output, executor, aad, aad_len);
+            }
+            pass_digested = true;
+            return process_pixel_data_digest(key, iv, mode, direction, payload, payload_len, output, pass_digests, executor);
+        });
+    if (pass_digested) {
+        digests.input_crc = crc32c_combine(header_crc, pass_digests.input_crc, layout.pixel_len);
+        digests.output_crc = crc32c_combine(header_crc, pass_digests.output_crc, output_len - layout.header_len);
+    } else {
+        digests.input_crc = image_crc;
+        digests.output_crc = crc32c_parallel(output_data, output_len, executor);
+    }
+    return output_len;
+}
+
+#endif // INTEGRITY_DIGEST_HPP
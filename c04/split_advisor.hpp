@@ -0,0 +1,313 @@
+#ifndef SPLIT_ADVISOR_HPP
+#define SPLIT_ADVISOR_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <utility>   // For std::pair
+#include <algorithm> // For std::sort, std::min, std::max
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>    // For std::fopen, std::fprintf
+#include <cstdlib>   // For std::getenv
+#include <ctime>     // For std::time
+
+#include "cipher_engine.hpp" // Mode/direction enums
+#include "result_cache.hpp"  // env_size
+
+// Local-vs-remote split advice. Given a payload size, mode and operation and the remote
+// workers the caller can reach, advise() says how many shards to cut and where each one
+// should run so that the last one finishes as early as possible. Every location
+// (local, or a worker by name) is modelled as
+//     seconds = overhead + bytes / throughput
+// and fitted online from observe() calls with the measured time of each phase (an
+// exponentially weighted least-squares fit, so the model follows load changes). Until a
+// location has been observed at two different sizes its overhead comes from the prior:
+// the caller's measured RTT for a worker, IMAGE_PROCESSOR_SPLIT_*_OVERHEAD_US otherwise.
+//
+// Only ECB and CBC decryption can be cut into independent shards (a CBC-decrypt shard
+// needs the ciphertext block before it as its IV). CBC encryption, GCM, CHACHA20 and AUTO
+// get one shard at the cheapest location. Shards are whole AES blocks except the last,
+// and none is smaller than IMAGE_PROCESSOR_SPLIT_MIN_SHARD_KB, so small payloads stay local.
+//
+// With IMAGE_PROCESSOR_SPLIT_LOG set, every decision and observation is appended to that
+// file as one JSON object per line; observations carry the decision id for joining.
+
+const size_t SPLIT_DEFAULT_LOCAL_MBPS = 400;
+const size_t SPLIT_DEFAULT_LOCAL_OVERHEAD_US = 500;
+const size_t SPLIT_DEFAULT_REMOTE_MBPS = 100;
+const size_t SPLIT_DEFAULT_REMOTE_OVERHEAD_US = 20000;
+const size_t SPLIT_DEFAULT_MIN_SHARD_KB = 512;
+const double SPLIT_OBSERVATION_WEIGHT = 0.1; // Share of the fit taken by each new observation
+
+// A remote worker as measured by the caller.
+struct SplitWorker {
+    std::string name;      // Stable identifier (e.g. base URL); keys the learned costs
+    double throughput_bps; // 0 if unknown
+    double rtt_seconds;    // Negative if unknown
+};
+
+struct SplitShard {
+    uint64_t offset;
+    uint64_t len;
+    int location; // -1 = local, otherwise an index into the workers
+};
+
+struct SplitAdvice {
+    std::vector<SplitShard> shards;
+    double estimated_seconds; // Makespan of the plan
+    double local_seconds;     // Everything local, for comparison
+    uint64_t decision_id;
+};
+
+inline bool split_shardable(AesMode mode, Direction direction) {
+    return mode == AesMode::ECB || (mode == AesMode::CBC && direction == Direction::Decrypt);
+}
+
+namespace split_detail {
+
+// Exponentially weighted least-squares fit of seconds = overhead + bytes / throughput.
+class CostFit {
+public:
+    CostFit() : weight_(0), sum_x_(0), sum_y_(0), sum_xx_(0), sum_xy_(0) {}
+
+    void observe(double bytes, double seconds) {
+        const double keep = weight_ > 0 ? 1.0 - SPLIT_OBSERVATION_WEIGHT : 0.0;
+        weight_ = weight_ * keep + 1;
+        sum_x_ = sum_x_ * keep + bytes;
+        sum_y_ = sum_y_ * keep + seconds;
+        sum_xx_ = sum_xx_ * keep + bytes * bytes;
+        sum_xy_ = sum_xy_ * keep + bytes * seconds;
+    }
+
+    // The priors fill in what the observations cannot tell apart: with one payload size
+    // seen so far, the overhead stays at the prior and the rest is put down to bytes.
+    void estimate(double prior_overhead, double prior_throughput, double& overhead, double& throughput) const {
+        overhead = prior_overhead;
+        throughput = prior_throughput;
+        if (weight_ <= 0) return;
+        const double mean_x = sum_x_ / weight_;
+        const double mean_y = sum_y_ / weight_;
+        const double variance = sum_xx_ / weight_ - mean_x * mean_x;
+        const double covariance = sum_xy_ / weight_ - mean_x * mean_y;
+        if (variance > 0.01 * mean_x * mean_x && covariance > 0) {
+            const double slope = covariance / variance;
+            const double intercept = mean_y - slope * mean_x;
+            if (intercept >= 0) {
+                overhead = intercept;
+                throughput = 1.0 / slope;
+                return;
+            }
+        }
+        overhead = std::min(prior_overhead, mean_y / 2);
+        if (mean_x > 0) throughput = mean_x / (mean_y - overhead);
+    }
+
+private:
+    double weight_;
+    double sum_x_;
+    double sum_y_;
+    double sum_xx_;
+    double sum_xy_;
+};
+
+struct Location {
+    int index;         // -1 = local
+    double overhead;   // Seconds
+    double throughput; // Bytes per second
+};
+
+// Finish time when every location in the set ends together: each gets
+// (T - overhead) * throughput bytes and the shares add up to bytes.
+inline double common_finish(const std::vector<Location>& set, double bytes) {
+    double weighted_overhead = 0, total_throughput = 0;
+    for (const Location& location : set) {
+        weighted_overhead += location.overhead * location.throughput;
+        total_throughput += location.throughput;
+    }
+    return (bytes + weighted_overhead) / total_throughput;
+}
+
+inline const char* direction_name(Direction direction) {
+    return direction == Direction::Encrypt ? "encrypt" : "decrypt";
+}
+
+// Names go into the log verbatim; quotes, backslashes and control characters are escaped.
+inline std::string json_string(const std::string& value) {
+    std::string escaped = "\"";
+    for (unsigned char c : value) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += static_cast<char>(c);
+        } else if (c < 0x20) {
+            char code[8];
+            std::snprintf(code, sizeof(code), "\\u%04x", c);
+            escaped += code;
+        } else {
+            escaped += static_cast<char>(c);
+        }
+    }
+    return escaped + "\"";
+}
+
+} // namespace split_detail
+
+// Thread-safe; one instance per process is meant to learn from all requests.
+class SplitAdvisor {
+public:
+    SplitAdvisor()
+        : local_throughput_(static_cast<double>(env_size("IMAGE_PROCESSOR_SPLIT_LOCAL_MBPS", SPLIT_DEFAULT_LOCAL_MBPS)) * 1e6),
+          local_overhead_(static_cast<double>(env_size("IMAGE_PROCESSOR_SPLIT_LOCAL_OVERHEAD_US", SPLIT_DEFAULT_LOCAL_OVERHEAD_US)) * 1e-6),
+          remote_throughput_(static_cast<double>(env_size("IMAGE_PROCESSOR_SPLIT_REMOTE_MBPS", SPLIT_DEFAULT_REMOTE_MBPS)) * 1e6),
+          remote_overhead_(static_cast<double>(env_size("IMAGE_PROCESSOR_SPLIT_REMOTE_OVERHEAD_US", SPLIT_DEFAULT_REMOTE_OVERHEAD_US)) * 1e-6),
+          min_shard_(std::max<uint64_t>(env_size("IMAGE_PROCESSOR_SPLIT_MIN_SHARD_KB", SPLIT_DEFAULT_MIN_SHARD_KB) * 1024, AES_BLOCK_BYTES)),
+          next_decision_(1), log_(NULL) {
+        const char* log_path = std::getenv("IMAGE_PROCESSOR_SPLIT_LOG");
+        if (log_path != NULL && *log_path != '\0') {
+            log_ = std::fopen(log_path, "a"); // Unwritable: carry on without the log
+        }
+        if (local_throughput_ <= 0) local_throughput_ = SPLIT_DEFAULT_LOCAL_MBPS * 1e6;
+        if (remote_throughput_ <= 0) remote_throughput_ = SPLIT_DEFAULT_REMOTE_MBPS * 1e6;
+    }
+    ~SplitAdvisor() {
+        if (log_ != NULL) std::fclose(log_);
+    }
+    SplitAdvisor(const SplitAdvisor&) = delete;
+    SplitAdvisor& operator=(const SplitAdvisor&) = delete;
+
+    SplitAdvice advise(uint64_t payload_len, AesMode mode, Direction direction, const std::vector<SplitWorker>& workers) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<split_detail::Location> candidates;
+        candidates.push_back(locate(-1, "", mode, direction, local_overhead_, local_throughput_));
+        for (size_t i = 0; i < workers.size(); ++i) {
+            const SplitWorker& worker = workers[i];
+            candidates.push_back(locate(static_cast<int>(i), worker.name, mode, direction,
+                                        worker.rtt_seconds >= 0 ? worker.rtt_seconds : remote_overhead_,
+                                        worker.throughput_bps > 0 ? worker.throughput_bps : remote_throughput_));
+        }
+        const double bytes = static_cast<double>(payload_len);
+        auto alone = [bytes](const split_detail::Location& location) {
+            return location.overhead + bytes / location.throughput;
+        };
+
+        // Start from the cheapest single location, then add the others by overhead while
+        // that brings the finish time down and every share stays above the minimum.
+        std::vector<split_detail::Location> chosen(1, *std::min_element(candidates.begin(), candidates.end(),
+            [&](const split_detail::Location& a, const split_detail::Location& b) { return alone(a) < alone(b); }));
+        double finish = alone(chosen[0]);
+        if (split_shardable(mode, direction)) {
+            std::vector<split_detail::Location> rest;
+            for (const split_detail::Location& location : candidates) {
+                if (location.index != chosen[0].index) rest.push_back(location);
+            }
+            std::sort(rest.begin(), rest.end(), [](const split_detail::Location& a, const split_detail::Location& b) {
+                return a.overhead < b.overhead;
+            });
+            for (const split_detail::Location& location : rest) {
+                std::vector<split_detail::Location> trial = chosen;
+                trial.push_back(location);
+                const double trial_finish = split_detail::common_finish(trial, bytes);
+                bool shares_ok = trial_finish < finish;
+                for (const split_detail::Location& member : trial) {
+                    shares_ok = shares_ok && (trial_finish - member.overhead) * member.throughput >= static_cast<double>(min_shard_);
+                }
+                if (shares_ok) {
+                    chosen.swap(trial);
+                    finish = trial_finish;
+                }
+            }
+        }
+
+        SplitAdvice advice;
+        advice.decision_id = next_decision_++;
+        advice.estimated_seconds = finish;
+        advice.local_seconds = alone(candidates[0]);
+        std::sort(chosen.begin(), chosen.end(), [](const split_detail::Location& a, const split_detail::Location& b) {
+            return a.index < b.index; // Local first
+        });
+        uint64_t offset = 0;
+        for (size_t i = 0; i < chosen.size(); ++i) {
+            uint64_t len = payload_len - offset;
+            if (i + 1 < chosen.size()) {
+                const double share = (finish - chosen[i].overhead) * chosen[i].throughput;
+                len = std::min<uint64_t>(static_cast<uint64_t>(share) / AES_BLOCK_BYTES * AES_BLOCK_BYTES, len);
+            }
+            SplitShard shard = {offset, len, chosen[i].index};
+            advice.shards.push_back(shard);
+            offset += len;
+        }
+        log_decision(payload_len, mode, direction, workers, advice);
+        return advice;
+    }
+
+    // location is empty for local processing, otherwise the worker's name as passed to advise().
+    void observe(uint64_t decision_id, const std::string& location, AesMode mode, Direction direction,
+                 uint64_t bytes, double seconds) {
+        if (!(seconds > 0)) return;
+        std::lock_guard<std::mutex> lock(mutex_);
+        fits_[key(location, mode, direction)].observe(static_cast<double>(bytes), seconds);
+        if (log_ != NULL) {
+            std::fprintf(log_, "{\"time\":%lld,\"decision\":%llu,\"observe\":%s,\"mode\":\"%s\",\"operation\":\"%s\","
+                               "\"bytes\":%llu,\"seconds\":%.6f}\n",
+                         static_cast<long long>(std::time(NULL)), static_cast<unsigned long long>(decision_id),
+                         location.empty() ? "\"local\"" : split_detail::json_string(location).c_str(),
+                         aes_mode_name(mode), split_detail::direction_name(direction),
+                         static_cast<unsigned long long>(bytes), seconds);
+            std::fflush(log_);
+        }
+    }
+
+private:
+    typedef std::pair<std::string, int> FitKey;
+
+    static FitKey key(const std::string& location, AesMode mode, Direction direction) {
+        return FitKey(location, static_cast<int>(mode) * 2 + (direction == Direction::Encrypt ? 0 : 1));
+    }
+
+    split_detail::Location locate(int index, const std::string& name, AesMode mode, Direction direction,
+                                  double prior_overhead, double prior_throughput) const {
+        split_detail::Location location;
+        location.index = index;
+        location.overhead = prior_overhead;
+        location.throughput = prior_throughput;
+        std::map<FitKey, split_detail::CostFit>::const_iterator fit = fits_.find(key(name, mode, direction));
+        if (fit != fits_.end()) {
+            fit->second.estimate(prior_overhead, prior_throughput, location.overhead, location.throughput);
+        }
+        return location;
+    }
+
+    void log_decision(uint64_t payload_len, AesMode mode, Direction direction,
+                      const std::vector<SplitWorker>& workers, const SplitAdvice& advice) {
+        if (log_ == NULL) return;
+        std::string shards;
+        for (const SplitShard& shard : advice.shards) {
+            char entry[64];
+            std::snprintf(entry, sizeof(entry), "%s{\"location\":", shards.empty() ? "" : ",");
+            shards += entry;
+            shards += shard.location < 0 ? "\"local\"" : split_detail::json_string(workers[shard.location].name);
+            std::snprintf(entry, sizeof(entry), ",\"bytes\":%llu}", static_cast<unsigned long long>(shard.len));
+            shards += entry;
+        }
+        std::fprintf(log_, "{\"time\":%lld,\"decision\":%llu,\"bytes\":%llu,\"mode\":\"%s\",\"operation\":\"%s\","
+                           "\"workers\":%zu,\"local_seconds\":%.6f,\"estimated_seconds\":%.6f,\"shards\":[%s]}\n",
+                     static_cast<long long>(std::time(NULL)), static_cast<unsigned long long>(advice.decision_id),
+                     static_cast<unsigned long long>(payload_len), aes_mode_name(mode),
+                     split_detail::direction_name(direction), workers.size(),
+                     advice.local_seconds, advice.estimated_seconds, shards.c_str());
+        std::fflush(log_);
+    }
+
+    std::mutex mutex_;
+    std::map<FitKey, split_detail::CostFit> fits_;
+    double local_throughput_;
+    double local_overhead_;
+    double remote_throughput_;
+    double remote_overhead_;
+    uint64_t min_shard_;
+    uint64_t next_decision_;
+    FILE* log_;
+};
+
+#endif // SPLIT_ADVISOR_HPP
@@ -0,0 +1,130 @@
+package stud.bratutudor.services;
+
+import org.springframework.beans.factory.annotation.Value;
+import org.springframework.stereotype.Component;
+
+import java.io.IOException;
+import java.lang.foreign.Arena;
+import java.lang.foreign.FunctionDescriptor;
+import java.lang.foreign.Linker;
+import java.lang.foreign.MemorySegment;
+import java.lang.foreign.SymbolLookup;
+import java.lang.invoke.MethodHandle;
+import java.nio.charset.StandardCharsets;
+import java.nio.file.Path;
+import java.util.Arrays;
+
+import static java.lang.foreign.ValueLayout.ADDRESS;
+import static java.lang.foreign.ValueLayout.JAVA_BYTE;
+import static java.lang.foreign.ValueLayout.JAVA_INT;
+import static java.lang.foreign.ValueLayout.JAVA_LONG;
+
+/**
+ * Panama (FFM) binding for libimagecrypt (see openmpi/imagecrypt.h).
+ * The process call is a normal downcall over off-heap segments from a confined arena: the
+ * image is copied in and the result copied out, so the JVM can still reach a safepoint
+ * (and run the GC) while a large image is being processed, and nothing is pinned.
+ */
+@Component
+public class NativeImageCrypt {
+
+    private static final int IMAGECRYPT_OK = 0;
+    private static final int IMAGECRYPT_ENCRYPT = 0;
+    private static final int IMAGECRYPT_DECRYPT = 1;
+    private static final int IMAGECRYPT_MODE_ECB = 0;
+    private static final int IMAGECRYPT_MODE_CBC = 1;
+
+    private final String libraryPath;
+    private volatile Bindings bindings;
+
+    private record Bindings(MethodHandle maxOutputSize, MethodHandle process, MethodHandle lastError) {
+    }
+
+    public NativeImageCrypt(@Value("${native.image.crypt.library}") String libraryPath) {
+        this.libraryPath = libraryPath;
+    }
+
+    // The library is bound on first use so the application context starts without it.
+    private Bindings bindings() {
+        Bindings current = bindings;
+        if (current == null) {
+            synchronized (this) {
+                current = bindings;
+                if (current == null) {
+                    current = bind(libraryPath);
+                    bindings = current;
+                }
+            }
+        }
+        return current;
+    }
+
+    private static Bindings bind(String libraryPath) {
+        Linker linker = Linker.nativeLinker();
+        SymbolLookup library = SymbolLookup.libraryLookup(Path.of(libraryPath).toAbsolutePath(), Arena.global());
+
+        MethodHandle maxOutputSize = linker.downcallHandle(
+                library.find("imagecrypt_max_output_size").orElseThrow(),
+                FunctionDescriptor.of(JAVA_LONG, JAVA_LONG));
+        MethodHandle process = linker.downcallHandle(
+                library.find("imagecrypt_process").orElseThrow(),
+                FunctionDescriptor.of(JAVA_INT,
+                        ADDRESS, JAVA_LONG,            // input, input_len
+                        ADDRESS, JAVA_LONG, ADDRESS,   // output, output_capacity, output_len
+                        ADDRESS, JAVA_LONG,            // passphrase, passphrase_len
+                        JAVA_INT, JAVA_INT));          // operation, mode
+        MethodHandle lastError = linker.downcallHandle(
+                library.find("imagecrypt_last_error").orElseThrow(),
+                FunctionDescriptor.of(ADDRESS));
+        return new Bindings(maxOutputSize, process, lastError);
+    }
+
+    public byte[] process(byte[] imageData, String mode, String operation, String aesKey) throws IOException {
+        int op = switch (operation) {
+            case "encrypt" -> IMAGECRYPT_ENCRYPT;
+            case "decrypt" -> IMAGECRYPT_DECRYPT;
+            default -> throw new IOException("Invalid operation. Must be 'encrypt' or 'decrypt'.");
+        };
+        int nativeMode = switch (mode) {
+            case "ECB" -> IMAGECRYPT_MODE_ECB;
+            case "CBC" -> IMAGECRYPT_MODE_CBC;
+            default -> throw new IOException("Invalid mode. Must be 'ECB' or 'CBC'.");
+        };
+        byte[] passphrase = aesKey.getBytes(StandardCharsets.UTF_8);
+
+        try (Arena arena = Arena.ofConfined()) {
+            Bindings lib = bindings();
+            long capacity = (long) lib.maxOutputSize().invokeExact((long) imageData.length);
+            MemorySegment input = arena.allocate(Math.max(1, imageData.length));
+            MemorySegment.copy(imageData, 0, input, JAVA_BYTE, 0, imageData.length);
+            MemorySegment output = arena.allocate(capacity);
+            MemorySegment outputLen = arena.allocate(JAVA_LONG);
+            MemorySegment nativePassphrase = arena.allocate(Math.max(1, passphrase.length));
+            MemorySegment.copy(passphrase, 0, nativePassphrase, JAVA_BYTE, 0, passphrase.length);
+            try {
+                int status = (int) lib.process().invokeExact(
+                        input, (long) imageData.length,
+                        output, capacity, outputLen,
+                        nativePassphrase, (long) passphrase.length,
+                        op, nativeMode);
+                if (status != IMAGECRYPT_OK) {
+                    throw new IOException("Native image processing failed with status " + status + ": " + lastErrorMessage(lib));
+                }
+                return output.asSlice(0, outputLen.get(JAVA_LONG, 0)).toArray(JAVA_BYTE);
+            } finally {
+                nativePassphrase.fill((byte) 0);
+            }
+        } catch (IOException e) {
+            throw e;
+        } catch (Throwable t) {
+            throw new IOException("Native image processing call failed", t);
+        } finally {
+            Arrays.fill(passphrase, (byte) 0);
+        }
+    }
+
+    private static String lastErrorMessage(Bindings lib) throws Throwable {
+        MemorySegment message = (MemorySegment) lib.lastError().invokeExact();
+        return message.reinterpret(Long.MAX_VALUE).getString(0);
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef TCP_LISTENER_HPP
+#define TCP_LISTENER_HPP
+
+#include <string>
+#include <stdexcept> // For std::runtime_error
+#include <cstdint>
+#include <cstring>   // For strerror
+#include <cerrno>
+
+#include <arpa/inet.h> // For inet_pton, htons
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>    // For close
+
+// Listening socket shared by the TCP servers (--serve-http, --coordinate).
+
+// IPv4 socket bound to bind_address:port and listening (SO_REUSEADDR, close-on-exec).
+// Throws on a malformed address or when the port cannot be bound.
+inline int listen_tcp(const std::string& bind_address, uint16_t port) {
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    if (inet_pton(AF_INET, bind_address.c_str(), &address.sin_addr) != 1) {
+        throw std::runtime_error("Error: Invalid bind address: " + bind_address);
+    }
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        throw std::runtime_error(std::string("Error: Could not create socket: ") + std::strerror(errno));
+    }
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(fd, SOMAXCONN) != 0) {
+        int err = errno;
+        close(fd);
+        throw std::runtime_error("Error: Could not listen on " + bind_address + ":" + std::to_string(port) + ": " +
+                                 std::strerror(err));
+    }
+    return fd;
+}
+
+#endif // TCP_LISTENER_HPP
@@ -0,0 +1,727 @@
+#ifndef ASYNC_ENGINE_HPP
+#define ASYNC_ENGINE_HPP
+
+#if __cplusplus < 202002L
+#error "async_engine.hpp uses C++20 coroutines: build with -std=c++20"
+#endif
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <type_traits> // For std::is_void_v
+#include <utility>   // For std::exchange, std::move
+#include <algorithm> // For std::min, std::max
+#include <stdexcept> // For std::runtime_error
+#include <cstdint>
+#include <cstddef>
+#include <cstdlib>   // For std::getenv
+#include <cstring>   // For memset, strerror
+#include <cerrno>
+
+#include <fcntl.h>         // For open
+#include <sys/mman.h>      // For mmap
+#include <sys/stat.h>      // For fstat
+#include <sys/syscall.h>   // For the io_uring system calls
+#include <unistd.h>        // For pread, pwrite, close
+#include <linux/io_uring.h>
+
+#include <openssl/crypto.h> // For OPENSSL_cleanse
+
+#include "cipher_engine.hpp"    // Mode/direction enums
+#include "image_pipeline.hpp"   // process_image_buffer
+#include "worker_pool.hpp"      // CPU pool (cipher ranges and resumed coroutines)
+#include "integrity_digest.hpp" // CRC32C digests and the digesting image pass
+#include "result_cache.hpp"     // Result cache, env_size
+#include "stream_file.hpp"      // Window-by-window processing of large files
+
+// Coroutine API over the cipher and I/O engine, for embedding in event-driven servers:
+//
+//     AsyncRuntime runtime;
+//     AsyncImageResult result = sync_wait(runtime.process(request));
+//
+// process() is a task<AsyncImageResult>. It runs on the CPU pool, a WorkerPool of
+// IMAGE_PROCESSOR_ASYNC_THREADS threads (default OMP_NUM_THREADS, or one per CPU) that
+// also resumes the coroutines whose I/O completed: key derivation and the cipher pass
+// run there, and file reads and writes suspend on an io_uring reactor (one more
+// thread). Writes that cannot complete inline are carried out by the kernel's io-wq
+// workers (iou-wrk-* threads), a set per submitting thread; the runtime caps each set at
+// ASYNC_IO_WORKERS (Linux 5.15 and later), and only pool threads submit. So any number
+// of requests are in flight on at most N + 1 + N * ASYNC_IO_WORKERS threads for a pool
+// of N, next to the threads that wait in sync_wait (test_async_threads.cpp checks
+// this). Where io_uring is not available (old kernels, seccomp profiles) or
+// IMAGE_PROCESSOR_ASYNC_IO=blocking, I/O falls back to blocking pread/pwrite on the
+// pool, and the pool threads are all; epoll is no help here, since regular files
+// always poll ready. A streamed file (below) adds its read-ahead thread while it runs.
+//
+// process() does what the command line tool does for one image, which is a thin wrapper
+// around it. The output is that of process_image_buffer, with the request's compression
+// codec. Results come from and go to the runtime's result cache when it is enabled.
+// Files of IMAGE_PROCESSOR_STREAM_THRESHOLD_MB or more in a streamable mode go through
+// process_image_file_streamed on the CPU pool instead, with its bounded memory and
+// checkpoints. Any other request holds its whole input and output in memory while in
+// flight, so callers bound the number in flight by the memory they have. The output is
+// written to <output>.partial and renamed when complete. Every task must have finished
+// before its runtime is destroyed.
+
+const size_t ASYNC_IO_MAX_BYTES = size_t(1) << 30; // io_uring lengths are 32-bit
+const unsigned ASYNC_RING_ENTRIES = 256;           // Submission queue
+const unsigned ASYNC_RING_COMPLETIONS = 4096;      // Operations in flight in the kernel
+const unsigned ASYNC_IO_WORKERS = 1;               // io-wq workers per submitting thread
+const unsigned ASYNC_REGISTER_IOWQ_MAX_WORKERS = 19; // IORING_REGISTER_IOWQ_MAX_WORKERS (Linux 5.15)
+
+// --- Tasks ---
+template <typename T = void>
+class task;
+
+namespace async_detail {
+
+struct PromiseBase {
+    std::coroutine_handle<> continuation;
+    std::exception_ptr error;
+
+    // Lazy: a task starts when it is awaited, and hands control back to its awaiter when done.
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+            std::coroutine_handle<> continuation = handle.promise().continuation;
+            return continuation ? continuation : std::noop_coroutine();
+        }
+        void await_resume() noexcept {}
+    };
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() { error = std::current_exception(); }
+};
+
+template <typename T>
+struct Promise : PromiseBase {
+    std::optional<T> value;
+    task<T> get_return_object();
+    void return_value(T result) { value.emplace(std::move(result)); }
+    T result() {
+        if (error) std::rethrow_exception(error);
+        return std::move(*value);
+    }
+};
+
+template <>
+struct Promise<void> : PromiseBase {
+    task<void> get_return_object();
+    void return_void() {}
+    void result() {
+        if (error) std::rethrow_exception(error);
+    }
+};
+
+} // namespace async_detail
+
+template <typename T>
+class task {
+public:
+    using promise_type = async_detail::Promise<T>;
+
+    explicit task(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+    task(task&& other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+    task& operator=(task&& other) noexcept {
+        if (this != &other) {
+            if (handle_) handle_.destroy();
+            handle_ = std::exchange(other.handle_, {});
+        }
+        return *this;
+    }
+    task(const task&) = delete;
+    task& operator=(const task&) = delete;
+    ~task() {
+        if (handle_) handle_.destroy();
+    }
+
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        handle_.promise().continuation = awaiting;
+        return handle_;
+    }
+    T await_resume() { return handle_.promise().result(); }
+
+private:
+    std::coroutine_handle<promise_type> handle_;
+};
+
+namespace async_detail {
+
+template <typename T>
+task<T> Promise<T>::get_return_object() {
+    return task<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+}
+
+inline task<void> Promise<void>::get_return_object() {
+    return task<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+}
+
+// Fire-and-forget coroutine that drives a task for the sync_wait functions.
+struct Detached {
+    struct promise_type {
+        Detached get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+class Latch {
+public:
+    explicit Latch(size_t count) : count_(count) {}
+    // Notifies under the lock: the waiter may destroy the latch as soon as it wakes.
+    void count_down() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--count_ == 0) done_.notify_all();
+    }
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [this] { return count_ == 0; });
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable done_;
+    size_t count_;
+};
+
+template <typename T>
+struct Outcome {
+    std::optional<T> value;
+    std::exception_ptr error;
+};
+
+template <>
+struct Outcome<void> {
+    std::exception_ptr error;
+};
+
+template <typename T>
+Detached drive(task<T> work, Outcome<T>& outcome, Latch& latch) {
+    try {
+        if constexpr (std::is_void_v<T>) {
+            co_await work;
+        } else {
+            outcome.value.emplace(co_await work);
+        }
+    } catch (...) {
+        outcome.error = std::current_exception();
+    }
+    latch.count_down();
+}
+
+} // namespace async_detail
+
+// Blocks the calling thread until work has finished; rethrows its exception.
+template <typename T>
+T sync_wait(task<T> work) {
+    async_detail::Outcome<T> outcome;
+    async_detail::Latch latch(1);
+    async_detail::drive(std::move(work), outcome, latch);
+    latch.wait();
+    if (outcome.error) std::rethrow_exception(outcome.error);
+    if constexpr (!std::is_void_v<T>) return std::move(*outcome.value);
+}
+
+// Runs all tasks concurrently and blocks until every one has finished. Each entry of the
+// result holds the task's value, or its exception.
+template <typename T>
+std::vector<async_detail::Outcome<T>> sync_wait_all(std::vector<task<T>> work) {
+    std::vector<async_detail::Outcome<T>> outcomes(work.size());
+    async_detail::Latch latch(work.size());
+    for (size_t i = 0; i < work.size(); ++i) {
+        async_detail::drive(std::move(work[i]), outcomes[i], latch);
+    }
+    latch.wait();
+    return outcomes;
+}
+
+// --- I/O Reactor ---
+namespace async_detail {
+
+// One read or write, from submission to completion.
+struct IoOperation {
+    int opcode; // IORING_OP_READ or IORING_OP_WRITE
+    int fd;
+    void* buffer;
+    unsigned len;
+    uint64_t offset;
+    int result; // Bytes transferred, or -errno
+    std::coroutine_handle<> handle;
+};
+
+inline void run_blocking(IoOperation& operation) {
+    ssize_t n;
+    do {
+        n = operation.opcode == IORING_OP_READ
+            ? pread(operation.fd, operation.buffer, operation.len, static_cast<off_t>(operation.offset))
+            : pwrite(operation.fd, operation.buffer, operation.len, static_cast<off_t>(operation.offset));
+    } while (n < 0 && errno == EINTR);
+    operation.result = n < 0 ? -errno : static_cast<int>(n);
+}
+
+// io_uring driven through the raw system calls. Any thread submits; the reactor thread
+// only reaps completions and posts the suspended coroutines to the CPU pool. Operations
+// beyond ASYNC_RING_COMPLETIONS wait in a queue, so the completion ring cannot overflow.
+class IoRing {
+public:
+    IoRing(WorkerPool& pool, bool blocking)
+        : pool_(pool), fd_(-1), sq_map_(MAP_FAILED), cq_map_(MAP_FAILED), sqes_(MAP_FAILED),
+          in_flight_(0), unsubmitted_(0), stopping_(false) {
+        const char* io_mode = std::getenv("IMAGE_PROCESSOR_ASYNC_IO");
+        if (blocking || (io_mode != NULL && std::string(io_mode) == "blocking")) return;
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        params.flags = IORING_SETUP_CQSIZE;
+        params.cq_entries = ASYNC_RING_COMPLETIONS;
+        fd_ = static_cast<int>(syscall(__NR_io_uring_setup, ASYNC_RING_ENTRIES, &params));
+        if (fd_ < 0) return;
+        if (!map_rings(params)) {
+            unmap_rings();
+            close(fd_);
+            fd_ = -1;
+            return;
+        }
+        capacity_ = params.cq_entries;
+        // Bounded (file) and unbounded work alike; older kernels reject it and keep their default.
+        unsigned max_workers[2] = {ASYNC_IO_WORKERS, ASYNC_IO_WORKERS};
+        syscall(__NR_io_uring_register, fd_, ASYNC_REGISTER_IOWQ_MAX_WORKERS, max_workers, 2);
+        reactor_ = std::thread([this] { reap_loop(); });
+    }
+
+    ~IoRing() {
+        if (fd_ < 0) return;
+        {
+            // A NOP with no operation behind it wakes the reactor; it leaves once the rest drain.
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+            ++in_flight_;
+            push(IORING_OP_NOP, -1, NULL, 0, 0, 0);
+        }
+        reactor_.join();
+        unmap_rings();
+        close(fd_);
+    }
+
+    IoRing(const IoRing&) = delete;
+    IoRing& operator=(const IoRing&) = delete;
+
+    bool uring() const { return fd_ >= 0; }
+
+    // The operation may complete, and its coroutine resume, before this returns.
+    void submit(IoOperation& operation) {
+        if (fd_ < 0) {
+            pool_.post([&operation] {
+                run_blocking(operation);
+                operation.handle.resume();
+            });
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (in_flight_ >= capacity_) {
+            waiting_.push_back(&operation);
+            return;
+        }
+        ++in_flight_;
+        push_operation(operation);
+    }
+
+private:
+    WorkerPool& pool_;
+    int fd_;
+    void* sq_map_;
+    void* cq_map_;
+    void* sqes_;
+    size_t sq_map_len_;
+    size_t cq_map_len_;
+    size_t sqes_len_;
+    unsigned* sq_tail_;
+    unsigned sq_mask_;
+    unsigned* sq_array_;
+    unsigned* cq_head_;
+    unsigned* cq_tail_;
+    unsigned cq_mask_;
+    io_uring_cqe* cqes_;
+    unsigned capacity_;
+
+    std::mutex mutex_; // Submission side
+    unsigned in_flight_;
+    unsigned unsubmitted_;
+    std::deque<IoOperation*> waiting_;
+    bool stopping_;
+    std::thread reactor_;
+
+    template <typename P>
+    static P* at(void* base, size_t offset) {
+        return reinterpret_cast<P*>(static_cast<char*>(base) + offset);
+    }
+
+    bool map_rings(const io_uring_params& params) {
+        sq_map_len_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_map_len_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool single_map = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single_map) sq_map_len_ = cq_map_len_ = std::max(sq_map_len_, cq_map_len_);
+        sq_map_ = mmap(NULL, sq_map_len_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+        if (sq_map_ == MAP_FAILED) return false;
+        cq_map_ = single_map ? sq_map_
+                : mmap(NULL, cq_map_len_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+        if (cq_map_ == MAP_FAILED) return false;
+        sqes_len_ = params.sq_entries * sizeof(io_uring_sqe);
+        sqes_ = mmap(NULL, sqes_len_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+        if (sqes_ == MAP_FAILED) return false;
+        sq_tail_ = at<unsigned>(sq_map_, params.sq_off.tail);
+        sq_mask_ = *at<unsigned>(sq_map_, params.sq_off.ring_mask);
+        sq_array_ = at<unsigned>(sq_map_, params.sq_off.array);
+        cq_head_ = at<unsigned>(cq_map_, params.cq_off.head);
+        cq_tail_ = at<unsigned>(cq_map_, params.cq_off.tail);
+        cq_mask_ = *at<unsigned>(cq_map_, params.cq_off.ring_mask);
+        cqes_ = at<io_uring_cqe>(cq_map_, params.cq_off.cqes);
+        return true;
+    }
+
+    void unmap_rings() {
+        if (sqes_ != MAP_FAILED) munmap(sqes_, sqes_len_);
+        if (cq_map_ != MAP_FAILED && cq_map_ != sq_map_) munmap(cq_map_, cq_map_len_);
+        if (sq_map_ != MAP_FAILED) munmap(sq_map_, sq_map_len_);
+    }
+
+    // Called with mutex_ held.
+    void push_operation(IoOperation& operation) {
+        push(static_cast<uint8_t>(operation.opcode), operation.fd, operation.buffer, operation.len,
+             operation.offset, reinterpret_cast<uint64_t>(&operation));
+    }
+
+    // Called with mutex_ held. The submission ring cannot fill up: every entry is handed
+    // to the kernel before the lock is released, unless io_uring_enter failed outright.
+    void push(uint8_t opcode, int fd, void* buffer, unsigned len, uint64_t offset, uint64_t user_data) {
+        const unsigned tail = *sq_tail_;
+        const unsigned index = tail & sq_mask_;
+        io_uring_sqe* sqe = static_cast<io_uring_sqe*>(sqes_) + index;
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = opcode;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<uint64_t>(buffer);
+        sqe->len = len;
+        sqe->off = offset;
+        sqe->user_data = user_data;
+        sq_array_[index] = index;
+        __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+        ++unsubmitted_;
+        while (unsubmitted_ > 0) {
+            const int submitted = static_cast<int>(syscall(__NR_io_uring_enter, fd_, unsubmitted_, 0, 0, NULL, 0));
+            if (submitted < 0 && errno == EINTR) continue;
+            if (submitted <= 0) break; // Left in the ring for the next submission
+            unsubmitted_ -= static_cast<unsigned>(submitted);
+        }
+    }
+
+    void reap_loop() {
+        bool stop_seen = false;
+        std::vector<IoOperation*> completed;
+        while (true) {
+            const int waited = static_cast<int>(
+                syscall(__NR_io_uring_enter, fd_, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0));
+            if (waited < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                std::terminate(); // The ring is unusable and suspended coroutines would never resume
+            }
+            unsigned head = *cq_head_;
+            const unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+            unsigned reaped = 0;
+            for (; head != tail; ++head, ++reaped) {
+                const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+                IoOperation* operation = reinterpret_cast<IoOperation*>(cqe.user_data);
+                if (operation == NULL) {
+                    stop_seen = true;
+                    continue;
+                }
+                operation->result = cqe.res;
+                completed.push_back(operation);
+            }
+            __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+            for (IoOperation* operation : completed) {
+                std::coroutine_handle<> handle = operation->handle;
+                pool_.post([handle] { handle.resume(); });
+            }
+            completed.clear();
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            in_flight_ -= reaped;
+            while (!waiting_.empty() && in_flight_ < capacity_) {
+                ++in_flight_;
+                push_operation(*waiting_.front());
+                waiting_.pop_front();
+            }
+            if (stop_seen && in_flight_ == 0) return;
+        }
+    }
+};
+
+struct IoAwaiter {
+    IoRing& ring;
+    IoOperation operation;
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle) {
+        operation.handle = handle;
+        ring.submit(operation);
+    }
+    int await_resume() const noexcept { return operation.result; }
+};
+
+struct ScheduleAwaiter {
+    WorkerPool& pool;
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle) {
+        pool.post([handle] { handle.resume(); });
+    }
+    void await_resume() const noexcept {}
+};
+
+class FileDescriptor {
+public:
+    explicit FileDescriptor(int fd) : fd_(fd) {}
+    ~FileDescriptor() {
+        if (fd_ >= 0) close(fd_);
+    }
+    FileDescriptor(const FileDescriptor&) = delete;
+    FileDescriptor& operator=(const FileDescriptor&) = delete;
+    int get() const { return fd_; }
+    int release() { return std::exchange(fd_, -1); }
+
+private:
+    int fd_;
+};
+
+// IMAGE_PROCESSOR_ASYNC_THREADS, else OMP_NUM_THREADS (its first entry), else one per CPU.
+inline size_t default_async_threads() {
+    const unsigned cpus = std::thread::hardware_concurrency();
+    const size_t omp_threads = env_size("OMP_NUM_THREADS", cpus > 0 ? cpus : 1);
+    return std::max<size_t>(env_size("IMAGE_PROCESSOR_ASYNC_THREADS", omp_threads), 1);
+}
+
+} // namespace async_detail
+
+// --- Image Requests ---
+struct AsyncImageRequest {
+    std::string input_path;
+    std::string output_path;
+    std::string passphrase;
+    AesMode mode;
+    Direction direction;
+    PixelCodec codec = PixelCodec::None; // Encryption: compress the pixels first (if they shrink)
+};
+
+// How process() produced the output.
+enum class AsyncImagePath {
+    Buffered, // Read whole and processed in memory
+    Streamed, // Window by window (stream_file.hpp)
+    Cached    // Taken from the result cache
+};
+
+struct AsyncImageResult {
+    uint64_t input_len;
+    uint64_t output_len;
+    uint32_t input_crc;      // CRC32C of the input file
+    uint32_t output_crc;     // CRC32C of the output file
+    AsyncImagePath path;
+    AesMode mode;            // Mode used, AUTO resolved
+    uint64_t header_len;     // Bytes before the pixel array (not set when streamed)
+    uint64_t pixel_len;      // Pixel bytes of the input (not set when streamed)
+    PixelCodec compressed;   // Encryption: codec the pixels were compressed with, or None
+    PixelCodec decompressed; // Decryption: codec of a compressed payload, or None
+    uint64_t resumed_at;     // Streamed: pixel bytes taken over from an interrupted run
+};
+
+// How an AsyncRuntime reads and writes files.
+enum class AsyncIo {
+    Uring,   // io_uring where available (and IMAGE_PROCESSOR_ASYNC_IO is not "blocking")
+    Blocking // pread/pwrite on the pool: no ring or reactor thread, for a single request
+};
+
+class AsyncRuntime {
+public:
+    // cpu_threads = 0: IMAGE_PROCESSOR_ASYNC_THREADS, else OMP_NUM_THREADS, else one per
+    // online CPU; the threads start on first use (worker_pool.hpp). The result cache is
+    // off unless cache_config enables a tier.
+    explicit AsyncRuntime(size_t cpu_threads = 0, const ResultCacheConfig& cache_config = ResultCacheConfig(),
+                          AsyncIo io = AsyncIo::Uring)
+        : cache_(cache_config),
+          pool_(cpu_threads > 0 ? cpu_threads : async_detail::default_async_threads()),
+          ring_(pool_, io == AsyncIo::Blocking) {}
+
+    AsyncRuntime(const AsyncRuntime&) = delete;
+    AsyncRuntime& operator=(const AsyncRuntime&) = delete;
+
+    bool uring() const { return ring_.uring(); }
+    WorkerPool& pool() { return pool_; }
+
+    // co_await runtime.schedule() continues the coroutine on the CPU pool.
+    async_detail::ScheduleAwaiter schedule() { return async_detail::ScheduleAwaiter{pool_}; }
+
+    // One read or write of at most ASYNC_IO_MAX_BYTES; returns the bytes transferred
+    // (0 at end of file) and throws on errors.
+    task<size_t> read_at(int fd, void* buffer, size_t len, uint64_t offset) {
+        co_return co_await transfer(IORING_OP_READ, fd, buffer, len, offset);
+    }
+    task<size_t> write_at(int fd, const void* buffer, size_t len, uint64_t offset) {
+        co_return co_await transfer(IORING_OP_WRITE, fd, const_cast<void*>(buffer), len, offset);
+    }
+
+    task<AsyncImageResult> process(AsyncImageRequest request) {
+        struct PassphraseGuard {
+            std::string& passphrase;
+            ~PassphraseGuard() { OPENSSL_cleanse(&passphrase[0], passphrase.size()); }
+        } passphrase_guard = {request.passphrase};
+        if (request.direction == Direction::Decrypt) request.codec = PixelCodec::None;
+        // Only pool threads submit I/O, so only they get io-wq workers.
+        co_await schedule();
+
+        // --- Streamed ---
+        // Compression needs the whole payload, so it keeps a file in memory.
+        if (request.codec == PixelCodec::None && stream_file_enabled(request.input_path)) {
+            AesMode stream_mode = request.mode;
+            if (streamable_pixel_mode(request.input_path, stream_mode, request.direction)) {
+                co_return process_streamed(request, stream_mode);
+            }
+        }
+
+        async_detail::FileDescriptor input(open(request.input_path.c_str(), O_RDONLY | O_CLOEXEC));
+        struct stat st;
+        if (input.get() < 0 || fstat(input.get(), &st) != 0) {
+            throw std::runtime_error("Error: Could not open file for reading: " + request.input_path);
+        }
+        std::vector<unsigned char> image(static_cast<size_t>(st.st_size));
+        for (size_t done = 0; done < image.size();) {
+            const size_t n = co_await read_at(input.get(), image.data() + done, image.size() - done, done);
+            if (n == 0) {
+                throw std::runtime_error("Error: Could not read file: " + request.input_path);
+            }
+            done += n;
+        }
+        close(input.release());
+
+        const BmpLayout layout = locate_pixel_data(image.data(), image.size(), request.direction);
+        AsyncImageResult result = {};
+        result.input_len = image.size();
+        result.mode = resolve_pixel_mode(request.mode, request.direction, image.data() + layout.header_len,
+                                         layout.pixel_len);
+        result.header_len = layout.header_len;
+        result.pixel_len = layout.pixel_len;
+        result.decompressed = layout.codec;
+        std::vector<unsigned char> output(processed_image_capacity(layout, image.size()));
+
+        // --- Result Cache ---
+        // GCM and ChaCha20 encryptions draw a fresh nonce every time, so they bypass the cache.
+        const bool use_cache = cache_.enabled() &&
+                               !(request.direction == Direction::Encrypt && pixel_encryption_randomized(result.mode));
+        ResultCacheKey cache_key;
+        size_t cached_len = 0;
+        if (use_cache) {
+            cache_key = cache_.make_key(image.data(), image.size(), request.passphrase, result.mode,
+                                        request.direction, request.codec);
+        }
+        if (use_cache && cache_.lookup(cache_key, output.data(), output.size(), cached_len)) {
+            result.path = AsyncImagePath::Cached;
+            result.output_len = cached_len;
+            result.input_crc = crc32c_parallel(image.data(), image.size(), pool_);
+            result.output_crc = crc32c_parallel(output.data(), cached_len, pool_);
+        } else {
+            ImageDigests digests;
+            result.path = AsyncImagePath::Buffered;
+            result.output_len = process_image_buffer_digest(image.data(), image.size(), output.data(), output.size(),
+                                                            request.passphrase, result.mode, request.direction,
+                                                            request.codec, digests, pool_);
+            result.input_crc = digests.input_crc;
+            result.output_crc = digests.output_crc;
+        }
+        if (request.codec != PixelCodec::None && pixel_codec_marked(output.data())) {
+            result.compressed = request.codec;
+        }
+        std::vector<unsigned char>().swap(image);
+
+        const std::string partial_path = request.output_path + ".partial";
+        async_detail::FileDescriptor out(open(partial_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644));
+        if (out.get() < 0) {
+            throw std::runtime_error("Error: Could not open file for writing: " + request.output_path);
+        }
+        bool written = true;
+        try {
+            for (size_t done = 0; written && done < result.output_len;) {
+                const size_t n = co_await write_at(out.get(), output.data() + done, result.output_len - done, done);
+                written = n > 0;
+                done += n;
+            }
+        } catch (const std::exception&) {
+            written = false;
+        }
+        if (close(out.release()) != 0 || !written || rename(partial_path.c_str(), request.output_path.c_str()) != 0) {
+            unlink(partial_path.c_str());
+            throw std::runtime_error("Error: Could not write to file: " + request.output_path);
+        }
+        if (result.path == AsyncImagePath::Buffered && use_cache) {
+            cache_.store(cache_key, output.data(), result.output_len);
+        }
+        co_return result;
+    }
+
+private:
+    ResultCache cache_;
+    WorkerPool pool_;
+    async_detail::IoRing ring_; // Destroyed before the pool: its completions post to it
+
+    // Runs on a pool thread: the streamed pass does its own (blocking) file I/O.
+    AsyncImageResult process_streamed(const AsyncImageRequest& request, AesMode mode) {
+        unsigned char derived_key[AES_KEY_BYTES];
+        unsigned char derived_iv[AES_IV_BYTES];
+        StreamedImage streamed;
+        try {
+            derive_image_key_and_iv(request.passphrase, derived_key, derived_iv, pool_);
+            streamed = process_image_file_streamed(request.input_path, request.output_path, derived_key, derived_iv,
+                                                   mode, request.direction, stream_window_bytes(),
+                                                   stream_checkpoint_bytes(), pool_);
+        } catch (...) {
+            OPENSSL_cleanse(derived_key, sizeof(derived_key));
+            OPENSSL_cleanse(derived_iv, sizeof(derived_iv));
+            throw;
+        }
+        OPENSSL_cleanse(derived_key, sizeof(derived_key));
+        OPENSSL_cleanse(derived_iv, sizeof(derived_iv));
+        AsyncImageResult result = {};
+        result.input_len = streamed.input_len;
+        result.output_len = streamed.output_len;
+        result.input_crc = streamed.input_crc;
+        result.output_crc = streamed.output_crc;
+        result.path = AsyncImagePath::Streamed;
+        result.mode = mode;
+        result.resumed_at = streamed.resumed_at;
+        return result;
+    }
+
+    task<size_t> transfer(int opcode, int fd, void* buffer, size_t len, uint64_t offset) {
+        async_detail::IoOperation operation;
+        operation.opcode = opcode;
+        operation.fd = fd;
+        operation.buffer = buffer;
+        operation.len = static_cast<unsigned>(std::min(len, ASYNC_IO_MAX_BYTES));
+        operation.offset = offset;
+        operation.result = 0;
+        const int result = co_await async_detail::IoAwaiter{ring_, operation};
+        if (result < 0) {
+            throw std::runtime_error(std::string("Error: ") + (opcode == IORING_OP_READ ? "read" : "write") +
+                                     " failed: " + std::strerror(-result));
+        }
+        co_return static_cast<size_t>(result);
+    }
+};
+
+#endif // ASYNC_ENGINE_HPP
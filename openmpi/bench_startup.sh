@@ -0,0 +1,57 @@
+#!/bin/sh
+# Startup-time benchmark for image_processor_ssl.
+# Builds the dynamic and the statically linked binary, then times repeated runs
+# on a tiny BMP where process startup dominates the total run time. The zygote
+# row runs the same command through zygote_front against a running --zygote.
+#
+# Usage: ./bench_startup.sh [runs]
+set -e
+
+RUNS=${1:-50}
+SRC_DIR=$(cd "$(dirname "$0")" && pwd)
+WORK_DIR=$(mktemp -d)
+ZYGOTE_PID=
+trap '[ -n "$ZYGOTE_PID" ] && kill $ZYGOTE_PID; rm -rf "$WORK_DIR"' EXIT
+
+echo "Building dynamic and static binaries in $WORK_DIR ..."
+g++ -o "$WORK_DIR/image_processor_ssl" "$SRC_DIR/image_processor_ssl.cpp" \
+    -Wall -O2 -std=c++20 -fcoroutines \
+    $(pkg-config --cflags --libs openssl) \
+    $(pkg-config --cflags --libs liblz4 libzstd 2>/dev/null) \
+    -fopenmp
+g++ -static -o "$WORK_DIR/image_processor_ssl_static" "$SRC_DIR/image_processor_ssl.cpp" \
+    -Wall -O2 -std=c++20 -fcoroutines \
+    $(pkg-config --cflags openssl) $(pkg-config --static --libs openssl) \
+    $(pkg-config --static --libs liblz4 libzstd 2>/dev/null) \
+    -fopenmp 2>/dev/null
+gcc -O2 -o "$WORK_DIR/zygote_front" "$SRC_DIR/zygote_front.c"
+
+# 16x16 24-bit BMP: 54-byte header followed by 768 bytes of pixel data
+printf 'BM\066\003\000\000\000\000\000\000\066\000\000\000\050\000\000\000\020\000\000\000\020\000\000\000\001\000\030\000\000\000\000\000\000\003\000\000\023\013\000\000\023\013\000\000\000\000\000\000\000\000\000\000' > "$WORK_DIR/tiny.bmp"
+head -c 768 /dev/urandom >> "$WORK_DIR/tiny.bmp"
+
+# Prints the mean wall time in microseconds of RUNS invocations.
+time_runs() {
+    start=$(date +%s%N)
+    i=0
+    while [ $i -lt "$RUNS" ]; do
+        "$@" > /dev/null
+        i=$((i + 1))
+    done
+    end=$(date +%s%N)
+    echo $(( (end - start) / RUNS / 1000 ))
+}
+
+export IMAGE_PROCESSOR_ZYGOTE_SOCKET="$WORK_DIR/zygote.sock"
+export IMAGE_PROCESSOR_STANDALONE="$WORK_DIR/image_processor_ssl"
+"$WORK_DIR/image_processor_ssl" --zygote "$IMAGE_PROCESSOR_ZYGOTE_SOCKET" > /dev/null &
+ZYGOTE_PID=$!
+while [ ! -S "$IMAGE_PROCESSOR_ZYGOTE_SOCKET" ]; do sleep 0.1; done
+
+for mode in ECB CBC; do
+    dyn=$(time_runs "$WORK_DIR/image_processor_ssl" "$WORK_DIR/tiny.bmp" bench "$WORK_DIR/out.bmp" encrypt $mode)
+    dyn_low=$(IMAGE_PROCESSOR_LOW_STARTUP=1 time_runs "$WORK_DIR/image_processor_ssl" "$WORK_DIR/tiny.bmp" bench "$WORK_DIR/out.bmp" encrypt $mode)
+    sta_low=$(IMAGE_PROCESSOR_LOW_STARTUP=1 time_runs "$WORK_DIR/image_processor_ssl_static" "$WORK_DIR/tiny.bmp" bench "$WORK_DIR/out.bmp" encrypt $mode)
+    zyg=$(time_runs "$WORK_DIR/zygote_front" "$WORK_DIR/tiny.bmp" bench "$WORK_DIR/out.bmp" encrypt $mode)
+    echo "$mode: dynamic ${dyn} us, dynamic low-startup ${dyn_low} us, static low-startup ${sta_low} us, zygote ${zyg} us (mean of $RUNS runs)"
+done
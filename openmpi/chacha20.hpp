@@ -0,0 +1,410 @@
+#ifndef CHACHA20_HPP
+#define CHACHA20_HPP
+
+#include <string>
+#include <stdexcept> // For std::runtime_error
+#include <cstdint>
+#include <cstddef>
+#include <cstring>   // For memcpy, memcmp
+#include <cstdlib>   // For std::getenv
+#include <mutex>
+
+#include <openssl/evp.h>
+#include <openssl/err.h>    // For ERR_clear_error
+#include <openssl/rand.h>   // For RAND_bytes
+#include <openssl/crypto.h> // For OPENSSL_cleanse
+
+#include "cipher_engine.hpp" // Executors, error handling
+
+// ChaCha20 (RFC 8439, 32-bit counter, 96-bit nonce) for the pixel payload, for hosts
+// where AES instructions are missing and EVP falls back to table-based AES. ChaCha20
+// is plain 32-bit additions, rotations and XORs, so it runs at full speed on any
+// SSE2/AVX2 core.
+//
+// The stored payload is ciphertext || nonce (12 bytes) || "ICCHACHA". The nonce is
+// random for every encryption (a fixed per-passphrase nonce would reuse the keystream
+// across images). The marker is what lets AUTO decryption recognise the format. Like
+// ECB/CBC the payload is not authenticated; use GCM where integrity matters.
+//
+// The keystream is split into block ranges across the executor; each range starts at
+// its own block counter. A range goes through EVP ChaCha20, whose multi-block
+// SSSE3/AVX2/AVX-512 code is the fastest available. Where the provider has no ChaCha20
+// (FIPS-only configurations), the built-in kernel is used instead. It generates blocks
+// 8 at a time with AVX2 (one block per 32-bit lane), then 4 at a time with SSE2, then
+// one at a time, and produces the same bytes. IMAGE_PROCESSOR_CHACHA_ENGINE=simd forces
+// the built-in kernel, =sse2 forces it without the AVX2 width (test_chacha20.cpp checks
+// both against EVP), =evp or unset keeps EVP where the provider has it.
+
+const size_t CHACHA20_KEY_BYTES = 32;
+const size_t CHACHA20_NONCE_BYTES = 12;
+const size_t CHACHA20_BLOCK_BYTES = 64;
+const char CHACHA20_MARKER[] = "ICCHACHA";
+const size_t CHACHA20_MARKER_BYTES = sizeof(CHACHA20_MARKER) - 1;
+const size_t CHACHA20_TRAILER_BYTES = CHACHA20_NONCE_BYTES + CHACHA20_MARKER_BYTES;
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CHACHA20_HAVE_AVX2 1
+#define CHACHA20_AVX2_TARGET __attribute__((target("avx2")))
+#else
+#define CHACHA20_HAVE_AVX2 0
+#endif
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+inline const EVP_CIPHER* fetched_chacha20_cipher() {
+    static EVP_CIPHER* chacha20 = [] {
+        EVP_CIPHER* cipher = EVP_CIPHER_fetch(NULL, "ChaCha20", NULL);
+        ERR_clear_error(); // A missing algorithm is not an error here
+        return cipher;
+    }();
+    return chacha20;
+}
+#elif !defined(OPENSSL_NO_CHACHA)
+inline const EVP_CIPHER* fetched_chacha20_cipher() { return EVP_chacha20(); }
+#else
+inline const EVP_CIPHER* fetched_chacha20_cipher() { return NULL; }
+#endif
+
+namespace chacha20_detail {
+
+inline uint32_t load_le32(const unsigned char* p) {
+    return static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8 |
+           static_cast<uint32_t>(p[2]) << 16 | static_cast<uint32_t>(p[3]) << 24;
+}
+
+inline uint32_t rotl(uint32_t v, int n) {
+    return (v << n) | (v >> (32 - n));
+}
+
+// Initial state with the block counter left at zero.
+struct ChaChaState {
+    uint32_t words[16];
+
+    ChaChaState(const unsigned char* key, const unsigned char* nonce) {
+        words[0] = 0x61707865; // "expand 32-byte k"
+        words[1] = 0x3320646e;
+        words[2] = 0x79622d32;
+        words[3] = 0x6b206574;
+        for (int i = 0; i < 8; ++i) words[4 + i] = load_le32(key + 4 * i);
+        words[12] = 0;
+        for (int i = 0; i < 3; ++i) words[13 + i] = load_le32(nonce + 4 * i);
+    }
+    ~ChaChaState() { OPENSSL_cleanse(words, sizeof(words)); }
+};
+
+// --- Scalar ---
+#define CHACHA20_QR(a, b, c, d)                  \
+    a += b; d ^= a; d = rotl(d, 16);             \
+    c += d; b ^= c; b = rotl(b, 12);             \
+    a += b; d ^= a; d = rotl(d, 8);              \
+    c += d; b ^= c; b = rotl(b, 7);
+
+inline void keystream_block(const ChaChaState& state, uint32_t counter, unsigned char* out) {
+    uint32_t x[16];
+    std::memcpy(x, state.words, sizeof(x));
+    x[12] = counter;
+    for (int round = 0; round < 10; ++round) {
+        CHACHA20_QR(x[0], x[4], x[8], x[12]);
+        CHACHA20_QR(x[1], x[5], x[9], x[13]);
+        CHACHA20_QR(x[2], x[6], x[10], x[14]);
+        CHACHA20_QR(x[3], x[7], x[11], x[15]);
+        CHACHA20_QR(x[0], x[5], x[10], x[15]);
+        CHACHA20_QR(x[1], x[6], x[11], x[12]);
+        CHACHA20_QR(x[2], x[7], x[8], x[13]);
+        CHACHA20_QR(x[3], x[4], x[9], x[14]);
+    }
+    for (int i = 0; i < 16; ++i) {
+        const uint32_t v = x[i] + (i == 12 ? counter : state.words[i]);
+        out[4 * i] = static_cast<unsigned char>(v);
+        out[4 * i + 1] = static_cast<unsigned char>(v >> 8);
+        out[4 * i + 2] = static_cast<unsigned char>(v >> 16);
+        out[4 * i + 3] = static_cast<unsigned char>(v >> 24);
+    }
+    OPENSSL_cleanse(x, sizeof(x));
+}
+
+#undef CHACHA20_QR
+
+// --- SIMD ---
+// Each vector holds one state word of 4 (SSE2) or 8 (AVX2) consecutive blocks. After
+// the rounds, 4x4 word transposes turn the lanes back into block order. The fixed loops
+// are unrolled so the state arrays stay in registers at -O2.
+#define CHACHA20_VQR(a, b, c, d, ADD, XOR, ROT16, ROT12, ROT8, ROT7) \
+    a = ADD(a, b); d = ROT16(XOR(d, a));                            \
+    c = ADD(c, d); b = ROT12(XOR(b, c));                            \
+    a = ADD(a, b); d = ROT8(XOR(d, a));                             \
+    c = ADD(c, d); b = ROT7(XOR(b, c));
+
+#define CHACHA20_DOUBLE_ROUND(v, ADD, XOR, ROT16, ROT12, ROT8, ROT7)                   \
+    CHACHA20_VQR(v[0], v[4], v[8], v[12], ADD, XOR, ROT16, ROT12, ROT8, ROT7)           \
+    CHACHA20_VQR(v[1], v[5], v[9], v[13], ADD, XOR, ROT16, ROT12, ROT8, ROT7)           \
+    CHACHA20_VQR(v[2], v[6], v[10], v[14], ADD, XOR, ROT16, ROT12, ROT8, ROT7)          \
+    CHACHA20_VQR(v[3], v[7], v[11], v[15], ADD, XOR, ROT16, ROT12, ROT8, ROT7)          \
+    CHACHA20_VQR(v[0], v[5], v[10], v[15], ADD, XOR, ROT16, ROT12, ROT8, ROT7)          \
+    CHACHA20_VQR(v[1], v[6], v[11], v[12], ADD, XOR, ROT16, ROT12, ROT8, ROT7)          \
+    CHACHA20_VQR(v[2], v[7], v[8], v[13], ADD, XOR, ROT16, ROT12, ROT8, ROT7)           \
+    CHACHA20_VQR(v[3], v[4], v[9], v[14], ADD, XOR, ROT16, ROT12, ROT8, ROT7)
+
+#if defined(__SSE2__)
+#define CHACHA20_SSE_ROT(n) [](__m128i x) { return _mm_or_si128(_mm_slli_epi32(x, n), _mm_srli_epi32(x, 32 - n)); }
+
+// XORs 4 keystream blocks starting at counter into 256 bytes.
+inline void xor_blocks_sse2(const ChaChaState& state, uint32_t counter, const unsigned char* in, unsigned char* out) {
+    __m128i v[16];
+    __m128i initial[16];
+    #pragma GCC unroll 16
+    for (int i = 0; i < 16; ++i) initial[i] = _mm_set1_epi32(static_cast<int>(state.words[i]));
+    initial[12] = _mm_add_epi32(_mm_set1_epi32(static_cast<int>(counter)), _mm_set_epi32(3, 2, 1, 0));
+    #pragma GCC unroll 16
+    for (int i = 0; i < 16; ++i) v[i] = initial[i];
+    const auto rot16 = CHACHA20_SSE_ROT(16);
+    const auto rot12 = CHACHA20_SSE_ROT(12);
+    const auto rot8 = CHACHA20_SSE_ROT(8);
+    const auto rot7 = CHACHA20_SSE_ROT(7);
+    for (int round = 0; round < 10; ++round) {
+        CHACHA20_DOUBLE_ROUND(v, _mm_add_epi32, _mm_xor_si128, rot16, rot12, rot8, rot7)
+    }
+    #pragma GCC unroll 16
+    for (int i = 0; i < 16; ++i) v[i] = _mm_add_epi32(v[i], initial[i]);
+    #pragma GCC unroll 16
+    for (int group = 0; group < 4; ++group) {
+        const __m128i* w = v + 4 * group;
+        const __m128i t0 = _mm_unpacklo_epi32(w[0], w[1]);
+        const __m128i t1 = _mm_unpacklo_epi32(w[2], w[3]);
+        const __m128i t2 = _mm_unpackhi_epi32(w[0], w[1]);
+        const __m128i t3 = _mm_unpackhi_epi32(w[2], w[3]);
+        const __m128i rows[4] = {_mm_unpacklo_epi64(t0, t1), _mm_unpackhi_epi64(t0, t1),
+                                 _mm_unpacklo_epi64(t2, t3), _mm_unpackhi_epi64(t2, t3)};
+        #pragma GCC unroll 16
+        for (int block = 0; block < 4; ++block) {
+            const size_t offset = block * CHACHA20_BLOCK_BYTES + group * 16;
+            const __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + offset));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + offset), _mm_xor_si128(data, rows[block]));
+        }
+    }
+}
+#undef CHACHA20_SSE_ROT
+#endif // __SSE2__
+
+inline const char* engine_setting() {
+    const char* engine = std::getenv("IMAGE_PROCESSOR_CHACHA_ENGINE");
+    return engine != NULL ? engine : "";
+}
+
+// True if ranges go through the built-in kernel rather than EVP.
+inline bool builtin_kernel_selected() {
+    static const bool selected = [] {
+        const std::string engine = engine_setting();
+        return engine == "simd" || engine == "sse2" || fetched_chacha20_cipher() == NULL;
+    }();
+    return selected;
+}
+
+#if CHACHA20_HAVE_AVX2
+// True if the CPU has AVX2 and IMAGE_PROCESSOR_CHACHA_ENGINE does not cap the kernel at SSE2.
+inline bool avx2_available() {
+    static const bool available = [] {
+        if (std::string(engine_setting()) == "sse2") return false;
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") != 0;
+    }();
+    return available;
+}
+
+CHACHA20_AVX2_TARGET inline __m256i add8(__m256i a, __m256i b) { return _mm256_add_epi32(a, b); }
+CHACHA20_AVX2_TARGET inline __m256i xor8(__m256i a, __m256i b) { return _mm256_xor_si256(a, b); }
+CHACHA20_AVX2_TARGET inline __m256i rot16_8(__m256i x) {
+    return _mm256_shuffle_epi8(x, _mm256_set_epi8(13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2,
+                                                  13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2));
+}
+CHACHA20_AVX2_TARGET inline __m256i rot8_8(__m256i x) {
+    return _mm256_shuffle_epi8(x, _mm256_set_epi8(14, 13, 12, 15, 10, 9, 8, 11, 6, 5, 4, 7, 2, 1, 0, 3,
+                                                  14, 13, 12, 15, 10, 9, 8, 11, 6, 5, 4, 7, 2, 1, 0, 3));
+}
+CHACHA20_AVX2_TARGET inline __m256i rot12_8(__m256i x) {
+    return _mm256_or_si256(_mm256_slli_epi32(x, 12), _mm256_srli_epi32(x, 20));
+}
+CHACHA20_AVX2_TARGET inline __m256i rot7_8(__m256i x) {
+    return _mm256_or_si256(_mm256_slli_epi32(x, 7), _mm256_srli_epi32(x, 25));
+}
+
+// XORs 8 keystream blocks starting at counter into 512 bytes.
+CHACHA20_AVX2_TARGET inline void xor_blocks_avx2(const ChaChaState& state, uint32_t counter,
+                                                 const unsigned char* in, unsigned char* out) {
+    __m256i v[16];
+    __m256i initial[16];
+    #pragma GCC unroll 16
+    for (int i = 0; i < 16; ++i) initial[i] = _mm256_set1_epi32(static_cast<int>(state.words[i]));
+    initial[12] = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(counter)), _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+    #pragma GCC unroll 16
+    for (int i = 0; i < 16; ++i) v[i] = initial[i];
+    for (int round = 0; round < 10; ++round) {
+        CHACHA20_DOUBLE_ROUND(v, add8, xor8, rot16_8, rot12_8, rot8_8, rot7_8)
+    }
+    #pragma GCC unroll 16
+    for (int i = 0; i < 16; ++i) v[i] = _mm256_add_epi32(v[i], initial[i]);
+    // rows[group][b]: words 4*group..4*group+3 of block b (low half) and block b + 4 (high half).
+    __m256i rows[4][4];
+    #pragma GCC unroll 16
+    for (int group = 0; group < 4; ++group) {
+        const __m256i* w = v + 4 * group;
+        const __m256i t0 = _mm256_unpacklo_epi32(w[0], w[1]);
+        const __m256i t1 = _mm256_unpacklo_epi32(w[2], w[3]);
+        const __m256i t2 = _mm256_unpackhi_epi32(w[0], w[1]);
+        const __m256i t3 = _mm256_unpackhi_epi32(w[2], w[3]);
+        rows[group][0] = _mm256_unpacklo_epi64(t0, t1);
+        rows[group][1] = _mm256_unpackhi_epi64(t0, t1);
+        rows[group][2] = _mm256_unpacklo_epi64(t2, t3);
+        rows[group][3] = _mm256_unpackhi_epi64(t2, t3);
+    }
+    #pragma GCC unroll 16
+    for (int block = 0; block < 4; ++block) {
+        #pragma GCC unroll 16
+        for (int half = 0; half < 2; ++half) {
+            // Words 0-7 and 8-15 of block, then of block + 4.
+            const __m256i lo_words = _mm256_permute2x128_si256(rows[2 * half][block], rows[2 * half + 1][block], 0x20);
+            const __m256i hi_words = _mm256_permute2x128_si256(rows[2 * half][block], rows[2 * half + 1][block], 0x31);
+            const size_t offset = block * CHACHA20_BLOCK_BYTES + half * 32;
+            const size_t high_offset = offset + 4 * CHACHA20_BLOCK_BYTES;
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + offset),
+                                _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + offset)), lo_words));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + high_offset),
+                                _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + high_offset)), hi_words));
+        }
+    }
+}
+#endif // CHACHA20_HAVE_AVX2
+
+#undef CHACHA20_DOUBLE_ROUND
+#undef CHACHA20_VQR
+
+// XORs the keystream from block counter onward into len bytes (in may equal out).
+inline void xor_keystream(const ChaChaState& state, uint32_t counter,
+                          const unsigned char* in, size_t len, unsigned char* out) {
+    size_t done = 0;
+#if CHACHA20_HAVE_AVX2
+    if (avx2_available()) {
+        for (; len - done >= 8 * CHACHA20_BLOCK_BYTES; done += 8 * CHACHA20_BLOCK_BYTES, counter += 8) {
+            xor_blocks_avx2(state, counter, in + done, out + done);
+        }
+    }
+#endif
+#if defined(__SSE2__)
+    for (; len - done >= 4 * CHACHA20_BLOCK_BYTES; done += 4 * CHACHA20_BLOCK_BYTES, counter += 4) {
+        xor_blocks_sse2(state, counter, in + done, out + done);
+    }
+#endif
+    unsigned char block[CHACHA20_BLOCK_BYTES];
+    for (; done < len; done += CHACHA20_BLOCK_BYTES, ++counter) {
+        keystream_block(state, counter, block);
+        const size_t n = std::min(CHACHA20_BLOCK_BYTES, len - done);
+        for (size_t i = 0; i < n; ++i) out[done + i] = in[done + i] ^ block[i];
+    }
+    OPENSSL_cleanse(block, sizeof(block));
+}
+
+// EVP ChaCha20 from block counter onward; its 16-byte IV is counter (LE) || nonce.
+inline void xor_keystream_evp(const unsigned char* key, const unsigned char* nonce, uint32_t counter,
+                              const unsigned char* in, size_t len, unsigned char* out) {
+    unsigned char iv[4 + CHACHA20_NONCE_BYTES];
+    for (int i = 0; i < 4; ++i) iv[i] = static_cast<unsigned char>(counter >> (8 * i));
+    std::memcpy(iv + 4, nonce, CHACHA20_NONCE_BYTES);
+    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+    if (!ctx) {
+        handle_openssl_errors("EVP_CIPHER_CTX_new failed: ");
+    }
+    struct CtxGuard {
+        EVP_CIPHER_CTX* ctx;
+        ~CtxGuard() { EVP_CIPHER_CTX_free(ctx); }
+    } guard = {ctx};
+    if (1 != EVP_EncryptInit_ex(ctx, fetched_chacha20_cipher(), NULL, key, iv)) {
+        handle_openssl_errors("EVP_EncryptInit_ex (ChaCha20) failed: ");
+    }
+    for (size_t done = 0; done < len;) {
+        const int step = static_cast<int>(std::min(len - done, EVP_UPDATE_MAX_BYTES));
+        int out_len = 0;
+        if (1 != EVP_EncryptUpdate(ctx, out + done, &out_len, in + done, step)) {
+            handle_openssl_errors("EVP_EncryptUpdate (ChaCha20) failed: ");
+        }
+        done += static_cast<size_t>(step);
+    }
+}
+
+inline void xor_keystream_parallel(const unsigned char* key, const unsigned char* nonce,
+                                   const unsigned char* in, size_t len, unsigned char* out,
+                                   RangeExecutor& executor) {
+    const size_t num_blocks = (len + CHACHA20_BLOCK_BYTES - 1) / CHACHA20_BLOCK_BYTES;
+    if (static_cast<uint64_t>(num_blocks) > (static_cast<uint64_t>(1) << 32)) {
+        throw std::runtime_error("Error: Pixel data exceeds the ChaCha20 block counter (256 GiB).");
+    }
+    const ChaChaState state(key, nonce);
+    const bool use_evp = !builtin_kernel_selected();
+    const size_t num_ranges = len < OMP_PARALLEL_MIN_BYTES
+        ? 1 : std::min(std::max<size_t>(executor.concurrency(), 1), num_blocks);
+    bool parallel_success = true;
+    std::string parallel_error;
+    std::mutex error_mutex;
+    auto run_range = [&](size_t r) {
+        const size_t first_block = num_blocks * r / num_ranges;
+        const size_t begin = first_block * CHACHA20_BLOCK_BYTES;
+        const size_t end = std::min(len, num_blocks * (r + 1) / num_ranges * CHACHA20_BLOCK_BYTES);
+        const uint32_t counter = static_cast<uint32_t>(first_block);
+        try {
+            if (use_evp) {
+                xor_keystream_evp(key, nonce, counter, in + begin, end - begin, out + begin);
+            } else {
+                xor_keystream(state, counter, in + begin, end - begin, out + begin);
+            }
+        } catch (const std::exception& e) {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            parallel_success = false;
+            parallel_error = e.what();
+        }
+    };
+    if (num_ranges == 1) {
+        run_range(0);
+    } else {
+        executor.run(num_ranges, run_range);
+    }
+    if (!parallel_success) {
+        throw std::runtime_error("Error occurred during parallel ChaCha20 processing: " + parallel_error);
+    }
+}
+
+} // namespace chacha20_detail
+
+// True if the payload ends with the ChaCha20 trailer.
+inline bool chacha20_payload(const unsigned char* data, size_t len) {
+    return len >= CHACHA20_TRAILER_BYTES &&
+           std::memcmp(data + len - CHACHA20_MARKER_BYTES, CHACHA20_MARKER, CHACHA20_MARKER_BYTES) == 0;
+}
+
+// Encrypts len bytes into output (len + CHACHA20_TRAILER_BYTES bytes). output may be
+// the same buffer as input. Returns the payload length.
+inline size_t chacha20_encrypt_pixels(const unsigned char* key, const unsigned char* input, size_t len,
+                                      unsigned char* output, RangeExecutor& executor = OpenMPExecutor::instance()) {
+    unsigned char nonce[CHACHA20_NONCE_BYTES];
+    if (1 != RAND_bytes(nonce, sizeof(nonce))) {
+        handle_openssl_errors("RAND_bytes failed for the ChaCha20 nonce: ");
+    }
+    chacha20_detail::xor_keystream_parallel(key, nonce, input, len, output, executor);
+    std::memcpy(output + len, nonce, CHACHA20_NONCE_BYTES);
+    std::memcpy(output + len + CHACHA20_NONCE_BYTES, CHACHA20_MARKER, CHACHA20_MARKER_BYTES);
+    return len + CHACHA20_TRAILER_BYTES;
+}
+
+// Decrypts a payload written by chacha20_encrypt_pixels. output may be the same buffer
+// as input. Returns the plaintext length.
+inline size_t chacha20_decrypt_pixels(const unsigned char* key, const unsigned char* input, size_t len,
+                                      unsigned char* output, RangeExecutor& executor = OpenMPExecutor::instance()) {
+    if (!chacha20_payload(input, len)) {
+        throw std::runtime_error("Error: Pixel data does not end with a ChaCha20 nonce trailer.");
+    }
+    const size_t cipher_len = len - CHACHA20_TRAILER_BYTES;
+    unsigned char nonce[CHACHA20_NONCE_BYTES];
+    std::memcpy(nonce, input + cipher_len, CHACHA20_NONCE_BYTES);
+    chacha20_detail::xor_keystream_parallel(key, nonce, input, cipher_len, output, executor);
+    return cipher_len;
+}
+
+#endif // CHACHA20_HPP
@@ -0,0 +1,414 @@
+#ifndef CIPHER_ENGINE_HPP
+#define CIPHER_ENGINE_HPP
+
+#include <string>
+#include <vector>
+#include <stdexcept> // For std::runtime_error
+#include <cstdint>
+#include <cstdlib>   // For std::getenv
+#include <cstddef>
+#include <cstring>   // For memcpy, memset
+#include <algorithm> // For std::min, std::max
+#include <functional>
+#include <memory>    // For std::unique_ptr
+#include <mutex>
+
+#ifdef _OPENMP
+#include <omp.h>     // OpenMP library
+#endif
+
+// OpenSSL headers
+#include <openssl/evp.h>
+#include <openssl/err.h>      // For error reporting
+#include <openssl/crypto.h>   // For OPENSSL_init_crypto
+#include <openssl/opensslv.h> // For OPENSSL_VERSION_NUMBER
+
+#include "bitsliced_aes.hpp" // Constant-time engine for hosts without AES instructions
+
+// Shared AES engine for image_processor_ssl, image_processor_ssl2 and image_processor_ssl3.
+// Mode, direction and padding are template parameters, so the string arguments from the
+// command line are parsed once (see dispatch_cipher) and the hot loops carry no branches
+// on them.
+
+// --- Configuration ---
+const int AES_KEY_BITS = 256; // Using AES-256
+const int AES_KEY_BYTES = AES_KEY_BITS / 8;
+const int AES_IV_BYTES = 16;    // AES block size is 128 bits (16 bytes), so IV is 16 bytes
+const int AES_BLOCK_BYTES = 16; // AES block size
+// Below this many bytes the OpenMP team is never started: spawning the
+// worker threads costs more than encrypting a small buffer on one core.
+const size_t OMP_PARALLEL_MIN_BYTES = 256 * 1024;
+// EVP lengths are int. Longer buffers are fed in sub-chunks of this size (block-aligned,
+// well below INT_MAX), so any size_t length works.
+const size_t EVP_UPDATE_MAX_BYTES = size_t(1) << 30;
+
+// Only ECB and CBC run through CipherEngine. GCM (aes_gcm.hpp) and CHACHA20 (chacha20.hpp)
+// are separate pixel passes. AUTO picks CBC or CHACHA20 per host (image_pipeline.hpp).
+enum class AesMode { ECB, CBC, GCM, CHACHA20, AUTO };
+enum class Direction { Encrypt, Decrypt };
+enum class Padding { None, PKCS7 };
+
+// --- OpenSSL Runtime (low-startup) ---
+// Setting IMAGE_PROCESSOR_LOW_STARTUP=1 also skips reading openssl.cnf at startup.
+// The default provider is still loaded implicitly on first use.
+inline void init_openssl_runtime() {
+    uint64_t opts = OPENSSL_INIT_NO_ADD_ALL_CIPHERS | OPENSSL_INIT_NO_ADD_ALL_DIGESTS;
+    const char* low_startup = std::getenv("IMAGE_PROCESSOR_LOW_STARTUP");
+    if (low_startup != NULL && std::string(low_startup) == "1") {
+        opts |= OPENSSL_INIT_NO_LOAD_CONFIG;
+    }
+    OPENSSL_init_crypto(opts, NULL);
+}
+
+// Error strings are only needed to describe a failure, so they are loaded
+// on the error path instead of on every start.
+inline void load_openssl_error_strings() {
+    OPENSSL_init_crypto(OPENSSL_INIT_LOAD_CRYPTO_STRINGS, NULL);
+}
+
+// Each algorithm is fetched from the provider once per process. Under OpenSSL 3
+// EVP_aes_256_*() returns a legacy handle that triggers an implicit fetch on
+// every EVP_*Init_ex call.
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+inline const EVP_CIPHER* fetched_aes_cipher(AesMode mode) {
+    static EVP_CIPHER* ecb = EVP_CIPHER_fetch(NULL, "AES-256-ECB", NULL);
+    static EVP_CIPHER* cbc = EVP_CIPHER_fetch(NULL, "AES-256-CBC", NULL);
+    return mode == AesMode::ECB ? ecb : cbc;
+}
+
+inline const EVP_MD* fetched_digest(const std::string& name) {
+    static EVP_MD* sha256 = EVP_MD_fetch(NULL, "SHA256", NULL);
+    static EVP_MD* md5 = EVP_MD_fetch(NULL, "MD5", NULL);
+    if (name == "SHA256") return sha256;
+    if (name == "MD5") return md5;
+    return NULL;
+}
+#else
+inline const EVP_CIPHER* fetched_aes_cipher(AesMode mode) {
+    return mode == AesMode::ECB ? EVP_aes_256_ecb() : EVP_aes_256_cbc();
+}
+
+inline const EVP_MD* fetched_digest(const std::string& name) {
+    if (name == "SHA256") return EVP_sha256();
+    if (name == "MD5") return EVP_md5();
+    return NULL;
+}
+#endif
+
+// --- OpenSSL Error Handling ---
+// Always throws: callers invoke it on a failed OpenSSL call.
+[[noreturn]] inline void handle_openssl_errors(const std::string& context_message = "") {
+    unsigned long err_code;
+    std::string error_string = context_message;
+    bool errors_found = false;
+    load_openssl_error_strings();
+    while ((err_code = ERR_get_error())) {
+        errors_found = true;
+        error_string += "OpenSSL Error: ";
+        char buf[256];
+        ERR_error_string_n(err_code, buf, sizeof(buf));
+        error_string += buf;
+        error_string += "\n";
+    }
+    if (errors_found) {
+        throw std::runtime_error(error_string);
+    }
+    // Failure without a queued OpenSSL error; still report it to the caller.
+    throw std::runtime_error(context_message);
+}
+
+// --- Parallel Execution ---
+// Runs task(i) for every i in [0, num_tasks), possibly concurrently, and returns once
+// all tasks are done. Tasks must not throw.
+class RangeExecutor {
+public:
+    virtual ~RangeExecutor() {}
+    virtual size_t concurrency() const = 0;
+    virtual void run(size_t num_tasks, const std::function<void(size_t)>& task) = 0;
+};
+
+// Default executor for the command line tools: the OpenMP team of the calling thread.
+class OpenMPExecutor : public RangeExecutor {
+public:
+    size_t concurrency() const override {
+#ifdef _OPENMP
+        return static_cast<size_t>(omp_get_max_threads());
+#else
+        return 1;
+#endif
+    }
+
+    // The team is no larger than the task count, so a two-task call (one key derivation)
+    // starts two threads rather than the full team.
+    void run(size_t num_tasks, const std::function<void(size_t)>& task) override {
+        const long long count = static_cast<long long>(num_tasks);
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(static) num_threads(std::max<long long>(1, std::min<long long>(count, omp_get_max_threads())))
+#endif
+        for (long long i = 0; i < count; ++i) {
+            task(static_cast<size_t>(i));
+        }
+    }
+
+    static OpenMPExecutor& instance() {
+        static OpenMPExecutor executor;
+        return executor;
+    }
+};
+
+// --- Command Line Parsing (done once, at the CLI boundary) ---
+// GCM, CHACHA20 and AUTO are only accepted where the caller handles them (allow_extended).
+inline bool parse_aes_mode(const std::string& mode_str, AesMode& mode, bool allow_extended = false) {
+    if (mode_str == "ECB") { mode = AesMode::ECB; return true; }
+    if (mode_str == "CBC") { mode = AesMode::CBC; return true; }
+    if (allow_extended && mode_str == "GCM") { mode = AesMode::GCM; return true; }
+    if (allow_extended && mode_str == "CHACHA20") { mode = AesMode::CHACHA20; return true; }
+    if (allow_extended && mode_str == "AUTO") { mode = AesMode::AUTO; return true; }
+    return false;
+}
+
+inline const char* aes_mode_name(AesMode mode) {
+    switch (mode) {
+    case AesMode::ECB: return "ECB";
+    case AesMode::CBC: return "CBC";
+    case AesMode::GCM: return "GCM";
+    case AesMode::CHACHA20: return "CHACHA20";
+    case AesMode::AUTO: return "AUTO";
+    }
+    return "?";
+}
+
+inline bool parse_direction(const std::string& operation_str, Direction& direction) {
+    if (operation_str == "encrypt") { direction = Direction::Encrypt; return true; }
+    if (operation_str == "decrypt") { direction = Direction::Decrypt; return true; }
+    return false;
+}
+
+// --- Cipher Engine ---
+template <AesMode M, Direction D, Padding P>
+class CipherEngine {
+public:
+    static constexpr AesMode mode = M;
+    static constexpr Direction direction = D;
+    static constexpr Padding padding = P;
+    static constexpr bool is_encrypt = (D == Direction::Encrypt);
+    // ECB blocks are independent; CBC decryption only needs the previous
+    // ciphertext block, which is already known. CBC encryption is a true chain.
+    static constexpr bool block_parallel = (M == AesMode::ECB) || (D == Direction::Decrypt);
+
+    // Streaming context over key/iv. The iv is ignored for ECB. Block-parallel modes run
+    // on the bitsliced engine instead of EVP when bitsliced_aes_selected(); both give the
+    // same bytes and the same update/finish contract.
+    CipherEngine(const unsigned char* key, const unsigned char* iv)
+        : ctx_(NULL) { open(key, iv, P == Padding::PKCS7); }
+
+    ~CipherEngine() { EVP_CIPHER_CTX_free(ctx_); }
+
+    CipherEngine(const CipherEngine&) = delete;
+    CipherEngine& operator=(const CipherEngine&) = delete;
+
+    // Output buffer must hold input_len + AES_BLOCK_BYTES bytes.
+    size_t update(const unsigned char* input_data, size_t input_len, unsigned char* output_data) {
+        if (bitsliced_) {
+            return bitsliced_->update(input_data, input_len, output_data);
+        }
+        size_t out_len = 0;
+        for (size_t done = 0; done < input_len;) {
+            const size_t step = std::min(input_len - done, EVP_UPDATE_MAX_BYTES);
+            int len = 0;
+            if (1 != EVP_CipherUpdate(ctx_, output_data + out_len, &len, input_data + done, static_cast<int>(step))) {
+                handle_openssl_errors("EVP_CipherUpdate failed: ");
+            }
+            done += step;
+            out_len += static_cast<size_t>(len);
+        }
+        return out_len;
+    }
+
+    // Flushes the final (padded) block. Output buffer must hold AES_BLOCK_BYTES bytes.
+    size_t finish(unsigned char* output_data) {
+        if (bitsliced_) {
+            size_t len = 0;
+            if (!bitsliced_->finish(output_data, len)) {
+                throw std::runtime_error(is_encrypt ? "Bitsliced AES final block failed: input is not a whole number of blocks."
+                                                    : "Bitsliced AES final block failed (check key/IV/data/padding).");
+            }
+            return len;
+        }
+        int len = 0;
+        if (1 != EVP_CipherFinal_ex(ctx_, output_data, &len)) {
+            if constexpr (is_encrypt) {
+                handle_openssl_errors("EVP_EncryptFinal_ex failed: ");
+            } else {
+                // This can fail if key/IV is wrong, ciphertext is corrupt, or padding is incorrect
+                handle_openssl_errors("EVP_DecryptFinal_ex failed (check key/IV/data/padding): ");
+            }
+        }
+        return static_cast<size_t>(len);
+    }
+
+    // Processes a whole buffer. Block-parallel modes are split into block-aligned
+    // ranges with one cipher context per executor task (OpenMP threads by default);
+    // padding is applied or removed once, on the last block of the buffer.
+    // Output buffer must hold input_len + AES_BLOCK_BYTES bytes. Returns the output length.
+    static size_t process(const unsigned char* key, const unsigned char* iv,
+                          const unsigned char* input_data, size_t input_len,
+                          unsigned char* output_data,
+                          size_t parallel_min_bytes = OMP_PARALLEL_MIN_BYTES,
+                          RangeExecutor& executor = OpenMPExecutor::instance()) {
+        if constexpr (P == Padding::None) {
+            if (input_len % AES_BLOCK_BYTES != 0) {
+                throw std::runtime_error("Error: Input length is not a multiple of the AES block size and padding is disabled.");
+            }
+        }
+        if constexpr (!block_parallel) {
+            return process_serial(key, iv, input_data, input_len, output_data);
+        } else {
+            if (input_len < parallel_min_bytes) {
+                return process_serial(key, iv, input_data, input_len, output_data);
+            }
+            // The block carrying the padding goes through a padded context; everything
+            // before it is padding-free and can be split freely.
+            size_t body_len = input_len - input_len % AES_BLOCK_BYTES;
+            if (P == Padding::PKCS7 && !is_encrypt && body_len == input_len && body_len > 0) {
+                body_len -= AES_BLOCK_BYTES;
+            }
+            // Chain state is copied before any output is written, so input and output may alias.
+            unsigned char tail_iv[AES_BLOCK_BYTES];
+            copy_chain_block(tail_iv, body_len > 0 ? input_data + body_len - AES_BLOCK_BYTES : iv);
+            process_blocks_parallel(key, iv, input_data, body_len, output_data, executor);
+            if (P == Padding::None) {
+                return body_len;
+            }
+            CipherEngine tail(key, tail_iv);
+            size_t out_len = body_len;
+            out_len += tail.update(input_data + body_len, input_len - body_len, output_data + out_len);
+            out_len += tail.finish(output_data + out_len);
+            return out_len;
+        }
+    }
+
+private:
+    EVP_CIPHER_CTX* ctx_;
+    std::unique_ptr<BitslicedCipher> bitsliced_;
+
+    void open(const unsigned char* key, const unsigned char* iv, bool enable_padding) {
+        if constexpr (block_parallel) {
+            if (bitsliced_aes_selected()) {
+                bitsliced_.reset(new BitslicedCipher(key, M == AesMode::ECB ? NULL : iv, is_encrypt, enable_padding));
+                return;
+            }
+        }
+        ctx_ = new_context(key, iv, enable_padding);
+    }
+
+    static EVP_CIPHER_CTX* new_context(const unsigned char* key, const unsigned char* iv, bool enable_padding) {
+        EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+        if (!ctx) {
+            handle_openssl_errors("EVP_CIPHER_CTX_new failed: ");
+        }
+        const unsigned char* init_iv = (M == AesMode::ECB) ? NULL : iv;
+        if (1 != EVP_CipherInit_ex(ctx, fetched_aes_cipher(M), NULL, key, init_iv, is_encrypt ? 1 : 0)) {
+            EVP_CIPHER_CTX_free(ctx);
+            handle_openssl_errors(is_encrypt ? "EVP_EncryptInit_ex failed: " : "EVP_DecryptInit_ex failed: ");
+        }
+        if (1 != EVP_CIPHER_CTX_set_padding(ctx, enable_padding ? 1 : 0)) {
+            EVP_CIPHER_CTX_free(ctx);
+            handle_openssl_errors("EVP_CIPHER_CTX_set_padding failed: ");
+        }
+        return ctx;
+    }
+
+    static size_t process_serial(const unsigned char* key, const unsigned char* iv,
+                                 const unsigned char* input_data, size_t input_len,
+                                 unsigned char* output_data) {
+        CipherEngine engine(key, iv);
+        size_t out_len = engine.update(input_data, input_len, output_data);
+        out_len += engine.finish(output_data + out_len);
+        return out_len;
+    }
+
+    // ECB callers may pass a NULL iv; the copy is then zero-filled and never used.
+    static void copy_chain_block(unsigned char* dst, const unsigned char* src) {
+        if (src != NULL) {
+            std::memcpy(dst, src, AES_BLOCK_BYTES);
+        } else {
+            std::memset(dst, 0, AES_BLOCK_BYTES);
+        }
+    }
+
+    // body_len must be a multiple of AES_BLOCK_BYTES.
+    static void process_blocks_parallel(const unsigned char* key, const unsigned char* iv,
+                                        const unsigned char* input_data, size_t body_len,
+                                        unsigned char* output_data, RangeExecutor& executor) {
+        const size_t num_blocks = body_len / AES_BLOCK_BYTES;
+        if (num_blocks == 0) return;
+        const size_t num_ranges = std::min(std::max<size_t>(executor.concurrency(), 1), num_blocks);
+        bool parallel_success = true;
+        std::string parallel_error;
+        std::mutex error_mutex;
+
+        // CBC decryption of a range chains from the ciphertext block just before it.
+        // Those blocks are copied up front so an in-place pass cannot overwrite them.
+        std::vector<unsigned char> range_ivs(num_ranges * AES_BLOCK_BYTES);
+        for (size_t range_idx = 0; range_idx < num_ranges; ++range_idx) {
+            const size_t offset = num_blocks * range_idx / num_ranges * AES_BLOCK_BYTES;
+            copy_chain_block(range_ivs.data() + range_idx * AES_BLOCK_BYTES,
+                             offset > 0 ? input_data + offset - AES_BLOCK_BYTES : iv);
+        }
+
+        executor.run(num_ranges, [&](size_t range_idx) {
+            const size_t first_block = num_blocks * range_idx / num_ranges;
+            const size_t last_block = num_blocks * (range_idx + 1) / num_ranges;
+            const size_t offset = first_block * AES_BLOCK_BYTES;
+            const size_t len = (last_block - first_block) * AES_BLOCK_BYTES;
+            try {
+                CipherEngine engine(key, range_ivs.data() + range_idx * AES_BLOCK_BYTES, Padding::None);
+                engine.update(input_data + offset, len, output_data + offset);
+            } catch (const std::exception& e) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                parallel_success = false;
+                parallel_error = e.what();
+            }
+        });
+
+        if (!parallel_success) {
+            throw std::runtime_error("Error occurred during parallel " + std::string(M == AesMode::ECB ? "ECB" : "CBC") +
+                                     " processing: " + parallel_error);
+        }
+    }
+
+    // Range context used by the parallel path: padding is always off.
+    CipherEngine(const unsigned char* key, const unsigned char* iv, Padding)
+        : ctx_(NULL) { open(key, iv, false); }
+};
+
+// --- Dispatch ---
+template <AesMode M, Direction D, Padding P>
+struct EngineTag {
+    using type = CipherEngine<M, D, P>;
+};
+
+// Maps the runtime choice onto one of the specialized engines and calls fn(EngineTag<...>{}).
+template <typename Fn>
+auto dispatch_cipher(AesMode mode, Direction direction, Padding padding, Fn&& fn) {
+    if (mode != AesMode::ECB && mode != AesMode::CBC) {
+        throw std::runtime_error("Error: Only ECB and CBC are supported by this operation.");
+    }
+    if (mode == AesMode::ECB) {
+        if (direction == Direction::Encrypt) {
+            if (padding == Padding::PKCS7) return fn(EngineTag<AesMode::ECB, Direction::Encrypt, Padding::PKCS7>{});
+            return fn(EngineTag<AesMode::ECB, Direction::Encrypt, Padding::None>{});
+        }
+        if (padding == Padding::PKCS7) return fn(EngineTag<AesMode::ECB, Direction::Decrypt, Padding::PKCS7>{});
+        return fn(EngineTag<AesMode::ECB, Direction::Decrypt, Padding::None>{});
+    }
+    if (direction == Direction::Encrypt) {
+        if (padding == Padding::PKCS7) return fn(EngineTag<AesMode::CBC, Direction::Encrypt, Padding::PKCS7>{});
+        return fn(EngineTag<AesMode::CBC, Direction::Encrypt, Padding::None>{});
+    }
+    if (padding == Padding::PKCS7) return fn(EngineTag<AesMode::CBC, Direction::Decrypt, Padding::PKCS7>{});
+    return fn(EngineTag<AesMode::CBC, Direction::Decrypt, Padding::None>{});
+}
+
+#endif // CIPHER_ENGINE_HPP
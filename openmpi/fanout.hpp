@@ -0,0 +1,201 @@
+#ifndef FANOUT_HPP
+#define FANOUT_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <stdexcept> // For std::runtime_error
+#include <cstddef>
+#include <cstring>   // For memcpy
+
+#include <openssl/crypto.h> // For OPENSSL_cleanse
+
+#include "cipher_engine.hpp"  // AES engine, executors
+#include "image_pipeline.hpp" // Key derivation, BMP layout
+
+// Multi-output fan-out: one input BMP, several (passphrase, mode, direction) targets.
+// The input is read and parsed once. Its pixel data is then walked in windows of
+// FANOUT_WINDOW_BYTES, and every target processes a window while it is still in cache
+// before the pass moves on. Within a window the block-parallel targets (ECB, CBC
+// decryption) are split into sub-ranges, and each CBC encryption continues its own chain.
+// All of these run as tasks of one executor call. Each output is identical to a
+// separate process_image_buffer call. A failing target (e.g. a wrong CBC key) reports
+// its own error and does not stop the others.
+
+const size_t FANOUT_WINDOW_BYTES = 1024 * 1024;
+
+// output_data must not overlap the input or another target's output.
+struct FanoutTarget {
+    std::string passphrase;
+    AesMode mode;
+    Direction direction;
+    unsigned char* output_data;     // At least max_processed_image_len(image_len) bytes
+    size_t output_len;              // Set on success
+    std::string error;              // Set on failure
+};
+
+namespace fanout_detail {
+
+struct TargetState {
+    unsigned char key[AES_KEY_BYTES];
+    unsigned char iv[AES_IV_BYTES];
+    size_t body_len;  // Bytes processed window by window
+    bool chained;     // CBC encryption: one task per window, streaming engine
+    std::unique_ptr<CipherEngine<AesMode::CBC, Direction::Encrypt, Padding::PKCS7>> chain;
+    bool failed;
+
+    TargetState() : body_len(0), chained(false), failed(false) {}
+    ~TargetState() {
+        OPENSSL_cleanse(key, sizeof(key));
+        OPENSSL_cleanse(iv, sizeof(iv));
+    }
+};
+
+struct WindowTask {
+    size_t target;
+    size_t begin;
+    size_t end;
+};
+
+// Processes [begin, end) of a block-parallel target with the chain block before begin.
+inline void process_parallel_range(const FanoutTarget& target, const TargetState& state,
+                                   const unsigned char* pixels, size_t begin, size_t end, unsigned char* out) {
+    const unsigned char* chain = begin > 0 ? pixels + begin - AES_BLOCK_BYTES : state.iv;
+    dispatch_cipher(target.mode, target.direction, Padding::None, [&](auto engine_tag) {
+        using Engine = typename decltype(engine_tag)::type;
+        Engine engine(state.key, chain);
+        return engine.update(pixels + begin, end - begin, out + begin);
+    });
+}
+
+} // namespace fanout_detail
+
+inline void process_image_fanout(const unsigned char* image_data, size_t image_len,
+                                 std::vector<FanoutTarget>& targets,
+                                 RangeExecutor& executor = OpenMPExecutor::instance()) {
+    using namespace fanout_detail;
+    if (image_len < BMP_HEADER_SIZE) {
+        throw std::runtime_error("Error: Input file is smaller than a typical BMP header.");
+    }
+    BmpLayout layout;
+    layout.header_len = get_pixel_data_offset(image_data, BMP_HEADER_SIZE);
+    layout.pixel_len = image_len - std::min<size_t>(layout.header_len, image_len);
+    const unsigned char* pixels = image_data + layout.header_len;
+
+    // --- Per-target setup ---
+    // Targets sharing a passphrase share one key derivation; the distinct passphrases
+    // are derived together in one multi-lane batch.
+    std::vector<const std::string*> passphrases;
+    std::vector<size_t> passphrase_index(targets.size());
+    for (size_t t = 0; t < targets.size(); ++t) {
+        size_t same = 0;
+        while (same < passphrases.size() && *passphrases[same] != targets[t].passphrase) ++same;
+        if (same == passphrases.size()) passphrases.push_back(&targets[t].passphrase);
+        passphrase_index[t] = same;
+    }
+    std::vector<unsigned char> keys(passphrases.size() * AES_KEY_BYTES);
+    std::vector<unsigned char> ivs(passphrases.size() * AES_IV_BYTES);
+    derive_image_keys_and_ivs(passphrases, keys.data(), ivs.data(), executor);
+    std::vector<TargetState> states(targets.size());
+    for (size_t t = 0; t < targets.size(); ++t) {
+        FanoutTarget& target = targets[t];
+        TargetState& state = states[t];
+        target.output_len = 0;
+        target.error.clear();
+        try {
+            require_uncompressed_layout(locate_pixel_data(image_data, image_len, target.direction));
+            std::memcpy(state.key, keys.data() + passphrase_index[t] * AES_KEY_BYTES, AES_KEY_BYTES);
+            std::memcpy(state.iv, ivs.data() + passphrase_index[t] * AES_IV_BYTES, AES_IV_BYTES);
+            std::memcpy(target.output_data, image_data, layout.header_len);
+            const size_t input_len = pixel_cipher_input_len(target.mode, layout.pixel_len);
+            state.chained = target.mode == AesMode::CBC && target.direction == Direction::Encrypt;
+            if (state.chained) {
+                state.chain.reset(new CipherEngine<AesMode::CBC, Direction::Encrypt, Padding::PKCS7>(state.key, state.iv));
+                state.body_len = input_len;
+            } else {
+                // As in CipherEngine::process: the block carrying CBC padding is left for the end.
+                state.body_len = input_len - input_len % AES_BLOCK_BYTES;
+                if (target.mode == AesMode::CBC && state.body_len == input_len && state.body_len > 0) {
+                    state.body_len -= AES_BLOCK_BYTES;
+                }
+            }
+        } catch (const std::exception& e) {
+            state.failed = true;
+            target.error = e.what();
+        }
+    }
+    OPENSSL_cleanse(keys.data(), keys.size());
+    OPENSSL_cleanse(ivs.data(), ivs.size());
+
+    // --- Windowed pass ---
+    const size_t split = std::max<size_t>(executor.concurrency(), 1);
+    std::vector<WindowTask> tasks;
+    std::vector<std::string> task_errors;
+    for (size_t window = 0; window < layout.pixel_len; window += FANOUT_WINDOW_BYTES) {
+        const size_t window_end = std::min(layout.pixel_len, window + FANOUT_WINDOW_BYTES);
+        tasks.clear();
+        for (size_t t = 0; t < targets.size(); ++t) {
+            if (states[t].failed) continue;
+            const size_t end = std::min(window_end, states[t].body_len);
+            if (end <= window) continue;
+            if (states[t].chained || states[t].body_len < OMP_PARALLEL_MIN_BYTES) {
+                tasks.push_back(WindowTask{t, window, end});
+                continue;
+            }
+            const size_t blocks = (end - window) / AES_BLOCK_BYTES;
+            const size_t parts = std::min(split, blocks);
+            for (size_t p = 0; p < parts; ++p) {
+                tasks.push_back(WindowTask{t, window + blocks * p / parts * AES_BLOCK_BYTES,
+                                           window + blocks * (p + 1) / parts * AES_BLOCK_BYTES});
+            }
+        }
+        if (tasks.empty()) break;
+        task_errors.assign(tasks.size(), std::string());
+        executor.run(tasks.size(), [&](size_t i) {
+            const WindowTask& task = tasks[i];
+            TargetState& state = states[task.target];
+            unsigned char* out = targets[task.target].output_data + layout.header_len;
+            try {
+                if (state.chained) {
+                    state.chain->update(pixels + task.begin, task.end - task.begin, out + task.begin);
+                } else {
+                    process_parallel_range(targets[task.target], state, pixels, task.begin, task.end, out);
+                }
+            } catch (const std::exception& e) {
+                task_errors[i] = e.what();
+            }
+        });
+        for (size_t i = 0; i < tasks.size(); ++i) {
+            if (!task_errors[i].empty() && !states[tasks[i].target].failed) {
+                states[tasks[i].target].failed = true;
+                targets[tasks[i].target].error = task_errors[i];
+            }
+        }
+    }
+
+    // --- Final blocks ---
+    for (size_t t = 0; t < targets.size(); ++t) {
+        FanoutTarget& target = targets[t];
+        TargetState& state = states[t];
+        if (state.failed) continue;
+        unsigned char* out = target.output_data + layout.header_len;
+        try {
+            size_t pixel_out_len = state.body_len;
+            if (state.chained) {
+                // The engine holds back a trailing partial block until finish().
+                pixel_out_len = state.body_len / AES_BLOCK_BYTES * AES_BLOCK_BYTES;
+                pixel_out_len += state.chain->finish(out + pixel_out_len);
+            } else if (target.mode == AesMode::CBC) {
+                pixel_out_len += CipherEngine<AesMode::CBC, Direction::Decrypt, Padding::PKCS7>::process(
+                    state.key, state.body_len > 0 ? pixels + state.body_len - AES_BLOCK_BYTES : state.iv,
+                    pixels + state.body_len, layout.pixel_len - state.body_len, out + state.body_len);
+            }
+            target.output_len = layout.header_len + pixel_out_len;
+        } catch (const std::exception& e) {
+            state.failed = true;
+            target.error = e.what();
+        }
+    }
+}
+
+#endif // FANOUT_HPP
@@ -11,37 +11,12 @@
 #include <openssl/evp.h>
 #include <openssl/rand.h> 
 #include <openssl/err.h>  
-#include <openssl/conf.h> 
+
+#include "cipher_engine.hpp" // AES engine, OpenSSL runtime and error handling
 
 // --- Configuration ---
-const int AES_KEY_BITS = 256;
-const int AES_KEY_BYTES = AES_KEY_BITS / 8;
-const int AES_IV_BYTES = 16;    
-const int AES_BLOCK_BYTES = 16; 
 const int PBKDF2_ITERATIONS = 10000;
 
-// --- OpenSSL Error Handling ---
-// This function is CRUCIAL. If OpenSSL operations fail, it prints why.
-void handle_openssl_errors(const std::string& context_message = "") {
-    unsigned long err_code;
-    std::string error_string = context_message;
-    bool errors_found = false;
-    while ((err_code = ERR_get_error())) {
-        errors_found = true;
-        error_string += "\nOpenSSL Error: "; // Added newline for better formatting
-        char err_buf[256];
-        ERR_error_string_n(err_code, err_buf, sizeof(err_buf));
-        error_string += err_buf;
-    }
-    if (errors_found) {
-        // Print to cerr and throw, or print and exit(1)
-        // Throwing allows a calling C++ context to catch if needed,
-        // but for a standalone tool, printing and exiting is also common.
-        // We'll keep throwing as it integrates with the main try-catch.
-        throw std::runtime_error(error_string);
-    }
-}
-
 // --- Key/IV Derivation ---
 bool derive_key_and_iv(const std::string& passphrase, const unsigned char* salt, int salt_len,
                        unsigned char* key_out, int key_out_len,
@@ -54,7 +29,7 @@ bool derive_key_and_iv(const std::string& passphrase, const unsigned char* salt,
 
     if (PKCS5_PBKDF2_HMAC(passphrase.c_str(), passphrase.length(),
                           salt, salt_len,
-                          PBKDF2_ITERATIONS, EVP_sha256(),
+                          PBKDF2_ITERATIONS, fetched_digest("SHA256"),
                           key_out_len, key_out) != 1) {
         handle_openssl_errors("Key derivation (PKCS5_PBKDF2_HMAC for key) failed.");
         return false; // Should not be reached if handle_openssl_errors throws
@@ -66,7 +41,7 @@ bool derive_key_and_iv(const std::string& passphrase, const unsigned char* salt,
 
     if (PKCS5_PBKDF2_HMAC(passphrase.c_str(), passphrase.length(),
                           iv_salt.data(), iv_salt.size(),
-                          PBKDF2_ITERATIONS, EVP_sha256(),      
+                          PBKDF2_ITERATIONS, fetched_digest("SHA256"),      
                           iv_out_len, iv_out) != 1) {
         handle_openssl_errors("IV derivation (PKCS5_PBKDF2_HMAC for IV) failed.");
         return false; // Should not be reached
@@ -74,75 +49,6 @@ bool derive_key_and_iv(const std::string& passphrase, const unsigned char* salt,
     return true;
 }
 
-// --- AES Operation (Always Padded) ---
-bool aes_openssl_operation(
-    const unsigned char* input_data, size_t input_len, 
-    unsigned char* output_data, int& output_len, 
-    const unsigned char* key,
-    const unsigned char* iv,
-    const std::string& operation, 
-    const std::string& mode
-) {
-    EVP_CIPHER_CTX *ctx = NULL;
-    const EVP_CIPHER *cipher_type = NULL;
-    int len = 0;
-    output_len = 0; 
-
-    try {
-        if (mode == "ECB") {
-            cipher_type = EVP_aes_256_ecb();
-        } else if (mode == "CBC") {
-            cipher_type = EVP_aes_256_cbc();
-        } else {
-            throw std::runtime_error("Unsupported AES mode: " + mode); // Basic validation
-        }
-
-        if (!(ctx = EVP_CIPHER_CTX_new())) {
-            handle_openssl_errors("EVP_CIPHER_CTX_new failed.");
-            return false; // Should not be reached
-        }
-
-        bool is_encrypt = (operation == "encrypt");
-        const unsigned char* current_iv = (mode == "ECB" ? NULL : iv);
-
-        if (1 != EVP_CipherInit_ex(ctx, cipher_type, NULL, key, current_iv, (is_encrypt ? 1 : 0))) {
-             handle_openssl_errors(std::string(is_encrypt ? "EVP_EncryptInit_ex" : "EVP_DecryptInit_ex") + " failed.");
-             EVP_CIPHER_CTX_free(ctx); return false; // Should not be reached
-        }
-
-        if (1 != EVP_CIPHER_CTX_set_padding(ctx, 1)) { // ALWAYS ENABLE PADDING
-             handle_openssl_errors("EVP_CIPHER_CTX_set_padding (to enable) failed.");
-             EVP_CIPHER_CTX_free(ctx); return false; // Should not be reached
-        }
-
-        if (input_len > 0) {
-            if (1 != EVP_CipherUpdate(ctx, output_data, &len, input_data, static_cast<int>(input_len))) {
-                handle_openssl_errors("EVP_CipherUpdate failed.");
-                EVP_CIPHER_CTX_free(ctx); return false; // Should not be reached
-            }
-            output_len = len;
-        } else {
-            output_len = 0; 
-        }
-
-        int final_len = 0;
-        if (1 != EVP_CipherFinal_ex(ctx, output_data + output_len, &final_len)) {
-            // Simplified: No extra "Warning" print here. 
-            // If this fails (e.g. padding error on decrypt), handle_openssl_errors will report it.
-            handle_openssl_errors(std::string(is_encrypt ? "EVP_EncryptFinal_ex" : "EVP_DecryptFinal_ex") + " failed.");
-            EVP_CIPHER_CTX_free(ctx); return false; // Should not be reached
-        }
-        output_len += final_len;
-
-    } catch (...) { // Catch any exception from within try, including what handle_openssl_errors throws
-        if(ctx) EVP_CIPHER_CTX_free(ctx);
-        throw; // Re-throw to be caught by main or terminate
-    }
-    
-    if(ctx) EVP_CIPHER_CTX_free(ctx);
-    return true;
-}
-
 // --- File Handling Utilities ---
 std::vector<unsigned char> read_file_bytes(const std::string& file_path) {
     std::ifstream file(file_path, std::ios::binary | std::ios::ate);
@@ -175,10 +81,26 @@ void write_file_bytes(const std::string& file_path, const std::vector<unsigned c
     file.close();
 }
 
+// Last AES block of a file: the CBC chaining value for the chunk that follows it
+// (the previous chunk's ciphertext, i.e. its output when encrypting and its input when decrypting).
+void read_chain_block(const std::string& file_path, unsigned char* block) {
+    std::ifstream file(file_path, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) {
+        throw std::runtime_error("Error: Could not open input file: " + file_path);
+    }
+    if (file.tellg() < static_cast<std::streamoff>(AES_BLOCK_BYTES)) {
+        throw std::runtime_error("Error: Chain file is shorter than one AES block: " + file_path);
+    }
+    file.seekg(-static_cast<std::streamoff>(AES_BLOCK_BYTES), std::ios::end);
+    if (!file.read(reinterpret_cast<char*>(block), AES_BLOCK_BYTES)) {
+        throw std::runtime_error("Error: Could not read input file: " + file_path);
+    }
+}
+
 // --- Main Application Logic ---
 int main(int argc, char* argv[]) {
-    if (argc != 6) { 
-        std::cerr << "Usage: " << argv[0] << " <input_path> <aes_passphrase> <output_path> <encrypt|decrypt> <ECB|CBC>" << std::endl;
+    if (argc < 6) {
+        std::cerr << "Usage: " << argv[0] << " <input_path> <aes_passphrase> <output_path> <encrypt|decrypt> <ECB|CBC> [--no-pad] [--chain-from <previous_chunk_path>]" << std::endl;
         return 1;
     }
 
@@ -188,19 +110,39 @@ int main(int argc, char* argv[]) {
     std::string operation_str = argv[4];
     std::string mode_str = argv[5];
 
-    if (operation_str != "encrypt" && operation_str != "decrypt") {
+    Direction direction;
+    AesMode mode;
+    if (!parse_direction(operation_str, direction)) {
         std::cerr << "Error: Invalid operation. Must be 'encrypt' or 'decrypt'." << std::endl; return 1;
     }
-    if (mode_str != "ECB" && mode_str != "CBC") {
+    if (!parse_aes_mode(mode_str, mode)) {
         std::cerr << "Error: Invalid mode. Must be 'ECB' or 'CBC'." << std::endl; return 1;
     }
 
+    // A stream processed in pieces: every chunk but the last takes --no-pad, and every CBC
+    // chunk but the first chains from the one before it. The concatenated outputs then
+    // match a single run over the whole stream.
+    Padding padding = Padding::PKCS7;
+    std::string chain_path;
+    for (int i = 6; i < argc; ++i) {
+        const std::string option = argv[i];
+        if (option == "--no-pad") {
+            padding = Padding::None;
+        } else if (option == "--chain-from" && i + 1 < argc) {
+            chain_path = argv[++i];
+        } else {
+            std::cerr << "Error: Unknown option: " << option << std::endl; return 1;
+        }
+    }
+    if (!chain_path.empty() && mode != AesMode::CBC) {
+        std::cerr << "Error: --chain-from only applies to CBC." << std::endl; return 1;
+    }
+
     // Minimal logging
     // std::cout << "Processing: " << operation_str << " " << input_path << " -> " << output_path << " (Mode: " << mode_str << ")" << std::endl;
 
     try {
-        OpenSSL_add_all_algorithms(); 
-        ERR_load_crypto_strings(); // Load error strings for libcrypto
+        init_openssl_runtime(); // Error strings are loaded only if an error is reported
 
         std::vector<unsigned char> data_to_process = read_file_bytes(input_path);
         
@@ -216,21 +158,18 @@ int main(int argc, char* argv[]) {
             std::cerr << "Error: Failed to derive AES key and IV." << std::endl;
             return 1;
         }
+        if (!chain_path.empty()) {
+            read_chain_block(chain_path, derived_iv);
+        }
         
+        // Block-parallel over OpenMP threads where the mode allows; padding only on the last block.
         std::vector<unsigned char> processed_data; 
         processed_data.resize(data_to_process.size() + AES_BLOCK_BYTES); 
-        int actual_output_len = 0;
-        
-        if (!aes_openssl_operation(data_to_process.data(), data_to_process.size(),
-                                   processed_data.data(), actual_output_len,
-                                   derived_key, derived_iv,
-                                   operation_str, mode_str)) {
-            // aes_openssl_operation now calls handle_openssl_errors which throws.
-            // This path might not be strictly needed.
-            std::cerr << "Error: AES processing failed." << std::endl;
-            // ERR_print_errors_fp(stderr); // Already handled by handle_openssl_errors
-            return 1; 
-        }
+        size_t actual_output_len = dispatch_cipher(mode, direction, padding, [&](auto engine_tag) {
+            using Engine = typename decltype(engine_tag)::type; // Throws on failure
+            return Engine::process(derived_key, derived_iv, data_to_process.data(), data_to_process.size(),
+                                   processed_data.data());
+        });
         processed_data.resize(actual_output_len); 
 
         write_file_bytes(output_path, processed_data);
@@ -239,12 +178,8 @@ int main(int argc, char* argv[]) {
     } catch (const std::exception& e) {
         // This will catch errors thrown by handle_openssl_errors, read_file_bytes, write_file_bytes, etc.
         std::cerr << "An error occurred: " << e.what() << std::endl;
-        // Ensure OpenSSL error strings are available for e.what() if it's from handle_openssl_errors
-        // ERR_free_strings(); // Call at the very end if not relying on auto-cleanup
         return 1;
     }
 
-    ERR_free_strings(); // Clean up loaded error strings
-    // EVP_cleanup(); // Deprecated, OpenSSL_cleanup() is newer but auto-cleanup is common
     return 0;
 }
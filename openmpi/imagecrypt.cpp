@@ -0,0 +1,397 @@
+// libimagecrypt: shared-library build of the image processor with a C ABI (see imagecrypt.h).
+#include <cstdlib>   // For std::getenv, std::atoi
+#include <cstring>   // For memcpy
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "imagecrypt.h"
+#include "cipher_engine.hpp"  // AES engine, OpenSSL runtime and error handling
+#include "image_pipeline.hpp" // BMP parsing, key derivation and the pixel cipher pass
+#include "worker_pool.hpp"    // Library-owned worker threads
+#include "result_cache.hpp"   // Repeated requests are served from the cache
+#include "row_decrypt.hpp"    // Row range decryption
+#include "reencrypt.hpp"      // Key rotation
+#include "fanout.hpp"         // Multi-output processing
+#include "integrity_digest.hpp" // CRC32C digests
+#include "split_advisor.hpp"  // Local-vs-remote split advice
+
+namespace {
+
+thread_local std::string last_error;
+
+std::mutex pool_mutex;
+std::unique_ptr<WorkerPool> pool;
+std::once_flag openssl_once;
+
+// Copy of a caller's passphrase that is wiped however the call leaves its scope,
+// including by an exception out of the pipeline.
+struct PassphraseCopy {
+    std::string value;
+    PassphraseCopy(const uint8_t* data, size_t len) : value(reinterpret_cast<const char*>(data), len) {}
+    ~PassphraseCopy() { OPENSSL_cleanse(&value[0], value.size()); }
+    PassphraseCopy(const PassphraseCopy&) = delete;
+    PassphraseCopy& operator=(const PassphraseCopy&) = delete;
+};
+
+int fail(int status, const std::string& message) {
+    last_error = message;
+    return status;
+}
+
+size_t default_thread_count() {
+    const char* env_threads = std::getenv("IMAGECRYPT_THREADS");
+    if (env_threads != NULL && std::atoi(env_threads) > 0) {
+        return static_cast<size_t>(std::atoi(env_threads));
+    }
+    unsigned int cpus = std::thread::hardware_concurrency();
+    return cpus > 0 ? cpus : 1;
+}
+
+// The calling thread also works on its own batch, so the pool holds one thread less.
+WorkerPool& shared_pool() {
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    if (!pool) {
+        pool.reset(new WorkerPool(default_thread_count() - 1));
+    }
+    return *pool;
+}
+
+ResultCache& shared_cache() {
+    static ResultCache cache(result_cache_config_from_env(RESULT_CACHE_DEFAULT_MEMORY_BYTES));
+    return cache;
+}
+
+SplitAdvisor& shared_advisor() {
+    static SplitAdvisor advisor;
+    return advisor;
+}
+
+// Records the layout error in last_error and returns false if the input cannot go
+// through the given operation.
+bool pixel_layout_valid(const uint8_t* input, size_t input_len, int operation) {
+    try {
+        locate_pixel_data(input, input_len, operation == IMAGECRYPT_ENCRYPT ? Direction::Encrypt : Direction::Decrypt);
+    } catch (const std::exception& e) {
+        last_error = e.what();
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+extern "C" int imagecrypt_init(int num_threads) {
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    if (pool) {
+        return fail(IMAGECRYPT_ERR_ARGUMENT, "Error: imagecrypt worker pool is already running.");
+    }
+    try {
+        std::call_once(openssl_once, init_openssl_runtime);
+        size_t threads = num_threads > 0 ? static_cast<size_t>(num_threads) : default_thread_count();
+        pool.reset(new WorkerPool(threads - 1));
+    } catch (const std::exception& e) {
+        return fail(IMAGECRYPT_ERR_INTERNAL, e.what());
+    }
+    return IMAGECRYPT_OK;
+}
+
+extern "C" void imagecrypt_shutdown(void) {
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    pool.reset();
+}
+
+extern "C" size_t imagecrypt_max_output_size(size_t input_len) {
+    return max_processed_image_len(input_len);
+}
+
+extern "C" int imagecrypt_process(const uint8_t* input, size_t input_len,
+                                  uint8_t* output, size_t output_capacity, size_t* output_len,
+                                  const uint8_t* passphrase, size_t passphrase_len,
+                                  int operation, int mode) {
+    if (input == NULL || output == NULL || output_len == NULL || (passphrase == NULL && passphrase_len > 0)) {
+        return fail(IMAGECRYPT_ERR_ARGUMENT, "Error: NULL buffer passed to imagecrypt_process.");
+    }
+    if (operation != IMAGECRYPT_ENCRYPT && operation != IMAGECRYPT_DECRYPT) {
+        return fail(IMAGECRYPT_ERR_ARGUMENT, "Error: Invalid operation. Must be IMAGECRYPT_ENCRYPT or IMAGECRYPT_DECRYPT.");
+    }
+    AesMode aes_mode;
+    PixelCodec codec;
+    if (!pixel_mode_codec_from_imagecrypt(mode, aes_mode, codec)) {
+        return fail(IMAGECRYPT_ERR_ARGUMENT, "Error: Invalid mode. Must be one of the IMAGECRYPT_MODE_* values, "
+                                             "optionally with an IMAGECRYPT_COMPRESS_* flag this build supports.");
+    }
+    if (output != input && output < input + input_len && input < output + output_capacity) {
+        return fail(IMAGECRYPT_ERR_ARGUMENT, "Error: Input and output buffers overlap without being the same buffer.");
+    }
+    const Direction direction = operation == IMAGECRYPT_ENCRYPT ? Direction::Encrypt : Direction::Decrypt;
+    *output_len = 0;
+
+    size_t required = 0;
+    try {
+        std::call_once(openssl_once, init_openssl_runtime);
+        required = processed_image_capacity(locate_pixel_data(input, input_len, direction), input_len);
+    } catch (const std::exception& e) {
+        return fail(IMAGECRYPT_ERR_FORMAT, e.what());
+    }
+    if (output_capacity < required) {
+        *output_len = required;
+        return fail(IMAGECRYPT_ERR_BUFFER_TOO_SMALL, "Error: Output buffer is smaller than the processed image (" +
+                                                     std::to_string(required) + " bytes).");
+    }
+
+    try {
+        const PassphraseCopy passphrase_copy(passphrase, passphrase_len);
+        *output_len = process_image_buffer_cached(shared_cache(), input, input_len, output, output_capacity,
+                                                  passphrase_copy.value, aes_mode, direction, codec, shared_pool());
+    } catch (const std::bad_alloc&) {
+        return fail(IMAGECRYPT_ERR_INTERNAL, "Error: Out of memory.");
+    } catch (const std::exception& e) {
+        return fail(IMAGECRYPT_ERR_CRYPTO, e.what());
+    } catch (...) {
+        return fail(IMAGECRYPT_ERR_INTERNAL, "Error: Unknown failure in imagecrypt_process.");
+    }
+    last_error.clear();
+    return IMAGECRYPT_OK;
+}
+
+extern "C" int imagecrypt_process_multi(const uint8_t* input, size_t input_len,
+                                        imagecrypt_target* targets, size_t num_targets) {
+    if (input == NULL || (targets == NULL && num_targets > 0)) {
+        return fail(IMAGECRYPT_ERR_ARGUMENT, "Error: NULL buffer passed to imagecrypt_process_multi.");
+    }
+    // Arguments and layout are checked per target; targets that fail here are left out of the pass.
+    std::vector<FanoutTarget> fanout;
+    std::vector<size_t> fanout_index;
+    struct FanoutPassphraseGuard {
+        std::vector<FanoutTarget>& targets;
+        ~FanoutPassphraseGuard() {
+            for (FanoutTarget& target : targets) OPENSSL_cleanse(&target.passphrase[0], target.passphrase.size());
+        }
+    } fanout_guard = {fanout};
+    std::string first_error;
+    int first_status = IMAGECRYPT_OK;
+    auto target_fail = [&](imagecrypt_target& target, int status, const std::string& message) {
+        target.status = status;
+        if (first_status == IMAGECRYPT_OK) {
+            first_status = status;
+            first_error = message;
+        }
+    };
+    try {
+        std::call_once(openssl_once, init_openssl_runtime);
+        // Entries are built in place and never reallocated, so no stray passphrase copies are left behind.
+        fanout.reserve(num_targets);
+        for (size_t t = 0; t < num_targets; ++t) {
+            imagecrypt_target& target = targets[t];
+            target.output_len = 0;
+            target.status = IMAGECRYPT_OK;
+            if (target.output == NULL || (target.passphrase == NULL && target.passphrase_len > 0)) {
+                target_fail(target, IMAGECRYPT_ERR_ARGUMENT, "Error: NULL buffer passed to imagecrypt_process_multi.");
+            } else if (target.operation != IMAGECRYPT_ENCRYPT && target.operation != IMAGECRYPT_DECRYPT) {
+                target_fail(target, IMAGECRYPT_ERR_ARGUMENT, "Error: Invalid operation. Must be IMAGECRYPT_ENCRYPT or IMAGECRYPT_DECRYPT.");
+            } else if (target.mode != IMAGECRYPT_MODE_ECB && target.mode != IMAGECRYPT_MODE_CBC) {
+                target_fail(target, IMAGECRYPT_ERR_ARGUMENT, "Error: Invalid mode. Must be IMAGECRYPT_MODE_ECB or IMAGECRYPT_MODE_CBC.");
+            } else if (target.output < input + input_len && input < target.output + target.output_capacity) {
+                target_fail(target, IMAGECRYPT_ERR_ARGUMENT, "Error: Output buffer overlaps the input.");
+            } else if (target.output_capacity < imagecrypt_max_output_size(input_len)) {
+                target_fail(target, IMAGECRYPT_ERR_BUFFER_TOO_SMALL, "Error: Output buffer is smaller than imagecrypt_max_output_size().");
+            } else if (!pixel_layout_valid(input, input_len, target.operation)) {
+                target_fail(target, IMAGECRYPT_ERR_FORMAT, last_error);
+            } else {
+                fanout.push_back(FanoutTarget());
+                FanoutTarget& entry = fanout.back();
+                entry.passphrase.assign(reinterpret_cast<const char*>(target.passphrase), target.passphrase_len);
+                entry.mode = target.mode == IMAGECRYPT_MODE_ECB ? AesMode::ECB : AesMode::CBC;
+                entry.direction = target.operation == IMAGECRYPT_ENCRYPT ? Direction::Encrypt : Direction::Decrypt;
+                entry.output_data = target.output;
+                entry.output_len = 0;
+                fanout_index.push_back(t);
+            }
+        }
+        if (!fanout.empty()) {
+            process_image_fanout(input, input_len, fanout, shared_pool());
+        }
+        for (size_t i = 0; i < fanout.size(); ++i) {
+            imagecrypt_target& target = targets[fanout_index[i]];
+            if (fanout[i].error.empty()) {
+                target.output_len = fanout[i].output_len;
+            } else {
+                target_fail(target, IMAGECRYPT_ERR_CRYPTO, fanout[i].error);
+            }
+        }
+    } catch (const std::bad_alloc&) {
+        return fail(IMAGECRYPT_ERR_INTERNAL, "Error: Out of memory.");
+    } catch (const std::exception& e) {
+        return fail(IMAGECRYPT_ERR_FORMAT, e.what());
+    }
+    if (first_status != IMAGECRYPT_OK) {
+        return fail(first_status, first_error);
+    }
+    last_error.clear();
+    return IMAGECRYPT_OK;
+}
+
+extern "C" int imagecrypt_reencrypt(const uint8_t* input, size_t input_len,
+                                    uint8_t* output, size_t output_capacity, size_t* output_len,
+                                    const uint8_t* old_passphrase, size_t old_passphrase_len, int old_mode,
+                                    const uint8_t* new_passphrase, size_t new_passphrase_len, int new_mode) {
+    if (input == NULL || output == NULL || output_len == NULL ||
+        (old_passphrase == NULL && old_passphrase_len > 0) || (new_passphrase == NULL && new_passphrase_len > 0)) {
+        return fail(IMAGECRYPT_ERR_ARGUMENT, "Error: NULL buffer passed to imagecrypt_reencrypt.");
+    }
+    if ((old_mode != IMAGECRYPT_MODE_ECB && old_mode != IMAGECRYPT_MODE_CBC) ||
+        (new_mode != IMAGECRYPT_MODE_ECB && new_mode != IMAGECRYPT_MODE_CBC)) {
+        return fail(IMAGECRYPT_ERR_ARGUMENT, "Error: Invalid mode. Must be IMAGECRYPT_MODE_ECB or IMAGECRYPT_MODE_CBC.");
+    }
+    if (output != input && output < input + input_len && input < output + output_capacity) {
+        return fail(IMAGECRYPT_ERR_ARGUMENT, "Error: Input and output buffers overlap without being the same buffer.");
+    }
+    *output_len = 0;
+
+    try {
+        std::call_once(openssl_once, init_openssl_runtime);
+        locate_pixel_data(input, input_len, Direction::Decrypt);
+    } catch (const std::exception& e) {
+        return fail(IMAGECRYPT_ERR_FORMAT, e.what());
+    }
+    if (output_capacity < imagecrypt_max_output_size(input_len)) {
+        return fail(IMAGECRYPT_ERR_BUFFER_TOO_SMALL, "Error: Output buffer is smaller than imagecrypt_max_output_size().");
+    }
+
+    try {
+        const PassphraseCopy old_copy(old_passphrase, old_passphrase_len);
+        const PassphraseCopy new_copy(new_passphrase, new_passphrase_len);
+        *output_len = reencrypt_image_buffer(input, input_len, output, output_capacity,
+                                             old_copy.value, old_mode == IMAGECRYPT_MODE_ECB ? AesMode::ECB : AesMode::CBC,
+                                             new_copy.value, new_mode == IMAGECRYPT_MODE_ECB ? AesMode::ECB : AesMode::CBC,
+                                             shared_pool());
+    } catch (const std::bad_alloc&) {
+        return fail(IMAGECRYPT_ERR_INTERNAL, "Error: Out of memory.");
+    } catch (const std::exception& e) {
+        return fail(IMAGECRYPT_ERR_CRYPTO, e.what());
+    } catch (...) {
+        return fail(IMAGECRYPT_ERR_INTERNAL, "Error: Unknown failure in imagecrypt_reencrypt.");
+    }
+    last_error.clear();
+    return IMAGECRYPT_OK;
+}
+
+extern "C" int imagecrypt_decrypt_rows(const char* path,
+                                       const uint8_t* passphrase, size_t passphrase_len, int mode,
+                                       uint32_t first_row, uint32_t row_count,
+                                       uint8_t* output, size_t output_capacity, size_t* output_len) {
+    if (path == NULL || output_len == NULL || (output == NULL && output_capacity > 0) ||
+        (passphrase == NULL && passphrase_len > 0)) {
+        return fail(IMAGECRYPT_ERR_ARGUMENT, "Error: NULL argument passed to imagecrypt_decrypt_rows.");
+    }
+    if (mode != IMAGECRYPT_MODE_ECB && mode != IMAGECRYPT_MODE_CBC) {
+        return fail(IMAGECRYPT_ERR_ARGUMENT, "Error: Invalid mode. Must be IMAGECRYPT_MODE_ECB or IMAGECRYPT_MODE_CBC.");
+    }
+    *output_len = 0;
+    std::vector<unsigned char> rows_image;
+    try {
+        std::call_once(openssl_once, init_openssl_runtime);
+        const PassphraseCopy passphrase_copy(passphrase, passphrase_len);
+        rows_image = decrypt_bmp_rows(path, passphrase_copy.value,
+                                      mode == IMAGECRYPT_MODE_ECB ? AesMode::ECB : AesMode::CBC,
+                                      first_row, row_count, shared_pool());
+    } catch (const std::bad_alloc&) {
+        return fail(IMAGECRYPT_ERR_INTERNAL, "Error: Out of memory.");
+    } catch (const std::exception& e) {
+        return fail(IMAGECRYPT_ERR_FORMAT, e.what());
+    }
+    if (rows_image.size() > output_capacity) {
+        *output_len = rows_image.size();
+        OPENSSL_cleanse(rows_image.data(), rows_image.size());
+        return fail(IMAGECRYPT_ERR_BUFFER_TOO_SMALL, "Error: Output buffer is too small for the requested rows.");
+    }
+    std::memcpy(output, rows_image.data(), rows_image.size());
+    OPENSSL_cleanse(rows_image.data(), rows_image.size());
+    *output_len = rows_image.size();
+    last_error.clear();
+    return IMAGECRYPT_OK;
+}
+
+extern "C" uint32_t imagecrypt_crc32c(const uint8_t* data, size_t len) {
+    if (data == NULL || len == 0) {
+        return 0;
+    }
+    return crc32c_parallel(data, len, shared_pool());
+}
+
+extern "C" int imagecrypt_advise(uint64_t payload_len, int operation, int mode,
+                                 const imagecrypt_worker* workers, size_t num_workers,
+                                 imagecrypt_shard* shards, size_t shard_capacity, size_t* num_shards,
+                                 double* estimated_ms, uint64_t* decision_id) {
+    if (shards == NULL || num_shards == NULL || (workers == NULL && num_workers > 0)) {
+        return fail(IMAGECRYPT_ERR_ARGUMENT, "Error: NULL argument passed to imagecrypt_advise.");
+    }
+    if (operation != IMAGECRYPT_ENCRYPT && operation != IMAGECRYPT_DECRYPT) {
+        return fail(IMAGECRYPT_ERR_ARGUMENT, "Error: Invalid operation. Must be IMAGECRYPT_ENCRYPT or IMAGECRYPT_DECRYPT.");
+    }
+    AesMode aes_mode;
+    if (!pixel_mode_from_imagecrypt(mode, aes_mode)) {
+        return fail(IMAGECRYPT_ERR_ARGUMENT, "Error: Invalid mode. Must be one of the IMAGECRYPT_MODE_* values.");
+    }
+    *num_shards = 0;
+    if (shard_capacity < num_workers + 1) {
+        return fail(IMAGECRYPT_ERR_BUFFER_TOO_SMALL, "Error: shard_capacity must be at least num_workers + 1.");
+    }
+    try {
+        std::vector<SplitWorker> split_workers(num_workers);
+        for (size_t i = 0; i < num_workers; ++i) {
+            if (workers[i].name == NULL || workers[i].name[0] == '\0') {
+                return fail(IMAGECRYPT_ERR_ARGUMENT, "Error: Every worker passed to imagecrypt_advise needs a name.");
+            }
+            split_workers[i].name = workers[i].name;
+            split_workers[i].throughput_bps = workers[i].throughput_mbps * 1e6;
+            split_workers[i].rtt_seconds = workers[i].rtt_ms / 1000;
+        }
+        const SplitAdvice advice = shared_advisor().advise(
+            payload_len, aes_mode, operation == IMAGECRYPT_ENCRYPT ? Direction::Encrypt : Direction::Decrypt,
+            split_workers);
+        for (size_t i = 0; i < advice.shards.size(); ++i) {
+            shards[i].offset = advice.shards[i].offset;
+            shards[i].length = advice.shards[i].len;
+            shards[i].location = advice.shards[i].location;
+        }
+        *num_shards = advice.shards.size();
+        if (estimated_ms != NULL) *estimated_ms = advice.estimated_seconds * 1000;
+        if (decision_id != NULL) *decision_id = advice.decision_id;
+    } catch (const std::bad_alloc&) {
+        return fail(IMAGECRYPT_ERR_INTERNAL, "Error: Out of memory.");
+    }
+    last_error.clear();
+    return IMAGECRYPT_OK;
+}
+
+extern "C" int imagecrypt_observe(uint64_t decision_id, const char* location, int operation, int mode,
+                                  uint64_t bytes, double elapsed_ms) {
+    if (operation != IMAGECRYPT_ENCRYPT && operation != IMAGECRYPT_DECRYPT) {
+        return fail(IMAGECRYPT_ERR_ARGUMENT, "Error: Invalid operation. Must be IMAGECRYPT_ENCRYPT or IMAGECRYPT_DECRYPT.");
+    }
+    AesMode aes_mode;
+    if (!pixel_mode_from_imagecrypt(mode, aes_mode)) {
+        return fail(IMAGECRYPT_ERR_ARGUMENT, "Error: Invalid mode. Must be one of the IMAGECRYPT_MODE_* values.");
+    }
+    if (!(elapsed_ms > 0)) {
+        return fail(IMAGECRYPT_ERR_ARGUMENT, "Error: elapsed_ms must be positive.");
+    }
+    try {
+        shared_advisor().observe(decision_id, location != NULL ? location : "", aes_mode,
+                                 operation == IMAGECRYPT_ENCRYPT ? Direction::Encrypt : Direction::Decrypt,
+                                 bytes, elapsed_ms / 1000);
+    } catch (const std::bad_alloc&) {
+        return fail(IMAGECRYPT_ERR_INTERNAL, "Error: Out of memory.");
+    }
+    last_error.clear();
+    return IMAGECRYPT_OK;
+}
+
+extern "C" const char* imagecrypt_last_error(void) {
+    return last_error.c_str();
+}
@@ -0,0 +1,407 @@
+#ifndef INCREMENTAL_UPDATE_HPP
+#define INCREMENTAL_UPDATE_HPP
+
+#include <string>
+#include <vector>
+#include <stdexcept> // For std::runtime_error
+#include <cstdint>
+#include <cstddef>
+#include <cstring>   // For memcpy, memcmp
+#include <cerrno>
+#include <fstream>
+
+#include <fcntl.h>    // For open
+#include <sys/stat.h> // For fstat
+#include <unistd.h>   // For pwrite, ftruncate, close
+
+#include <openssl/evp.h>
+#include <openssl/crypto.h> // For OPENSSL_cleanse
+
+#include "cipher_engine.hpp"  // AES engine, executors
+#include "image_pipeline.hpp" // Key derivation, BMP layout, process_image_buffer
+#include "content_hash.hpp"   // Tile digests
+#include "row_decrypt.hpp"    // BMP geometry, pread_exact
+
+// Incremental re-encryption: after an edit, only the row tiles that changed are
+// re-encrypted and written back into the existing encrypted file.
+//
+// The pixel array is cut into tiles of whole rows (about TILE_TARGET_BYTES each). Changed
+// tiles are found by comparing against the previous plaintext (memcmp per tile) or
+// against a digest manifest written by an earlier run. Then:
+//   - ECB: blocks are independent, so only the blocks covering changed tiles are
+//     re-encrypted and written with pwrite;
+//   - CBC: every block chains on the one before, so the file is re-encrypted from the
+//     first changed tile to the end, chaining on the stored ciphertext block before it.
+// If the layout changed (pixel offset or size), the whole image is re-encrypted.
+//
+// Manifest digests are keyed with a seed derived from the AES key, so a manifest alone
+// does not reveal which tiles hold common content such as blank rows.
+//
+// Unchanged tiles keep their stored ciphertext, so the passphrase must be the one the
+// file was encrypted with. Before anything is written, the update decrypts one stored
+// block of an unchanged tile and compares it with the previous plaintext, or compares
+// the manifest's key check with the passphrase's; a mismatch is refused rather than
+// leaving a file encrypted under two keys.
+
+const size_t TILE_TARGET_BYTES = 64 * 1024;
+const uint32_t TILE_MANIFEST_MAGIC = 0x4d544349; // "ICTM"
+const uint32_t TILE_MANIFEST_VERSION = 2;        // 2: key check
+const size_t TILE_MANIFEST_KEY_CHECK_BYTES = 16;
+
+struct TileManifest {
+    uint64_t header_len;    // Bytes before the pixel array
+    uint64_t pixel_len;
+    uint64_t tile_bytes;
+    unsigned char key_check[TILE_MANIFEST_KEY_CHECK_BYTES]; // SHA-256 of a label, the key and the IV (truncated)
+    Hash128 header_digest;
+    std::vector<Hash128> tile_digests;
+};
+
+struct UpdateStats {
+    bool full_rewrite;
+    size_t tiles;
+    size_t changed_tiles;
+    size_t bytes_written;
+};
+
+// Whole rows per tile; images without usable geometry fall back to block-aligned tiles.
+inline size_t tile_bytes_for(const unsigned char* image, size_t image_len) {
+    try {
+        BmpGeometry geometry = read_bmp_geometry(image, image_len);
+        size_t rows = std::max<size_t>(1, TILE_TARGET_BYTES / geometry.row_stride);
+        return rows * geometry.row_stride;
+    } catch (const std::exception&) {
+        return TILE_TARGET_BYTES;
+    }
+}
+
+inline uint64_t manifest_seed(const unsigned char* key) {
+    static const char label[] = "image tile manifest";
+    unsigned char material[AES_KEY_BYTES + sizeof(label)];
+    std::memcpy(material, key, AES_KEY_BYTES);
+    std::memcpy(material + AES_KEY_BYTES, label, sizeof(label));
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int digest_len = 0;
+    if (EVP_Digest(material, sizeof(material), digest, &digest_len, fetched_digest("SHA256"), NULL) != 1) {
+        OPENSSL_cleanse(material, sizeof(material));
+        handle_openssl_errors("Manifest seed derivation failed: ");
+    }
+    OPENSSL_cleanse(material, sizeof(material));
+    uint64_t seed;
+    std::memcpy(&seed, digest, sizeof(seed));
+    return seed;
+}
+
+inline void manifest_key_check(const unsigned char* key, const unsigned char* iv, unsigned char* check) {
+    static const char label[] = "image tile manifest key check";
+    unsigned char material[sizeof(label) + AES_KEY_BYTES + AES_IV_BYTES];
+    std::memcpy(material, label, sizeof(label));
+    std::memcpy(material + sizeof(label), key, AES_KEY_BYTES);
+    std::memcpy(material + sizeof(label) + AES_KEY_BYTES, iv, AES_IV_BYTES);
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int digest_len = 0;
+    if (EVP_Digest(material, sizeof(material), digest, &digest_len, fetched_digest("SHA256"), NULL) != 1) {
+        OPENSSL_cleanse(material, sizeof(material));
+        handle_openssl_errors("Manifest key check derivation failed: ");
+    }
+    OPENSSL_cleanse(material, sizeof(material));
+    std::memcpy(check, digest, TILE_MANIFEST_KEY_CHECK_BYTES);
+}
+
+inline TileManifest build_tile_manifest(const unsigned char* image, size_t image_len,
+                                        const unsigned char* key, const unsigned char* iv) {
+    BmpLayout layout = locate_pixel_data(image, image_len, Direction::Encrypt);
+    const uint64_t seed = manifest_seed(key);
+    TileManifest manifest;
+    manifest_key_check(key, iv, manifest.key_check);
+    manifest.header_len = layout.header_len;
+    manifest.pixel_len = layout.pixel_len;
+    manifest.tile_bytes = tile_bytes_for(image, image_len);
+    manifest.header_digest = hash_bytes_128(image, layout.header_len, seed);
+    const unsigned char* pixels = image + layout.header_len;
+    for (size_t offset = 0; offset < layout.pixel_len; offset += manifest.tile_bytes) {
+        const size_t len = std::min<size_t>(manifest.tile_bytes, layout.pixel_len - offset);
+        manifest.tile_digests.push_back(hash_bytes_128(pixels + offset, len, seed));
+    }
+    return manifest;
+}
+
+inline void write_tile_manifest(const std::string& path, const TileManifest& manifest) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        throw std::runtime_error("Error: Could not open file for writing: " + path);
+    }
+    const uint32_t head[2] = {TILE_MANIFEST_MAGIC, TILE_MANIFEST_VERSION};
+    const uint64_t sizes[4] = {manifest.header_len, manifest.pixel_len, manifest.tile_bytes,
+                               static_cast<uint64_t>(manifest.tile_digests.size())};
+    file.write(reinterpret_cast<const char*>(head), sizeof(head));
+    file.write(reinterpret_cast<const char*>(sizes), sizeof(sizes));
+    file.write(reinterpret_cast<const char*>(manifest.key_check), sizeof(manifest.key_check));
+    file.write(reinterpret_cast<const char*>(&manifest.header_digest), sizeof(Hash128));
+    file.write(reinterpret_cast<const char*>(manifest.tile_digests.data()),
+               static_cast<std::streamsize>(manifest.tile_digests.size() * sizeof(Hash128)));
+    if (!file.good()) {
+        throw std::runtime_error("Error: Could not write to file: " + path);
+    }
+}
+
+inline bool is_tile_manifest(const std::vector<unsigned char>& bytes) {
+    uint32_t magic = 0;
+    if (bytes.size() >= sizeof(magic)) std::memcpy(&magic, bytes.data(), sizeof(magic));
+    return magic == TILE_MANIFEST_MAGIC;
+}
+
+inline TileManifest parse_tile_manifest(const std::vector<unsigned char>& bytes) {
+    const size_t fixed_len = 2 * sizeof(uint32_t) + 4 * sizeof(uint64_t) + TILE_MANIFEST_KEY_CHECK_BYTES + sizeof(Hash128);
+    uint32_t head[2] = {0, 0};
+    if (bytes.size() >= sizeof(head)) std::memcpy(head, bytes.data(), sizeof(head));
+    if (head[0] != TILE_MANIFEST_MAGIC || head[1] != TILE_MANIFEST_VERSION) {
+        // Version 1 manifests carry no key check, so an update could not be verified against them.
+        throw std::runtime_error("Error: Unsupported tile manifest version (write a new one with --manifest).");
+    }
+    if (bytes.size() < fixed_len) {
+        throw std::runtime_error("Error: Tile manifest is truncated.");
+    }
+    uint64_t sizes[4];
+    TileManifest manifest;
+    std::memcpy(sizes, bytes.data() + sizeof(head), sizeof(sizes));
+    std::memcpy(manifest.key_check, bytes.data() + sizeof(head) + sizeof(sizes), TILE_MANIFEST_KEY_CHECK_BYTES);
+    std::memcpy(&manifest.header_digest, bytes.data() + sizeof(head) + sizeof(sizes) + TILE_MANIFEST_KEY_CHECK_BYTES,
+                sizeof(Hash128));
+    manifest.header_len = sizes[0];
+    manifest.pixel_len = sizes[1];
+    manifest.tile_bytes = sizes[2];
+    if (sizes[3] > (bytes.size() - fixed_len) / sizeof(Hash128) || sizes[3] * sizeof(Hash128) != bytes.size() - fixed_len) {
+        throw std::runtime_error("Error: Tile manifest is truncated.");
+    }
+    manifest.tile_digests.resize(sizes[3]);
+    std::memcpy(manifest.tile_digests.data(), bytes.data() + fixed_len, sizes[3] * sizeof(Hash128));
+    return manifest;
+}
+
+namespace incremental_detail {
+
+inline void pwrite_exact(int fd, const unsigned char* data, size_t len, off_t offset) {
+    while (len > 0) {
+        ssize_t written = pwrite(fd, data, len, offset);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) {
+            throw std::runtime_error(std::string("Error: Could not write encrypted image: ") + std::strerror(errno));
+        }
+        data += written;
+        len -= static_cast<size_t>(written);
+        offset += written;
+    }
+}
+
+inline size_t encrypted_pixel_len(AesMode mode, size_t pixel_len) {
+    return mode == AesMode::ECB ? pixel_len / AES_BLOCK_BYTES * AES_BLOCK_BYTES
+                                : (pixel_len / AES_BLOCK_BYTES + 1) * AES_BLOCK_BYTES;
+}
+
+// Decrypts one stored block that lies wholly in an unchanged tile and compares it with
+// the previous plaintext. Returns false on a mismatch, i.e. the file was encrypted under
+// another key; true also if no such block exists (every stored block is rewritten).
+inline bool stored_block_matches(int fd, const BmpLayout& layout, AesMode mode, const unsigned char* key,
+                                 const unsigned char* iv, const unsigned char* old_pixels,
+                                 const std::vector<char>& changed, size_t tile_bytes) {
+    const size_t stored_end = layout.pixel_len / AES_BLOCK_BYTES * AES_BLOCK_BYTES; // Blocks of whole pixels
+    for (size_t t = 0; t < changed.size(); ++t) {
+        if (changed[t]) continue;
+        const size_t block = (t * tile_bytes + AES_BLOCK_BYTES - 1) / AES_BLOCK_BYTES * AES_BLOCK_BYTES;
+        if (block + AES_BLOCK_BYTES > std::min(stored_end, (t + 1) * tile_bytes)) continue;
+        // CBC also needs the stored block before it (or the IV).
+        unsigned char stored[2 * AES_BLOCK_BYTES];
+        unsigned char* chain = stored;
+        unsigned char* cipher = stored + AES_BLOCK_BYTES;
+        if (mode == AesMode::CBC && block > 0) {
+            pread_exact(fd, stored, sizeof(stored), static_cast<off_t>(layout.header_len + block - AES_BLOCK_BYTES));
+        } else {
+            std::memcpy(chain, iv, AES_BLOCK_BYTES);
+            pread_exact(fd, cipher, AES_BLOCK_BYTES, static_cast<off_t>(layout.header_len + block));
+        }
+        unsigned char plain[AES_BLOCK_BYTES];
+        CipherEngine<AesMode::ECB, Direction::Decrypt, Padding::None>::process(key, NULL, cipher, AES_BLOCK_BYTES, plain);
+        if (mode == AesMode::CBC) {
+            for (size_t i = 0; i < AES_BLOCK_BYTES; ++i) plain[i] ^= chain[i];
+        }
+        const bool matches = std::memcmp(plain, old_pixels + block, AES_BLOCK_BYTES) == 0;
+        OPENSSL_cleanse(plain, sizeof(plain));
+        return matches;
+    }
+    return true;
+}
+
+} // namespace incremental_detail
+
+// Brings the encrypted file at encrypted_path up to date with new_image. previous is
+// either the previous plaintext BMP or a tile manifest of it. If manifest_out is given,
+// the manifest of new_image is written there.
+inline UpdateStats update_encrypted_image(const std::string& encrypted_path, const std::string& passphrase,
+                                          AesMode mode, const std::vector<unsigned char>& new_image,
+                                          const std::vector<unsigned char>& previous,
+                                          const std::string& manifest_out,
+                                          RangeExecutor& executor = OpenMPExecutor::instance()) {
+    using namespace incremental_detail;
+    const BmpLayout layout = locate_pixel_data(new_image.data(), new_image.size(), Direction::Encrypt);
+    const size_t tile_bytes = tile_bytes_for(new_image.data(), new_image.size());
+    const size_t num_tiles = (layout.pixel_len + tile_bytes - 1) / tile_bytes;
+    const unsigned char* new_pixels = new_image.data() + layout.header_len;
+
+    int fd = open(encrypted_path.c_str(), O_RDWR);
+    if (fd < 0) {
+        throw std::runtime_error("Error: Could not open file for update: " + encrypted_path);
+    }
+    struct FdGuard {
+        int fd;
+        ~FdGuard() { close(fd); }
+    } guard = {fd};
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        throw std::runtime_error("Error: Could not stat file: " + encrypted_path);
+    }
+
+    unsigned char key[AES_KEY_BYTES];
+    unsigned char iv[AES_IV_BYTES];
+    derive_image_key_and_iv(passphrase, key, iv, executor);
+    struct KeyGuard {
+        unsigned char* key;
+        unsigned char* iv;
+        ~KeyGuard() { OPENSSL_cleanse(key, AES_KEY_BYTES); OPENSSL_cleanse(iv, AES_IV_BYTES); }
+    } key_guard = {key, iv};
+
+    UpdateStats stats = {false, num_tiles, 0, 0};
+    std::vector<char> changed(num_tiles, 0);
+    bool header_changed = false;
+
+    // --- Find changed tiles ---
+    // A compressed payload has no tile-aligned ciphertext to patch, so it is always rewritten.
+    bool same_layout = static_cast<size_t>(st.st_size) == layout.header_len + encrypted_pixel_len(mode, layout.pixel_len);
+    if (same_layout) {
+        unsigned char encrypted_header[BMP_HEADER_SIZE];
+        pread_exact(fd, encrypted_header, BMP_HEADER_SIZE, 0);
+        same_layout = !pixel_codec_marked(encrypted_header);
+    }
+    TileManifest new_manifest;
+    bool have_new_manifest = false;
+    if (is_tile_manifest(previous)) {
+        TileManifest old_manifest = parse_tile_manifest(previous);
+        new_manifest = build_tile_manifest(new_image.data(), new_image.size(), key, iv);
+        have_new_manifest = true;
+        if (std::memcmp(old_manifest.key_check, new_manifest.key_check, TILE_MANIFEST_KEY_CHECK_BYTES) != 0) {
+            throw std::runtime_error("Error: The passphrase does not match the one the tile manifest was written with.");
+        }
+        same_layout = same_layout && old_manifest.header_len == layout.header_len &&
+                      old_manifest.pixel_len == layout.pixel_len && old_manifest.tile_bytes == tile_bytes;
+        if (same_layout) {
+            header_changed = old_manifest.header_digest != new_manifest.header_digest;
+            for (size_t t = 0; t < num_tiles; ++t) {
+                changed[t] = old_manifest.tile_digests[t] != new_manifest.tile_digests[t];
+            }
+        }
+    } else {
+        const BmpLayout old_layout = locate_pixel_data(previous.data(), previous.size(), Direction::Encrypt);
+        same_layout = same_layout && old_layout.header_len == layout.header_len && old_layout.pixel_len == layout.pixel_len;
+        if (same_layout) {
+            header_changed = std::memcmp(previous.data(), new_image.data(), layout.header_len) != 0;
+            const unsigned char* old_pixels = previous.data() + layout.header_len;
+            for (size_t t = 0; t < num_tiles; ++t) {
+                const size_t offset = t * tile_bytes;
+                const size_t len = std::min(tile_bytes, layout.pixel_len - offset);
+                changed[t] = std::memcmp(old_pixels + offset, new_pixels + offset, len) != 0;
+            }
+            if (!stored_block_matches(fd, layout, mode, key, iv, old_pixels, changed, tile_bytes)) {
+                throw std::runtime_error("Error: The passphrase does not decrypt the encrypted image to the previous image.");
+            }
+        }
+    }
+
+    if (!same_layout) {
+        // --- Full re-encryption ---
+        std::vector<unsigned char> output(max_processed_image_len(new_image.size()));
+        size_t output_len = process_image_buffer(new_image.data(), new_image.size(), output.data(), output.size(),
+                                                 passphrase, mode, Direction::Encrypt, executor);
+        pwrite_exact(fd, output.data(), output_len, 0);
+        if (ftruncate(fd, static_cast<off_t>(output_len)) != 0) {
+            throw std::runtime_error("Error: Could not resize encrypted image: " + encrypted_path);
+        }
+        stats.full_rewrite = true;
+        stats.changed_tiles = num_tiles;
+        stats.bytes_written = output_len;
+    } else {
+        // --- Rewrite changed tiles ---
+        if (header_changed) {
+            pwrite_exact(fd, new_image.data(), layout.header_len, 0);
+            stats.bytes_written += layout.header_len;
+        }
+        const size_t encrypted_end = encrypted_pixel_len(mode, layout.pixel_len);
+        std::vector<unsigned char> cipher;
+        for (size_t t = 0; t < num_tiles; ++t) {
+            if (!changed[t]) continue;
+            // A run of changed tiles becomes one block-aligned range.
+            size_t run_end = t;
+            while (run_end < num_tiles && changed[run_end]) ++run_end;
+            stats.changed_tiles += run_end - t;
+
+            const size_t start = t * tile_bytes / AES_BLOCK_BYTES * AES_BLOCK_BYTES;
+            if (mode == AesMode::ECB) {
+                const size_t end = std::min(encrypted_end,
+                                            (std::min(run_end * tile_bytes, layout.pixel_len) + AES_BLOCK_BYTES - 1)
+                                                / AES_BLOCK_BYTES * AES_BLOCK_BYTES);
+                if (start < end) {
+                    cipher.resize(end - start + AES_BLOCK_BYTES);
+                    process_pixel_data(key, iv, AesMode::ECB, Direction::Encrypt,
+                                       new_pixels + start, end - start, cipher.data(), executor);
+                    pwrite_exact(fd, cipher.data(), end - start, static_cast<off_t>(layout.header_len + start));
+                    stats.bytes_written += end - start;
+                }
+                t = run_end - 1;
+            } else {
+                // Chain on the stored ciphertext block before the first changed block.
+                unsigned char chain[AES_BLOCK_BYTES];
+                if (start == 0) {
+                    std::memcpy(chain, iv, AES_BLOCK_BYTES);
+                } else {
+                    pread_exact(fd, chain, AES_BLOCK_BYTES, static_cast<off_t>(layout.header_len + start - AES_BLOCK_BYTES));
+                }
+                cipher.resize(layout.pixel_len - start + AES_BLOCK_BYTES);
+                size_t len = CipherEngine<AesMode::CBC, Direction::Encrypt, Padding::PKCS7>::process(
+                    key, chain, new_pixels + start, layout.pixel_len - start, cipher.data());
+                pwrite_exact(fd, cipher.data(), len, static_cast<off_t>(layout.header_len + start));
+                stats.bytes_written += len;
+                for (size_t rest = run_end; rest < num_tiles; ++rest) {
+                    stats.changed_tiles += changed[rest] ? 1 : 0;
+                }
+                break;
+            }
+        }
+    }
+
+    if (!manifest_out.empty()) {
+        if (!have_new_manifest) {
+            new_manifest = build_tile_manifest(new_image.data(), new_image.size(), key, iv);
+        }
+        write_tile_manifest(manifest_out, new_manifest);
+    }
+    return stats;
+}
+
+// Manifest of a plaintext BMP for a later update_encrypted_image call.
+inline TileManifest manifest_for_image(const std::vector<unsigned char>& image, const std::string& passphrase) {
+    unsigned char key[AES_KEY_BYTES];
+    unsigned char iv[AES_IV_BYTES];
+    derive_image_key_and_iv(passphrase, key, iv);
+    TileManifest manifest;
+    try {
+        manifest = build_tile_manifest(image.data(), image.size(), key, iv);
+    } catch (...) {
+        OPENSSL_cleanse(key, sizeof(key));
+        OPENSSL_cleanse(iv, sizeof(iv));
+        throw;
+    }
+    OPENSSL_cleanse(key, sizeof(key));
+    OPENSSL_cleanse(iv, sizeof(iv));
+    return manifest;
+}
+
+#endif // INCREMENTAL_UPDATE_HPP
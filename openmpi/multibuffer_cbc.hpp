@@ -0,0 +1,185 @@
+#ifndef MULTIBUFFER_CBC_HPP
+#define MULTIBUFFER_CBC_HPP
+
+#include <vector>
+#include <cstddef>
+#include <cstring> // For memcpy, memset
+#include <cstdint> // For SIZE_MAX
+#include <algorithm> // For std::min
+
+#include "cipher_engine.hpp" // AES constants and the EVP engine (fallback)
+#include "aesni.hpp"         // Key expansion and AES-NI detection
+
+// Multi-buffer AES-256-CBC encryption (PKCS#7 padded, same output as CipherEngine).
+// A single CBC encryption stalls on every block because each block needs the previous
+// ciphertext, leaving most of the AES unit idle. Here up to CBC_MULTIBUFFER_LANES
+// independent streams (different images and/or keys) are interleaved round by round on
+// one core, so the pipeline stays full. When a stream finishes, its lane picks up the
+// next queued job.
+
+const size_t CBC_MULTIBUFFER_LANES = 8;
+
+// One stream to encrypt. output must hold input_len + AES_BLOCK_BYTES bytes and may be
+// the same buffer as input. output_len is set when the job completes.
+struct CbcEncryptJob {
+    const unsigned char* key; // AES_KEY_BYTES
+    const unsigned char* iv;  // AES_IV_BYTES
+    const unsigned char* input;
+    size_t input_len;
+    unsigned char* output;
+    size_t output_len;
+};
+
+#if IMAGE_PROCESSOR_HAVE_AESNI
+namespace multibuffer_detail {
+
+struct alignas(16) Lane {
+    Aes256KeySchedule schedule;
+    __m128i chain;
+    CbcEncryptJob* job;
+    size_t block;        // Next block to encrypt
+    size_t full_blocks;  // Unpadded blocks in the input
+};
+
+AESNI_TARGET inline void start_lane(Lane& lane, CbcEncryptJob* job) {
+    aes256_expand_key(job->key, lane.schedule);
+    lane.chain = _mm_loadu_si128(reinterpret_cast<const __m128i*>(job->iv));
+    lane.job = job;
+    lane.block = 0;
+    lane.full_blocks = job->input_len / AES_BLOCK_BYTES;
+}
+
+// Next plaintext block of the lane; past the full blocks it is the PKCS#7 padded tail.
+AESNI_TARGET inline __m128i load_block(const Lane& lane) {
+    const CbcEncryptJob* job = lane.job;
+    if (lane.block < lane.full_blocks) {
+        return _mm_loadu_si128(reinterpret_cast<const __m128i*>(job->input + lane.block * AES_BLOCK_BYTES));
+    }
+    const size_t tail_len = job->input_len % AES_BLOCK_BYTES;
+    unsigned char padded[AES_BLOCK_BYTES];
+    std::memset(padded, static_cast<int>(AES_BLOCK_BYTES - tail_len), AES_BLOCK_BYTES);
+    std::memcpy(padded, job->input + lane.full_blocks * AES_BLOCK_BYTES, tail_len);
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(padded));
+}
+
+// Encrypts `steps` full blocks on every lane with no per-block branching. Idle lanes
+// spin on a scratch block so the loop stays uniform; their results are dropped.
+AESNI_TARGET inline void encrypt_full_blocks(Lane* lanes, const bool* active, size_t steps) {
+    alignas(16) unsigned char scratch[CBC_MULTIBUFFER_LANES][AES_BLOCK_BYTES] = {};
+    const unsigned char* in[CBC_MULTIBUFFER_LANES];
+    unsigned char* out[CBC_MULTIBUFFER_LANES];
+    size_t stride[CBC_MULTIBUFFER_LANES];
+    __m128i state[CBC_MULTIBUFFER_LANES];
+    for (size_t l = 0; l < CBC_MULTIBUFFER_LANES; ++l) {
+        if (active[l]) {
+            in[l] = lanes[l].job->input + lanes[l].block * AES_BLOCK_BYTES;
+            out[l] = lanes[l].job->output + lanes[l].block * AES_BLOCK_BYTES;
+            stride[l] = AES_BLOCK_BYTES;
+        } else {
+            in[l] = out[l] = scratch[l];
+            stride[l] = 0;
+        }
+        state[l] = lanes[l].chain;
+    }
+
+    for (size_t step = 0; step < steps; ++step) {
+        #pragma GCC unroll 8
+        for (size_t l = 0; l < CBC_MULTIBUFFER_LANES; ++l) {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in[l]));
+            state[l] = _mm_xor_si128(_mm_xor_si128(block, state[l]), lanes[l].schedule.round_keys[0]);
+        }
+        #pragma GCC unroll 13
+        for (int round = 1; round < AES256_ROUNDS; ++round) {
+            #pragma GCC unroll 8
+            for (size_t l = 0; l < CBC_MULTIBUFFER_LANES; ++l) {
+                state[l] = _mm_aesenc_si128(state[l], lanes[l].schedule.round_keys[round]);
+            }
+        }
+        #pragma GCC unroll 8
+        for (size_t l = 0; l < CBC_MULTIBUFFER_LANES; ++l) {
+            state[l] = _mm_aesenclast_si128(state[l], lanes[l].schedule.round_keys[AES256_ROUNDS]);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out[l]), state[l]);
+            in[l] += stride[l];
+            out[l] += stride[l];
+        }
+    }
+
+    for (size_t l = 0; l < CBC_MULTIBUFFER_LANES; ++l) {
+        if (!active[l]) continue;
+        lanes[l].chain = state[l];
+        lanes[l].block += steps;
+    }
+}
+
+AESNI_TARGET inline void encrypt_jobs_aesni(CbcEncryptJob* jobs, size_t num_jobs) {
+    Lane lanes[CBC_MULTIBUFFER_LANES];
+    std::memset(static_cast<void*>(lanes), 0, sizeof(lanes));
+    bool active[CBC_MULTIBUFFER_LANES] = {};
+    size_t next_job = 0;
+    size_t num_active = 0;
+    for (size_t l = 0; l < CBC_MULTIBUFFER_LANES && next_job < num_jobs; ++l) {
+        start_lane(lanes[l], &jobs[next_job++]);
+        active[l] = true;
+        ++num_active;
+    }
+
+    while (num_active > 0) {
+        // Run every lane up to the first lane that reaches its padded block...
+        size_t steps = SIZE_MAX;
+        for (size_t l = 0; l < CBC_MULTIBUFFER_LANES; ++l) {
+            if (active[l]) steps = std::min(steps, lanes[l].full_blocks - lanes[l].block);
+        }
+        if (steps > 0) {
+            encrypt_full_blocks(lanes, active, steps);
+        }
+
+        // ...then one step that handles padded tails and refills finished lanes.
+        __m128i state[CBC_MULTIBUFFER_LANES];
+        for (size_t l = 0; l < CBC_MULTIBUFFER_LANES; ++l) {
+            state[l] = active[l] ? _mm_xor_si128(load_block(lanes[l]), lanes[l].chain) : _mm_setzero_si128();
+            state[l] = aes256_encrypt_block(state[l], lanes[l].schedule);
+        }
+        for (size_t l = 0; l < CBC_MULTIBUFFER_LANES; ++l) {
+            if (!active[l]) continue;
+            Lane& lane = lanes[l];
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(lane.job->output + lane.block * AES_BLOCK_BYTES), state[l]);
+            lane.chain = state[l];
+            if (++lane.block > lane.full_blocks) { // The padded block was the last one
+                lane.job->output_len = lane.block * AES_BLOCK_BYTES;
+                if (next_job < num_jobs) {
+                    start_lane(lane, &jobs[next_job++]);
+                } else {
+                    active[l] = false;
+                    --num_active;
+                }
+            }
+        }
+    }
+    for (size_t l = 0; l < CBC_MULTIBUFFER_LANES; ++l) {
+        std::memset(static_cast<void*>(&lanes[l].schedule), 0, sizeof(lanes[l].schedule));
+    }
+}
+
+} // namespace multibuffer_detail
+#endif // IMAGE_PROCESSOR_HAVE_AESNI
+
+// Encrypts every job. Without AES-NI each job runs through the EVP engine in turn.
+inline void cbc_encrypt_multibuffer(CbcEncryptJob* jobs, size_t num_jobs) {
+#if IMAGE_PROCESSOR_HAVE_AESNI
+    if (aesni_available()) {
+        multibuffer_detail::encrypt_jobs_aesni(jobs, num_jobs);
+        return;
+    }
+#endif
+    using Engine = CipherEngine<AesMode::CBC, Direction::Encrypt, Padding::PKCS7>;
+    for (size_t i = 0; i < num_jobs; ++i) {
+        jobs[i].output_len = Engine::process(jobs[i].key, jobs[i].iv, jobs[i].input, jobs[i].input_len,
+                                             jobs[i].output);
+    }
+}
+
+inline void cbc_encrypt_multibuffer(std::vector<CbcEncryptJob>& jobs) {
+    cbc_encrypt_multibuffer(jobs.data(), jobs.size());
+}
+
+#endif // MULTIBUFFER_CBC_HPP
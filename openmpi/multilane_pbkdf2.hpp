@@ -0,0 +1,486 @@
+#ifndef MULTILANE_PBKDF2_HPP
+#define MULTILANE_PBKDF2_HPP
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>   // For memcpy, memset
+#include <algorithm> // For std::min
+#include <string>
+#include <cstdlib>   // For std::getenv
+
+#include <openssl/crypto.h> // For OPENSSL_cleanse
+
+// PBKDF2-HMAC (SHA-256 and MD5) for many derivations at once, bit-identical to
+// OpenSSL's PKCS5_PBKDF2_HMAC.
+//
+// Almost all of the time goes into the iteration loop, U(i) = HMAC(P, U(i-1)). There
+// each step is two compressions of one fixed-format block: the previous digest,
+// padding and a constant length. The HMAC inner and outer states are precomputed once
+// per password. Several chains (lanes) then run side by side in SIMD registers, one
+// 32-bit lane per chain: 16 lanes with AVX-512, 8 with AVX2. A digest stays in the
+// same word layout as the next message block, so lanes never need transposing inside
+// the loop. A single SHA-256 chain uses SHA-NI where available. Everything else
+// (password hashing, the first block with the salt) is scalar, since it runs once per
+// derivation.
+//
+// OpenSSL's own loop spends most of its time in EVP/HMAC bookkeeping around each
+// compression, so even one lane here is several times faster.
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PBKDF2_HAVE_X86 1
+#define PBKDF2_AVX2_TARGET __attribute__((target("avx2")))
+#define PBKDF2_AVX512_TARGET __attribute__((target("avx512f")))
+#define PBKDF2_SHANI_TARGET __attribute__((target("sha,sse4.1")))
+#else
+#define PBKDF2_HAVE_X86 0
+#endif
+
+// One derivation of a batch.
+struct Pbkdf2Request {
+    const unsigned char* password;
+    size_t password_len;
+    const unsigned char* salt;
+    size_t salt_len;
+    unsigned char* output;
+    size_t output_len;
+};
+
+namespace pbkdf2_detail {
+
+#define PBKDF2_INLINE inline __attribute__((always_inline))
+#define PBKDF2_ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+#define PBKDF2_ROTL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+// Lane vectors; the kernels below are written once over uint32_t and these types and
+// are always inlined into functions compiled for the matching instruction set.
+typedef uint32_t Lanes8 __attribute__((vector_size(32)));
+typedef uint32_t Lanes16 __attribute__((vector_size(64)));
+
+// --- SHA-256 ---
+struct Sha256 {
+    static const int STATE_WORDS = 8;  // Digest is the whole state
+    static const int BLOCK_BYTES = 64;
+    static const bool BIG_ENDIAN_WORDS = true;
+
+    static void init(uint32_t* state) {
+        static const uint32_t iv[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                       0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+        std::memcpy(state, iv, sizeof(iv));
+    }
+
+    template <typename V>
+    static PBKDF2_INLINE void compress(V* state, const V* block) {
+        static const uint32_t k[64] = {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+            0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+            0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+            0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+            0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+            0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+        V w[16];
+        for (int i = 0; i < 16; ++i) w[i] = block[i];
+        V a = state[0], b = state[1], c = state[2], d = state[3];
+        V e = state[4], f = state[5], g = state[6], h = state[7];
+#pragma GCC unroll 64
+        for (int i = 0; i < 64; ++i) {
+            if (i >= 16) {
+                const V w15 = w[(i - 15) & 15];
+                const V w2 = w[(i - 2) & 15];
+                w[i & 15] += (PBKDF2_ROTR(w15, 7) ^ PBKDF2_ROTR(w15, 18) ^ (w15 >> 3)) + w[(i - 7) & 15] +
+                             (PBKDF2_ROTR(w2, 17) ^ PBKDF2_ROTR(w2, 19) ^ (w2 >> 10));
+            }
+            const V t1 = h + (PBKDF2_ROTR(e, 6) ^ PBKDF2_ROTR(e, 11) ^ PBKDF2_ROTR(e, 25)) +
+                         (g ^ (e & (f ^ g))) + k[i] + w[i & 15];
+            const V t2 = (PBKDF2_ROTR(a, 2) ^ PBKDF2_ROTR(a, 13) ^ PBKDF2_ROTR(a, 22)) + ((a & b) | (c & (a | b)));
+            h = g; g = f; f = e; e = d + t1;
+            d = c; c = b; b = a; a = t1 + t2;
+        }
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+        state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+    }
+};
+
+// --- MD5 ---
+struct Md5 {
+    static const int STATE_WORDS = 4;
+    static const int BLOCK_BYTES = 64;
+    static const bool BIG_ENDIAN_WORDS = false;
+
+    static void init(uint32_t* state) {
+        static const uint32_t iv[4] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476};
+        std::memcpy(state, iv, sizeof(iv));
+    }
+
+    template <typename V>
+    static PBKDF2_INLINE void compress(V* state, const V* block) {
+        static const uint32_t k[64] = {
+            0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+            0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+            0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+            0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+            0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+            0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+            0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+            0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391};
+        static const int shift[16] = {7, 12, 17, 22, 5, 9, 14, 20, 4, 11, 16, 23, 6, 10, 15, 21};
+        V a = state[0], b = state[1], c = state[2], d = state[3];
+#pragma GCC unroll 64
+        for (int i = 0; i < 64; ++i) {
+            V f;
+            int g;
+            if (i < 16) { f = d ^ (b & (c ^ d)); g = i; }
+            else if (i < 32) { f = c ^ (d & (b ^ c)); g = (5 * i + 1) & 15; }
+            else if (i < 48) { f = b ^ c ^ d; g = (3 * i + 5) & 15; }
+            else { f = c ^ (b | ~d); g = (7 * i) & 15; }
+            const int s = shift[(i >> 4) * 4 + (i & 3)];
+            const V t = a + f + k[i] + block[g];
+            a = d; d = c; c = b;
+            b = b + PBKDF2_ROTL(t, s);
+        }
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    }
+};
+
+// --- Scalar Helpers ---
+template <class H>
+inline uint32_t load_word(const unsigned char* p) {
+    if (H::BIG_ENDIAN_WORDS) {
+        return static_cast<uint32_t>(p[0]) << 24 | static_cast<uint32_t>(p[1]) << 16 |
+               static_cast<uint32_t>(p[2]) << 8 | static_cast<uint32_t>(p[3]);
+    }
+    return static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8 |
+           static_cast<uint32_t>(p[2]) << 16 | static_cast<uint32_t>(p[3]) << 24;
+}
+
+template <class H>
+inline void store_word(unsigned char* p, uint32_t v) {
+    for (int i = 0; i < 4; ++i) {
+        p[i] = static_cast<unsigned char>(H::BIG_ENDIAN_WORDS ? v >> (24 - 8 * i) : v >> (8 * i));
+    }
+}
+
+#if PBKDF2_HAVE_X86
+// IMAGE_PROCESSOR_PBKDF2_LANES=scalar|shani|avx2|avx512 caps the widest code path the
+// kernels may use (e.g. to compare paths on one host); unset allows all the CPU has.
+enum LaneLevel { LANES_SCALAR = 0, LANES_SHANI = 1, LANES_AVX2 = 2, LANES_AVX512 = 3 };
+
+inline int lane_level_cap() {
+    static const int cap = [] {
+        const char* value = std::getenv("IMAGE_PROCESSOR_PBKDF2_LANES");
+        if (value == NULL) return static_cast<int>(LANES_AVX512);
+        const std::string name(value);
+        if (name == "scalar") return static_cast<int>(LANES_SCALAR);
+        if (name == "shani") return static_cast<int>(LANES_SHANI);
+        if (name == "avx2") return static_cast<int>(LANES_AVX2);
+        return static_cast<int>(LANES_AVX512);
+    }();
+    return cap;
+}
+
+inline bool sha_ni_available() {
+    static const bool available = [] {
+        if (lane_level_cap() < LANES_SHANI) return false;
+        __builtin_cpu_init();
+        unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+        // CPUID leaf 7, EBX bit 29: SHA extensions (not covered by __builtin_cpu_supports in GCC 12).
+        __asm__ volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(7), "c"(0));
+        return (ebx & (1u << 29)) != 0 && __builtin_cpu_supports("sse4.1");
+    }();
+    return available;
+}
+
+inline bool avx2_lanes_available() {
+    static const bool available = [] {
+        if (lane_level_cap() < LANES_AVX2) return false;
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") != 0;
+    }();
+    return available;
+}
+
+inline bool avx512_lanes_available() {
+    static const bool available = [] {
+        if (lane_level_cap() < LANES_AVX512) return false;
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx512f") != 0;
+    }();
+    return available;
+}
+
+// One SHA-256 compression with the SHA extensions; block holds 16 message words.
+PBKDF2_SHANI_TARGET inline void sha256_compress_shani(uint32_t* state, const uint32_t* block) {
+    alignas(16) static const uint32_t k[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+    // The instructions keep the state as ABEF / CDGH.
+    __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state)), 0xb1);
+    __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state + 4)), 0x1b);
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xf0);
+    const __m128i abef = state0;
+    const __m128i cdgh = state1;
+
+    __m128i msg[4];
+#pragma GCC unroll 16
+    for (int group = 0; group < 16; ++group) {
+        __m128i& m = msg[group & 3];
+        if (group < 4) {
+            m = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 4 * group));
+        } else {
+            // W[t..t+3] from W[t-16..t-1]: msg1 adds sigma0, alignr supplies W[t-7..t-4], msg2 adds sigma1.
+            m = _mm_sha256msg1_epu32(m, msg[(group + 1) & 3]);
+            m = _mm_add_epi32(m, _mm_alignr_epi8(msg[(group + 3) & 3], msg[(group + 2) & 3], 4));
+            m = _mm_sha256msg2_epu32(m, msg[(group + 3) & 3]);
+        }
+        __m128i wk = _mm_add_epi32(m, _mm_load_si128(reinterpret_cast<const __m128i*>(k + 4 * group)));
+        state1 = _mm_sha256rnds2_epu32(state1, state0, wk);
+        wk = _mm_shuffle_epi32(wk, 0x0e);
+        state0 = _mm_sha256rnds2_epu32(state0, state1, wk);
+    }
+    state0 = _mm_add_epi32(state0, abef);
+    state1 = _mm_add_epi32(state1, cdgh);
+
+    tmp = _mm_shuffle_epi32(state0, 0x1b);
+    state1 = _mm_shuffle_epi32(state1, 0xb1);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state), _mm_blend_epi16(tmp, state1, 0xf0));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state + 4), _mm_alignr_epi8(state1, tmp, 8));
+}
+#endif // PBKDF2_HAVE_X86
+
+// Single-chain compression: SHA-NI for SHA-256 where present, portable code otherwise.
+template <class H>
+inline void compress_one(uint32_t* state, const uint32_t* block) {
+#if PBKDF2_HAVE_X86
+    if (H::STATE_WORDS == Sha256::STATE_WORDS && H::BIG_ENDIAN_WORDS && sha_ni_available()) {
+        sha256_compress_shani(state, block);
+        return;
+    }
+#endif
+    H::compress(state, block);
+}
+
+// Hashes len bytes that follow prefix_len already-compressed bytes, with final padding.
+template <class H>
+inline void hash_tail(uint32_t* state, const unsigned char* data, size_t len, uint64_t prefix_len) {
+    uint32_t block[16];
+    size_t offset = 0;
+    for (; len - offset >= static_cast<size_t>(H::BLOCK_BYTES); offset += H::BLOCK_BYTES) {
+        for (int i = 0; i < 16; ++i) block[i] = load_word<H>(data + offset + 4 * i);
+        compress_one<H>(state, block);
+    }
+    unsigned char last[2 * H::BLOCK_BYTES] = {};
+    const size_t rest = len - offset;
+    std::memcpy(last, data + offset, rest);
+    last[rest] = 0x80;
+    const size_t last_len = rest + 9 <= static_cast<size_t>(H::BLOCK_BYTES) ? H::BLOCK_BYTES : 2 * H::BLOCK_BYTES;
+    const uint64_t bits = (prefix_len + len) * 8;
+    for (int i = 0; i < 8; ++i) {
+        last[last_len - 8 + i] = static_cast<unsigned char>(H::BIG_ENDIAN_WORDS ? bits >> (56 - 8 * i) : bits >> (8 * i));
+    }
+    for (size_t b = 0; b < last_len; b += H::BLOCK_BYTES) {
+        for (int i = 0; i < 16; ++i) block[i] = load_word<H>(last + b + 4 * i);
+        compress_one<H>(state, block);
+    }
+    OPENSSL_cleanse(last, sizeof(last));
+    OPENSSL_cleanse(block, sizeof(block));
+}
+
+// The message block of an iteration: the previous digest, then padding for a message of
+// one key block plus one digest.
+template <class H, typename V>
+PBKDF2_INLINE void digest_block(const V* digest, V* block) {
+    for (int i = 0; i < 16; ++i) block[i] = digest[0] ^ digest[0]; // Zero of type V
+    for (int i = 0; i < H::STATE_WORDS; ++i) block[i] = digest[i];
+    const uint32_t bits = (H::BLOCK_BYTES + 4 * H::STATE_WORDS) * 8;
+    block[H::STATE_WORDS] += H::BIG_ENDIAN_WORDS ? 0x80000000u : 0x80u;
+    block[H::BIG_ENDIAN_WORDS ? 15 : 14] += bits;
+}
+
+// State of one chain before the loop: HMAC midstates, U(1) and the running XOR.
+template <class H>
+struct Chain {
+    uint32_t inner[H::STATE_WORDS];
+    uint32_t outer[H::STATE_WORDS];
+    uint32_t u[H::STATE_WORDS];
+    uint32_t t[H::STATE_WORDS];
+
+    ~Chain() { OPENSSL_cleanse(this, sizeof(*this)); }
+};
+
+// HMAC key setup and U(1) = HMAC(P, S || INT(block_index)).
+template <class H>
+inline void start_chain(const Pbkdf2Request& request, uint32_t block_index, Chain<H>& chain) {
+    unsigned char key[H::BLOCK_BYTES] = {};
+    if (request.password_len > static_cast<size_t>(H::BLOCK_BYTES)) {
+        uint32_t digest[H::STATE_WORDS];
+        H::init(digest);
+        hash_tail<H>(digest, request.password, request.password_len, 0);
+        for (int i = 0; i < H::STATE_WORDS; ++i) store_word<H>(key + 4 * i, digest[i]);
+        OPENSSL_cleanse(digest, sizeof(digest));
+    } else if (request.password_len > 0) {
+        std::memcpy(key, request.password, request.password_len);
+    }
+    uint32_t block[16];
+    for (int pad = 0; pad < 2; ++pad) {
+        uint32_t* state = pad == 0 ? chain.inner : chain.outer;
+        const unsigned char mask = pad == 0 ? 0x36 : 0x5c;
+        unsigned char padded[H::BLOCK_BYTES];
+        for (int i = 0; i < H::BLOCK_BYTES; ++i) padded[i] = key[i] ^ mask;
+        for (int i = 0; i < 16; ++i) block[i] = load_word<H>(padded + 4 * i);
+        H::init(state);
+        compress_one<H>(state, block);
+        OPENSSL_cleanse(padded, sizeof(padded));
+    }
+    OPENSSL_cleanse(key, sizeof(key));
+
+    // Inner hash over salt || INT(i) (big-endian block number, as in RFC 8018).
+    std::vector<unsigned char> message(request.salt_len + 4);
+    if (request.salt_len > 0) std::memcpy(message.data(), request.salt, request.salt_len);
+    for (int i = 0; i < 4; ++i) message[request.salt_len + i] = static_cast<unsigned char>(block_index >> (24 - 8 * i));
+    uint32_t inner[H::STATE_WORDS];
+    std::memcpy(inner, chain.inner, sizeof(inner));
+    hash_tail<H>(inner, message.data(), message.size(), H::BLOCK_BYTES);
+    std::memcpy(chain.u, chain.outer, sizeof(chain.u));
+    digest_block<H, uint32_t>(inner, block);
+    compress_one<H>(chain.u, block);
+    std::memcpy(chain.t, chain.u, sizeof(chain.t));
+    OPENSSL_cleanse(inner, sizeof(inner));
+    OPENSSL_cleanse(block, sizeof(block));
+}
+
+// Iterations 2..count of up to LANES chains held in vector lanes.
+template <class H, typename V, int LANES>
+PBKDF2_INLINE void iterate_lanes(Chain<H>* const* chains, int num_chains, uint32_t iterations) {
+    V inner[H::STATE_WORDS], outer[H::STATE_WORDS], u[H::STATE_WORDS], t[H::STATE_WORDS];
+    for (int w = 0; w < H::STATE_WORDS; ++w) {
+        for (int lane = 0; lane < LANES; ++lane) {
+            const Chain<H>* chain = chains[lane < num_chains ? lane : 0];
+            inner[w][lane] = chain->inner[w];
+            outer[w][lane] = chain->outer[w];
+            u[w][lane] = chain->u[w];
+        }
+        t[w] = u[w];
+    }
+    V block[16];
+    V state[H::STATE_WORDS];
+    for (uint32_t iteration = 1; iteration < iterations; ++iteration) {
+        for (int w = 0; w < H::STATE_WORDS; ++w) state[w] = inner[w];
+        digest_block<H, V>(u, block);
+        H::compress(state, block);
+        for (int w = 0; w < H::STATE_WORDS; ++w) u[w] = outer[w];
+        digest_block<H, V>(state, block);
+        H::compress(u, block);
+        for (int w = 0; w < H::STATE_WORDS; ++w) t[w] ^= u[w];
+    }
+    for (int lane = 0; lane < num_chains; ++lane) {
+        for (int w = 0; w < H::STATE_WORDS; ++w) chains[lane]->t[w] = t[w][lane];
+    }
+    OPENSSL_cleanse(inner, sizeof(inner));
+    OPENSSL_cleanse(outer, sizeof(outer));
+    OPENSSL_cleanse(state, sizeof(state));
+    OPENSSL_cleanse(block, sizeof(block));
+}
+
+template <class H>
+inline void iterate_one(Chain<H>& chain, uint32_t iterations) {
+    uint32_t block[16];
+    uint32_t state[H::STATE_WORDS];
+    for (uint32_t iteration = 1; iteration < iterations; ++iteration) {
+        std::memcpy(state, chain.inner, sizeof(state));
+        digest_block<H, uint32_t>(chain.u, block);
+        compress_one<H>(state, block);
+        std::memcpy(chain.u, chain.outer, sizeof(chain.u));
+        digest_block<H, uint32_t>(state, block);
+        compress_one<H>(chain.u, block);
+        for (int w = 0; w < H::STATE_WORDS; ++w) chain.t[w] ^= chain.u[w];
+    }
+    OPENSSL_cleanse(state, sizeof(state));
+    OPENSSL_cleanse(block, sizeof(block));
+}
+
+#if PBKDF2_HAVE_X86
+template <class H>
+PBKDF2_AVX2_TARGET void iterate_lanes_avx2(Chain<H>* const* chains, int num_chains, uint32_t iterations) {
+    iterate_lanes<H, Lanes8, 8>(chains, num_chains, iterations);
+}
+
+template <class H>
+PBKDF2_AVX512_TARGET void iterate_lanes_avx512(Chain<H>* const* chains, int num_chains, uint32_t iterations) {
+    iterate_lanes<H, Lanes16, 16>(chains, num_chains, iterations);
+}
+#endif
+
+// Runs iterations 2..count for every chain, in the widest lane groups worth filling.
+template <class H>
+inline void iterate_chains(std::vector<Chain<H>*>& chains, uint32_t iterations) {
+    size_t next = 0;
+#if PBKDF2_HAVE_X86
+    // Thresholds from per-compression timings: a 16-lane AVX-512 group costs about
+    // five SHA-NI compressions or one portable one; an 8-lane AVX2 group (no vector
+    // rotate) costs about eight SHA-NI compressions but under two portable ones.
+    const bool shani = H::BIG_ENDIAN_WORDS && sha_ni_available();
+    const size_t avx512_min_fill = shani ? 6 : 2;
+    const size_t avx2_min_fill = shani ? 8 : 2;
+    if (avx512_lanes_available()) {
+        for (; chains.size() - next >= avx512_min_fill; next += std::min<size_t>(16, chains.size() - next)) {
+            iterate_lanes_avx512<H>(chains.data() + next, static_cast<int>(std::min<size_t>(16, chains.size() - next)), iterations);
+        }
+    }
+    if (avx2_lanes_available()) {
+        for (; chains.size() - next >= avx2_min_fill; next += std::min<size_t>(8, chains.size() - next)) {
+            iterate_lanes_avx2<H>(chains.data() + next, static_cast<int>(std::min<size_t>(8, chains.size() - next)), iterations);
+        }
+    }
+#endif
+    for (; next < chains.size(); ++next) {
+        iterate_one<H>(*chains[next], iterations);
+    }
+}
+
+#undef PBKDF2_ROTL
+#undef PBKDF2_ROTR
+
+} // namespace pbkdf2_detail
+
+// Derives every request with PBKDF2-HMAC-H (pbkdf2_detail::Sha256 or Md5) and the
+// same iteration count; each output block of each request is one chain.
+template <class H>
+inline void pbkdf2_hmac_batch(const std::vector<Pbkdf2Request>& requests, uint32_t iterations) {
+    using namespace pbkdf2_detail;
+    const size_t digest_bytes = 4 * H::STATE_WORDS;
+    size_t total_chains = 0;
+    for (const Pbkdf2Request& request : requests) {
+        total_chains += (request.output_len + digest_bytes - 1) / digest_bytes;
+    }
+    std::vector<Chain<H>> storage(total_chains);
+    std::vector<Chain<H>*> chains(total_chains);
+    size_t next = 0;
+    for (const Pbkdf2Request& request : requests) {
+        for (size_t offset = 0; offset < request.output_len; offset += digest_bytes, ++next) {
+            chains[next] = &storage[next];
+            start_chain<H>(request, static_cast<uint32_t>(offset / digest_bytes + 1), storage[next]);
+        }
+    }
+    iterate_chains<H>(chains, iterations < 1 ? 1 : iterations);
+    next = 0;
+    for (const Pbkdf2Request& request : requests) {
+        for (size_t offset = 0; offset < request.output_len; offset += digest_bytes, ++next) {
+            unsigned char digest[digest_bytes];
+            for (int w = 0; w < H::STATE_WORDS; ++w) store_word<H>(digest + 4 * w, storage[next].t[w]);
+            std::memcpy(request.output + offset, digest, std::min(digest_bytes, request.output_len - offset));
+            OPENSSL_cleanse(digest, sizeof(digest));
+        }
+    }
+}
+
+#endif // MULTILANE_PBKDF2_HPP
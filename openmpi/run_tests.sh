@@ -0,0 +1,49 @@
+#!/bin/sh
+# Builds and runs the known-answer tests for the hand-written crypto kernels (PBKDF2
+# lanes, bitsliced AES, ChaCha20), the async runtime's thread-count check and the >4 GiB
+# streamed round trip of the CLI (test_large_file.sh). Each test binary is run once
+# per code path it can be forced onto, so a host with the widest instruction set
+# covers every path.
+#
+# Usage: ./run_tests.sh
+set -e
+
+SRC_DIR=$(cd "$(dirname "$0")" && pwd)
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+echo "Building tests in $WORK_DIR ..."
+g++ -o "$WORK_DIR/test_pbkdf2" "$SRC_DIR/test_pbkdf2.cpp" \
+    -Wall -Wextra -O2 -std=c++17 \
+    $(pkg-config --cflags --libs libcrypto)
+g++ -o "$WORK_DIR/test_bitsliced_aes" "$SRC_DIR/test_bitsliced_aes.cpp" \
+    -Wall -Wextra -O2 -std=c++17 -fopenmp \
+    $(pkg-config --cflags --libs openssl)
+g++ -o "$WORK_DIR/test_chacha20" "$SRC_DIR/test_chacha20.cpp" \
+    -Wall -Wextra -O2 -std=c++17 -fopenmp \
+    $(pkg-config --cflags --libs openssl)
+g++ -o "$WORK_DIR/test_async_threads" "$SRC_DIR/test_async_threads.cpp" \
+    -Wall -Wextra -O2 -std=c++20 -fcoroutines -fopenmp \
+    $(pkg-config --cflags --libs openssl) \
+    $(pkg-config --cflags --libs liblz4 libzstd 2>/dev/null)
+g++ -o "$WORK_DIR/image_processor_ssl" "$SRC_DIR/image_processor_ssl.cpp" \
+    -Wall -O2 -std=c++20 -fcoroutines \
+    $(pkg-config --cflags --libs openssl) \
+    $(pkg-config --cflags --libs liblz4 libzstd 2>/dev/null) \
+    -fopenmp
+
+for lanes in avx512 avx2 shani scalar; do
+    IMAGE_PROCESSOR_PBKDF2_LANES=$lanes "$WORK_DIR/test_pbkdf2"
+done
+for lanes in avx2 sse2; do
+    IMAGE_PROCESSOR_AES_ENGINE=bitsliced IMAGE_PROCESSOR_BITSLICED_LANES=$lanes "$WORK_DIR/test_bitsliced_aes"
+done
+for engine in simd sse2; do
+    IMAGE_PROCESSOR_CHACHA_ENGINE=$engine "$WORK_DIR/test_chacha20"
+done
+# A large OpenMP team would show up in the count if anything fell back to OpenMP.
+for io in uring blocking; do
+    IMAGE_PROCESSOR_ASYNC_IO=$io OMP_NUM_THREADS=8 "$WORK_DIR/test_async_threads" "$WORK_DIR"
+done
+sh "$SRC_DIR/test_large_file.sh" "$WORK_DIR/image_processor_ssl"
+echo "All tests passed."
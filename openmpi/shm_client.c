@@ -0,0 +1,157 @@
+/*
+ * Test client for `image_processor_ssl --serve-shm`: exercises the shared-memory rings
+ * without the JVM. Sends the same image `repeat` times (pipelined through the request
+ * ring, one slab slot per in-flight request), checks every response, writes the last
+ * result to out.bmp and finally asks the server to shut down.
+ *
+ * Build: gcc -O2 -o shm_client shm_client.c
+ * Usage: shm_client <shm_name> <in.bmp> <passphrase> <out.bmp> <encrypt|decrypt> <ECB|CBC|GCM|CHACHA20|AUTO> [repeat]
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "shm_transport.h"
+
+static unsigned char* read_file(const char* path, size_t* len) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) return NULL;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    unsigned char* data = malloc(size > 0 ? (size_t)size : 1);
+    if (data != NULL && fread(data, 1, (size_t)size, file) != (size_t)size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+    *len = (size_t)size;
+    return data;
+}
+
+/* Waits for the server to create the region and publish the magic. */
+static struct shm_region* open_region(const char* name) {
+    char shm_name[256];
+    snprintf(shm_name, sizeof(shm_name), "/%s", name);
+    for (int attempt = 0; attempt < 500; ++attempt) {
+        int fd = shm_open(shm_name, O_RDWR, 0);
+        struct stat st;
+        if (fd >= 0 && fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(struct shm_region)) {
+            void* base = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            close(fd);
+            if (base == MAP_FAILED) return NULL;
+            struct shm_region* region = base;
+            while (__atomic_load_n(&region->magic, __ATOMIC_ACQUIRE) != SHM_TRANSPORT_MAGIC) usleep(1000);
+            return region;
+        }
+        if (fd >= 0) close(fd);
+        usleep(10000);
+    }
+    return NULL;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 7 && argc != 8) {
+        fprintf(stderr, "Usage: %s <shm_name> <in.bmp> <passphrase> <out.bmp> <encrypt|decrypt> <ECB|CBC|GCM|CHACHA20|AUTO> [repeat]\n", argv[0]);
+        return 1;
+    }
+    const char* passphrase = argv[3];
+    int operation = strcmp(argv[5], "encrypt") == 0 ? IMAGECRYPT_ENCRYPT : IMAGECRYPT_DECRYPT;
+    int mode = strcmp(argv[6], "ECB") == 0 ? IMAGECRYPT_MODE_ECB
+             : strcmp(argv[6], "GCM") == 0 ? IMAGECRYPT_MODE_GCM
+             : strcmp(argv[6], "CHACHA20") == 0 ? IMAGECRYPT_MODE_CHACHA20
+             : strcmp(argv[6], "AUTO") == 0 ? IMAGECRYPT_MODE_AUTO : IMAGECRYPT_MODE_CBC;
+    int repeat = argc == 8 ? atoi(argv[7]) : 1;
+    if (repeat < 1) repeat = 1;
+
+    size_t image_len = 0;
+    unsigned char* image = read_file(argv[2], &image_len);
+    if (image == NULL) {
+        fprintf(stderr, "Error: Could not read %s\n", argv[2]);
+        return 1;
+    }
+    struct shm_region* region = open_region(argv[1]);
+    if (region == NULL) {
+        fprintf(stderr, "Error: Could not open shared memory %s: %s\n", argv[1], strerror(errno));
+        return 1;
+    }
+
+    /* Slab layout: passphrase, then fixed-size payload slots. */
+    size_t key_len = strlen(passphrase);
+    size_t slot_size = (shm_payload_capacity(image, image_len) + 63) & ~(size_t)63; /* Cache aligned */
+    size_t first_slot = (key_len + 63) & ~(size_t)63;
+    size_t slots = (region->slab_size - first_slot) / slot_size;
+    if (slots == 0) {
+        fprintf(stderr, "Error: Slab of %llu bytes is too small for this image\n", (unsigned long long)region->slab_size);
+        return 1;
+    }
+    if (slots > SHM_RING_SLOTS) slots = SHM_RING_SLOTS;
+    uint8_t* slab = shm_slab(region);
+    memcpy(slab, passphrase, key_len);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    int failures = 0;
+    size_t result_len = 0;
+    uint64_t last_slot_offset = 0;
+    int sent = 0, received = 0;
+    while (received < repeat) {
+        /* Keep every free slot in flight, then collect one response. */
+        while (sent < repeat && (size_t)(sent - received) < slots) {
+            struct shm_message request;
+            memset(&request, 0, sizeof(request));
+            request.request_id = (uint64_t)sent;
+            request.payload_offset = first_slot + (sent % slots) * slot_size;
+            request.payload_len = image_len;
+            request.payload_capacity = slot_size;
+            request.key_offset = 0;
+            request.key_len = (uint32_t)key_len;
+            request.operation = operation;
+            request.mode = mode;
+            memcpy(slab + request.payload_offset, image, image_len);
+            shm_ring_push(&region->requests, &request);
+            ++sent;
+        }
+        struct shm_message response;
+        shm_ring_pop(&region->responses, &response);
+        ++received;
+        if (response.status != IMAGECRYPT_OK) {
+            fprintf(stderr, "Request %llu failed with status %d: %s\n", (unsigned long long)response.request_id,
+                    response.status, response.payload_len > 0 ? (const char*)(slab + response.payload_offset) : "");
+            ++failures;
+        } else {
+            result_len = response.payload_len;
+            last_slot_offset = response.payload_offset;
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("%d requests in %.3f s (%.3f ms/request)\n", repeat, seconds, seconds * 1000.0 / repeat);
+
+    if (failures == 0) {
+        FILE* out = fopen(argv[4], "wb");
+        if (out == NULL || fwrite(slab + last_slot_offset, 1, result_len, out) != result_len) {
+            fprintf(stderr, "Error: Could not write %s\n", argv[4]);
+            failures = 1;
+        }
+        if (out != NULL) fclose(out);
+    }
+
+    struct shm_message shutdown_request;
+    memset(&shutdown_request, 0, sizeof(shutdown_request));
+    shutdown_request.operation = SHM_OP_SHUTDOWN;
+    shm_ring_push(&region->requests, &shutdown_request);
+    shm_ring_pop(&region->responses, &shutdown_request);
+
+    munmap(region, region->region_size);
+    free(image);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,243 @@
+#ifndef SHM_SERVER_HPP
+#define SHM_SERVER_HPP
+
+#include <iostream>
+#include <string>
+#include <stdexcept> // For std::runtime_error
+#include <cstring>   // For memcpy, strerror
+#include <cerrno>
+#include <algorithm> // For std::min
+#include <vector>
+
+#include <fcntl.h>    // For O_* constants
+#include <sys/mman.h> // For shm_open, mmap
+#include <unistd.h>   // For ftruncate, close
+
+#include "shm_transport.h"    // Region layout and rings
+#include "cipher_engine.hpp"  // AES engine, OpenSSL runtime and error handling
+#include "image_pipeline.hpp" // BMP parsing, key derivation and the pixel cipher pass
+#include "result_cache.hpp"   // Repeated requests are served from the cache
+
+// Long-running mode of image_processor_ssl: serves requests from a client over the
+// shared-memory rings in shm_transport.h and processes each image in place in the slab.
+
+const size_t SHM_DEFAULT_SLAB_MB = 256;
+
+// Creates and maps /dev/shm/<name>. The magic is stored last so a client that maps the
+// region early waits until the layout is complete.
+inline shm_region* create_shm_region(const std::string& name, size_t slab_size) {
+    const std::string shm_name = "/" + name;
+    int fd = shm_open(shm_name.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0600);
+    if (fd < 0) {
+        throw std::runtime_error("Error: Could not create shared memory " + shm_name + ": " + std::strerror(errno));
+    }
+    const size_t region_size = shm_region_size(slab_size);
+    if (ftruncate(fd, static_cast<off_t>(region_size)) != 0) {
+        int err = errno;
+        close(fd);
+        shm_unlink(shm_name.c_str());
+        throw std::runtime_error("Error: Could not size shared memory " + shm_name + ": " + std::strerror(err));
+    }
+    void* base = mmap(NULL, region_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        int err = errno;
+        shm_unlink(shm_name.c_str());
+        throw std::runtime_error("Error: Could not map shared memory " + shm_name + ": " + std::strerror(err));
+    }
+    shm_region* region = static_cast<shm_region*>(base);
+    region->version = SHM_TRANSPORT_VERSION;
+    region->region_size = region_size;
+    region->slab_offset = sizeof(shm_region);
+    region->slab_size = slab_size;
+    __atomic_store_n(&region->magic, SHM_TRANSPORT_MAGIC, __ATOMIC_RELEASE);
+    return region;
+}
+
+inline bool shm_range_valid(const shm_region* region, uint64_t offset, uint64_t len) {
+    return offset <= region->slab_size && len <= region->slab_size - offset;
+}
+
+// Handles one request in place; fills in status and payload_len of the response.
+inline void serve_shm_request(shm_region* region, ResultCache& cache, shm_message& message) {
+    uint8_t* slab = shm_slab(region);
+    message.status = IMAGECRYPT_OK;
+
+    if (!shm_range_valid(region, message.payload_offset, message.payload_capacity) ||
+        message.payload_len > message.payload_capacity ||
+        !shm_range_valid(region, message.key_offset, message.key_len)) {
+        // The slot itself cannot be trusted, so no message is written back.
+        message.status = IMAGECRYPT_ERR_ARGUMENT;
+        message.payload_len = 0;
+        return;
+    }
+    unsigned char* payload = slab + message.payload_offset;
+
+    std::string error;
+    try {
+        AesMode mode;
+        PixelCodec codec;
+        if ((message.operation != IMAGECRYPT_ENCRYPT && message.operation != IMAGECRYPT_DECRYPT) ||
+            !pixel_mode_codec_from_imagecrypt(message.mode, mode, codec)) {
+            message.status = IMAGECRYPT_ERR_ARGUMENT;
+            throw std::runtime_error("Error: Invalid operation or mode in shared memory request.");
+        }
+        const Direction direction = message.operation == IMAGECRYPT_ENCRYPT ? Direction::Encrypt : Direction::Decrypt;
+
+        message.status = IMAGECRYPT_ERR_FORMAT;
+        const size_t required = processed_image_capacity(locate_pixel_data(payload, message.payload_len, direction),
+                                                         message.payload_len);
+        if (message.payload_capacity < required) {
+            message.status = IMAGECRYPT_ERR_BUFFER_TOO_SMALL;
+            throw std::runtime_error("Error: Payload slot is smaller than the processed image (" +
+                                     std::to_string(required) + " bytes).");
+        }
+
+        message.status = IMAGECRYPT_ERR_CRYPTO;
+        std::string passphrase(reinterpret_cast<const char*>(slab + message.key_offset), message.key_len);
+        message.payload_len = process_image_buffer_cached(cache, payload, message.payload_len, payload,
+                                                          message.payload_capacity, passphrase, mode, direction, codec);
+        OPENSSL_cleanse(&passphrase[0], passphrase.size());
+        message.status = IMAGECRYPT_OK;
+        return;
+    } catch (const std::bad_alloc&) {
+        message.status = IMAGECRYPT_ERR_INTERNAL;
+        error = "Error: Out of memory.";
+    } catch (const std::exception& e) {
+        error = e.what();
+    }
+
+    // On failure the slot carries the NUL-terminated message instead of the image.
+    size_t copy_len = message.payload_capacity > 0 ? std::min<size_t>(error.size(), message.payload_capacity - 1) : 0;
+    if (message.payload_capacity > 0) {
+        std::memcpy(payload, error.data(), copy_len);
+        payload[copy_len] = '\0';
+    }
+    message.payload_len = copy_len;
+}
+
+// True if the request is a well-formed CBC encryption that can join a multi-buffer batch.
+inline bool shm_request_batchable(const shm_region* region, const shm_message& message) {
+    if (message.operation != IMAGECRYPT_ENCRYPT || message.mode != IMAGECRYPT_MODE_CBC ||
+        !shm_range_valid(region, message.payload_offset, message.payload_capacity) ||
+        message.payload_len > message.payload_capacity ||
+        message.payload_capacity < max_processed_image_len(message.payload_len) ||
+        !shm_range_valid(region, message.key_offset, message.key_len)) {
+        return false;
+    }
+    try {
+        locate_pixel_data(shm_slab(const_cast<shm_region*>(region)) + message.payload_offset,
+                          message.payload_len, Direction::Encrypt);
+    } catch (const std::exception&) {
+        return false;
+    }
+    return true;
+}
+
+// Serves one batch drained from the request ring. CBC encryptions are interleaved by the
+// multi-buffer engine; everything else is served one request at a time.
+inline void serve_shm_batch(shm_region* region, ResultCache& cache, std::vector<shm_message>& batch) {
+    uint8_t* slab = shm_slab(region);
+    std::vector<CbcImageRequest> cbc_requests;
+    std::vector<size_t> cbc_indices;
+    std::vector<ResultCacheKey> cbc_keys;
+    for (size_t i = 0; i < batch.size(); ++i) {
+        shm_message& message = batch[i];
+        if (!shm_request_batchable(region, message)) {
+            serve_shm_request(region, cache, message);
+            continue;
+        }
+        unsigned char* payload = slab + message.payload_offset;
+        if (cache.enabled()) {
+            std::string passphrase(reinterpret_cast<const char*>(slab + message.key_offset), message.key_len);
+            ResultCacheKey key = cache.make_key(payload, message.payload_len, passphrase, AesMode::CBC, Direction::Encrypt);
+            OPENSSL_cleanse(&passphrase[0], passphrase.size());
+            size_t cached_len = 0;
+            if (cache.lookup(key, payload, message.payload_capacity, cached_len)) {
+                message.status = IMAGECRYPT_OK;
+                message.payload_len = cached_len;
+                continue;
+            }
+            cbc_keys.push_back(key);
+        }
+        CbcImageRequest request;
+        request.image_data = payload;
+        request.image_len = message.payload_len;
+        request.output_data = payload;
+        request.output_capacity = message.payload_capacity;
+        request.passphrase.assign(reinterpret_cast<const char*>(slab + message.key_offset), message.key_len);
+        request.output_len = 0;
+        cbc_requests.push_back(request);
+        cbc_indices.push_back(i);
+    }
+    if (cbc_requests.empty()) return;
+
+    std::string error;
+    try {
+        encrypt_images_cbc_batch(cbc_requests);
+    } catch (const std::exception& e) {
+        error = e.what();
+    }
+    for (size_t j = 0; j < cbc_requests.size(); ++j) {
+        shm_message& message = batch[cbc_indices[j]];
+        OPENSSL_cleanse(&cbc_requests[j].passphrase[0], cbc_requests[j].passphrase.size());
+        if (error.empty()) {
+            message.status = IMAGECRYPT_OK;
+            message.payload_len = cbc_requests[j].output_len;
+            if (cache.enabled()) {
+                cache.store(cbc_keys[j], slab + message.payload_offset, message.payload_len);
+            }
+        } else {
+            unsigned char* payload = slab + message.payload_offset;
+            size_t copy_len = std::min<size_t>(error.size(), message.payload_capacity - 1);
+            std::memcpy(payload, error.data(), copy_len);
+            payload[copy_len] = '\0';
+            message.status = IMAGECRYPT_ERR_CRYPTO;
+            message.payload_len = copy_len;
+        }
+    }
+}
+
+// Serves requests until a SHM_OP_SHUTDOWN request arrives, then removes the region.
+// Each wakeup drains whatever the client has queued, so concurrent CBC encryptions
+// share the AES pipeline (see multibuffer_cbc.hpp).
+inline int run_shm_server(const std::string& name, size_t slab_size) {
+    init_openssl_runtime();
+    shm_region* region = create_shm_region(name, slab_size);
+    ResultCache cache(result_cache_config_from_env(RESULT_CACHE_DEFAULT_MEMORY_BYTES));
+    std::cout << "Serving on shared memory /dev/shm/" << name << " (slab " << slab_size << " bytes)." << std::endl;
+
+    size_t served = 0;
+    bool shutdown = false;
+    std::vector<shm_message> batch;
+    shm_message shutdown_message;
+    while (!shutdown) {
+        batch.clear();
+        shm_message message;
+        shm_ring_pop(&region->requests, &message);
+        do {
+            if (message.operation == SHM_OP_SHUTDOWN) {
+                shutdown = true;
+                shutdown_message = message;
+                break;
+            }
+            batch.push_back(message);
+        } while (batch.size() < SHM_RING_SLOTS && shm_ring_try_pop(&region->requests, &message));
+
+        serve_shm_batch(region, cache, batch);
+        for (size_t i = 0; i < batch.size(); ++i) {
+            shm_ring_push(&region->responses, &batch[i]);
+        }
+        served += batch.size();
+    }
+    shutdown_message.status = IMAGECRYPT_OK;
+    shutdown_message.payload_len = 0;
+    shm_ring_push(&region->responses, &shutdown_message);
+
+    std::cout << "Shared memory server stopped after " << served << " requests." << std::endl;
+    munmap(region, region->region_size);
+    shm_unlink(("/" + name).c_str());
+    return 0;
+}
+
+#endif // SHM_SERVER_HPP
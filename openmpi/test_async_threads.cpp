@@ -0,0 +1,149 @@
+// Thread-count check for async_engine.hpp: an AsyncRuntime must run on its CPU pool, the
+// io_uring reactor and the capped io-wq workers only, however many requests are in
+// flight, and must not start an OpenMP team or per-request threads. Counts the entries
+// of /proc/self/task before, while and after a batch of requests runs. The pool starts
+// its threads on first use, so a single small request with blocking I/O (the command
+// line tool's case) must add one thread only. run_tests.sh
+// runs it with and without io_uring (IMAGE_PROCESSOR_ASYNC_IO=blocking) and with a
+// large OMP_NUM_THREADS.
+//
+// Build: g++ -std=c++20 -fcoroutines -O2 -fopenmp -o test_async_threads test_async_threads.cpp -lssl -lcrypto
+// Usage: test_async_threads <scratch_dir>
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstdio>  // For FILE, fopen
+#include <cstdlib> // For setenv
+
+#include <dirent.h> // For opendir
+
+#include "async_engine.hpp"
+
+namespace {
+
+const size_t POOL_THREADS = 3;
+const size_t JOBS = 12;
+
+size_t live_threads() {
+    DIR* dir = opendir("/proc/self/task");
+    if (dir == NULL) return 0;
+    size_t count = 0;
+    while (dirent* entry = readdir(dir)) {
+        if (entry->d_name[0] != '.') ++count;
+    }
+    closedir(dir);
+    return count;
+}
+
+// 24-bit BMP of width x height with an exact file size field.
+void write_bmp(const std::string& path, uint32_t width, uint32_t height) {
+    const uint32_t row = (width * 3 + 3) / 4 * 4;
+    const uint32_t pixel_len = row * height;
+    std::vector<unsigned char> image(54 + pixel_len);
+    auto put32 = [&](size_t offset, uint32_t value) {
+        for (int i = 0; i < 4; ++i) image[offset + i] = static_cast<unsigned char>(value >> (8 * i));
+    };
+    image[0] = 'B';
+    image[1] = 'M';
+    put32(2, static_cast<uint32_t>(image.size()));
+    put32(10, 54);
+    put32(14, 40);
+    put32(18, width);
+    put32(22, height);
+    image[26] = 1;
+    image[28] = 24;
+    put32(34, pixel_len);
+    for (uint32_t i = 0; i < pixel_len; ++i) image[54 + i] = static_cast<unsigned char>((i / 7) ^ (i >> 9));
+    FILE* file = std::fopen(path.c_str(), "wb");
+    if (file == NULL || std::fwrite(image.data(), 1, image.size(), file) != image.size() || std::fclose(file) != 0) {
+        throw std::runtime_error("Error: Could not write " + path);
+    }
+}
+
+// Samples the thread count from a pool thread while the other jobs are in flight.
+task<size_t> sample_threads(AsyncRuntime& runtime) {
+    co_await runtime.schedule();
+    co_return live_threads();
+}
+
+task<AsyncImageResult> sampled_job(AsyncRuntime& runtime, AsyncImageRequest request, size_t& peak) {
+    const size_t during = co_await sample_threads(runtime);
+    peak = std::max(peak, during);
+    co_return co_await runtime.process(request);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        std::cerr << "Usage: " << argv[0] << " <scratch_dir>" << std::endl;
+        return 1;
+    }
+    const std::string dir = argv[1];
+    setenv("IMAGE_PROCESSOR_CACHE_BYTES", "0", 1);
+    setenv("IMAGE_PROCESSOR_CACHE_DISK_BYTES", "0", 1);
+    init_openssl_runtime();
+    write_bmp(dir + "/threads.bmp", 640, 480);
+
+    const size_t before = live_threads();
+    size_t failures = 0;
+    {
+        AsyncRuntime runtime(POOL_THREADS);
+        const size_t reactor = runtime.uring() ? 1 : 0;
+        const size_t expected = before + POOL_THREADS + reactor;
+        const size_t limit = expected + (runtime.uring() ? POOL_THREADS * ASYNC_IO_WORKERS : 0);
+        const size_t started = live_threads();
+        std::cout << "I/O through " << (runtime.uring() ? "io_uring" : "blocking reads and writes") << ": "
+                  << before << " threads before the runtime, " << started << " with it (expected " << before + reactor
+                  << "; " << expected << " once split, at most " << limit << " with I/O in flight)" << std::endl;
+        failures += started != before + reactor;
+
+        const AesMode modes[] = {AesMode::ECB, AesMode::CBC, AesMode::GCM, AesMode::CHACHA20};
+        std::vector<size_t> peaks(JOBS, 0);
+        std::vector<task<AsyncImageResult>> jobs;
+        for (size_t i = 0; i < JOBS; ++i) {
+            AsyncImageRequest request;
+            request.input_path = dir + "/threads.bmp";
+            request.output_path = dir + "/threads_" + std::to_string(i) + ".enc";
+            request.passphrase = "passphrase " + std::to_string(i);
+            request.mode = modes[i % (sizeof(modes) / sizeof(modes[0]))];
+            request.direction = Direction::Encrypt;
+            jobs.push_back(sampled_job(runtime, request, peaks[i]));
+        }
+        const std::vector<async_detail::Outcome<AsyncImageResult>> outcomes = sync_wait_all(std::move(jobs));
+        size_t peak = 0;
+        for (size_t i = 0; i < JOBS; ++i) {
+            peak = std::max(peak, peaks[i]);
+            if (outcomes[i].error) {
+                std::cerr << "FAIL: job " << i << " threw" << std::endl;
+                ++failures;
+            }
+        }
+        const size_t after = live_threads();
+        std::cout << JOBS << " jobs in flight: at most " << peak << " threads, " << after << " afterwards" << std::endl;
+        failures += peak > limit || after < expected || after > limit;
+    }
+    {
+        write_bmp(dir + "/small.bmp", 64, 64);
+        AsyncRuntime runtime(POOL_THREADS, ResultCacheConfig(), AsyncIo::Blocking);
+        AsyncImageRequest request;
+        request.input_path = dir + "/small.bmp";
+        request.output_path = dir + "/small.enc";
+        request.passphrase = "small";
+        request.mode = AesMode::ECB;
+        request.direction = Direction::Encrypt;
+        sync_wait(runtime.process(request));
+        const size_t single = live_threads();
+        std::cout << "One small request with blocking I/O: " << single << " threads (expected " << before + 1
+                  << ")" << std::endl;
+        failures += single != before + 1;
+    }
+    const size_t stopped = live_threads();
+    std::cout << "After the runtime: " << stopped << " threads" << std::endl;
+    failures += stopped != before;
+
+    std::cout << (failures == 0 ? "PASS" : "FAIL") << ": AsyncRuntime thread count" << std::endl;
+    return failures == 0 ? 0 : 1;
+}
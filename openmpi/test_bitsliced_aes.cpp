@@ -0,0 +1,168 @@
+// Known-answer test for bitsliced_aes.hpp through the engines that use it: CipherEngine
+// (ECB both ways, CBC decryption; with and without PKCS#7 padding, whole-buffer and in
+// uneven streamed pieces) and the CTR stream under GCM, compared byte for byte with
+// OpenSSL's EVP AES-256 over lengths around the 8- and 16-block batch widths. Must run
+// with IMAGE_PROCESSOR_AES_ENGINE=bitsliced; run it once more with
+// IMAGE_PROCESSOR_BITSLICED_LANES=sse2 (run_tests.sh does) to cover both widths.
+//
+// Build: g++ -std=c++17 -O2 -fopenmp -o test_bitsliced_aes test_bitsliced_aes.cpp -lssl -lcrypto
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstring> // For memcmp
+
+#include <openssl/evp.h> // For EVP_aes_256_ecb, EVP_aes_256_cbc, EVP_aes_256_ctr
+
+#include "aes_gcm.hpp" // CtrStream; includes cipher_engine.hpp
+
+namespace {
+
+// Deterministic filler so a failure reproduces exactly.
+struct TestRng {
+    uint64_t state;
+    unsigned char next() {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        return static_cast<unsigned char>(state >> 56);
+    }
+    std::vector<unsigned char> bytes(size_t count) {
+        std::vector<unsigned char> out(count);
+        for (size_t i = 0; i < count; ++i) out[i] = next();
+        return out;
+    }
+};
+
+// Partial blocks, one batch either side of 8 and 16 blocks, and a buffer past
+// OMP_PARALLEL_MIN_BYTES so the split ranges and the padded tail are both hit.
+const size_t LENGTHS[] = {0, 1, 15, 16, 17, 31, 32, 112, 127, 128, 129, 144, 255, 256, 257, 272,
+                          511, 512, 1000, 4096, 65543, OMP_PARALLEL_MIN_BYTES + 16 * 37 + 5};
+// Streamed piece sizes: every update leaves a different partial block behind.
+const size_t PIECES[] = {1, 7, 16, 33, 129, 300};
+
+// EVP reference; false where EVP itself rejects the input (bad padding, partial block).
+bool evp_reference(const EVP_CIPHER* cipher, bool encrypt, bool padding, const unsigned char* key,
+                   const unsigned char* iv, const std::vector<unsigned char>& in, std::vector<unsigned char>& out) {
+    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+    out.assign(in.size() + AES_BLOCK_BYTES, 0);
+    int len = 0, final_len = 0;
+    const bool ok = ctx != NULL && 1 == EVP_CipherInit_ex(ctx, cipher, NULL, key, iv, encrypt ? 1 : 0) &&
+                    1 == EVP_CIPHER_CTX_set_padding(ctx, padding ? 1 : 0) &&
+                    1 == EVP_CipherUpdate(ctx, out.data(), &len, in.data(), static_cast<int>(in.size())) &&
+                    1 == EVP_CipherFinal_ex(ctx, out.data() + len, &final_len);
+    EVP_CIPHER_CTX_free(ctx);
+    out.resize(ok ? static_cast<size_t>(len + final_len) : 0);
+    return ok;
+}
+
+// One CipherEngine configuration against EVP: the whole-buffer pass and a streamed
+// pass in pieces of `piece` bytes must both give EVP's bytes, or both fail where EVP does.
+template <AesMode M, Direction D, Padding P>
+bool check_engine(const char* name, const std::vector<unsigned char>& in, size_t piece,
+                  const unsigned char* key, const unsigned char* iv) {
+    typedef CipherEngine<M, D, P> Engine;
+    const EVP_CIPHER* cipher = M == AesMode::ECB ? EVP_aes_256_ecb() : EVP_aes_256_cbc();
+    std::vector<unsigned char> expected;
+    const bool expected_ok = evp_reference(cipher, Engine::is_encrypt, P == Padding::PKCS7, key,
+                                           M == AesMode::ECB ? NULL : iv, in, expected);
+
+    std::vector<unsigned char> whole(in.size() + AES_BLOCK_BYTES);
+    bool whole_ok = true;
+    try {
+        whole.resize(Engine::process(key, iv, in.data(), in.size(), whole.data()));
+    } catch (const std::exception&) {
+        whole_ok = false;
+    }
+
+    std::vector<unsigned char> streamed(in.size() + 2 * AES_BLOCK_BYTES);
+    bool streamed_ok = true;
+    try {
+        Engine engine(key, iv);
+        size_t out_len = 0;
+        for (size_t done = 0; done < in.size(); done += std::min(piece, in.size() - done)) {
+            out_len += engine.update(in.data() + done, std::min(piece, in.size() - done), streamed.data() + out_len);
+        }
+        out_len += engine.finish(streamed.data() + out_len);
+        streamed.resize(out_len);
+    } catch (const std::exception&) {
+        streamed_ok = false;
+    }
+
+    const bool ok = whole_ok == expected_ok && streamed_ok == expected_ok &&
+                    (!expected_ok || (whole == expected && streamed == expected));
+    if (!ok) {
+        std::cerr << "FAIL: " << name << " len=" << in.size() << " piece=" << piece
+                  << " evp=" << (expected_ok ? "ok" : "rejects") << " whole=" << (whole_ok ? "ok" : "throws")
+                  << " streamed=" << (streamed_ok ? "ok" : "throws") << std::endl;
+    }
+    return ok;
+}
+
+bool check_ctr(const std::vector<unsigned char>& in, size_t piece, const unsigned char* key,
+               const unsigned char* counter) {
+    std::vector<unsigned char> expected;
+    evp_reference(EVP_aes_256_ctr(), true, false, key, counter, in, expected);
+    std::vector<unsigned char> out(in.size());
+    gcm_detail::CtrStream stream(key, counter);
+    for (size_t done = 0; done < in.size(); done += std::min(piece, in.size() - done)) {
+        stream.update(in.data() + done, std::min(piece, in.size() - done), out.data() + done);
+    }
+    if (out != expected) {
+        std::cerr << "FAIL: CTR len=" << in.size() << " piece=" << piece << std::endl;
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int main() {
+    const char* engine = std::getenv("IMAGE_PROCESSOR_AES_ENGINE");
+    const char* cap = std::getenv("IMAGE_PROCESSOR_BITSLICED_LANES");
+    if (!bitsliced_aes_selected()) {
+        std::cerr << "FAIL: bitsliced engine not selected (IMAGE_PROCESSOR_AES_ENGINE="
+                  << (engine != NULL ? engine : "unset") << ", or its self-test failed)" << std::endl;
+        return 1;
+    }
+    std::cout << "Bitsliced AES on " << (bitsliced_detail::avx2_available() ? "avx2 (16 blocks)" : "sse2 (8 blocks)")
+              << " (cap " << (cap != NULL ? cap : "none") << ")" << std::endl;
+
+    TestRng rng = {0x13198a2e03707344ULL};
+    size_t checks = 0, failures = 0;
+    for (size_t len : LENGTHS) {
+        const std::vector<unsigned char> key = rng.bytes(32);
+        std::vector<unsigned char> iv = rng.bytes(AES_BLOCK_BYTES);
+        const std::vector<unsigned char> data = rng.bytes(len);
+        // Valid padding for the decryptions; random data covers the rejected paddings.
+        std::vector<unsigned char> padded;
+        evp_reference(EVP_aes_256_cbc(), true, true, key.data(), iv.data(), data, padded);
+        std::vector<unsigned char> padded_ecb;
+        evp_reference(EVP_aes_256_ecb(), true, true, key.data(), NULL, data, padded_ecb);
+        const size_t piece = PIECES[len % (sizeof(PIECES) / sizeof(PIECES[0]))];
+
+        failures += !check_engine<AesMode::ECB, Direction::Encrypt, Padding::PKCS7>("ECB encrypt PKCS7", data, piece, key.data(), iv.data());
+        failures += !check_engine<AesMode::ECB, Direction::Decrypt, Padding::PKCS7>("ECB decrypt PKCS7", padded_ecb, piece, key.data(), iv.data());
+        failures += !check_engine<AesMode::CBC, Direction::Decrypt, Padding::PKCS7>("CBC decrypt PKCS7", padded, piece, key.data(), iv.data());
+        checks += 3;
+        if (len % AES_BLOCK_BYTES == 0) {
+            failures += !check_engine<AesMode::ECB, Direction::Encrypt, Padding::None>("ECB encrypt unpadded", data, piece, key.data(), iv.data());
+            failures += !check_engine<AesMode::ECB, Direction::Decrypt, Padding::None>("ECB decrypt unpadded", data, piece, key.data(), iv.data());
+            failures += !check_engine<AesMode::CBC, Direction::Decrypt, Padding::None>("CBC decrypt unpadded", data, piece, key.data(), iv.data());
+            if (len > 0) {
+                failures += !check_engine<AesMode::ECB, Direction::Decrypt, Padding::PKCS7>("ECB decrypt bad padding", data, piece, key.data(), iv.data());
+                failures += !check_engine<AesMode::CBC, Direction::Decrypt, Padding::PKCS7>("CBC decrypt bad padding", data, piece, key.data(), iv.data());
+                checks += 2;
+            }
+            checks += 3;
+        }
+        // The counter's low bytes carry within the first batch.
+        iv[AES_BLOCK_BYTES - 1] = 0xfd;
+        iv[AES_BLOCK_BYTES - 2] = 0xff;
+        failures += !check_ctr(data, piece, key.data(), iv.data());
+        failures += !check_ctr(data, len + 1, key.data(), iv.data());
+        checks += 2;
+    }
+    std::cout << (failures == 0 ? "PASS" : "FAIL") << ": " << checks - failures << "/" << checks
+              << " bitsliced passes match EVP" << std::endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,137 @@
+// Known-answer test for the built-in ChaCha20 kernel of chacha20.hpp: the keystream
+// from xor_keystream (AVX2 or SSE2 batches, then single blocks for the tail) and the
+// payloads of chacha20_encrypt_pixels / chacha20_decrypt_pixels split over a pool are
+// compared byte for byte with OpenSSL's EVP ChaCha20, over odd lengths around the 4-
+// and 8-block batch widths and start counters up to the last block before the 32-bit
+// counter wraps. Must run with IMAGE_PROCESSOR_CHACHA_ENGINE=simd; run it once more
+// with IMAGE_PROCESSOR_CHACHA_ENGINE=sse2 (run_tests.sh does) to cover both widths.
+//
+// Build: g++ -std=c++17 -O2 -fopenmp -o test_chacha20 test_chacha20.cpp -lssl -lcrypto
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstdlib> // For std::getenv
+#include <cstring> // For memcpy
+#include <algorithm> // For std::equal
+
+#include <openssl/evp.h> // For EVP_chacha20
+
+#include "chacha20.hpp"
+#include "worker_pool.hpp" // Splits the pixel passes into ranges on any host
+
+namespace {
+
+// Deterministic filler so a failure reproduces exactly.
+struct TestRng {
+    uint64_t state;
+    unsigned char next() {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        return static_cast<unsigned char>(state >> 56);
+    }
+    std::vector<unsigned char> bytes(size_t count) {
+        std::vector<unsigned char> out(count);
+        for (size_t i = 0; i < count; ++i) out[i] = next();
+        return out;
+    }
+};
+
+// Partial blocks, one batch either side of 4 and 8 blocks, and a buffer past
+// OMP_PARALLEL_MIN_BYTES so the pixel passes split into ranges.
+const size_t LENGTHS[] = {0, 1, 63, 64, 65, 191, 255, 256, 257, 319, 511, 512, 513, 767, 768, 769,
+                          1023, 1024, 1089, 4097, 65543, OMP_PARALLEL_MIN_BYTES + 64 * 37 + 5};
+// Start counters; the last ones leave room for the longest buffer before the wrap.
+const uint32_t COUNTERS[] = {0, 1, 7, 0x7fffffff, 0xffffffffu - 4200};
+
+// EVP ChaCha20 from counter onward; its 16-byte IV is counter (LE) || nonce.
+std::vector<unsigned char> evp_reference(const std::vector<unsigned char>& key, const unsigned char* nonce,
+                                         uint32_t counter, const std::vector<unsigned char>& in) {
+    unsigned char iv[4 + CHACHA20_NONCE_BYTES];
+    for (int i = 0; i < 4; ++i) iv[i] = static_cast<unsigned char>(counter >> (8 * i));
+    std::memcpy(iv + 4, nonce, CHACHA20_NONCE_BYTES);
+    std::vector<unsigned char> out(in.size());
+    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+    int len = 0;
+    const bool ok = ctx != NULL && 1 == EVP_EncryptInit_ex(ctx, EVP_chacha20(), NULL, key.data(), iv) &&
+                    1 == EVP_EncryptUpdate(ctx, out.data(), &len, in.data(), static_cast<int>(in.size()));
+    EVP_CIPHER_CTX_free(ctx);
+    if (!ok) out.clear();
+    return out;
+}
+
+bool check_kernel(const std::vector<unsigned char>& key, const std::vector<unsigned char>& nonce, uint32_t counter,
+                  const std::vector<unsigned char>& in) {
+    const chacha20_detail::ChaChaState state(key.data(), nonce.data());
+    std::vector<unsigned char> out(in.size());
+    chacha20_detail::xor_keystream(state, counter, in.data(), in.size(), out.data());
+    if (out != evp_reference(key, nonce.data(), counter, in)) {
+        std::cerr << "FAIL: keystream len=" << in.size() << " counter=" << counter << std::endl;
+        return false;
+    }
+    // In place, as the pixel passes run it.
+    std::vector<unsigned char> in_place = in;
+    chacha20_detail::xor_keystream(state, counter, in_place.data(), in_place.size(), in_place.data());
+    if (in_place != out) {
+        std::cerr << "FAIL: in-place keystream len=" << in.size() << " counter=" << counter << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Encrypts through the split pass, checks the ciphertext against EVP under the trailer's
+// nonce and decrypts it back.
+bool check_payload(const std::vector<unsigned char>& key, const std::vector<unsigned char>& in, WorkerPool& pool) {
+    std::vector<unsigned char> payload(in.size() + CHACHA20_TRAILER_BYTES);
+    const size_t payload_len = chacha20_encrypt_pixels(key.data(), in.data(), in.size(), payload.data(), pool);
+    const std::vector<unsigned char> expected = evp_reference(key, payload.data() + in.size(), 0, in);
+    if (payload_len != payload.size() || !std::equal(expected.begin(), expected.end(), payload.begin()) ||
+        expected.size() != in.size()) {
+        std::cerr << "FAIL: encrypted payload len=" << in.size() << std::endl;
+        return false;
+    }
+    std::vector<unsigned char> decrypted(payload.size());
+    decrypted.resize(chacha20_decrypt_pixels(key.data(), payload.data(), payload.size(), decrypted.data(), pool));
+    if (decrypted != in) {
+        std::cerr << "FAIL: decrypted payload len=" << in.size() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int main() {
+    const char* engine = std::getenv("IMAGE_PROCESSOR_CHACHA_ENGINE");
+    if (!chacha20_detail::builtin_kernel_selected()) {
+        std::cerr << "FAIL: built-in kernel not selected (IMAGE_PROCESSOR_CHACHA_ENGINE="
+                  << (engine != NULL ? engine : "unset") << ")" << std::endl;
+        return 1;
+    }
+#if CHACHA20_HAVE_AVX2
+    const bool avx2 = chacha20_detail::avx2_available();
+#else
+    const bool avx2 = false;
+#endif
+    std::cout << "ChaCha20 kernel on " << (avx2 ? "avx2 (8 blocks)" : "sse2 (4 blocks)")
+              << " (IMAGE_PROCESSOR_CHACHA_ENGINE=" << (engine != NULL ? engine : "unset") << ")" << std::endl;
+
+    WorkerPool pool(3);
+    TestRng rng = {0x243f6a8885a308d3ULL};
+    size_t checks = 0, failures = 0;
+    for (size_t len : LENGTHS) {
+        const std::vector<unsigned char> key = rng.bytes(CHACHA20_KEY_BYTES);
+        const std::vector<unsigned char> nonce = rng.bytes(CHACHA20_NONCE_BYTES);
+        const std::vector<unsigned char> data = rng.bytes(len);
+        for (uint32_t counter : COUNTERS) {
+            if (len / CHACHA20_BLOCK_BYTES >= 0xffffffffu - counter) continue;
+            failures += !check_kernel(key, nonce, counter, data);
+            ++checks;
+        }
+        failures += !check_payload(key, data, pool);
+        ++checks;
+    }
+    std::cout << (failures == 0 ? "PASS" : "FAIL") << ": " << checks - failures << "/" << checks
+              << " ChaCha20 kernel passes match EVP" << std::endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,71 @@
+#!/bin/sh
+# Streamed round trip of a BMP larger than 4 GiB: a sparse input with random bytes
+# at the start, across the 4 GiB boundary and at the end is encrypted and decrypted
+# with CBC through the windowed file path (stream_file.hpp), and every CRC32C the
+# runs print is checked with --verify. Needs about twice the image size in free
+# space under $TMPDIR; skips (exit 0) if that is not available.
+#
+# Usage: ./test_large_file.sh [image_processor_ssl]
+set -e
+
+SRC_DIR=$(cd "$(dirname "$0")" && pwd)
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+GIB=1073741824
+PIXEL_LEN=$((32768 * 3 * 45056))
+NEEDED_KB=$((2 * (PIXEL_LEN + 1048576) / 1024))
+AVAILABLE_KB=$(df -Pk "$WORK_DIR" | awk 'NR == 2 { print $4 }')
+if [ "$AVAILABLE_KB" -lt "$NEEDED_KB" ]; then
+    echo "SKIP: large file round trip needs $((NEEDED_KB / 1048576)) GiB free in $WORK_DIR"
+    exit 0
+fi
+
+BIN=$1
+if [ -z "$BIN" ]; then
+    echo "Building image_processor_ssl in $WORK_DIR ..."
+    BIN="$WORK_DIR/image_processor_ssl"
+    g++ -o "$BIN" "$SRC_DIR/image_processor_ssl.cpp" \
+        -Wall -O2 -std=c++20 -fcoroutines \
+        $(pkg-config --cflags --libs openssl) \
+        $(pkg-config --cflags --libs liblz4 libzstd 2>/dev/null) \
+        -fopenmp
+fi
+
+# 54-byte header of a 32768 x 45056 24-bit BMP; its 32-bit size fields cannot hold
+# the real size, which is taken from the file.
+printf 'BM\000\000\000\000\000\000\000\000\066\000\000\000\050\000\000\000\000\200\000\000\000\260\000\000\001\000\030\000\000\000\000\000\000\000\000\000\023\013\000\000\023\013\000\000\000\000\000\000\000\000\000\000' > "$WORK_DIR/large.bmp"
+truncate -s $((54 + PIXEL_LEN)) "$WORK_DIR/large.bmp"
+for offset in 54 $((54 + 4 * GIB - 524288)) $((54 + PIXEL_LEN - 1048576)); do
+    head -c 1048576 /dev/urandom | dd of="$WORK_DIR/large.bmp" bs=1048576 seek="$offset" oflag=seek_bytes conv=notrunc 2>/dev/null
+done
+
+# Default stream threshold and window; no result cache.
+unset IMAGE_PROCESSOR_CACHE_DIR IMAGE_PROCESSOR_STREAM_THRESHOLD_MB IMAGE_PROCESSOR_STREAM_WINDOW_MB
+export IMAGE_PROCESSOR_CACHE_BYTES=0
+
+# Runs one streamed pass and prints "<input crc> <output crc>".
+streamed_run() {
+    "$BIN" "$1" large "$2" "$3" CBC > "$WORK_DIR/run.log"
+    if ! grep -q '^Streamed CBC' "$WORK_DIR/run.log"; then
+        cat "$WORK_DIR/run.log" >&2
+        echo "FAIL: $3 of a $(($(wc -c < "$1") / 1048576)) MB file did not take the streamed path" >&2
+        exit 1
+    fi
+    echo "$(sed -n 's/^Input CRC32C: //p' "$WORK_DIR/run.log") $(sed -n 's/^Output CRC32C: //p' "$WORK_DIR/run.log")"
+}
+
+CRCS=$(streamed_run "$WORK_DIR/large.bmp" "$WORK_DIR/large.enc" encrypt)
+set -- $CRCS
+PLAIN_CRC=$1
+CIPHER_CRC=$2
+CRCS=$(streamed_run "$WORK_DIR/large.enc" "$WORK_DIR/large.dec" decrypt)
+set -- $CRCS
+[ "$1" = "$CIPHER_CRC" ] || { echo "FAIL: decryption read CRC32C $1, encryption wrote $CIPHER_CRC" >&2; exit 1; }
+[ "$2" = "$PLAIN_CRC" ] || { echo "FAIL: decryption wrote CRC32C $2, input was $PLAIN_CRC" >&2; exit 1; }
+
+"$BIN" --verify "$WORK_DIR/large.bmp" "$PLAIN_CRC"
+"$BIN" --verify "$WORK_DIR/large.enc" "$CIPHER_CRC"
+"$BIN" --verify "$WORK_DIR/large.dec" "$PLAIN_CRC"
+cmp "$WORK_DIR/large.bmp" "$WORK_DIR/large.dec"
+echo "PASS: streamed CBC round trip of a $(($(wc -c < "$WORK_DIR/large.bmp") / 1048576)) MB BMP"
@@ -0,0 +1,110 @@
+// Known-answer test for multilane_pbkdf2.hpp: every batch is compared byte for byte
+// with OpenSSL's PKCS5_PBKDF2_HMAC. Run it once per IMAGE_PROCESSOR_PBKDF2_LANES
+// value (run_tests.sh does) to cover the AVX-512, AVX2, SHA-NI and portable kernels.
+//
+// Build: g++ -std=c++17 -O2 -o test_pbkdf2 test_pbkdf2.cpp -lcrypto
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstring> // For memcmp
+
+#include <openssl/evp.h> // For PKCS5_PBKDF2_HMAC, EVP_sha256, EVP_md5
+
+#include "multilane_pbkdf2.hpp"
+
+namespace {
+
+// Deterministic filler so a failure reproduces exactly.
+struct TestRng {
+    uint64_t state;
+    unsigned char next() {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        return static_cast<unsigned char>(state >> 56);
+    }
+    std::vector<unsigned char> bytes(size_t count) {
+        std::vector<unsigned char> out(count);
+        for (size_t i = 0; i < count; ++i) out[i] = next();
+        return out;
+    }
+};
+
+struct Case {
+    std::vector<unsigned char> password;
+    std::vector<unsigned char> salt;
+    std::vector<unsigned char> output;
+};
+
+// Lengths around the HMAC block size (64) so key hashing and padding edges are hit;
+// 0 covers empty passphrases and salts.
+const size_t PASSWORD_LENGTHS[] = {0, 1, 7, 31, 55, 56, 63, 64, 65, 100, 200};
+const size_t SALT_LENGTHS[] = {0, 1, 8, 16, 51, 52, 55, 56, 64, 119, 120};
+
+// Runs one batch of `count` requests through H and through OpenSSL; `uniform` keeps
+// one chain per request so the chain count equals the batch size.
+template <class H>
+bool check_batch(const EVP_MD* md, size_t count, bool uniform, uint32_t iterations, TestRng& rng) {
+    const size_t digest_bytes = 4 * H::STATE_WORDS;
+    const size_t mixed_lengths[] = {digest_bytes, 1, digest_bytes / 2, digest_bytes + 1, 3 * digest_bytes};
+    std::vector<Case> cases(count);
+    std::vector<Pbkdf2Request> requests;
+    for (size_t i = 0; i < count; ++i) {
+        Case& c = cases[i];
+        c.password = rng.bytes(PASSWORD_LENGTHS[(i + iterations) % (sizeof(PASSWORD_LENGTHS) / sizeof(size_t))]);
+        c.salt = rng.bytes(SALT_LENGTHS[(i * 3 + count) % (sizeof(SALT_LENGTHS) / sizeof(size_t))]);
+        c.output.assign(uniform ? digest_bytes : mixed_lengths[i % (sizeof(mixed_lengths) / sizeof(size_t))], 0);
+        Pbkdf2Request request = {c.password.data(), c.password.size(), c.salt.data(), c.salt.size(),
+                                 c.output.data(), c.output.size()};
+        requests.push_back(request);
+    }
+    pbkdf2_hmac_batch<H>(requests, iterations);
+
+    bool ok = true;
+    for (size_t i = 0; i < count; ++i) {
+        const Case& c = cases[i];
+        std::vector<unsigned char> expected(c.output.size());
+        if (PKCS5_PBKDF2_HMAC(reinterpret_cast<const char*>(c.password.data()), static_cast<int>(c.password.size()),
+                              c.salt.data(), static_cast<int>(c.salt.size()), static_cast<int>(iterations), md,
+                              static_cast<int>(expected.size()), expected.data()) != 1) {
+            std::cerr << "FAIL: PKCS5_PBKDF2_HMAC returned an error" << std::endl;
+            return false;
+        }
+        if (std::memcmp(expected.data(), c.output.data(), expected.size()) != 0) {
+            std::cerr << "FAIL: " << EVP_MD_get0_name(md) << " batch=" << count << (uniform ? " uniform" : " mixed")
+                      << " iterations=" << iterations << " request=" << i << " password_len=" << c.password.size()
+                      << " salt_len=" << c.salt.size() << " output_len=" << c.output.size() << std::endl;
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+} // namespace
+
+int main() {
+    using namespace pbkdf2_detail;
+    const char* cap = std::getenv("IMAGE_PROCESSOR_PBKDF2_LANES");
+    std::cout << "PBKDF2 lanes (cap " << (cap != NULL ? cap : "none") << "):";
+#if PBKDF2_HAVE_X86
+    std::cout << (avx512_lanes_available() ? " avx512" : "") << (avx2_lanes_available() ? " avx2" : "")
+              << (sha_ni_available() ? " shani" : "");
+#endif
+    std::cout << " scalar" << std::endl;
+
+    TestRng rng = {0x243f6a8885a308d3ULL};
+    const uint32_t iteration_counts[] = {1, 2, 3, 1000};
+    size_t batches = 0, failures = 0;
+    for (uint32_t iterations : iteration_counts) {
+        for (size_t count = 1; count <= 17; ++count) {
+            for (int uniform = 0; uniform < 2; ++uniform) {
+                failures += !check_batch<Sha256>(EVP_sha256(), count, uniform != 0, iterations, rng);
+                failures += !check_batch<Md5>(EVP_md5(), count, uniform != 0, iterations, rng);
+                batches += 2;
+            }
+        }
+    }
+    std::cout << (failures == 0 ? "PASS" : "FAIL") << ": " << batches - failures << "/" << batches
+              << " batches match PKCS5_PBKDF2_HMAC" << std::endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,172 @@
+/*
+ * Front for `image_processor_ssl --zygote`: takes the same command line as
+ * image_processor_ssl and behaves the same (output files, stdout/stderr, exit status),
+ * but the job runs in a child forked from the running zygote, which has already paid
+ * for library loading and OpenSSL initialization. With no zygote listening (or one
+ * that refuses the request) it execs the standalone binary with the same arguments,
+ * as it does right away for the server modes (--zygote, --serve-http, --serve-shm, --work).
+ *
+ * Build: gcc -O2 -o image_processor_ssl zygote_front.c
+ *        (install the full binary next to it as image_processor_ssl_standalone, or
+ *        point IMAGE_PROCESSOR_STANDALONE at it)
+ * Zygote: image_processor_ssl_standalone --zygote <socket_path>
+ *         (IMAGE_PROCESSOR_ZYGOTE_SOCKET selects the socket, default /tmp/image_processor_ssl.zygote)
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "zygote_protocol.h"
+
+extern char** environ;
+
+/* Runs the full binary in this process; only returns if the exec failed. */
+static int run_standalone(char* argv[]) {
+    char path[PATH_MAX];
+    const char* standalone = getenv(ZYGOTE_STANDALONE_ENV);
+    if (standalone == NULL || standalone[0] == '\0') {
+        ssize_t len = readlink("/proc/self/exe", path, sizeof(path) - 1);
+        if (len < 0) len = 0;
+        path[len] = '\0';
+        char* slash = strrchr(path, '/');
+        size_t dir_len = slash != NULL ? (size_t)(slash - path) + 1 : 0;
+        snprintf(path + dir_len, sizeof(path) - dir_len, "%s", ZYGOTE_STANDALONE_NAME);
+        standalone = path;
+    }
+    execv(standalone, argv);
+    fprintf(stderr, "Error: No zygote available and could not run %s: %s\n", standalone, strerror(errno));
+    return 127;
+}
+
+static int connect_zygote(void) {
+    const char* path = zygote_socket_path();
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) return -1;
+    strcpy(address.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int append(char** buffer, size_t* len, size_t* capacity, const char* text) {
+    size_t text_len = strlen(text) + 1;
+    if (*len + text_len > ZYGOTE_MAX_PAYLOAD) return -1;
+    if (*len + text_len > *capacity) {
+        size_t grown = *capacity * 2 > *len + text_len ? *capacity * 2 : *len + text_len;
+        char* bigger = realloc(*buffer, grown);
+        if (bigger == NULL) return -1;
+        *buffer = bigger;
+        *capacity = grown;
+    }
+    memcpy(*buffer + *len, text, text_len);
+    *len += text_len;
+    return 0;
+}
+
+/* Sends the request; 0 on success. Nothing has run if this fails. */
+static int send_request(int fd, int argc, char* argv[]) {
+    char cwd[PATH_MAX];
+    if (getcwd(cwd, sizeof(cwd)) == NULL) return -1;
+    char* payload = NULL;
+    size_t payload_len = 0, capacity = 0;
+    int failed = append(&payload, &payload_len, &capacity, cwd);
+    for (int i = 0; i < argc && !failed; ++i) failed = append(&payload, &payload_len, &capacity, argv[i]);
+    uint32_t envc = 0;
+    for (char** entry = environ; entry != NULL && *entry != NULL && !failed; ++entry, ++envc) {
+        failed = append(&payload, &payload_len, &capacity, *entry);
+    }
+    if (failed) {
+        free(payload);
+        return -1;
+    }
+
+    struct zygote_request header;
+    header.magic = ZYGOTE_MAGIC;
+    header.version = ZYGOTE_VERSION;
+    header.argc = (uint32_t)argc;
+    header.envc = envc;
+    mode_t mask = umask(0);
+    umask(mask);
+    header.umask = (uint32_t)mask;
+    header.payload_len = (uint32_t)payload_len;
+
+    /* Closed stdio descriptors are passed as /dev/null. */
+    int stdio[3];
+    for (int i = 0; i < 3; ++i) {
+        stdio[i] = fcntl(i, F_GETFD) >= 0 ? i : open("/dev/null", i == 0 ? O_RDONLY : O_WRONLY);
+    }
+    union {
+        char buffer[CMSG_SPACE(sizeof(stdio))];
+        struct cmsghdr align;
+    } control;
+    memset(&control, 0, sizeof(control));
+    struct iovec iov = {&header, sizeof(header)};
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer;
+    message.msg_controllen = sizeof(control.buffer);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&message);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(stdio));
+    memcpy(CMSG_DATA(cmsg), stdio, sizeof(stdio));
+
+    int result = sendmsg(fd, &message, MSG_NOSIGNAL) == (ssize_t)sizeof(header) ? 0 : -1;
+    for (size_t sent = 0; result == 0 && sent < payload_len;) {
+        ssize_t n = send(fd, payload + sent, payload_len - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) result = -1;
+        else sent += (size_t)n;
+    }
+    free(payload);
+    return result;
+}
+
+int main(int argc, char* argv[]) {
+    /* Server modes are never forwarded, so the zygote does not fork a long-lived server. */
+    if (argc > 1 && zygote_server_mode(argv[1])) return run_standalone(argv);
+    int fd = connect_zygote();
+    if (fd < 0) return run_standalone(argv);
+    if (send_request(fd, argc, argv) != 0) {
+        close(fd);
+        return run_standalone(argv);
+    }
+
+    struct zygote_response response;
+    size_t received = 0;
+    while (received < sizeof(response)) {
+        ssize_t n = read(fd, (char*)&response + received, sizeof(response) - received);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        received += (size_t)n;
+    }
+    close(fd);
+    if (received < sizeof(response) || response.magic != ZYGOTE_MAGIC) {
+        fprintf(stderr, "Error: Lost the connection to the zygote at %s.\n", zygote_socket_path());
+        return 1;
+    }
+    if (response.outcome == ZYGOTE_REJECTED) return run_standalone(argv);
+    if (response.outcome == ZYGOTE_SIGNALED) {
+        /* End the same way the job did, so the caller sees the same status. */
+        signal(response.value, SIG_DFL);
+        raise(response.value);
+        return 128 + response.value;
+    }
+    return response.value;
+}
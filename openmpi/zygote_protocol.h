@@ -0,0 +1,70 @@
+#ifndef ZYGOTE_PROTOCOL_H
+#define ZYGOTE_PROTOCOL_H
+
+/*
+ * Protocol between the zygote front (zygote_front.c) and `image_processor_ssl --zygote`.
+ *
+ * The front connects to a Unix stream socket and sends one zygote_request followed by
+ * payload_len bytes: the working directory, the argv strings and then the environment
+ * strings, each NUL-terminated. Its stdin, stdout and stderr travel with the request
+ * header as SCM_RIGHTS, so the forked job writes straight to the caller's pipes.
+ * The zygote answers with one zygote_response when the job has ended, or with
+ * ZYGOTE_REJECTED before anything ran, in which case the front runs the standalone
+ * binary instead. Closing the connection early terminates the job (SIGTERM), as
+ * killing a standalone process would.
+ *
+ * Plain C so the same header serves the C++ server and the C front.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ZYGOTE_MAGIC          0x475a4349u /* "ICZG" */
+#define ZYGOTE_VERSION        1u
+#define ZYGOTE_MAX_PAYLOAD    (1u << 20)  /* Working directory + argv + environment */
+#define ZYGOTE_SOCKET_ENV     "IMAGE_PROCESSOR_ZYGOTE_SOCKET"
+#define ZYGOTE_DEFAULT_SOCKET "/tmp/image_processor_ssl.zygote"
+#define ZYGOTE_STANDALONE_ENV "IMAGE_PROCESSOR_STANDALONE"
+#define ZYGOTE_STANDALONE_NAME "image_processor_ssl_standalone" /* Next to the front by default */
+
+enum zygote_outcome {
+    ZYGOTE_EXITED = 0,   /* value is the exit status */
+    ZYGOTE_SIGNALED = 1, /* value is the signal that ended the job */
+    ZYGOTE_REJECTED = 2  /* Nothing ran; value is unused */
+};
+
+struct zygote_request {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t argc;
+    uint32_t envc;
+    uint32_t umask;       /* Applied to the files the job creates */
+    uint32_t payload_len;
+};
+
+struct zygote_response {
+    uint32_t magic;
+    int32_t outcome;
+    int32_t value;
+};
+
+/*
+ * Long-running server modes, which gain nothing from a warm process and must not run as
+ * children of the zygote: the front runs them with the standalone binary, and the
+ * zygote rejects them.
+ */
+static inline int zygote_server_mode(const char* mode) {
+    static const char* const server_modes[] = {"--zygote", "--serve-http", "--serve-shm", "--work"};
+    for (size_t i = 0; i < sizeof(server_modes) / sizeof(server_modes[0]); ++i) {
+        if (strcmp(mode, server_modes[i]) == 0) return 1;
+    }
+    return 0;
+}
+
+static inline const char* zygote_socket_path(void) {
+    const char* path = getenv(ZYGOTE_SOCKET_ENV);
+    return path != NULL && path[0] != '\0' ? path : ZYGOTE_DEFAULT_SOCKET;
+}
+
+#endif /* ZYGOTE_PROTOCOL_H */